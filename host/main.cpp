@@ -0,0 +1,186 @@
+// Host build driver: benchmarks hot paths, runs the fan policy against a synthetic print, or replays a
+// recorded trace (see `replay.hpp`).
+#include "lib/sensirion_gas_index_algorithm.h"
+#include "replay.hpp"
+#include "sensors.hpp"
+#include "utility/benchmark.hpp"
+#include "utility/crc.hpp"
+#include "utility/fan_policy.hpp"
+#include "utility/packed_tuple.hpp"
+#include "ws2812/effects.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+
+using namespace std;
+using namespace std::literals::chrono_literals;
+using namespace nevermore;
+
+namespace {
+
+// Deterministic noise, so runs are comparable.
+struct LCG {
+    uint32_t state = 0x1234'5678;
+
+    uint32_t operator()() {
+        state = state * 1664525u + 1013904223u;
+        return state;
+    }
+};
+
+// Synthetic print: clean chamber, off-gassing ramps up when the print starts, plateaus, then decays
+// once it ends. The filter keeps the exhaust some fraction below the intake while the fan runs.
+struct Print {
+    chrono::seconds start = 10min;
+    chrono::seconds ramp = 10min;
+    chrono::seconds end = 60min;
+    chrono::seconds decay = 5min;  // time constant
+    float voc_clean = 100;
+    float voc_peak = 300;
+
+    [[nodiscard]] float intake(chrono::seconds t) const {
+        if (t < start) return voc_clean;
+        if (t < start + ramp)
+            return voc_clean + (voc_peak - voc_clean) * float((t - start) / 1.s / (ramp / 1.s));
+        if (t < end) return voc_peak;
+        return voc_clean + (voc_peak - voc_clean) * exp(-float((t - end) / 1.s / (decay / 1.s)));
+    }
+};
+
+int simulate() {
+    FanPolicyEnvironmental const params;
+    auto instance = params.instance();
+    Print const print;
+    LCG noise;
+
+    printf("t_s,voc_intake,voc_exhaust,power\n");
+    chrono::system_clock::time_point const epoch{};
+    float power = 0;
+    for (auto t = 0s; t < 2h; t += 1s) {
+        auto const jitter = float(int32_t(noise() >> 28) - 8) / 4;  // +/- 2 index
+        auto const intake = clamp(print.intake(t) + jitter, 1.f, 500.f);
+        // a running fan scrubs the exhaust side
+        auto const exhaust = clamp(intake * (1 - 0.6f * power), 1.f, 500.f);
+
+        sensors::Sensors state;
+        state.voc_index_intake = intake;
+        state.voc_index_exhaust = exhaust;
+        power = instance(state, epoch + t);
+
+        printf("%lld,%.1f,%.1f,%.3f\n", (long long)(t / 1s), intake, exhaust, power);
+    }
+
+    return 0;
+}
+
+// Synthetic prints in the replay trace format, for when there's no recording at hand.
+// Raw SGP40 ticks, so the replay exercises the gas index algorithm too: they drop as the VOCs climb.
+// Open loop, the exhaust is scrubbed as if the fan ran whenever there's anything to scrub.
+int trace() {
+    constexpr float SRAW_CLEAN = 30'000;
+    constexpr float SRAW_PER_VOC = 25;  // ticks per index above clean, roughly
+    array<Print, 3> const prints{{
+            {.start = 1h, .end = 2h},
+            {.start = 3h, .ramp = 20min, .end = 5h, .voc_peak = 400},
+            {.start = 6h, .ramp = 30min, .end = 7h, .voc_peak = 160},
+    }};
+    LCG noise;
+
+    printf("t_s,voc_raw_intake,voc_raw_exhaust,temperature_intake,temperature_exhaust,humidity_intake\n");
+    for (auto t = 0s; t < 8h; t += 1s) {
+        auto const jitter = float(int32_t(noise() >> 26) - 32);  // +/- 32 ticks
+        float voc = prints[0].voc_clean;
+        for (auto const& x : prints)
+            voc = max(voc, x.intake(t));
+        auto const scrubbed = (voc - prints[0].voc_clean) * 0.4f;  // above clean
+        printf("%lld,%d,%d,%.1f,%.1f,%.1f\n", (long long)(t / 1s),
+                int(SRAW_CLEAN - SRAW_PER_VOC * (voc - prints[0].voc_clean) + jitter),
+                int(SRAW_CLEAN - SRAW_PER_VOC * scrubbed + jitter), 35.f, 38.f, 40.f);
+    }
+
+    return 0;
+}
+
+int bench() {
+    using benchmark::keep;
+    using benchmark::run;
+
+    // SGP40 frames are 2 octets + CRC, a whole chain of them is representative of a sensor read
+    array<uint8_t, 32> crc_input{};
+    for (size_t i = 0; i < crc_input.size(); ++i)
+        crc_input[i] = uint8_t(i * 37);
+    run("crc8 32B", [&]() { keep(crc8(crc_input, 0xFF)); });
+    run("crc8_small 32B", [&]() { keep(crc8_small(crc_input, 0xFF)); });
+
+    run("PackedTuple SGP40 cmd", [&]() {
+        uint16_t const temperature = 0x6666;
+        uint16_t const humidity = 0x8000;
+        PackedTuple cmd{uint16_t(0x260F), humidity, uint8_t(0), temperature, uint8_t(0)};
+        keep(cmd);
+    });
+
+    GasIndexAlgorithmParams gas_index;
+    GasIndexAlgorithm_init(&gas_index, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
+    LCG noise;
+    run("GasIndexAlgorithm_process", [&]() {
+        int32_t index = 0;
+        GasIndexAlgorithm_process(&gas_index, int32_t(30000 + (noise() >> 22)), &index);
+        keep(index);
+    });
+
+    sensors::Sensors partial;
+    partial.temperature_exhaust = 40;
+    partial.voc_index_intake = 150;
+    partial.temperature_mcu = 30;
+    run("Sensors::with_fallbacks", [&]() { keep(partial.with_fallbacks()); });
+
+    FanPolicyEnvironmental const params;
+    auto instance = params.instance();
+    chrono::system_clock::time_point now{};
+    run("FanPolicyEnvironmental step", [&]() {
+        sensors::Sensors state;
+        state.voc_index_intake = 150 + int(noise() >> 28);
+        state.voc_index_exhaust = 100;
+        now += 1s;
+        keep(instance(state, now));
+    });
+
+    array<uint8_t, 1024> leds{};
+    ws2812::effects::Params const gradient{
+            .kind = ws2812::effects::Kind::Gradient, .colour_b = {255, 128, 64}, .period_ms = 2000};
+    uint32_t now_ms = 0;
+    run("effects::render 1024 components", [&]() {
+        ws2812::effects::render(gradient, now_ms += 33, 200, leds.size(), 0, leds);
+        keep(leds);
+    });
+
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    string_view const mode = 1 < argc ? argv[1] : "bench";
+    if (mode == "bench") return bench();
+    if (mode == "sim") return simulate();
+    if (mode == "trace") return trace();
+    if (mode == "replay" && 2 < argc) {
+        string_view const path = argv[2];
+        bool const csv = 3 < argc && string_view(argv[3]) == "--csv";
+        auto* file = path == "-" ? stdin : fopen(argv[2], "r");
+        if (!file) {
+            fprintf(stderr, "ERR - replay - can't open `%s`\n", argv[2]);
+            return 1;
+        }
+        auto const result = host::replay(file, csv);
+        if (file != stdin) fclose(file);
+        return result;
+    }
+
+    fprintf(stderr, "usage: %s [bench|sim|trace|replay <trace.csv|-> [--csv]]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,302 @@
+#include "replay.hpp"
+#include "lib/sensirion_gas_index_algorithm.h"
+#include "sensors.hpp"
+#include "utility/benchmark.hpp"
+#include "utility/fan_policy.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::literals::chrono_literals;
+
+namespace nevermore::host {
+
+namespace {
+
+// Longer rows are malformed, a trace has a handful of short numeric columns.
+constexpr size_t TRACE_ROW_MAX = 1024;
+
+enum class Column : uint8_t {
+    Time,
+    VocRawIntake,
+    VocRawExhaust,
+    VocIndexIntake,
+    VocIndexExhaust,
+    TemperatureIntake,
+    TemperatureExhaust,
+    TemperatureMcu,
+    HumidityIntake,
+    HumidityExhaust,
+    PressureIntake,
+    PressureExhaust,
+    Ignored,
+};
+
+constexpr array<pair<string_view, Column>, size_t(Column::Ignored)> COLUMNS{{
+        {"t_s", Column::Time},
+        {"voc_raw_intake", Column::VocRawIntake},
+        {"voc_raw_exhaust", Column::VocRawExhaust},
+        {"voc_index_intake", Column::VocIndexIntake},
+        {"voc_index_exhaust", Column::VocIndexExhaust},
+        {"temperature_intake", Column::TemperatureIntake},
+        {"temperature_exhaust", Column::TemperatureExhaust},
+        {"temperature_mcu", Column::TemperatureMcu},
+        {"humidity_intake", Column::HumidityIntake},
+        {"humidity_exhaust", Column::HumidityExhaust},
+        {"pressure_intake", Column::PressureIntake},
+        {"pressure_exhaust", Column::PressureExhaust},
+}};
+
+using Row = array<optional<double>, size_t(Column::Ignored)>;
+
+struct Trace {
+    FILE* file;
+    vector<Column> columns;  // by position in a row
+    size_t line = 0;
+
+    [[nodiscard]] bool has(Column x) const {
+        return ranges::find(columns, x) != columns.end();
+    }
+
+    // False on a malformed header (or an empty trace).
+    bool header() {
+        array<char, TRACE_ROW_MAX> buffer{};
+        if (!read_line(buffer)) return false;
+
+        for (auto name : split(buffer.data())) {
+            auto const* it = ranges::find(COLUMNS, name, &pair<string_view, Column>::first);
+            columns.push_back(it == COLUMNS.end() ? Column::Ignored : it->second);
+        }
+        if (!has(Column::Time)) {
+            fprintf(stderr, "ERR - replay - trace has no `t_s` column\n");
+            return false;
+        }
+        return true;
+    }
+
+    // `nullopt` at the end of the trace. Sets `malformed` (& stops) on a row that can't be parsed.
+    optional<Row> next(bool& malformed) {
+        array<char, TRACE_ROW_MAX> buffer{};
+        if (!read_line(buffer)) return {};
+
+        Row row{};
+        auto const cells = split(buffer.data());
+        for (size_t i = 0; i < min(cells.size(), columns.size()); ++i) {
+            if (columns[i] == Column::Ignored || cells[i].empty()) continue;
+
+            string const cell{cells[i]};
+            char* end = nullptr;
+            auto const value = strtod(cell.c_str(), &end);
+            if (end != cell.c_str() + cell.size() || !isfinite(value)) {
+                fprintf(stderr, "ERR - replay - line %zu: `%s` isn't a number\n", line, cell.c_str());
+                malformed = true;
+                return {};
+            }
+            row.at(size_t(columns[i])) = value;
+        }
+        if (!row.at(size_t(Column::Time))) {
+            fprintf(stderr, "ERR - replay - line %zu: no `t_s`\n", line);
+            malformed = true;
+            return {};
+        }
+        return row;
+    }
+
+private:
+    bool read_line(array<char, TRACE_ROW_MAX>& buffer) {
+        if (!fgets(buffer.data(), int(buffer.size()), file)) return false;
+        line += 1;
+        buffer.at(strcspn(buffer.data(), "\r\n")) = '\0';
+        return true;
+    }
+
+    static vector<string_view> split(string_view xs) {
+        vector<string_view> cells;
+        for (;;) {
+            auto const n = xs.find(',');
+            auto cell = xs.substr(0, n);
+            while (!cell.empty() && cell.front() == ' ') cell.remove_prefix(1);
+            while (!cell.empty() && cell.back() == ' ') cell.remove_suffix(1);
+            cells.push_back(cell);
+            if (n == string_view::npos) return cells;
+            xs.remove_prefix(n + 1);
+        }
+    }
+};
+
+// Same as `SGP40`: the algorithm steps in 1s, a slower sample is held for each step it spans. While the
+// algorithm has no index (start up blackout) the side keeps its last one.
+struct VocSide {
+    GasIndexAlgorithmParams algorithm{};
+    sensors::VOCIndex index = BLE::NOT_KNOWN;
+
+    VocSide() {
+        GasIndexAlgorithm_init(&algorithm, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
+    }
+
+    void operator()(int32_t sraw, uint32_t steps) {
+        int32_t gas_index{};
+        for (uint32_t i = 0; i < steps; ++i)
+            GasIndexAlgorithm_process(&algorithm, sraw, &gas_index);
+        if (gas_index != 0) index = sensors::VOCIndex::from_fixed<0>(gas_index);
+    }
+};
+
+// `x` in the quantity's base units (e.g. C, %, Pa)
+template <typename A>
+A quantity(optional<double> x) {
+    if (!x) return BLE::NOT_KNOWN;
+    return A::template from_fixed<-3>(llround(*x * 1000));
+}
+
+struct Timings {
+    vector<chrono::nanoseconds> gas_index;
+    vector<chrono::nanoseconds> fallbacks;
+    vector<chrono::nanoseconds> policy;
+};
+
+}  // namespace
+
+int replay(FILE* file, bool csv) {
+    Trace trace{.file = file};
+    if (!trace.header()) return 1;
+
+    auto* report = csv ? stderr : stdout;
+    if (csv) printf("t_s,voc_intake,voc_exhaust,power\n");
+
+    FanPolicyEnvironmental const params;
+    auto instance = params.instance();
+    chrono::system_clock::time_point const epoch{};
+    array<VocSide, 2> voc;
+    bool const voc_raw_intake = trace.has(Column::VocRawIntake);
+    bool const voc_raw_exhaust = trace.has(Column::VocRawExhaust);
+
+    Timings timings;
+    size_t samples = 0;
+    optional<double> t_first;
+    double t_last = 0;
+    double fan_on_s = 0;
+    double fan_energy_s = 0;  // power x seconds, 1s at 100 % -> 1
+    size_t fan_starts = 0;
+    float power = 0;
+
+    // Reaction: VOCs crossing `voc_passive_max` (fan off), until the fan comes on.
+    vector<double> reactions_s;
+    size_t reactions_ahead = 0;   // the fan was already on when they crossed (e.g. the predictive trigger)
+    double reaction_from = -1;    // < 0 -> not waiting on the fan
+    size_t reactions_missed = 0;  // the fan never came on before the VOCs dropped back (or the trace ended)
+    bool voc_high = false;
+
+    bool malformed = false;
+    while (auto const row = trace.next(malformed)) {
+        auto const at = [&](Column x) { return row->at(size_t(x)); };
+        auto const t = *at(Column::Time);
+        if (t_first && t < t_last) {
+            fprintf(stderr, "ERR - replay - line %zu: time goes backwards\n", trace.line);
+            return 1;
+        }
+        auto const dt = t_first ? t - t_last : 1.;
+        if (!t_first) t_first = t;
+
+        auto const bgn = chrono::steady_clock::now();
+        auto const steps = uint32_t(max<int64_t>(llround(dt), 1));
+        if (auto x = at(Column::VocRawIntake)) voc[0](int32_t(*x), steps);
+        if (auto x = at(Column::VocRawExhaust)) voc[1](int32_t(*x), steps);
+        auto const gas_indexed = chrono::steady_clock::now();
+
+        sensors::Sensors state;
+        state.temperature_intake = quantity<BLE::Temperature>(at(Column::TemperatureIntake));
+        state.temperature_exhaust = quantity<BLE::Temperature>(at(Column::TemperatureExhaust));
+        state.temperature_mcu = quantity<BLE::Temperature>(at(Column::TemperatureMcu));
+        state.humidity_intake = quantity<BLE::Humidity>(at(Column::HumidityIntake));
+        state.humidity_exhaust = quantity<BLE::Humidity>(at(Column::HumidityExhaust));
+        state.pressure_intake = quantity<BLE::Pressure>(at(Column::PressureIntake));
+        state.pressure_exhaust = quantity<BLE::Pressure>(at(Column::PressureExhaust));
+        state.voc_index_intake =
+                voc_raw_intake ? voc[0].index : quantity<sensors::VOCIndex>(at(Column::VocIndexIntake));
+        state.voc_index_exhaust =
+                voc_raw_exhaust ? voc[1].index : quantity<sensors::VOCIndex>(at(Column::VocIndexExhaust));
+
+        auto const resolved = state.with_fallbacks();
+        auto const fell_back = chrono::steady_clock::now();
+        auto const power_prev = power;
+        power = instance(resolved, epoch + chrono::round<chrono::system_clock::duration>(
+                                                  chrono::duration<double>(t - *t_first)));
+        auto const end = chrono::steady_clock::now();
+
+        timings.gas_index.push_back(gas_indexed - bgn);
+        timings.fallbacks.push_back(fell_back - gas_indexed);
+        timings.policy.push_back(end - fell_back);
+
+        // the current sample's power holds until the next one
+        if (0 < power_prev) fan_on_s += dt;
+        fan_energy_s += power_prev * dt;
+        if (power_prev <= 0 && 0 < power) fan_starts += 1;
+
+        auto const voc_max =
+                max(resolved.voc_index_intake.value_or(0), resolved.voc_index_exhaust.value_or(0));
+        bool const voc_high_now = params.voc_passive_max.value_or(0) <= voc_max && 0 < voc_max;
+        if (voc_high_now && !voc_high) {
+            if (power_prev <= 0)
+                reaction_from = t;
+            else
+                reactions_ahead += 1;
+        }
+        if (0 <= reaction_from && 0 < power) {
+            reactions_s.push_back(t - reaction_from);
+            reaction_from = -1;
+        } else if (0 <= reaction_from && !voc_high_now) {
+            reactions_missed += 1;
+            reaction_from = -1;
+        }
+        voc_high = voc_high_now;
+
+        if (csv)
+            printf("%.3f,%.1f,%.1f,%.3f\n", t, resolved.voc_index_intake.value_or(0),
+                    resolved.voc_index_exhaust.value_or(0), power);
+
+        t_last = t;
+        samples += 1;
+    }
+    if (malformed) return 1;
+    if (samples == 0) {
+        fprintf(stderr, "ERR - replay - trace has no samples\n");
+        return 1;
+    }
+    if (0 <= reaction_from) reactions_missed += 1;
+
+    auto const duration_s = t_last - *t_first;
+    fprintf(report, "%-32s %zu over %.1f h\n", "samples", samples, duration_s / 3600);
+    fprintf(report, "%-32s %.1f min (%.1f %%), %zu starts, %.1f min at full power\n", "fan on", fan_on_s / 60,
+            duration_s <= 0 ? 0. : fan_on_s * 100 / duration_s, fan_starts, fan_energy_s / 60);
+    if (reactions_s.empty()) {
+        fprintf(report, "%-32s n/a  (%zu ahead, %zu missed)\n", "reaction latency", reactions_ahead,
+                reactions_missed);
+    } else {
+        ranges::sort(reactions_s);
+        double total = 0;
+        for (auto x : reactions_s)
+            total += x;
+        fprintf(report, "%-32s n=%zu mean %.1f s  max %.1f s  (%zu ahead, %zu missed)\n", "reaction latency",
+                reactions_s.size(), total / double(reactions_s.size()), reactions_s.back(), reactions_ahead,
+                reactions_missed);
+    }
+
+    benchmark::report("cost/sample gas index", benchmark::summarise(span{timings.gas_index}), report);
+    benchmark::report("cost/sample with_fallbacks", benchmark::summarise(span{timings.fallbacks}), report);
+    benchmark::report("cost/sample policy", benchmark::summarise(span{timings.policy}), report);
+    return 0;
+}
+
+}  // namespace nevermore::host
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdio>
+
+// Replays a recorded sensor trace through the firmware's sensor processing (SGP40 gas index, fallbacks) &
+// fan policy, then reports what the policy did w/ it (fan-on time, reaction latency) & what each sample cost
+// to process. Open loop: a recording's exhaust already shows what its fans did, the replay's don't feed back.
+//
+// Trace: CSV, the 1st line names the columns, then 1 row per sample in time order. Unrecognised columns are
+// ignored, an empty cell is not-known for that sample (sensor missing, a dropped read). Recognised:
+//   t_s                                   seconds since the trace began (required), fractions allowed
+//   voc_raw_intake, voc_raw_exhaust       SGP40 SRAW ticks, run through the gas index algorithm
+//   voc_index_intake, voc_index_exhaust   already indexed, only used for a side w/o a raw column
+//   temperature_{intake,exhaust,mcu}      C
+//   humidity_{intake,exhaust}             %
+//   pressure_{intake,exhaust}             Pa
+namespace nevermore::host {
+
+// Reads `trace` to the end. `csv` -> also writes the replayed series to stdout (`t_s,voc_intake,voc_exhaust,
+// power`), the report then goes to stderr. Returns the exit code, non-zero if the trace is malformed.
+int replay(FILE* trace, bool csv);
+
+}  // namespace nevermore::host
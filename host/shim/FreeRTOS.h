@@ -0,0 +1,3 @@
+#pragma once
+
+// Host build stand-in. The host build is single threaded, there's no scheduler to configure.
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Host build stand-in. Microseconds since the first call, like the Pico's since boot.
+inline uint64_t time_us_64() {
+    static auto const epoch = std::chrono::steady_clock::now();
+    auto const elapsed = std::chrono::steady_clock::now() - epoch;
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
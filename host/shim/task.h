@@ -0,0 +1,7 @@
+#pragma once
+
+// Host build stand-in. Single threaded -> critical sections are no-ops.
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define taskENTER_CRITICAL_FROM_ISR() 0
+#define taskEXIT_CRITICAL_FROM_ISR(x) ((void)(x))
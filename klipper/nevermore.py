@@ -10,6 +10,7 @@ import datetime
 import enum
 import logging
 import threading
+import time
 import weakref
 from abc import abstractmethod
 from dataclasses import dataclass
@@ -20,6 +21,7 @@ from typing import (
     Callable,
     Coroutine,
     Dict,
+    Iterable,
     List,
     MutableMapping,
     Optional,
@@ -54,7 +56,11 @@ RGBW = Tuple[float, float, float, float]
 
 # BLE Constants (inclusive)
 TIMESEC16_MAX = 2**16 - 2
+FAN_RAMP_MS_MAX = 2**16 - 1
+FAN_PWM_HZ_MIN = 10
+FAN_PWM_HZ_MAX = 100_000
 VOC_INDEX_MAX = 500
+COMMAND_BATCH_ITEMS_MAX = 16
 
 
 # Not actually provided by `bleak`. IDK why not.
@@ -116,12 +122,37 @@ class SensorState:
         }
 
 
+class FanFault(Enum):
+    NONE = 0
+    STALL = 1
+    CLOG = 2  # spinning faster than usual for its duty, e.g. a blocked intake/filter
+
+
+class RelayPeerState(Enum):
+    SEARCHING = 0  # waiting to see its advert
+    CONNECTING = 1
+    CONNECTED = 2
+
+
+# Another controller, as seen through the one we're connected to (see `relay_peers`).
+@dataclass(frozen=True)
+class RelayPeer:
+    state: RelayPeerState = RelayPeerState.SEARCHING
+    intake: SensorState = SensorState()
+    exhaust: SensorState = SensorState()
+    fan_power: Optional[float] = None  # [0, 1]
+    fan_tacho: Optional[float] = None
+
+
 @dataclass
 class ControllerState:
     intake: SensorState = SensorState()
     exhaust: SensorState = SensorState()
     fan_power: float = 0
     fan_tacho: float = 0
+    fan_faults: Tuple[FanFault, ...] = ()  # 1 per fan channel, empty if unknown
+    # by index in `relay_peers`, listed peers only
+    relay_peers: Dict[int, RelayPeer] = dataclasses.field(default_factory=dict)
 
 
 def short_uuid(x: int):
@@ -135,15 +166,34 @@ UUID_SERVICE_CONFIGURATION = UUID("b5078b20-aea3-4c37-a18f-b370c03f02a6")
 UUID_SERVICE_FAN = UUID("4553d138-1d00-4b6f-bc42-955a89cf8c36")
 UUID_SERVICE_WS2812 = UUID("f62918ab-33b7-4f47-9fba-8ce9de9fecbb")
 UUID_SERVICE_FAN_POLICY = UUID("260a0845-e62f-48c6-aef9-04f62ff8bffd")
+UUID_SERVICE_RELAY = UUID("8d2f6b1a-43c9-4e7d-a05b-6c1e9f3a7d24")
 
 UUID_CHAR_PERCENT8 = short_uuid(0x2B04)
 UUID_CHAR_COUNT16 = short_uuid(0x2AEA)
 UUID_CHAR_TIMESEC16 = short_uuid(0x2B16)
 UUID_CHAR_DATA_AGGREGATE = UUID("75134bec-dd06-49b1-bac2-c15e05fd7199")
+UUID_CHAR_DATA_AGGREGATE_DELTA = UUID("594e8339-84c9-4a66-ae07-2ea77a62d715")
 UUID_CHAR_FAN_TACHO = UUID("03f61fe0-9fe7-4516-98e6-056de551687f")
+UUID_CHAR_FAN_RPM_TARGET = UUID("03c52c19-588b-4ac8-b963-be8177b10971")
 UUID_CHAR_VOC_INDEX = UUID("216aa791-97d0-46ac-8752-60bbc00611e1")
 UUID_CHAR_WS2812_UPDATE = UUID("5d91b6ce-7db1-4e06-b8cb-d75e7dd49aae")
+UUID_CHAR_WS2812_UPDATE_SPANS = UUID("c7e2a4d1-8b3f-4f6a-9e05-1d2c3b4a5f60")
+UUID_CHAR_WS2812_UPDATE_SPANS_16 = UUID("e1f04b7a-26c9-4d3e-b58a-7c0d9e2f4a16")
+UUID_CHAR_WS2812_UPDATE_SPANS_16_STAGED = UUID("4b8d2c6e-91a7-4f3b-8e0d-5c2a7f1b9e38")
 UUID_CHAR_CONFIG_FLAGS64 = UUID("d4b66bf4-3d8f-4746-b6a2-8a59d2eac3ce")
+UUID_CHAR_COMMAND_BATCH = UUID("0e7d4c1b-58a3-4f26-9b0e-d3c8a1f5726e")
+UUID_CHAR_FAN_POLICY_PRINT_HINT = UUID("fd8fb287-cb14-4bd2-995b-ab52db50600e")
+UUID_CHAR_NOTIFY_INTERVAL = UUID("6636e8ca-4529-46f2-ae54-831c4d757835")
+UUID_CHAR_FILTER_LIFE = UUID("b3bcb7eb-d401-416f-9b1a-8e7ae9bee492")
+UUID_CHAR_FAN_HEALTH = UUID("a7c53e19-6d2b-4f80-9e4a-3b1f8c0d52e7")
+UUID_CHAR_FAN_RAMP = UUID("4e9a2c17-8b3d-4f61-a0c5-d27e8f1b6a39")
+UUID_CHAR_FAN_PWM = UUID("c6f2a9d4-1e7b-4a35-8c02-9b5d3e7f1a68")
+UUID_CHAR_RELAY_PEERS = UUID("1b7e3c95-d26a-4f08-8e4b-2a9c7d5f0e13")
+UUID_CHAR_RELAY_AGGREGATE = UUID("e4a9d273-5f1c-4b86-9d0e-73b2c8a1f546")
+UUID_CHAR_SENSOR_CLOCK = UUID("5d1457fb-dd3a-4738-8155-2bb54cca08cc")
+
+# Must match `RELAY_PEERS_MAX` in the controller's `gatt/relay.hpp`.
+RELAY_PEERS_MAX = 4
 
 
 def _clamp(x: _Float, min: _Float, max: _Float) -> _Float:
@@ -275,6 +325,64 @@ def parse_agg_env(reader: BleAttrReader) -> Tuple[SensorState, SensorState]:
     )
 
 
+# Byte size of each field in the env aggregate, in order.
+# Must match `SENSORS_FIELDS` in the controller's `gatt/environmental.cpp`.
+AGG_ENV_FIELD_SIZES = [2, 2, 2, 2, 2, 4, 4, 2, 2]
+
+# [u8 peer index, u8 state, env aggregate, fan aggregate (power, power override, tachometer)]
+# Must match `PeerRecord` in the controller's `gatt/relay.cpp`.
+RELAY_RECORD_SIZE = 2 + sum(AGG_ENV_FIELD_SIZES) + 1 + 1 + 2
+
+
+def parse_relay_aggregate(raw: bytes) -> Dict[int, RelayPeer]:
+    peers: Dict[int, RelayPeer] = {}
+    for i in range(0, len(raw) - RELAY_RECORD_SIZE + 1, RELAY_RECORD_SIZE):
+        record = raw[i : i + RELAY_RECORD_SIZE]
+        reader = BleAttrReader(record[2:])
+        (intake, exhaust) = parse_agg_env(reader)
+        fan_power = reader.percentage8()
+        _ = reader.percentage8()  # power-override
+        peers[record[0]] = RelayPeer(
+            RelayPeerState(record[1]),
+            intake,
+            exhaust,
+            None if fan_power is None else fan_power / 100.0,  # need it in [0,1]
+            reader.tachometer(),
+        )
+    return peers
+
+
+# Reassembles the full env aggregate from the delta encoded aggregate.
+# Wire format: u16 LE mask, bit `i` set -> field `i` follows. Fields are packed, in order.
+class AggEnvDeltaDecoder:
+    def __init__(self):
+        self._fields: List[Optional[bytes]] = [None] * len(AGG_ENV_FIELD_SIZES)
+
+    # Returns `None` until every field is known (i.e. until the first keyframe).
+    def apply(self, raw: bytes) -> Optional[bytes]:
+        if len(raw) < 2:
+            raise BleAttrReaderNotEnoughData("insufficient data remaining")
+
+        mask = int.from_bytes(raw[:2], "little")
+        offset = 2
+        for i, sz in enumerate(AGG_ENV_FIELD_SIZES):
+            if not mask & (1 << i):
+                continue
+
+            chunk = raw[offset : offset + sz]
+            if len(chunk) != sz:
+                raise BleAttrReaderNotEnoughData("insufficient data remaining")
+
+            self._fields[i] = bytes(chunk)
+            offset += sz
+
+        fields = self._fields
+        if any(x is None for x in fields):
+            return None
+
+        return b"".join(x for x in fields if x is not None)
+
+
 def require_chars(
     service: BleakGATTService,
     id: UUID,
@@ -331,18 +439,23 @@ async def discover_controllers(
 
 @dataclass
 class LedUpdateSpan:
+    # Theoretically we should be able to do 512 (ATT maximum).
+    # Can't send more than 253 octets at once (tested).
+    # FUTURE WORK: Investigate. For now it's more than enough for our use case.
+    TX_MAX = 253
+    HEADER_SZ = 2  # 2 octets: 1 offset, 1 length
+    HEADER_SZ_WIDE = 4  # 4 octets: 2 offset, 2 length
+    # the 8-bit headers can't address anything beyond this
+    OFFSET_MAX_NARROW = 0xFF
+
     begin: int
     end: int  # INVARIANT(begin < end)
     num_dirty: int = 1
 
     def worth_extending_to(self, i: int):
-        # Theoretically we should be able to do 512 (ATT maximum).
-        # Can't send more than 253 octets at once (tested).
-        # FUTURE WORK: Investigate. For now it's more than enough for our use case.
-        TX_MAX = 253
-        HEADER_SZ = 2  # 2 octets: 1 offset, 1 length
-        MAX_LENGTH = TX_MAX - HEADER_SZ
-        MIN_LENGTH = 20 - HEADER_SZ  # picked ad-hoc, amortise comm overhead
+        # must fit in either header's length field, w/ either header
+        MAX_LENGTH = min(self.TX_MAX - self.HEADER_SZ_WIDE, 0xFF)
+        MIN_LENGTH = 20 - self.HEADER_SZ  # picked ad-hoc, amortise comm overhead
         MIN_DENSITY = 0.5  # picked ad-hoc
 
         if i < self.end:
@@ -385,6 +498,28 @@ class LedUpdateSpan:
         if span is not None:
             yield cmd(span)
 
+    @staticmethod
+    def header(offset: int, length: int, wide: bool) -> bytearray:
+        if wide:
+            return bytearray(offset.to_bytes(2, "little") + length.to_bytes(2, "little"))
+
+        return bytearray([offset, length])
+
+    @staticmethod
+    def batch(diffs: Iterable[Tuple[int, bytearray]], wide: bool, tx_max: int = TX_MAX):
+        # Pack as many spans as fit into each write, for the batched update characteristics.
+        # Each write gets a single refresh on the controller.
+        batch = bytearray()
+        for offset, data in diffs:
+            params = LedUpdateSpan.header(offset, len(data), wide) + data
+            if batch and tx_max < len(batch) + len(params):
+                yield batch
+                batch = bytearray()
+            batch += params
+
+        if batch:
+            yield batch
+
 
 # Commands which aren't directly forwarded to the controller.
 class PseudoCommand:
@@ -393,13 +528,44 @@ class PseudoCommand:
 
 # Commands which are directly forwarded to the controller.
 class Command:
+    # tag in the controller's command batch characteristic
+    BATCH_TAG: int
+    # absolute settings only need their latest value sent, events need every one
+    BATCH_LATEST_ONLY = True
+
     @abstractmethod
     def params(self) -> bytearray:
         raise NotImplemented
 
+    # Folds `cmds` into as few batch writes as possible, each at most `tx_max` octets.
+    # Only the latest of each setting matters, events (`BATCH_LATEST_ONLY`) all do.
+    @staticmethod
+    def batch(cmds: Iterable["Command"], tx_max: int):
+        latest: Dict[Tuple[int, int], Command] = {}
+        for i, cmd in enumerate(cmds):
+            key = (cmd.BATCH_TAG, 0 if cmd.BATCH_LATEST_ONLY else i)
+            latest.pop(key, None)  # keep the order they were issued in
+            latest[key] = cmd
+
+        write = bytearray()
+        items = 0
+        for cmd in latest.values():
+            params = cmd.params()
+            item = bytearray([cmd.BATCH_TAG, len(params)]) + params
+            full = tx_max < len(write) + len(item) or COMMAND_BATCH_ITEMS_MAX <= items
+            if write and full:
+                yield write
+                write = bytearray()
+                items = 0
+            write += item
+            items += 1
+        if write:
+            yield write
+
 
 @dataclass(frozen=True)
 class CmdFanPower(Command):
+    BATCH_TAG = 1
     percent: Optional[float]
 
     def params(self):
@@ -412,6 +578,7 @@ class CmdFanPower(Command):
 
 @dataclass(frozen=True)
 class CmdFanPolicyCooldown(Command):
+    BATCH_TAG = 2
     value: int  # seconds
 
     def params(self):
@@ -420,6 +587,7 @@ class CmdFanPolicyCooldown(Command):
 
 @dataclass(frozen=True)
 class CmdFanPolicyVocPassiveMax(Command):
+    BATCH_TAG = 3
     value: int
 
     def params(self):
@@ -428,6 +596,7 @@ class CmdFanPolicyVocPassiveMax(Command):
 
 @dataclass(frozen=True)
 class CmdFanPolicyVocImproveMin(Command):
+    BATCH_TAG = 4
     value: int
 
     def params(self):
@@ -436,6 +605,7 @@ class CmdFanPolicyVocImproveMin(Command):
 
 @dataclass(frozen=True)
 class CmdWs2812Length(Command):
+    BATCH_TAG = 5
     n_total_components: int
 
     def params(self):
@@ -444,12 +614,95 @@ class CmdWs2812Length(Command):
 
 @dataclass(frozen=True)
 class CmdConfigFlags(Command):
+    BATCH_TAG = 6
     flags: int
 
     def params(self):
         return self.flags.to_bytes(8, "little")
 
 
+class PrintEvent(Enum):
+    STARTED = 1
+    ENDED = 2
+    MATERIAL = 3  # the running print's material changed
+
+
+class PrintMaterial(Enum):
+    UNKNOWN = 0
+    LOW = 1  # low VOC, e.g. PLA
+    HIGH = 2  # high VOC, e.g. ABS
+
+
+@dataclass(frozen=True)
+class CmdPrintHint(Command):
+    BATCH_TAG = 7
+    BATCH_LATEST_ONLY = False
+    event: PrintEvent
+    material: PrintMaterial = PrintMaterial.UNKNOWN
+
+    def params(self):
+        return bytearray([self.event.value, self.material.value])
+
+
+@dataclass(frozen=True)
+class CmdFilterReset(Command):
+    BATCH_TAG = 8
+    capacity: int = 0  # VOC index x seconds at full fan, 0 -> controller's default
+
+    def params(self):
+        return _clamp(self.capacity, 0, 2**32 - 1).to_bytes(4, "little")
+
+
+# Floor for running fans while any fan's faulted, `None` -> no floor
+@dataclass(frozen=True)
+class CmdFanFaultPower(Command):
+    BATCH_TAG = 9
+    percent: Optional[float]
+
+    def params(self):
+        return CmdFanPower(self.percent).params()
+
+
+# Other controllers to relay, by BT address. Unused slots are all zero.
+@dataclass(frozen=True)
+class CmdRelayPeers(Command):
+    BATCH_TAG = 10
+    addresses: Tuple[str, ...]
+
+    def params(self):
+        assert len(self.addresses) <= RELAY_PEERS_MAX
+        x = b"".join(bytes.fromhex(addr.replace(":", "")) for addr in self.addresses)
+        return x.ljust(RELAY_PEERS_MAX * 6, b"\0")
+
+
+class FanRampShape(Enum):
+    LINEAR = 0
+    EASE_IN = 1  # slow start, gentler on a stopped fan spinning up
+    SMOOTH = 2  # slow start & finish
+
+
+# How fan power changes are ramped in, over `seconds` for 0 -> 100% (0 -> step)
+@dataclass(frozen=True)
+class CmdFanRamp(Command):
+    BATCH_TAG = 11
+    seconds: float
+    shape: FanRampShape
+
+    def params(self):
+        ms = int(_clamp(self.seconds * 1000, 0, FAN_RAMP_MS_MAX))
+        return ms.to_bytes(2, "little") + bytearray([self.shape.value])
+
+
+# Every fan's PWM frequency
+@dataclass(frozen=True)
+class CmdFanPwm(Command):
+    BATCH_TAG = 12
+    hz: int
+
+    def params(self):
+        return _clamp(self.hz, FAN_PWM_HZ_MIN, FAN_PWM_HZ_MAX).to_bytes(4, "little")
+
+
 class CmdFanPolicy(PseudoCommand):
     def __init__(self, config: ConfigWrapper) -> None:
         def cfg_int(key: str, min: int, max: int) -> Optional[int]:
@@ -470,6 +723,8 @@ class CmdConfiguration(PseudoCommand):
 
         cfg_flag("sensors_fallback", True, 0)
         cfg_flag("sensors_fallback_exhaust_mcu", False, 1)
+        cfg_flag("sensors_voc_bme68x", False, 2)
+        cfg_flag("sensors_sampling_adaptive", True, 3)
 
 
 # Special pseudo command: Due to the very high frequency of these commands, we don't
@@ -637,6 +892,18 @@ class NevermoreBackgroundWorker:
 
         await client.get_services()  # fetch and cache services
 
+        # BlueZ negotiates the MTU on connect, but `bleak` only reports it once asked.
+        acquire_mtu = getattr(client._backend, "_acquire_mtu", None)
+        if acquire_mtu is not None:
+            try:
+                await acquire_mtu()
+            except Exception:
+                log.warning("failed to query ATT MTU")
+        # write w/o response payload is `MTU - 3`
+        tx_max = min(LedUpdateSpan.TX_MAX, client.mtu_size - 3)
+        if tx_max < LedUpdateSpan.TX_MAX:
+            log.warning(f"ATT MTU {client.mtu_size} is small, LED updates will be slow")
+
         def require(id: UUID):
             x = client.services.get_service(id)
             if x is None:
@@ -652,11 +919,39 @@ class NevermoreBackgroundWorker:
         P = CharacteristicProperty
         aggregate_env = require_char(service_env, UUID_CHAR_DATA_AGGREGATE, {P.NOTIFY})
         aggregate_fan = require_char(service_fan, UUID_CHAR_DATA_AGGREGATE, {P.NOTIFY})
+        # optional, older controllers only have the full aggregate
+        aggregate_env_deltas = require_chars(
+            service_env, UUID_CHAR_DATA_AGGREGATE_DELTA, None, {P.NOTIFY}
+        )
+        aggregate_env_delta = aggregate_env_deltas[0] if aggregate_env_deltas else None
         fan_power_override = require_char(service_fan, UUID_CHAR_PERCENT8, {P.WRITE})
         ws2812_length = require_char(service_ws2812, UUID_CHAR_COUNT16, {P.WRITE})
         ws2812_update = require_char(
             service_ws2812, UUID_CHAR_WS2812_UPDATE, {P.WRITE_NO_RESPONSE}
         )
+        # optional, older controllers only take 1 span per write w/ 8-bit offsets
+        ws2812_update_batched = None
+        ws2812_update_batched_wide = False
+        for uuid, wide in [
+            (UUID_CHAR_WS2812_UPDATE_SPANS, False),
+            (UUID_CHAR_WS2812_UPDATE_SPANS_16, True),  # preferred, can reach the whole chain
+        ]:
+            xs = require_chars(service_ws2812, uuid, None, {P.WRITE_NO_RESPONSE})
+            if xs:
+                ws2812_update_batched = xs[0]
+                ws2812_update_batched_wide = wide
+        # optional, lets a frame that needs several writes be shown all at once
+        ws2812_update_staged = next(
+            iter(
+                require_chars(
+                    service_ws2812,
+                    UUID_CHAR_WS2812_UPDATE_SPANS_16_STAGED,
+                    None,
+                    {P.WRITE_NO_RESPONSE},
+                )
+            ),
+            None,
+        )
         fan_policy_cooldown = require_char(
             service_fan_policy, UUID_CHAR_TIMESEC16, {P.WRITE}
         )
@@ -664,6 +959,72 @@ class NevermoreBackgroundWorker:
             service_fan_policy, UUID_CHAR_VOC_INDEX, 2, {P.WRITE}
         )
         config_flags = require_char(service_config, UUID_CHAR_CONFIG_FLAGS64, {P.WRITE})
+        # optional, older controllers don't take print hints
+        fan_policy_print_hint = next(
+            iter(
+                require_chars(
+                    service_fan_policy, UUID_CHAR_FAN_POLICY_PRINT_HINT, None, {P.WRITE}
+                )
+            ),
+            None,
+        )
+        # optional, older controllers don't track filter life
+        filter_life = next(
+            iter(require_chars(service_fan, UUID_CHAR_FILTER_LIFE, None, {P.WRITE})),
+            None,
+        )
+        # optional, older controllers don't watch for fan faults
+        fan_health = next(
+            iter(
+                require_chars(
+                    service_fan, UUID_CHAR_FAN_HEALTH, None, {P.WRITE, P.NOTIFY}
+                )
+            ),
+            None,
+        )
+        # optional, older controllers step their fans
+        fan_ramp = next(
+            iter(require_chars(service_fan, UUID_CHAR_FAN_RAMP, None, {P.WRITE})),
+            None,
+        )
+        # optional, older controllers' fan PWM is fixed at 25 kHz
+        fan_pwm = next(
+            iter(require_chars(service_fan, UUID_CHAR_FAN_PWM, None, {P.WRITE})),
+            None,
+        )
+        # optional, older controllers can't relay other controllers
+        service_relay = client.services.get_service(UUID_SERVICE_RELAY)
+        relay_peers = None
+        relay_aggregate = None
+        if service_relay is not None:
+            relay_peers = require_char(service_relay, UUID_CHAR_RELAY_PEERS, {P.WRITE})
+            relay_aggregate = require_char(
+                service_relay, UUID_CHAR_RELAY_AGGREGATE, {P.READ, P.NOTIFY}
+            )
+        # optional, older controllers take each command as its own write
+        command_batch = next(
+            iter(
+                require_chars(
+                    service_config, UUID_CHAR_COMMAND_BATCH, None, {P.READ, P.WRITE}
+                )
+            ),
+            None,
+        )
+
+        # optional, older controllers don't throttle notifications
+        # We're the latency sensitive client, never have our notifications held back while idle.
+        for char in require_chars(
+            service_config, UUID_CHAR_NOTIFY_INTERVAL, None, {P.WRITE}
+        ):
+            await client.write_gatt_char(char, (0).to_bytes(2, "little"), response=True)
+
+        # optional, older controllers don't timestamp their readings
+        # Puts the sensor clock on unix time (us), so its timestamps line up w/ ours & the logs.
+        for char in require_chars(
+            service_env, UUID_CHAR_SENSOR_CLOCK, None, {P.READ, P.WRITE}
+        ):
+            now = time.time_ns() // 1000
+            await client.write_gatt_char(char, now.to_bytes(8, "little"), response=True)
 
         self._connected.set()
 
@@ -695,6 +1056,13 @@ class NevermoreBackgroundWorker:
             nevermore.state.intake = intake
             nevermore.state.exhaust = exhaust
 
+        aggregate_env_decoder = AggEnvDeltaDecoder()
+
+        def notify_env_delta(nevermore: "Nevermore", params: BleAttrReader):
+            raw = aggregate_env_decoder.apply(params.remaining)
+            if raw is not None:  # still waiting on a keyframe
+                notify_env(nevermore, BleAttrReader(raw))
+
         def notify_fan(nevermore: "Nevermore", params: BleAttrReader):
             # HACK: Abuse GIL to keep this thread-safe
             # show the current fan power even if it isn't overridden
@@ -702,8 +1070,68 @@ class NevermoreBackgroundWorker:
             _ = params.percentage8()  # power-override
             nevermore.state.fan_tacho = params.tachometer()
 
+        def notify_fan_health(nevermore: "Nevermore", params: BleAttrReader):
+            _ = params.percentage8()  # fault power
+            faults = tuple(FanFault(x) for x in params.remaining)
+            for i, (old, new) in enumerate(
+                zip(nevermore.state.fan_faults or [FanFault.NONE] * len(faults), faults)
+            ):
+                if old != new:
+                    if new == FanFault.NONE:
+                        log.info(f"fan {i} recovered")
+                    else:
+                        log.warning(f"fan {i} fault: {new.name.lower()}")
+            # HACK: Abuse GIL to keep this thread-safe
+            nevermore.state.fan_faults = faults
+
+        def notify_relay(nevermore: "Nevermore", params: BleAttrReader):
+            peers = parse_relay_aggregate(params.remaining)
+            old = nevermore.state.relay_peers
+            # more than fits in the MTU is split over notifications, continuing w/ higher indices
+            if peers and old and max(old) < min(peers):
+                peers = {**old, **peers}
+            for i, peer in peers.items():
+                if old.get(i, RelayPeer()).state != peer.state:
+                    log.info(f"relay peer {i} {peer.state.name.lower()}")
+            # HACK: Abuse GIL to keep this thread-safe
+            nevermore.state.relay_peers = peers
+
         async def handle_commands():
             cmd = await self._command_queue.async_q.get()
+            if command_batch is not None:
+                # take everything queued up (e.g. the setup burst on connect), 1 round trip
+                cmds = [cmd]
+                while not self._command_queue.async_q.empty():
+                    cmds.append(self._command_queue.async_q.get_nowait())
+                # an unknown tag would reject the whole batch
+                if fan_policy_print_hint is None:
+                    cmds = [x for x in cmds if not isinstance(x, CmdPrintHint)]
+                if filter_life is None:
+                    cmds = [x for x in cmds if not isinstance(x, CmdFilterReset)]
+                if fan_health is None:
+                    cmds = [x for x in cmds if not isinstance(x, CmdFanFaultPower)]
+                if relay_peers is None:
+                    cmds = [x for x in cmds if not isinstance(x, CmdRelayPeers)]
+                if fan_ramp is None:
+                    cmds = [x for x in cmds if not isinstance(x, CmdFanRamp)]
+                if fan_pwm is None:
+                    cmds = [x for x in cmds if not isinstance(x, CmdFanPwm)]
+
+                for params in Command.batch(cmds, client.mtu_size - 3):
+                    try:
+                        await client.write_gatt_char(
+                            command_batch, params, response=True
+                        )
+                    except BleakError as e:
+                        # same as below, only a lost connection is fatal
+                        if e.args[0] == "Not connected":
+                            raise
+
+                        status = await client.read_gatt_char(command_batch)
+                        items = list(status[1 : 1 + status[0]])
+                        log.error(f"command batch failed, item status={items}")
+                return
+
             if isinstance(cmd, CmdFanPower):
                 char = fan_power_override
             elif isinstance(cmd, CmdFanPolicyCooldown):
@@ -716,6 +1144,33 @@ class NevermoreBackgroundWorker:
                 char = ws2812_length
             elif isinstance(cmd, CmdConfigFlags):
                 char = config_flags
+            elif isinstance(cmd, CmdPrintHint):
+                if fan_policy_print_hint is None:
+                    return  # nothing to tell, the policy works w/o hints
+                char = fan_policy_print_hint
+            elif isinstance(cmd, CmdFilterReset):
+                if filter_life is None:
+                    log.warning("controller doesn't track filter life, ignoring reset")
+                    return
+                char = filter_life
+            elif isinstance(cmd, CmdFanFaultPower):
+                if fan_health is None:
+                    return  # nothing to configure, the controller doesn't detect faults
+                char = fan_health
+            elif isinstance(cmd, CmdFanRamp):
+                if fan_ramp is None:
+                    return  # nothing to configure, the controller steps its fans
+                char = fan_ramp
+            elif isinstance(cmd, CmdFanPwm):
+                if fan_pwm is None:
+                    log.warning("fan PWM is fixed, ignoring `fan_pwm_frequency`")
+                    return
+                char = fan_pwm
+            elif isinstance(cmd, CmdRelayPeers):
+                if relay_peers is None:
+                    log.warning("controller can't relay, ignoring `relay_peers`")
+                    return
+                char = relay_peers
             else:
                 raise Exception(f"unhandled command {cmd}")
 
@@ -733,8 +1188,26 @@ class NevermoreBackgroundWorker:
             await self._led_dirty.wait()
             self._led_dirty.clear()
 
-            for offset, data in self._worker_led_diffs():
-                params = bytearray([offset, len(data)]) + data
+            diffs = self._worker_led_diffs()
+            if ws2812_update_batched is not None:
+                wide = ws2812_update_batched_wide
+                writes = list(LedUpdateSpan.batch(diffs, wide, tx_max))
+                if wide and ws2812_update_staged is not None:
+                    # stage all but the last, which presents the whole frame at once
+                    for params in writes[:-1]:
+                        await client.write_gatt_char(ws2812_update_staged, params)
+                    writes = writes[-1:]
+
+                for params in writes:
+                    await client.write_gatt_char(ws2812_update_batched, params)
+                return
+
+            for offset, data in diffs:
+                if LedUpdateSpan.OFFSET_MAX_NARROW < offset:
+                    log.error("LED chain too long for this controller, update its firmware")
+                    break
+
+                params = LedUpdateSpan.header(offset, len(data), False) + data
                 await client.write_gatt_char(ws2812_update, params)
 
         async def forever(go: Callable[[], Coroutine[Any, Any, Any]]):
@@ -744,8 +1217,27 @@ class NevermoreBackgroundWorker:
         tasks = asyncio.gather(*[forever(x) for x in [handle_commands, handle_led]])
 
         try:
-            await notify(aggregate_env, notify_env)
+            if aggregate_env_delta is not None:
+                await notify(aggregate_env_delta, notify_env_delta)
+            else:
+                await notify(aggregate_env, notify_env)
             await notify(aggregate_fan, notify_fan)
+            if fan_health is not None:
+                await notify(fan_health, notify_fan_health)
+                # pick up faults raised before we subscribed
+                health = await client.read_gatt_char(fan_health)
+                nevermore = self._nevermore()
+                if nevermore is not None:
+                    notify_fan_health(nevermore, BleAttrReader(health))
+                nevermore = None  # release local ref
+            if relay_aggregate is not None:
+                await notify(relay_aggregate, notify_relay)
+                # notifications only come on change
+                aggregate = await client.read_gatt_char(relay_aggregate)
+                nevermore = self._nevermore()
+                if nevermore is not None:
+                    notify_relay(nevermore, BleAttrReader(aggregate))
+                nevermore = None  # release local ref
             await tasks
         except BleakError as e:
             # consider non-fatal. don't to abort due to potentially transient error
@@ -820,16 +1312,138 @@ class Nevermore:
 
         self._configuration = CmdConfiguration(config)
         self._fan_policy = CmdFanPolicy(config)
+        # fan power while a fan's stalled/clogged (the rest pick up the slack), unset -> leave it to the policy
+        self._fan_fault_power: Optional[float] = config.getfloat(
+            "fan_fault_power", None, minval=0, maxval=1
+        )
+        # seconds for a fan to ramp from 0 to 100%, unset -> leave it to the controller
+        fan_ramp_time: Optional[float] = config.getfloat(
+            "fan_ramp_time", None, minval=0, maxval=FAN_RAMP_MS_MAX / 1000
+        )
+        fan_ramp_shape: FanRampShape = config.getchoice(
+            "fan_ramp_shape", {x.name.lower(): x for x in FanRampShape}, "ease_in"
+        )
+        self._fan_ramp: Optional[CmdFanRamp] = None
+        if fan_ramp_time is not None:
+            self._fan_ramp = CmdFanRamp(fan_ramp_time, fan_ramp_shape)
+        # fans' PWM frequency, unset -> leave it to the controller (25 kHz)
+        fan_pwm_frequency: Optional[int] = config.getint(
+            "fan_pwm_frequency", None, minval=FAN_PWM_HZ_MIN, maxval=FAN_PWM_HZ_MAX
+        )
+        self._fan_pwm: Optional[CmdFanPwm] = None
+        if fan_pwm_frequency is not None:
+            self._fan_pwm = CmdFanPwm(fan_pwm_frequency)
+        # other controllers to watch through this one's connection, index in the list -> a sensor's `peer`
+        relay_peers: Optional[List[str]] = config.getlist("relay_peers", None)
+        self._relay_peers: Optional[CmdRelayPeers] = None
+        if relay_peers is not None:
+            relay_peers = [x.upper() for x in relay_peers]
+            for x in relay_peers:
+                if not _bt_address_validate(x):
+                    raise config.error(
+                        f"invalid bluetooth address in `relay_peers`, given `{x}`"
+                    )
+            if RELAY_PEERS_MAX < len(relay_peers):
+                raise config.error(
+                    f"`relay_peers` has more than {RELAY_PEERS_MAX} entries"
+                )
+            if len(set(relay_peers)) != len(relay_peers):
+                raise config.error("`relay_peers` lists an address more than once")
+            if self.bt_address is not None and self.bt_address in relay_peers:
+                raise config.error(
+                    "`relay_peers` lists the controller's own `bt_address`"
+                )
+            self._relay_peers = CmdRelayPeers(tuple(relay_peers))
+        # materials which off-gas enough to filter from the start of a print, matched case insensitively
+        self._print_materials_high = {
+            x.upper()
+            for x in config.getlist(
+                "print_materials_high", ["ABS", "ASA", "PC", "PA", "NYLON", "HIPS"]
+            )
+        }
+        # resent on reconnect, the controller may have restarted mid-print
+        self._print_hint: Optional[CmdPrintHint] = None
         self._interface: Optional[NevermoreBackgroundWorker] = None
         self._handle_request_restart(None)
 
         self.printer.add_object(f"fan_generic {self.fan.name}", self.fan)
+        gcode: GCodeDispatch = self.printer.lookup_object("gcode")
+        gcode.register_command(
+            "NEVERMORE_PRINT_START",
+            self.cmd_NEVERMORE_PRINT_START,
+            desc=self.cmd_NEVERMORE_PRINT_START_help,
+        )
+        gcode.register_command(
+            "NEVERMORE_PRINT_END",
+            self.cmd_NEVERMORE_PRINT_END,
+            desc=self.cmd_NEVERMORE_PRINT_END_help,
+        )
+        gcode.register_command(
+            "NEVERMORE_FILTER_RESET",
+            self.cmd_NEVERMORE_FILTER_RESET,
+            desc=self.cmd_NEVERMORE_FILTER_RESET_help,
+        )
         self.printer.register_event_handler("klippy:connect", self._handle_connect)
         self.printer.register_event_handler("klippy:shutdown", self._handle_shutdown)
         self.printer.register_event_handler(
             "gcode:request_restart", self._handle_request_restart
         )
 
+    cmd_NEVERMORE_PRINT_START_help = (
+        "Tells the nevermore a print is starting (or its `MATERIAL` changed)"
+    )
+    cmd_NEVERMORE_PRINT_END_help = "Tells the nevermore the print has ended"
+    cmd_NEVERMORE_FILTER_RESET_help = (
+        "Tells the nevermore a fresh carbon filter was installed (optional `CAPACITY`)"
+    )
+
+    def _print_material(self, gcmd: GCodeCommand) -> PrintMaterial:
+        material: Optional[str] = gcmd.get("MATERIAL", None)
+        if not material:
+            return PrintMaterial.UNKNOWN
+        if material.strip().upper() in self._print_materials_high:
+            return PrintMaterial.HIGH
+        return PrintMaterial.LOW
+
+    def _send_print_hint(self, hint: CmdPrintHint):
+        self._print_hint = hint
+        if self._interface is not None:
+            self._interface.send_command(hint)
+
+    def cmd_NEVERMORE_PRINT_START(self, gcmd: GCodeCommand) -> None:
+        material = self._print_material(gcmd)
+        # already printing -> only the material changed (e.g. a tool change)
+        printing = self._print_hint is not None
+        event = PrintEvent.MATERIAL if printing else PrintEvent.STARTED
+        self._send_print_hint(CmdPrintHint(event, material))
+
+    def cmd_NEVERMORE_PRINT_END(self, gcmd: GCodeCommand) -> None:
+        if self._print_hint is not None:
+            self._print_hint = None
+            if self._interface is not None:
+                self._interface.send_command(CmdPrintHint(PrintEvent.ENDED))
+
+    def cmd_NEVERMORE_FILTER_RESET(self, gcmd: GCodeCommand) -> None:
+        capacity = gcmd.get_int("CAPACITY", 0, minval=0, maxval=2**32 - 1)
+        if self._interface is None:
+            raise gcmd.error("nevermore isn't connected")
+        self._interface.send_command(CmdFilterReset(capacity))
+
+    def get_status(self, eventtime: float) -> Dict[str, Any]:
+        return {
+            # by index in `relay_peers`
+            "relay_peers": {
+                i: {
+                    "state": x.state.name.lower(),
+                    "intake": x.intake.as_dict(),
+                    "exhaust": x.exhaust.as_dict(),
+                    "speed": x.fan_power,
+                    "rpm": x.fan_tacho,
+                }
+                for i, x in self.state.relay_peers.items()
+            },
+        }
+
     def set_fan_power(self, percent: Optional[float]):
         if self._interface is not None:
             self._interface.send_command(CmdFanPower(percent))
@@ -858,6 +1472,18 @@ class Nevermore:
         self._interface.send_command(self._configuration)
         self._interface.send_command(self._fan_policy)
         self._interface.send_command(CmdWs2812Length(len(self.led_colour_idxs)))
+        if self._fan_fault_power is not None:
+            self._interface.send_command(CmdFanFaultPower(self._fan_fault_power))
+        if self._fan_ramp is not None:
+            self._interface.send_command(self._fan_ramp)
+        if self._fan_pwm is not None:
+            self._interface.send_command(self._fan_pwm)
+        if self._relay_peers is not None:
+            self._interface.send_command(self._relay_peers)
+        if self._print_hint is not None:
+            self._interface.send_command(
+                CmdPrintHint(PrintEvent.STARTED, self._print_hint.material)
+            )
 
     def _handle_request_restart(self, print_time: Optional[float]):
         self._handle_shutdown()
@@ -892,10 +1518,13 @@ class NevermoreFan:
 
         self.printer.register_event_handler("klippy:connect", self._handle_connect)
 
-    def get_status(self, eventtime: float) -> Dict[str, float]:
+    def get_status(self, eventtime: float) -> Dict[str, Any]:
+        faults = () if self.nevermore is None else self.nevermore.state.fan_faults
         return {
             "speed": 0 if self.nevermore is None else self.nevermore.state.fan_power,
             "rpm": 0 if self.nevermore is None else self.nevermore.state.fan_tacho,
+            # per fan channel: "none", "stall", "clog"
+            "faults": [x.name.lower() for x in faults],
         }
 
     def _handle_connect(self) -> None:
@@ -920,6 +1549,11 @@ class NevermoreSensor:
                 "`sensor_kind` isn't `intake` or `exhaust`, nor is the sensor name"
             )
 
+        # index in the nevermore's `relay_peers`, unset -> the nevermore itself
+        self.peer: Optional[int] = config.getint(
+            "peer", None, minval=0, maxval=RELAY_PEERS_MAX - 1
+        )
+
         class_name = config.get("class_name_override", "NevermoreSensor").strip()
         if len(class_name) == 0:
             raise config.error("`class_name_override` cannot be an empty string")
@@ -937,10 +1571,14 @@ class NevermoreSensor:
         if self.nevermore is None:
             return SensorState()
 
+        state: Union[ControllerState, RelayPeer] = self.nevermore.state
+        if self.peer is not None:
+            state = self.nevermore.state.relay_peers.get(self.peer, RelayPeer())
+
         if self.sensor_kind == SensorKind.INTAKE:
-            return self.nevermore.state.intake
+            return state.intake
         else:
-            return self.nevermore.state.exhaust
+            return state.exhaust
 
     def get_status(self, eventtime: float) -> Dict[str, float]:
         # HACK: can only plot on mainsail/fluidd if we pretend the VOC Index is a temperature
@@ -0,0 +1,87 @@
+#include "benchmark.hpp"
+#include "display/stats.hpp"
+#include "lib/sensirion_gas_index_algorithm.h"
+#include "sdk/task.hpp"
+#include "sdk/timer.hpp"
+#include "sensors.hpp"
+#include "ui.hpp"
+#include "utility/benchmark.hpp"
+#include "utility/crc.hpp"
+#include "utility/fan_policy.hpp"
+#include "ws2812/effects.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+using namespace std::literals::chrono_literals;
+
+namespace nevermore::benchmark {
+
+namespace {
+
+constexpr auto ROUND_PERIOD = 10s;  // rerun periodically, so a late USB connection still sees results
+
+// Anything much under ~50us needs batching to be measurable w/ a 1us clock.
+template <size_t SAMPLES = 128, size_t BATCH = 1, typename F>
+void bench(char const* name, F&& go) {
+    run<TimerClock, SAMPLES, BATCH>(name, std::forward<F>(go));
+}
+
+void run_round() {
+    // SGP40 frames are 2 octets + CRC, a whole chain of them is representative of a sensor read
+    array<uint8_t, 32> crc_input{};
+    for (size_t i = 0; i < crc_input.size(); ++i)
+        crc_input[i] = uint8_t(i * 37);
+    bench<128, 16>("crc8 32B", [&]() { keep(crc8(crc_input, 0xFF)); });
+
+    static GasIndexAlgorithmParams g_gas_index;  // big-ish, keep it off the stack
+    GasIndexAlgorithm_init(&g_gas_index, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
+    int32_t sraw = 30000;
+    bench<128, 4>("GasIndexAlgorithm_process", [&]() {
+        int32_t index = 0;
+        GasIndexAlgorithm_process(&g_gas_index, sraw = 30000 + (sraw * 7 + 13) % 1024, &index);
+        keep(index);
+    });
+
+    auto const state = sensors::snapshot();
+    bench<128, 16>("Sensors::with_fallbacks", [&]() { keep(state.with_fallbacks()); });
+
+    FanPolicyEnvironmental const params;
+    auto instance = params.instance();
+    chrono::system_clock::time_point now{};
+    bench<128, 16>("FanPolicyEnvironmental step", [&]() {
+        now += 1s;
+        keep(instance(state, now));
+    });
+
+    static array<uint8_t, 1024> g_leds;
+    ws2812::effects::Params const gradient{
+            .kind = ws2812::effects::Kind::Gradient, .colour_b = {255, 128, 64}, .period_ms = 2000};
+    uint32_t now_ms = 0;
+    bench("effects::render 1024 components", [&]() {
+        ws2812::effects::render(gradient, now_ms += 33, 200, g_leds.size(), 0, g_leds);
+        keep(g_leds);
+    });
+
+    bench<32>("ui plot update", ui::update_plot);
+
+    // Render time here, flush time (`gc9a01_flush_dma` -> DMA & PIO done) from the display's own stats.
+    display::stats::reset();
+    bench<32>("ui full frame (lv_refr_now)", ui::render_full_frame);
+    display::stats::print(display::stats::snapshot());
+}
+
+}  // namespace
+
+void suite() {
+    for (;;) {
+        printf("BENCHMARK - begin\n");
+        run_round();
+        printf("BENCHMARK - end\n");
+        task_delay(ROUND_PERIOD);
+    }
+}
+
+}  // namespace nevermore::benchmark
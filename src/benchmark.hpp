@@ -0,0 +1,9 @@
+#pragma once
+
+// On-target benchmark suite, only run by the `nevermore-benchmark` firmware (see `CMakeLists.txt`).
+namespace nevermore::benchmark {
+
+// Repeatedly times the hot paths & prints the results to stdio (USB). Call once the display is up.
+[[noreturn]] void suite();
+
+}  // namespace nevermore::benchmark
@@ -7,6 +7,8 @@
 
 // BTstack features that can be enabled
 #define ENABLE_LE_PERIPHERAL
+// suggest max LL PDU size for new connections, otherwise every ATT PDU over 27 octets is fragmented on-air
+#define ENABLE_LE_DATA_LENGTH_EXTENSION
 #define ENABLE_PRINTF_HEXDUMP
 #define ENABLE_LOG_ERROR
 
@@ -18,13 +20,9 @@
 #define ENABLE_LOG_DEBUG
 #endif
 
-// for the client
-#if RUNNING_AS_CLIENT
+// relay mode connects out to other controllers, 1 GATT client per peer (see `gatt/relay.hpp`)
 #define ENABLE_LE_CENTRAL
-#define MAX_NR_GATT_CLIENTS 1
-#else
-#define MAX_NR_GATT_CLIENTS 0
-#endif
+#define MAX_NR_GATT_CLIENTS 4
 
 // BTstack configuration. buffers, sizes, ...
 #define HCI_OUTGOING_PRE_BUFFER_SIZE 4
@@ -73,11 +73,11 @@ constexpr uint8_t spi_has_at_least(span<GPIO_Pin const> pins, initializer_list<S
     return missing == 0;
 }
 
+// Fans can share a slice w/ each other (same frequency), but not w/ the display backlight.
 constexpr bool pwm_slices_overlap() {
-    array xs{PIN_FAN_PWM, PIN_FAN_TACHOMETER, PIN_DISPLAY_BRIGHTNESS};
-    ranges::sort(xs, {}, pwm_gpio_to_slice_num_);
-    auto [last, end] = ranges::unique(xs);
-    return last != end;
+    return ranges::any_of(PINS_FAN, [](auto&& fan) {
+        return pwm_gpio_to_slice_num_(fan.pwm) == pwm_gpio_to_slice_num_(PIN_DISPLAY_BRIGHTNESS);
+    });
 }
 
 static_assert(all_pins_valid(), "`config.hpp` uses a GPIO pin outside of range [0, 29].");
@@ -92,15 +92,15 @@ static_assert(i2c_bus_pins_defined(0) & 0b10, "`config.hpp` has no pins defined
 static_assert(i2c_bus_pins_defined(1) & 0b01, "`config.hpp` has no pins defined for I2C1 SDA.");
 static_assert(i2c_bus_pins_defined(1) & 0b10, "`config.hpp` has no pins defined for I2C1 SCL.");
 
-// can't use the same slice to both drive a signal and read a signal, and all of thee require
-// drastically different frequencies.
+// These require drastically different frequencies. (The tachometer is read via GPIO IRQ, any pin will do.)
 static_assert(!pwm_slices_overlap(),
-        "`config.hpp` specifies `PIN_FAN_PWM`, `PIN_FAN_TACHOMETER`, or `PIN_DISPLAY_BRIGHTNESS` on "
-        " the same PWM slice. They must all be on separate slices.");
-// PWM slice can only read from B channel
-static_assert(pwm_gpio_to_channel_(PIN_FAN_TACHOMETER) == PWM_CHAN_B,
-        "`config.hpp` specifies `PIN_FAN_TACHOMETER` on a A channel pin instead of a B channel pin . "
-        "Move `PIN_FAN_TACHOMETER` to an odd # pin to fix this.");
+        "`config.hpp` specifies a `PINS_FAN` PWM pin and `PIN_DISPLAY_BRIGHTNESS` on the same PWM slice. "
+        "They must be on separate slices.");
+
+static_assert(1 <= size(PINS_FAN) && size(PINS_FAN) <= 4, "`config.hpp`'s `PINS_FAN` must have 1 to 4 fans.");
+static_assert(ranges::all_of(PINS_FAN, [](auto&& fan) { return 0 <= fan.stage && fan.stage <= 1; }),
+        "`config.hpp`'s `PINS_FAN` stages must be in [0, 1].");
+static_assert(PINS_FAN[0].stage == 0, "`config.hpp`'s primary fan (1st in `PINS_FAN`) must have stage 0.");
 
 static_assert(
         ranges::all_of(PINS_DISPLAY_SPI,
@@ -12,8 +12,18 @@ using namespace std::literals::chrono_literals;
 
 using GPIO_Pin = uint8_t;
 
-constexpr GPIO_Pin PIN_FAN_PWM = 13;
-constexpr GPIO_Pin PIN_FAN_TACHOMETER = 15;
+struct FanChannel {
+    GPIO_Pin pwm;
+    GPIO_Pin tachometer;  // any GPIO, edges are timestamped by IRQ
+    // Staged control: this fan only spins once the fan policy asks for at least this much power [0, 1].
+    // e.g. a 2nd fan w/ `stage = 0.5` stays off until the policy wants >= 50%.
+    float stage = 0;
+};
+
+// 1 to 4 fans. The 1st is the primary: it's the fan shown on the display & by the single-fan characteristics.
+constexpr FanChannel PINS_FAN[] = {
+        {.pwm = 13, .tachometer = 15},
+};
 constexpr GPIO_Pin PIN_NEOPIXEL_DATA_IN = 12;
 
 // A pin has at most 1 I2C function & bus, so no need to specify if the pin is SDA/SCL.
@@ -43,16 +53,72 @@ constexpr GPIO_Pin PIN_TOUCH_RESET = 9;
 constexpr auto SENSOR_UPDATE_PERIOD = 1s;
 static_assert(0.5s <= SENSOR_UPDATE_PERIOD,
         "SENSOR_UPDATE_PERIOD too low, SGP40 needs at least 0.5s between measures.");
+// period between sensor polls while idle, if `sensors_sampling_adaptive` is enabled.
+// VOC algos still step in `SENSOR_UPDATE_PERIOD`s, each slow sample is held for the steps it spans.
+constexpr auto SENSOR_UPDATE_PERIOD_SLOW = 10s;
+static_assert(SENSOR_UPDATE_PERIOD <= SENSOR_UPDATE_PERIOD_SLOW &&
+                      SENSOR_UPDATE_PERIOD_SLOW % SENSOR_UPDATE_PERIOD == 0s,
+        "SENSOR_UPDATE_PERIOD_SLOW must be a multiple of SENSOR_UPDATE_PERIOD");
+// Values measured longer ago than this are ignored by the fan policy (e.g. a hung sensor that's stopped
+// reading, but still has its last value published). A few slow periods, so a missed read or two is fine.
+constexpr auto SENSOR_STALE_AFTER = 3 * SENSOR_UPDATE_PERIOD_SLOW;
 
 constexpr auto ADVERTISE_INTERVAL_MIN = 1000ms;
 constexpr auto ADVERTISE_INTERVAL_MAX = 1000ms;
 
+// Each connection asks for a short interval while it's streaming LED frames, a moderate one while it's
+// reading/writing, and a wide one once it's only listening to notifications. Leaves radio time for the
+// other connections. A client can also pin a profile via the configuration service.
+constexpr auto BLE_CONNECTION_STREAMING_TIMEOUT = 2s;  // no LED writes for this long -> no longer streaming
+constexpr auto BLE_CONNECTION_IDLE_TIMEOUT = 10s;      // no reads/writes for this long -> idle
+constexpr auto BLE_CONNECTION_SUPERVISION_TIMEOUT = 2s;
+// Floor on the time between state change notifications to an idle connection (e.g. a backgrounded phone).
+// Each of its notifications carries the latest state, but a slow central can't tie up the controller's
+// ACL buffers the other connections share. A client can also pick its own via the configuration service.
+constexpr auto BLE_NOTIFY_INTERVAL_IDLE = 1s;
+
 // Set to desired baud rate. Most sensors support 400 kbit/s.
 // Compile time error checks will trigger if set too high for included sensors.
 constexpr uint32_t I2C_BAUD_RATE = 400 * 1000;
+
+// Sensor manifest: the drivers built in & probed for, in probe order. Defaults to every driver, each is
+// probed for at boot & re-probed if hot-plugged. A board w/ a fixed BOM can list only what it fits (or
+// configure w/ `-DSENSOR_<DRIVER>=OFF`); anything else is then neither probed for nor linked.
+enum class SensorDriver : uint8_t { HTU2xD, BME280, BME68x, SGP40, CST816S };
+constexpr SensorDriver SENSOR_DRIVERS[] = {
+#ifndef CMAKE_NO_SENSOR_HTU2XD
+        SensorDriver::HTU2xD,
+#endif
+#ifndef CMAKE_NO_SENSOR_BME280
+        SensorDriver::BME280,
+#endif
+#ifndef CMAKE_NO_SENSOR_BME68X
+        SensorDriver::BME68x,
+#endif
+#ifndef CMAKE_NO_SENSOR_SGP40
+        SensorDriver::SGP40,
+#endif
+#ifndef CMAKE_NO_SENSOR_CST816S
+        SensorDriver::CST816S,  // touch controller, the display's input
+#endif
+};
 // TODO:  Find what's the actual max baud rate for a GC9A01.
 //        So far I've ran all the way to max (125M).
 constexpr uint32_t SPI_BAUD_RATE_DISPLAY = 125'000'000 / 2;
+// Pixel data is pushed by PIO, w/ 1 or 2 data lanes. 2 lanes doubles flush bandwidth, but needs the GC9A01's
+// 2nd data lane wired to the GPIO right after the display's SPI TX pin.
+constexpr uint8_t DISPLAY_SPI_DATA_LANES = 1;
+// LVGL renders into a draw buffer strip while the other is being flushed (DMA ping-pong).
+// Each buffer costs 480 bytes per line. Full height (240) is a whole frame per buffer (~115 KiB each).
+// The UI is mostly static & updates are small, so a fraction of the screen is plenty.
+// Set `DEBUG_DISPLAY_BENCHMARK` in `display.cpp` to measure frame time for a given size.
+constexpr uint16_t DISPLAY_DRAW_BUFFER_LINES = 48;
+// 1 or 2. A single buffer saves memory, but rendering then has to wait for every flush to finish.
+constexpr uint8_t DISPLAY_DRAW_BUFFERS = 2;
+// Max # of components (i.e. octets) in the WS2812 chain. e.g. a 144 LED RGB strip is 432 components.
+// Costs 1 byte of RAM per component. A full chain refresh takes ~10us per component actually in use.
+// Must be a multiple of 4, and at most 65532.
+constexpr uint16_t WS2812_COMPONENTS_MAX = 1024;
 
 ////////////////////////////////////////////////////
 //         End of Configurable Settings.
@@ -64,7 +130,10 @@ constexpr GPIO_Pin PIN_MAX = 30;  // DO NOT ALTER.
 template <typename F>
 constexpr bool pins_forall(F&& go) {
     if (!std::all_of(std::begin(PINS_I2C), std::end(PINS_I2C), go)) return false;
-    if (!(go(PIN_FAN_PWM) && go(PIN_FAN_TACHOMETER))) return false;
+    if (!std::all_of(std::begin(PINS_FAN), std::end(PINS_FAN), [&](auto&& fan) {
+            return go(fan.pwm) && go(fan.tachometer);
+        }))
+        return false;
     if (!go(PIN_NEOPIXEL_DATA_IN)) return false;
     if (!std::all_of(std::begin(PINS_DISPLAY_SPI), std::end(PINS_DISPLAY_SPI), go)) return false;
     if (!go(PIN_DISPLAY_COMMAND)) return false;
@@ -42,18 +42,27 @@
 
 /* Scheduler Related */
 
-// Don't preempt. Complicates things[1], and for now we don't have long running
-// tasks w/o frequent yields.
-// [1]  Our main problem right now is a shitload of data races.
-//      We currently deal with it by humming really really loudly.
-//      (We have some locks around things like I2C comms where we don't want
-//       both cores banging on the same bus.)
-#define configUSE_PREEMPTION 0
+// Preempt, so a slow `lv_timer_handler` pass (or a long sensor init) can't hold up BLE/sensors.
+// State shared between tasks must be safe against it:
+//  - `sensors::g_sensors`: written under a critical section, read via `sensors::snapshot()`
+//  - fan power/override: set under a critical section (single byte reads are fine)
+//  - WS2812 pixel buffer: bounds check + copy under a critical section
+//  - BTstack isn't thread safe: `NotifyState::notify` defers to BTstack's run loop
+//  - I2C buses are owned by their worker task, LVGL by the display task (others `ui::post` to it)
+#define configUSE_PREEMPTION 1
+#if CMAKE_FREERTOS_TICKLESS_IDLE
+#define configUSE_TICKLESS_IDLE 1
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP 2
+#else
 #define configUSE_TICKLESS_IDLE 0
+#endif
 #define configUSE_IDLE_HOOK 0
 #define configUSE_TICK_HOOK 1
-#define configTICK_RATE_HZ ((TickType_t)20000)
+// Fastest periodic job is the 5 ms display refresh. Anything finer than a tick is done w/ hardware alarms
+// (`task_delay_alarm`, executor deadlines), so there's no reason to take more tick IRQs than this.
+#define configTICK_RATE_HZ ((TickType_t)1000)
 #define configMAX_PRIORITIES 32
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES 3  // [1] `task_delay_alarm`, [2] replies (`ui::call`)
 #define configMINIMAL_STACK_SIZE (configSTACK_DEPTH_TYPE)256
 #define configUSE_16_BIT_TICKS 0
 
@@ -66,7 +75,7 @@
 #define configUSE_COUNTING_SEMAPHORES 1
 #define configQUEUE_REGISTRY_SIZE 8
 #define configUSE_QUEUE_SETS 1
-#define configUSE_TIME_SLICING 1
+#define configUSE_TIME_SLICING 0  // only switch between equal priorities on block/yield, as before
 #define configUSE_NEWLIB_REENTRANT 0
 #define configENABLE_BACKWARD_COMPATIBILITY 0
 #define configNUM_THREAD_LOCAL_STORAGE_POINTERS 5
@@ -76,9 +85,13 @@
 #define configMESSAGE_BUFFER_LENGTH_TYPE size_t
 
 /* Memory allocation related definitions. */
-#define configSUPPORT_STATIC_ALLOCATION 0
+// Every task's stack & TCB is static (`nevermore::TaskStorage`, the idle & timer tasks' are in `main.cpp`).
+// The heap only holds kernel objects (queues, mutexes, timers, ~3 KiB) & the SDK's async context task
+// (~4.5 KiB), all created during init & never freed, so its use is fixed once boot is done.
+// `heap_free_min` in the diagnostics service reports the margin; re-check it after adding any of those.
+#define configSUPPORT_STATIC_ALLOCATION 1
 #define configSUPPORT_DYNAMIC_ALLOCATION 1
-#define configTOTAL_HEAP_SIZE (64 * 1024)
+#define configTOTAL_HEAP_SIZE (16 * 1024)
 #define configAPPLICATION_ALLOCATED_HEAP 0
 
 /* Hook function related definitions. */
@@ -87,9 +100,16 @@
 #define configUSE_DAEMON_TASK_STARTUP_HOOK 0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS 0
+// Run time counter is the free running 1 MHz system timer, nothing to configure.
+// 32 bits of us wraps every ~71 min, `nevermore::diagnostics` only ever looks at deltas.
+#define configGENERATE_RUN_TIME_STATS 1
 #define configUSE_TRACE_FACILITY 1
 #define configUSE_STATS_FORMATTING_FUNCTIONS 0
+#ifndef __ASSEMBLER__
+#include "hardware/timer.h"
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE() time_us_32()
 
 /* Co-routine related definitions. */
 #define configUSE_CO_ROUTINES 0
@@ -109,7 +129,7 @@
 */
 
 /* SMP port only */
-#define configNUM_CORES 2  // TODO: bump to 2 after initial test
+#define configNUM_CORES 2  // see `nevermore::Core` for who runs where
 #define configTICK_CORE 0
 #define configRUN_MULTIPLE_PRIORITIES 1
 #define configUSE_CORE_AFFINITY 1
@@ -136,6 +156,7 @@ to exclude the API function. */
 #define INCLUDE_xTaskGetIdleTaskHandle 1
 #define INCLUDE_eTaskGetState 1
 #define INCLUDE_xTimerPendFunctionCall 1
+#define INCLUDE_xTimerGetTimerDaemonTaskHandle 1
 #define INCLUDE_xTaskAbortDelay 1
 #define INCLUDE_xTaskGetHandle 1
 #define INCLUDE_xTaskResumeFromISR 1
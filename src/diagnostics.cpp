@@ -0,0 +1,132 @@
+#include "diagnostics.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "task.h"      // IWYU pragma: keep
+#include "utility/timer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+using namespace std;
+using namespace std::literals::chrono_literals;
+
+#define DEBUG_TASK_STATS_LOG 0
+
+namespace nevermore::diagnostics {
+
+namespace {
+
+constexpr auto SAMPLE_PERIOD = 5s;
+// Warn (once per task) if a task gets this close to overflowing. Overflow itself panics.
+constexpr uint16_t STACK_FREE_WARN = 64;  // words
+// Room for more tasks than are reported, `uxTaskGetSystemState` gives up if they don't all fit.
+constexpr size_t TASKS_STATUS_MAX = TASKS_MAX + 8;
+
+struct Previous {
+    UBaseType_t number;
+    uint32_t runtime;
+    bool stack_warned;
+};
+
+// Only touched by the timer task.
+array<TaskStatus_t, TASKS_STATUS_MAX> g_status;
+array<Previous, TASKS_STATUS_MAX> g_previous;
+size_t g_previous_count = 0;
+optional<uint32_t> g_total_previous;
+bool g_overflow_warned = false;
+
+// Written by the timer task, read by BTstack & stdio. Guarded by the kernel critical section.
+Stats g_stats;
+
+Previous const* previous(UBaseType_t number) {
+    auto const* end = g_previous.cbegin() + g_previous_count;
+    auto const* it = find_if(g_previous.cbegin(), end, [&](auto& x) { return x.number == number; });
+    return it == end ? nullptr : it;
+}
+
+void sample() {
+    uint32_t total = 0;
+    auto const n = uxTaskGetSystemState(g_status.data(), g_status.size(), &total);
+    if (n == 0) {
+        if (!g_overflow_warned)
+            printf("WARN - task stats - more than %u tasks, not sampled\n", unsigned(TASKS_STATUS_MAX));
+        g_overflow_warned = true;
+        return;
+    }
+
+    // unsigned deltas, so the counters wrapping is harmless
+    auto const window = g_total_previous ? total - *g_total_previous : 0;
+
+    Stats stats{
+            .heap_free = uint32_t(xPortGetFreeHeapSize()),
+            .heap_free_min = uint32_t(xPortGetMinimumEverFreeHeapSize()),
+            .window_us = window,
+    };
+
+    array<Previous, TASKS_STATUS_MAX> current{};
+    array<Task, TASKS_STATUS_MAX> tasks{};
+    for (size_t i = 0; i < n; ++i) {
+        auto const& status = g_status.at(i);
+        auto const* prev = previous(status.xTaskNumber);
+        // new tasks started counting from 0 at creation
+        auto const runtime = status.ulRunTimeCounter - (prev ? prev->runtime : 0);
+        auto const stack_free_min = uint16_t(min<uint32_t>(status.usStackHighWaterMark, UINT16_MAX));
+
+        bool const stack_low = stack_free_min < STACK_FREE_WARN;
+        if (stack_low && !(prev && prev->stack_warned))
+            printf("WARN - task stats - `%s` stack headroom low, %u words never used\n", status.pcTaskName,
+                    unsigned(stack_free_min));
+        current.at(i) = {status.xTaskNumber, status.ulRunTimeCounter, stack_low};
+
+        auto& task = tasks.at(i);
+        strncpy(task.name.data(), status.pcTaskName, task.name.size());
+        task.cpu_permille = window ? uint16_t(min<uint64_t>(uint64_t(runtime) * 1000 / window, 1000)) : 0;
+        task.stack_free_min = stack_free_min;
+        task.priority = uint8_t(status.uxCurrentPriority);
+    }
+
+    g_previous = current;
+    g_previous_count = n;
+    g_total_previous = total;
+
+    // keep the busiest if they don't all fit
+    sort(tasks.begin(), tasks.begin() + n, [](auto& a, auto& b) { return b.cpu_permille < a.cpu_permille; });
+    stats.tasks_count = uint8_t(min<size_t>(n, TASKS_MAX));
+    copy_n(tasks.begin(), stats.tasks_count, stats.tasks.begin());
+
+    taskENTER_CRITICAL();
+    g_stats = stats;
+    taskEXIT_CRITICAL();
+
+#if DEBUG_TASK_STATS_LOG
+    print(stats);
+#endif
+}
+
+}  // namespace
+
+bool init() {
+    sample();  // baseline, first window completes within a period from now
+    return mk_periodic("task-stats", SAMPLE_PERIOD)(sample);
+}
+
+Stats snapshot() {
+    taskENTER_CRITICAL();
+    auto const x = g_stats;
+    taskEXIT_CRITICAL();
+    return x;
+}
+
+void print(Stats const& x) {
+    printf("DBG - tasks - heap free=%u min=%u, window=%u us\n", unsigned(x.heap_free),
+            unsigned(x.heap_free_min), unsigned(x.window_us));
+    for (size_t i = 0; i < x.tasks_count; ++i) {
+        auto const& task = x.tasks.at(i);
+        printf("DBG - tasks - %-*.*s cpu=%3u.%u%% stack-free-min=%u words prio=%u\n", int(TASK_NAME_LENGTH),
+                int(TASK_NAME_LENGTH), task.name.data(), unsigned(task.cpu_permille / 10),
+                unsigned(task.cpu_permille % 10), unsigned(task.stack_free_min), unsigned(task.priority));
+    }
+}
+
+}  // namespace nevermore::diagnostics
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Runtime task & heap statistics, sampled over fixed windows.
+namespace nevermore::diagnostics {
+
+constexpr size_t TASKS_MAX = 16;
+constexpr size_t TASK_NAME_LENGTH = 12;
+
+// Requirements:
+// * Must be packed, sent as-is by the diagnostics task stats characteristic.
+struct [[gnu::packed]] Task {
+    std::array<char, TASK_NAME_LENGTH> name;  // truncated, NUL padded (not terminated if it fills it)
+    uint16_t cpu_permille;                    // of one core, over the last complete window
+    uint16_t stack_free_min;                  // high-water mark, in words (4 octets) of stack never touched
+    uint8_t priority;
+};
+
+struct [[gnu::packed]] Stats {
+    uint32_t heap_free = 0;
+    uint32_t heap_free_min = 0;  // lowest it's ever been since boot
+    uint32_t window_us = 0;      // 0 -> no complete window yet, `cpu_permille` are all 0
+    uint8_t tasks_count = 0;     // tasks beyond `TASKS_MAX` are dropped
+    std::array<Task, TASKS_MAX> tasks{};
+};
+
+bool init();
+
+// Safe to call from any task.
+Stats snapshot();
+void print(Stats const&);
+
+}  // namespace nevermore::diagnostics
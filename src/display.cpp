@@ -2,6 +2,7 @@
 #include "config.hpp"
 #include "config/lv_drv_conf.h"  // need the `extern "C"` decls for LVGL driver interface
 #include "display/gc9a01.hpp"
+#include "display/stats.hpp"
 #include "hardware/gpio.h"
 #include "hardware/spi.h"
 #include "lvgl.h"  // IWYU pragma: keep
@@ -9,14 +10,29 @@
 #include "sdk/spi.hpp"
 #include "sdk/timer.hpp"
 #include "ui.hpp"
+#include "utility/mailbox.hpp"
 #include "utility/task.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <cstdio>
 
+// Debugging helper for sizing the draw buffers. Repeatedly redraws the whole screen & periodically prints the
+// average frame time (render + flush) for the configured `DISPLAY_DRAW_BUFFER_LINES`.
+#define DEBUG_DISPLAY_BENCHMARK 0
+
+// Periodically dumps the render/flush timing histograms to stdio.
+// Same data is always available via the display diagnostics characteristic.
+#define DEBUG_DISPLAY_STATS_LOG 0
+#if DEBUG_DISPLAY_STATS_LOG
+#include "utility/timer.hpp"
+#include <chrono>
+#endif
+
 using namespace std;
 using namespace nevermore;
+using namespace std::literals::chrono_literals;
 
 namespace nevermore::display {
 
@@ -24,27 +40,109 @@ namespace {
 
 constexpr auto DISPLAY_BACKLIGHT_FREQ = 1'000;
 
-float g_display_brightness = 1;
+static_assert(0 < DISPLAY_DRAW_BUFFER_LINES && DISPLAY_DRAW_BUFFER_LINES <= RESOLUTION.height);
+static_assert(DISPLAY_DRAW_BUFFERS == 1 || DISPLAY_DRAW_BUFFERS == 2);
+
+// The backlight is the UI's (see `power`), `brightness` requests are handed over & applied by it.
+Mailbox<float, 4> g_brightness_requests;
+atomic<float> g_display_brightness = 1;  // only written by the UI, read by anyone
+Power g_power = Power::Active;
 
-lv_color_t g_draw_scratch_buffers[2][RESOLUTION.width * RESOLUTION.height / 2];
+lv_color_t g_draw_scratch_buffers[DISPLAY_DRAW_BUFFERS][RESOLUTION.width * DISPLAY_DRAW_BUFFER_LINES];
 lv_disp_draw_buf_t g_draw_buffer;
 lv_disp_drv_t g_driver;
 lv_disp_t* g_display;
 
+void backlight_apply() {
+    auto const scale = g_power == Power::Active ? 1.f : g_power == Power::Dim ? DIM_BRIGHTNESS : 0.f;
+    auto const brightness = g_display_brightness.load(memory_order_relaxed);
+    pwm_set_gpio_duty(PIN_DISPLAY_BRIGHTNESS, UINT16_MAX * brightness * scale);
+}
+
+#if DEBUG_DISPLAY_BENCHMARK
+void dbg_benchmark_init() {
+    constexpr auto REPORT_FRAMES = 50;
+
+    struct Stats {
+        uint32_t frames = 0;
+        uint32_t time_ms = 0;
+    };
+    static Stats g_stats;
+
+    // called by LVGL after every refresh w/ the time it took & # of pixels redrawn
+    g_driver.monitor_cb = [](lv_disp_drv_t*, uint32_t time_ms, uint32_t px) {
+        if (px < RESOLUTION.width * RESOLUTION.height) return;  // only count full frames
+
+        g_stats.frames += 1;
+        g_stats.time_ms += time_ms;
+        if (g_stats.frames < REPORT_FRAMES) return;
+
+        printf("DBG - display - %u lines x %u buffer(s): %.1f ms/frame\n",
+                unsigned(DISPLAY_DRAW_BUFFER_LINES), unsigned(DISPLAY_DRAW_BUFFERS),
+                g_stats.time_ms / double(g_stats.frames));
+        g_stats = {};
+    };
+
+    // keep the whole screen dirty, runs from `lv_timer_handler` so no extra locking needed
+    lv_timer_create([](lv_timer_t*) { lv_obj_invalidate(lv_scr_act()); }, 1, nullptr);
+}
+#endif
+
 }  // namespace
 
 void brightness(float power) {
-    g_display_brightness = clamp(power, 0.f, 1.f);
-    pwm_set_gpio_duty(PIN_DISPLAY_BRIGHTNESS, UINT16_MAX * g_display_brightness);
+    if (!g_brightness_requests.post(clamp(power, 0.f, 1.f)))
+        printf("WARN - display - too many pending brightness changes, dropped one\n");
 }
 
 float brightness() {
-    return g_display_brightness;
+    return g_display_brightness.load(memory_order_relaxed);
+}
+
+void power(Power power) {
+    bool brightness_changed = false;
+    g_brightness_requests.drain([&](float x) {
+        g_display_brightness.store(x, memory_order_relaxed);
+        brightness_changed = true;
+    });
+
+    if (g_power == power) {
+        if (brightness_changed) backlight_apply();
+        return;
+    }
+
+    auto const asleep = g_power == Power::Sleep;
+    g_power = power;
+    if (asleep == (power == Power::Sleep)) {
+        backlight_apply();
+        return;
+    }
+
+    // the last flush may still be going (double buffered), the panel can't take commands until it's done
+    while (g_draw_buffer.flushing)
+        tight_loop_contents();
+
+    if (power == Power::Sleep) {
+        backlight_apply();  // blank first, so the panel powering down is never visible
+        lv_timer_pause(g_display->refr_timer);
+        gc9a01_sleep(true);
+    } else {
+        gc9a01_sleep(false);
+        // nothing was rendered while asleep, redraw everything before lighting it back up
+        lv_timer_resume(g_display->refr_timer);
+        lv_obj_invalidate(lv_scr_act());
+        lv_refr_now(g_display);
+        backlight_apply();
+    }
+}
+
+Power power() {
+    return g_power;
 }
 
 // Initialises the UI. Everything else should be hands off after that.
-// FUTURE WORK: Move to second core if we ever run into perf issues.
-//              Have a care regarding potential issues w/ interrupts/timers w/ core 0.
+// Init runs on core 0 (so the flush DMA IRQ is owned by core 0), the UI tasks then render on core 1.
+// The flush-complete ISR only calls `lv_disp_flush_ready`, which just clears a flag, so that's fine.
 bool init_with_ui() {
     auto cfg_display_brightness = pwm_get_default_config();
     pwm_config_set_freq_hz(cfg_display_brightness, DISPLAY_BACKLIGHT_FREQ);
@@ -52,7 +150,8 @@ bool init_with_ui() {
     brightness(1);
 
     lv_init();
-    lv_disp_draw_buf_init(&g_draw_buffer, g_draw_scratch_buffers[0], g_draw_scratch_buffers[1],
+    lv_disp_draw_buf_init(&g_draw_buffer, g_draw_scratch_buffers[0],
+            DISPLAY_DRAW_BUFFERS == 2 ? g_draw_scratch_buffers[DISPLAY_DRAW_BUFFERS - 1] : nullptr,
             size(g_draw_scratch_buffers[0]));
 
     auto driver = gc9a01();
@@ -62,6 +161,12 @@ bool init_with_ui() {
     g_driver.hor_res = RESOLUTION.width;
     g_driver.ver_res = RESOLUTION.height;
     g_driver.draw_buf = &g_draw_buffer;
+#if DEBUG_DISPLAY_BENCHMARK
+    dbg_benchmark_init();
+#endif
+#if DEBUG_DISPLAY_STATS_LOG
+    mk_periodic("dbg-display-stats", 10s)([]() { stats::print(stats::snapshot()); });
+#endif
 
     if (g_display = lv_disp_drv_register(&g_driver); !g_display) {
         printf("ERR - init_with_ui - lv_disp_drv_register returned null\n");
@@ -105,5 +210,5 @@ void LV_DRV_DISP_SPI_WR_BYTE(uint8_t x) {
 }
 
 void LV_DRV_DELAY_MS(uint32_t ms) {
-    busy_wait(chrono::milliseconds(ms));
+    task_delay(chrono::milliseconds(ms));  // only used during init & panel sleep/wake, from a task
 }
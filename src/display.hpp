@@ -7,8 +7,23 @@ namespace nevermore::display {
 // Initialises the display and the UI.
 bool init_with_ui();
 
+// Any task, returns immediately. Applied by the UI's next `power` call (i.e. w/in a refresh interval).
 void brightness(float power);  // range: [0, 1]
-float brightness();            // range: [0, 1]
+float brightness();            // range: [0, 1], as last applied
+
+// Set by the UI's activity governor. The configured `brightness` is kept, & restored on waking.
+enum class Power : uint8_t {
+    Active,  // full brightness
+    Dim,     // backlight @ `DIM_BRIGHTNESS` of `brightness`
+    Sleep,   // backlight off, panel asleep, nothing rendered
+};
+
+constexpr float DIM_BRIGHTNESS = .2f;
+
+// Display task only, i.e. from LVGL callbacks/timers or a `ui::post`ed job.
+// Also applies any pending `brightness` change.
+void power(Power);
+Power power();
 
 struct Resolution {
     uint16_t width;
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// History backing the main screen's chart, kept at several zoom levels so the chart can swap between them
+// w/o waiting for it to fill back up.
+// Values are quantised to 8 bits & each point is a min/max bucket over the samples it covers. A 24h point
+// spans ~20 samples, so peaks would otherwise be averaged (or decimated) away.
+namespace nevermore::display {
+
+// Maps a (fixed point) value to `round(value / step)`, clamped to [0, 254]. 255 -> no value (a gap).
+struct Quantiser {
+    static constexpr uint8_t NONE = UINT8_MAX;
+
+    int32_t step = 1;  // same units as the values, `0 < step`
+
+    [[nodiscard]] constexpr uint8_t encode(std::optional<int64_t> x) const {
+        if (!x) return NONE;
+        if (*x <= 0) return 0;
+
+        return uint8_t(std::min<int64_t>((*x + step / 2) / step, NONE - 1));
+    }
+
+    [[nodiscard]] constexpr std::optional<int64_t> decode(uint8_t x) const {
+        if (x == NONE) return {};
+
+        return int64_t(x) * step;
+    }
+};
+
+struct Bucket {
+    uint8_t min = Quantiser::NONE;
+    uint8_t max = Quantiser::NONE;
+
+    [[nodiscard]] constexpr bool empty() const {
+        return max == Quantiser::NONE;
+    }
+
+    constexpr void merge(uint8_t x) {
+        if (x == Quantiser::NONE) return;  // gaps never count towards a bucket
+
+        min = empty() ? x : std::min(min, x);
+        max = empty() ? x : std::max(max, x);
+    }
+};
+
+// `SERIES` values are pushed together, once per finest point.
+// Level `i` merges `spans[i]` pushes into each of its `POINTS` points, covering `spans[i] * POINTS` pushes.
+template <size_t SERIES, size_t POINTS, size_t LEVELS>
+    requires(0 < POINTS && POINTS <= UINT8_MAX)
+struct ChartHistory {
+    using Spans = std::array<uint16_t, LEVELS>;
+
+    constexpr explicit ChartHistory(Spans spans) {
+        for (size_t i = 0; i < LEVELS; ++i)
+            levels[i].span = std::max<uint16_t>(spans[i], 1);
+    }
+
+    constexpr void push(std::array<uint8_t, SERIES> const& xs) {
+        for (auto& level : levels) {
+            if (level.count == 0 || level.filled == level.span) {
+                level.newest = level.count == 0 ? 0 : uint8_t((level.newest + 1) % POINTS);
+                level.count = uint8_t(std::min<size_t>(level.count + 1, POINTS));
+                level.filled = 0;
+                for (auto& series : level.buckets)
+                    series[level.newest] = {};
+            }
+
+            for (size_t i = 0; i < SERIES; ++i)
+                level.buckets[i][level.newest].merge(xs[i]);
+            level.filled += 1;
+        }
+    }
+
+    [[nodiscard]] constexpr uint16_t span(size_t level) const {
+        return levels.at(level).span;
+    }
+
+    // # of points in `level`, including the newest (which may still be filling).
+    [[nodiscard]] constexpr size_t size(size_t level) const {
+        return levels.at(level).count;
+    }
+
+    // `i`th oldest point of `series` in `level`, `i` in [0, size(level))
+    [[nodiscard]] constexpr Bucket get(size_t level, size_t series, size_t i) const {
+        auto const& x = levels.at(level);
+        return x.buckets.at(series).at((x.newest + 1 + POINTS - x.count + i) % POINTS);
+    }
+
+private:
+    struct Level {
+        std::array<std::array<Bucket, POINTS>, SERIES> buckets{};
+        uint16_t span = 1;
+        uint16_t filled = 0;  // # of pushes merged into the newest point
+        uint8_t newest = 0;
+        uint8_t count = 0;
+    };
+
+    std::array<Level, LEVELS> levels{};
+};
+
+namespace internal {
+
+static_assert(Quantiser{2}.encode(99) == 50);
+static_assert(Quantiser{2}.encode(-5) == 0);
+static_assert(Quantiser{2}.encode(1000) == 254);
+static_assert(Quantiser{50}.encode(21'30) == 43);  // 0.5 steps of 0.01 units
+static_assert(Quantiser{50}.encode({}) == Quantiser::NONE);
+static_assert(Quantiser{50}.decode(43) == 21'50);
+static_assert(!Quantiser{50}.decode(Quantiser::NONE));
+
+// level 0 keeps every push, level 1 the min/max of every 3, oldest evicted once full
+static_assert([] {
+    ChartHistory<1, 2, 2> history{{1, 3}};
+    for (uint8_t x : {5, 1, 9, 4})
+        history.push({x});
+
+    return history.size(0) == 2 && history.get(0, 0, 0).max == 9 && history.get(0, 0, 1).max == 4 &&
+           history.size(1) == 2 && history.get(1, 0, 0).min == 1 && history.get(1, 0, 0).max == 9 &&
+           history.get(1, 0, 1).min == 4 && history.get(1, 0, 1).max == 4;
+}());
+// gaps don't count, a point w/ only gaps is empty
+static_assert([] {
+    ChartHistory<2, 4, 1> history{{2}};
+    for (uint8_t x : {Quantiser::NONE, uint8_t(7), Quantiser::NONE})
+        history.push({x, Quantiser::NONE});
+
+    auto const a = history.get(0, 0, 0);
+    return history.size(0) == 2 && a.min == 7 && a.max == 7 && history.get(0, 1, 0).empty() &&
+           history.get(0, 0, 1).empty();
+}());
+
+}  // namespace internal
+
+}  // namespace nevermore::display
@@ -1,13 +1,21 @@
 #include "gc9a01.hpp"
 #include "config.hpp"
 #include "display/GC9A01.h"
+#include "gc9a01_spi.pio.h"
 #include "hardware/dma.h"
+#include "hardware/gpio.h"
 #include "hardware/irq.h"
+#include "hardware/pio.h"
 #include "hardware/regs/intctrl.h"
 #include "hardware/spi.h"
+#include "pico/platform.h"
+#include "sdk/dma.hpp"
 #include "sdk/spi.hpp"
+#include "stats.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
 
 using namespace std;
 
@@ -24,6 +32,11 @@ namespace {
 #define GC9A01_CASET 0x2A
 #define GC9A01_RASET 0x2B
 #define GC9A01_RAMWR 0x2C
+#define GC9A01_SPI_2DATA 0xE9
+#define GC9A01_SLPIN 0x10
+#define GC9A01_SLPOUT 0x11
+#define GC9A01_DISPOFF 0x28
+#define GC9A01_DISPON 0x29
 #define GC9A01_CMD_MODE 0
 #define GC9A01_DATA_MODE 1
 
@@ -61,41 +74,111 @@ void GC9A01_set_addr_win(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
 // End ripped from lvgl-driver GC9A01 driver.
 // ===================================
 
+static_assert(DISPLAY_SPI_DATA_LANES == 1 || DISPLAY_SPI_DATA_LANES == 2);
+
+// GPIO n's SPI function is `n % 4`: RX, CSn, SCK, TX
+constexpr GPIO_Pin spi_pin(GPIO_Pin function) {
+    auto const* it = std::find_if(std::begin(PINS_DISPLAY_SPI), std::end(PINS_DISPLAY_SPI),
+            [&](GPIO_Pin pin) { return pin % 4 == function; });
+    if (it == std::end(PINS_DISPLAY_SPI)) throw "`PINS_DISPLAY_SPI` needs a SCK & a TX pin";
+    return *it;
+}
+
+constexpr GPIO_Pin PIN_DISPLAY_SCK = spi_pin(2);
+constexpr GPIO_Pin PIN_DISPLAY_TX = spi_pin(3);
+static_assert(DISPLAY_SPI_DATA_LANES == 1 || PIN_DISPLAY_TX + 1 < PIN_MAX);
+
+// Flush completions are handled on core 1, where LVGL (the flush's other half) runs.
+constexpr auto DMA_IRQ_CORE = Core::C1;
+
 int g_dma_channel = -1;
+PIO g_pio = nullptr;
+uint g_pio_sm = 0;
 lv_disp_drv_t* g_update_display_driver;
 
-void __isr dma_complete() {
-    if (!dma_channel_get_irq0_status(g_dma_channel)) return;
-    dma_channel_acknowledge_irq0(g_dma_channel);
+gpio_function pio_gpio_function(PIO pio) {
+    return pio == pio0 ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1;
+}
+
+// Clock & data are shared between the hardware SPI (commands) and PIO (pixel data).
+void spi_pins_function(gpio_function function) {
+    gpio_set_function(PIN_DISPLAY_SCK, function);
+    gpio_set_function(PIN_DISPLAY_TX, function);
+}
+
+// The DMA is done once the last beat is in the FIFO, but the SM still has to shift it out.
+// At most a (joined) FIFO's worth, 8 pixels, so ~2 us @ full speed.
+void __not_in_flash_func(pio_wait_idle)() {
+    uint32_t const stall = 1u << (PIO_FDEBUG_TXSTALL_LSB + g_pio_sm);
+    g_pio->fdebug = stall;  // sticky, clear it & wait for the SM to stall on an empty FIFO again
+    while (!(g_pio->fdebug & stall))
+        tight_loop_contents();
+}
+
+void __isr __not_in_flash_func(dma_complete)() {
+    dma_irqn_acknowledge_channel(dma_irq_index(DMA_IRQ_CORE), g_dma_channel);  // the line's only channel
 
     assert(g_update_display_driver);
 
+    pio_wait_idle();
+    spi_pins_function(GPIO_FUNC_SPI);  // hand the pins back for the next command
     LV_DRV_DISP_SPI_CS(true);
+    stats::flush_end_from_isr();
     lv_disp_flush_ready(g_update_display_driver);
     g_update_display_driver = nullptr;
 }
 
-// FUTURE WORK: use 2-data mode + PIO to double tx bandwidth
+bool pio_init() {
+    auto const* program = DISPLAY_SPI_DATA_LANES == 2 ? &gc9a01_spi_2_program : &gc9a01_spi_1_program;
+    // WS2812 & the CYW43 driver also want PIO, take whichever block still has room
+    g_pio = pio_can_add_program(pio0, program) ? pio0 : pio1;
+    if (!pio_can_add_program(g_pio, program)) {
+        printf("ERR - GC9A01 - no PIO program space left\n");
+        return false;
+    }
+
+    auto sm = pio_claim_unused_sm(g_pio, false);
+    if (sm < 0) {
+        printf("ERR - GC9A01 - no PIO state machine left\n");
+        return false;
+    }
+
+    g_pio_sm = uint(sm);
+    auto const offset = pio_add_program(g_pio, program);
+    auto const config = DISPLAY_SPI_DATA_LANES == 2 ? gc9a01_spi_2_program_get_default_config(offset)
+                                                     : gc9a01_spi_1_program_get_default_config(offset);
+    gc9a01_spi_program_init(g_pio, g_pio_sm, offset, config, PIN_DISPLAY_SCK, PIN_DISPLAY_TX,
+            DISPLAY_SPI_DATA_LANES, SPI_BAUD_RATE_DISPLAY);
+
+    // 2nd lane is PIO only, the hardware SPI doesn't know about it
+    if (DISPLAY_SPI_DATA_LANES == 2) gpio_set_function(PIN_DISPLAY_TX + 1, pio_gpio_function(g_pio));
+    return true;
+}
+
 void gc9a01_flush_dma(lv_disp_drv_t* disp_drv, const lv_area_t* area, lv_color_t* color_p) {
     assert(disp_drv);
     assert(!g_update_display_driver && "transfer already in progres (assume we have 1 display)");
     if (area->x2 < area->x1 || area->y2 < area->y1) return;  // zero area write
 
     g_update_display_driver = disp_drv;
+    auto pixels = uint32_t(area->x2 - area->x1 + 1) * uint32_t(area->y2 - area->y1 + 1);
+    stats::flush_begin(pixels * sizeof(lv_color_t));
 
     LV_DRV_DISP_SPI_CS(false);  // Listen to us
 
     GC9A01_set_addr_win(area->x1, area->y1, area->x2, area->y2);
-    auto len = uint32_t(area->x2 - area->x1 + 1) * uint32_t(area->y2 - area->y1 + 1) * 2;
 
     LV_DRV_DISP_CMD_DATA(GC9A01_DATA_MODE);
 
-    // SPI seems to require 8 bit chunks. Get corrupted writes w/ 16 bits.
-    auto* spi = spi_gpio_bus(PINS_DISPLAY_SPI[0]);
+    // Commands went out via the hardware SPI (`spi_write_blocking` waits until it's idle), pixels go via PIO.
+    // One 16 bit beat per pixel. `LV_COLOR_16_SWAP` already stores them big-endian, byte swap so they're
+    // shifted out in memory order.
+    spi_pins_function(pio_gpio_function(g_pio));
     auto c = dma_channel_get_default_config(g_dma_channel);
-    channel_config_set_dreq(&c, spi_get_dreq(spi, true));
-    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
-    dma_channel_configure(g_dma_channel, &c, &spi_get_hw(spi)->dr, color_p, len, true);
+    channel_config_set_dreq(&c, pio_get_dreq(g_pio, g_pio_sm, true));
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_bswap(&c, true);
+    dma_channel_configure(g_dma_channel, &c, &g_pio->txf[g_pio_sm], color_p, pixels, true);
 }
 
 }  // namespace
@@ -104,11 +187,9 @@ optional<lv_disp_drv_t> gc9a01() {
     // FIXME: This should have locks to prevent races.
     //        For now display init is done from only one task, so we're safe.
     if (g_dma_channel == -1) {
-        g_dma_channel = dma_claim_unused_channel(true);
+        if (!pio_init()) return {};
 
-        irq_set_enabled(DMA_IRQ_0, true);
-        irq_add_shared_handler(DMA_IRQ_0, dma_complete, PICO_DEFAULT_IRQ_PRIORITY);
-        dma_channel_set_irq0_enabled(g_dma_channel, true);
+        g_dma_channel = int(dma_channel_claim_with_irq(DMA_IRQ_CORE, dma_complete));
     }
 
     if (auto e = GC9A01_init(); e != 0) {
@@ -117,10 +198,29 @@ optional<lv_disp_drv_t> gc9a01() {
         return {};
     }
 
+    if (DISPLAY_SPI_DATA_LANES == 2) {
+        GC9A01_command(GC9A01_SPI_2DATA);
+        GC9A01_data(0x08);  // 2 data lane enable, RGB565
+    }
+
     lv_disp_drv_t driver{};
     lv_disp_drv_init(&driver);
     driver.flush_cb = gc9a01_flush_dma;
     return driver;
 }
 
+void gc9a01_sleep(bool asleep) {
+    assert(!g_update_display_driver && "flush in progress");
+
+    if (asleep) {
+        GC9A01_command(GC9A01_DISPOFF);
+        GC9A01_command(GC9A01_SLPIN);
+        LV_DRV_DELAY_MS(120);  // datasheet: wait 120ms after sleep in before a sleep out
+    } else {
+        GC9A01_command(GC9A01_SLPOUT);
+        LV_DRV_DELAY_MS(120);  // datasheet: wait 120ms after sleep out before the next command
+        GC9A01_command(GC9A01_DISPON);
+    }
+}
+
 }  // namespace nevermore::display
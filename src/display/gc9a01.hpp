@@ -7,4 +7,8 @@ namespace nevermore::display {
 
 std::optional<lv_disp_drv_t> gc9a01();
 
+// Sleep: panel off & its oscillator/charge pumps stopped, RAM & config are retained.
+// Must not be called while a flush is in progress. Blocks for ~120ms either way (panel power up/down).
+void gc9a01_sleep(bool asleep);
+
 }
@@ -0,0 +1,63 @@
+#include "screens.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+namespace nevermore::display::screens {
+
+namespace {
+
+span<Screen const> g_screens;
+size_t g_shown = 0;
+lv_obj_t* g_screen = nullptr;
+
+void on_gesture(lv_event_t*) {
+    switch (lv_indev_get_gesture_dir(lv_indev_get_act())) {
+    default: break;
+    case LV_DIR_TOP: show((g_shown + 1) % g_screens.size()); break;
+    case LV_DIR_BOTTOM: show((g_shown + g_screens.size() - 1) % g_screens.size()); break;
+    }
+}
+
+void show_now(size_t i) {
+    assert(i < g_screens.size());
+    if (g_screen && g_shown == i) return;
+
+    // Free the old one first, so only 1 is ever resident. Nothing is drawn in between, a screen
+    // is only rendered by `lv_timer_handler`'s refresh after this returns.
+    if (g_screen) {
+        g_screens[g_shown].forget();
+        lv_obj_del(g_screen);  // also clears the display's active screen
+    }
+
+    g_shown = i;
+    g_screen = g_screens[i].build();
+    lv_obj_add_event_cb(g_screen, on_gesture, LV_EVENT_GESTURE, {});
+    lv_scr_load(g_screen);
+}
+
+}  // namespace
+
+void init(span<Screen const> screens) {
+    assert(!screens.empty());
+    g_screens = screens;
+    show_now(0);
+}
+
+void show(size_t i) {
+    auto const res = lv_async_call(
+            [](void* i) { show_now(reinterpret_cast<uintptr_t>(i)); }, reinterpret_cast<void*>(i));
+    if (res != LV_RES_OK) printf("WARN - display - no LVGL heap left to switch screens\n");
+}
+
+size_t shown() {
+    return g_shown;
+}
+
+void update() {
+    if (g_screen) g_screens[g_shown].update();
+}
+
+}  // namespace nevermore::display::screens
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "lvgl.h"
+#include <cstddef>
+#include <span>
+
+// The UI's pages. Only the shown one exists in LVGL: it's built when it's shown & freed once it's hidden,
+// anything that has to outlive that lives in the page's own (non-LVGL) model. LVGL's heap only has to fit
+// the biggest page, not all of them, & each frame only walks the shown page's widgets.
+// Swipe up/down for the next/previous page.
+// Display task only.
+namespace nevermore::display::screens {
+
+struct Screen {
+    // Creates the screen (`lv_obj_create(nullptr)`) & everything on it, filled in from the page's model.
+    lv_obj_t* (*build)();
+    // The screen is about to be deleted, drop every pointer into it.
+    void (*forget)();
+    // Refreshes the shown screen from the page's model, ~1 Hz (see `update`).
+    void (*update)();
+};
+
+// Builds & shows `screens[0]`. `screens` must outlive the UI.
+void init(std::span<Screen const> screens);
+
+// Replaces the shown screen w/ `screens[i]`. Deferred (`lv_async_call`), so it's safe from the event handlers
+// of the screen it replaces. The old one is freed before the new one is built.
+void show(size_t i);
+[[nodiscard]] size_t shown();
+
+// Refreshes whichever screen is shown.
+void update();
+
+}  // namespace nevermore::display::screens
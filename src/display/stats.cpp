@@ -0,0 +1,123 @@
+#include "stats.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "hardware/timer.h"
+#include "lvgl.h"
+#include "task.h"  // IWYU pragma: keep
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+using namespace std;
+
+namespace nevermore::display::stats {
+
+namespace {
+
+constexpr uint32_t BYTES_WINDOW_US = 1'000'000;
+
+// Written by the display task (core 1) & the flush ISR (core 0), read by BTstack & stdio.
+// Guarded by the kernel critical section.
+Stats g_stats;
+uint32_t g_flush_begin_us = 0;
+uint32_t g_window_begin_us = 0;
+uint32_t g_window_bytes = 0;  // flushed bytes since `g_window_begin_us`
+
+// PRECONDITION: in critical section
+void UNSAFE_window_roll(uint32_t now) {
+    auto const elapsed = now - g_window_begin_us;
+    if (elapsed < BYTES_WINDOW_US) return;
+
+    g_stats.flushed_bytes_per_second = uint32_t(uint64_t(g_window_bytes) * 1'000'000 / elapsed);
+    g_window_begin_us = now;
+    g_window_bytes = 0;
+}
+
+void print(char const* name, Histogram const& x) {
+    printf("DBG - display - %-6s n=%u mean=%u us max=%u us |", name, unsigned(x.samples),
+            unsigned(x.samples ? x.total_us / x.samples : 0), unsigned(x.max_us));
+    for (auto n : x.buckets)
+        printf(" %u", unsigned(n));
+    printf("\n");
+}
+
+}  // namespace
+
+void Histogram::add(uint32_t us) {
+    // bucket = floor(log2(us / base)) + 1, or 0 if below the base
+    auto const scaled = us / HISTOGRAM_BUCKET_BASE_US;
+    auto const bucket = min<size_t>(scaled ? bit_width(scaled) : 0, buckets.size() - 1);
+
+    samples += 1;
+    max_us = max(max_us, us);
+    total_us += us;
+    buckets[bucket] += 1;  // NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+}
+
+void render(uint32_t duration_us) {
+    taskENTER_CRITICAL();
+    g_stats.render.add(duration_us);
+    taskEXIT_CRITICAL();
+}
+
+void flush_begin(uint32_t bytes) {
+    auto const now = time_us_32();
+    taskENTER_CRITICAL();
+    g_flush_begin_us = now;
+    g_window_bytes += bytes;
+    taskEXIT_CRITICAL();
+}
+
+void flush_end_from_isr() {
+    auto const now = time_us_32();
+    auto const saved = taskENTER_CRITICAL_FROM_ISR();
+    g_stats.flush.add(now - g_flush_begin_us);
+    UNSAFE_window_roll(now);
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+void memory_sample() {
+    lv_mem_monitor_t mon{};
+    lv_mem_monitor(&mon);
+    Memory const x{
+            .total = mon.total_size,
+            .free = mon.free_size,
+            .free_biggest = mon.free_biggest_size,
+            .used_max = mon.max_used,
+            .allocations = mon.used_cnt,
+            .fragmentation_pct = mon.frag_pct,
+    };
+
+    taskENTER_CRITICAL();
+    g_stats.memory = x;
+    taskEXIT_CRITICAL();
+}
+
+Stats snapshot() {
+    auto const now = time_us_32();
+    taskENTER_CRITICAL();
+    UNSAFE_window_roll(now);  // otherwise an idle display keeps reporting its last busy window
+    auto const x = g_stats;
+    taskEXIT_CRITICAL();
+    return x;
+}
+
+void reset() {
+    auto const now = time_us_32();
+    taskENTER_CRITICAL();
+    g_stats = {.memory = g_stats.memory};  // a sample, not a counter
+    g_window_begin_us = now;
+    g_window_bytes = 0;
+    taskEXIT_CRITICAL();
+}
+
+void print(Stats const& x) {
+    print("render", x.render);
+    print("flush", x.flush);
+    printf("DBG - display - flushed %u bytes/s\n", unsigned(x.flushed_bytes_per_second));
+    auto const& m = x.memory;
+    printf("DBG - display - lvgl heap used=%u/%u max=%u biggest-free=%u blocks=%u frag=%u%%\n",
+            unsigned(m.total - m.free), unsigned(m.total), unsigned(m.used_max), unsigned(m.free_biggest),
+            unsigned(m.allocations), unsigned(m.fragmentation_pct));
+}
+
+}  // namespace nevermore::display::stats
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "utility/wire.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace nevermore::display::stats {
+
+// Log2 buckets of microseconds. Bucket `i` counts samples < `BUCKET_BASE_US << i`, the last bucket takes
+// everything longer than that.
+// e.g. [0, 250us), [250us, 500us), [500us, 1ms), ... [64ms, inf)
+constexpr uint32_t HISTOGRAM_BUCKET_BASE_US = 250;
+constexpr size_t HISTOGRAM_BUCKETS = 10;
+
+// Requirements:
+// * Must be tightly laid out, sent as-is by the display diagnostics characteristic (as part of `Stats`).
+struct Histogram {
+    uint32_t samples = 0;
+    uint32_t max_us = 0;
+    uint64_t total_us = 0;  // mean = total / samples
+    std::array<uint32_t, HISTOGRAM_BUCKETS> buckets{};
+
+    void add(uint32_t us);
+};
+static_assert(wire::tight<Histogram>({WIRE_FIELD(Histogram, samples), WIRE_FIELD(Histogram, max_us),
+        WIRE_FIELD(Histogram, total_us), WIRE_FIELD(Histogram, buckets)}));
+
+// LVGL's heap (`LV_MEM_SIZE`), as of the last `memory_sample`. Bytes unless noted otherwise.
+// At steady state nothing should be (re)allocated, `allocations` holds still & `free_biggest` doesn't shrink.
+// Requirements:
+// * Must be tightly laid out, sent as-is by the display diagnostics characteristic (as part of `Stats`).
+struct Memory {
+    uint32_t total = 0;
+    uint32_t free = 0;
+    uint32_t free_biggest = 0;  // largest allocation that'd still succeed
+    uint32_t used_max = 0;      // high water mark since boot, not cleared by `reset`
+    uint32_t allocations = 0;   // live blocks
+    uint32_t fragmentation_pct = 0;
+};
+static_assert(wire::tight<Memory>({WIRE_FIELD(Memory, total), WIRE_FIELD(Memory, free),
+        WIRE_FIELD(Memory, free_biggest), WIRE_FIELD(Memory, used_max), WIRE_FIELD(Memory, allocations),
+        WIRE_FIELD(Memory, fragmentation_pct)}));
+
+// Sent by the display diagnostics characteristic as `StatsWire` (tail padded in memory).
+struct Stats {
+    Histogram render;  // `lv_timer_handler` (render + waits on the flush if both buffers are busy)
+    Histogram flush;   // `gc9a01_flush_dma` start -> DMA & PIO done
+    uint32_t flushed_bytes_per_second = 0;  // over the last complete window (~1s)
+    Memory memory;
+};
+
+inline constexpr std::array STATS_FIELDS{WIRE_FIELD(Stats, render), WIRE_FIELD(Stats, flush),
+        WIRE_FIELD(Stats, flushed_bytes_per_second), WIRE_FIELD(Stats, memory)};
+using StatsWire = wire::Packed<Stats, STATS_FIELDS>;
+static_assert(sizeof(StatsWire) == 2 * sizeof(Histogram) + sizeof(uint32_t) + sizeof(Memory));
+
+// Called from the display task.
+void render(uint32_t duration_us);
+// Called when a flush is kicked off, & from the DMA complete ISR when it's done.
+void flush_begin(uint32_t bytes);
+void flush_end_from_isr();
+// Walks LVGL's heap, call from whichever task holds the UI (LVGL isn't thread safe). Not cheap, ~1 Hz.
+void memory_sample();
+
+// Safe to call from any task.
+Stats snapshot();
+void reset();
+void print(Stats const&);
+
+}  // namespace nevermore::display::stats
@@ -3,21 +3,34 @@
 #include "ble/sm.h"
 #include "bluetooth_gatt.h"
 #include "btstack_event.h"
+#include "btstack_run_loop.h"
 #include "config.hpp"
 #include "gatt/configuration.hpp"
+#include "gatt/connection.hpp"
+#include "gatt/diagnostics.hpp"
+#include "gatt/dfu.hpp"
 #include "gatt/display.hpp"
 #include "gatt/environmental.hpp"
 #include "gatt/fan.hpp"
 #include "gatt/handler_helpers.hpp"
+#include "gatt/relay.hpp"
 #include "gatt/ws2812.hpp"
 #include "hci_dump.h"
 #include "l2cap.h"
 #include "nevermore.h"
+#include "sdk/ble_data_types.hpp"
 #include "sdk/gap.hpp"
+#include "sensors.hpp"
 #include "utility/bt_advert.hpp"
+#include "utility/health.hpp"
+#include "utility/log.hpp"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <optional>
 #include <tuple>
 
 using namespace std;
@@ -27,16 +40,92 @@ namespace nevermore::gatt {
 
 namespace {
 
-// coincidentally packed b/c all `bt::advert` funcs return only tuples of packed members
-constexpr tuple ADVERT{
-        flags({
-                Flag::LE_DISCOVERABLE,
-                Flag::EDR_NOT_SUPPORTED,
-        }),
-        shortened_local_name("Nevermore"),
-        services<ORG_BLUETOOTH_SERVICE_ENVIRONMENTAL_SENSING>(),
+// Broadcast as ESS service data, so passive scanners can monitor w/o holding a connection slot.
+// Requirements:
+// * Must be packed, sent as-is.
+struct [[gnu::packed]] AdvertSensors {
+    sensors::VOCIndex voc_index_intake;
+    sensors::VOCIndex voc_index_exhaust;
+    BLE::Temperature temperature_intake;
+    BLE::Percentage8 fan_power;
 };
 
+constexpr auto advert(AdvertSensors const& sensors) {
+    // coincidentally packed b/c all `bt::advert` funcs return only tuples of packed members
+    return tuple{
+            flags({
+                    Flag::LE_DISCOVERABLE,
+                    Flag::EDR_NOT_SUPPORTED,
+            }),
+            shortened_local_name("Nevermore"),
+            services<ORG_BLUETOOTH_SERVICE_ENVIRONMENTAL_SENSING>(),
+            service_data<ORG_BLUETOOTH_SERVICE_ENVIRONMENTAL_SENSING>(sensors),
+    };
+}
+
+// BTstack only keeps a pointer to the advert data. Only touched from the BTstack run loop.
+decltype(advert({})) g_advert = advert({});
+
+btstack_context_callback_registration_t g_advert_update_deferred{};
+atomic<bool> g_advert_update_pending = false;
+
+void advert_update() {
+    auto const state = sensors::snapshot_resolved();
+    g_advert = advert({
+            .voc_index_intake = state.voc_index_intake,
+            .voc_index_exhaust = state.voc_index_exhaust,
+            .temperature_intake = state.temperature_intake,
+            .fan_power = fan::fan_power(),
+    });
+    gap_advertisements_set_data(sizeof(g_advert), (uint8_t*)&g_advert);  // NOLINT
+}
+
+// Sensor observer, any task. BTstack isn't thread safe, so the update is made from its run loop.
+void advert_update_request() {
+    if (g_advert_update_pending.exchange(true, memory_order_acq_rel)) return;  // already queued
+
+    btstack_run_loop_execute_on_main_thread(&g_advert_update_deferred);
+}
+
+// Long (queued) writes are staged here until they're executed. Pooled rather than per connection, they're
+// rare & a slot is as big as an attribute can be.
+constexpr size_t PREPARED_WRITE_SLOTS = 2;
+constexpr size_t PREPARED_WRITE_SIZE_MAX = 512;  // ATT's limit on an attribute value
+
+struct PreparedWrite {
+    hci_con_handle_t conn = HCI_CON_HANDLE_INVALID;  // invalid -> free
+    uint16_t attr = 0;
+    uint16_t size = 0;
+    array<uint8_t, PREPARED_WRITE_SIZE_MAX> data{};
+};
+
+array<PreparedWrite, PREPARED_WRITE_SLOTS> g_prepared_writes;  // only touched from the BTstack run loop
+
+PreparedWrite* prepared_write(hci_con_handle_t conn) {
+    auto* it = ranges::find(g_prepared_writes, conn, &PreparedWrite::conn);
+    return it == g_prepared_writes.end() ? nullptr : it;
+}
+
+void prepared_write_release(hci_con_handle_t conn) {
+    if (auto* x = prepared_write(conn)) *x = {};
+}
+
+// HCI LE Set PHY `tx_phys`/`rx_phys` bitmask: LE 2M
+constexpr uint8_t PHY_LE_2M = 1 << 1;
+
+// Bulk transfers (LED streaming, history downloads) are dominated by on-air overhead at the default
+// 27 octet PDU, 1M PHY, and whatever interval the central felt like. Ask for better.
+// Intervals are managed per connection by `connection`.
+// ATT MTU exchange is client initiated, we accept up to `l2cap_max_le_mtu()`.
+// LL data length is suggested to the controller by `ENABLE_LE_DATA_LENGTH_EXTENSION`.
+void connected(hci_con_handle_t conn) {
+    // prefer 2M both ways, controller falls back to 1M if either side can't do it
+    if (auto err = gap_le_set_phy(conn, 0, PHY_LE_2M, PHY_LE_2M, 0))
+        printf("WARN - BLE GATT - failed to request 2M PHY; err=0x%02x\n", int(err));
+
+    connection::connected(conn);
+}
+
 void hci_handler(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size) {
     UNUSED(size);
     UNUSED(channel);
@@ -52,70 +141,195 @@ void hci_handler(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_
         printf("BTstack up and running on %s.\n", bd_addr_to_str(local_addr));
 
         // setup advertisements
-        static_assert(sizeof(ADVERT) <= 31, "too large for non-extended advertisement");
+        static_assert(sizeof(g_advert) <= 31, "too large for non-extended advertisement");
         gap_advertisements_set_params(ADVERTISE_INTERVAL_MIN, ADVERTISE_INTERVAL_MAX);
-        gap_advertisements_set_data(sizeof(ADVERT), (uint8_t*)&ADVERT);  // NOLINT
+        advert_update();
         gap_advertisements_enable(1);
     } break;
 
+    case HCI_EVENT_LE_META: {
+        switch (hci_event_le_meta_get_subevent_code(packet)) {
+        case HCI_SUBEVENT_LE_CONNECTION_COMPLETE: {
+            if (hci_subevent_le_connection_complete_get_status(packet) != ERROR_CODE_SUCCESS) break;
+            // we're the central -> it's the relay's connection to a peer, not a host
+            if (hci_subevent_le_connection_complete_get_role(packet) == HCI_ROLE_MASTER) break;
+
+            connected(hci_subevent_le_connection_complete_get_connection_handle(packet));
+        } break;
+
+        case HCI_SUBEVENT_LE_DATA_LENGTH_CHANGE: {
+            printf("BLE GATT - conn 0x%04x data length tx=%u rx=%u\n",
+                    int(hci_subevent_le_data_length_change_get_connection_handle(packet)),
+                    unsigned(hci_subevent_le_data_length_change_get_max_tx_octets(packet)),
+                    unsigned(hci_subevent_le_data_length_change_get_max_rx_octets(packet)));
+        } break;
+        }
+    } break;
+
     case ATT_EVENT_DISCONNECTED: {
         auto conn = att_event_disconnected_get_handle(packet);
+        prepared_write_release(conn);
         configuration::disconnected(conn);
+        connection::disconnected(conn);
+        diagnostics::disconnected(conn);
+        dfu::disconnected(conn);
         display::disconnected(conn);
         environmental::disconnected(conn);
         fan::disconnected(conn);
+        relay::disconnected(conn);
         ws2812::disconnected(conn);
     };
     }
 }
 
+struct Service {
+    HandleRange handles;
+    optional<uint16_t> (*read)(hci_con_handle_t, uint16_t, uint16_t, uint8_t*, uint16_t);
+    optional<int> (*write)(hci_con_handle_t, uint16_t, uint16_t, uint8_t const*, uint16_t);
+    bool streaming = false;  // writes are bulk streams, wants the shortest connection interval
+};
+
+// Services are contiguous handle ranges in the DB, each served entirely by one module.
+constexpr array SERVICES{
+        Service{HANDLE_SERVICE(b5078b20_aea3_4c37_a18f_b370c03f02a6), configuration::attr_read,
+                configuration::attr_write},
+        Service{HANDLE_SERVICE(1f5e8a02_7c34_4b9d_a6e1_3d0f9b27c58e), diagnostics::attr_read,
+                diagnostics::attr_write},
+        Service{HANDLE_SERVICE(9c4e2b71_3f0a_4d6e_8b15_a7d2c90e4f36), dfu::attr_read, dfu::attr_write, true},
+        Service{HANDLE_SERVICE(7be8ac4b_7eb4_4e09_b134_91a46b622832), display::attr_read,
+                display::attr_write},
+        Service{HANDLE_SERVICE(ORG_BLUETOOTH_SERVICE_ENVIRONMENTAL_SENSING), environmental::attr_read,
+                environmental::attr_write},
+        Service{HANDLE_SERVICE(4553d138_1d00_4b6f_bc42_955a89cf8c36), fan::attr_read, fan::attr_write},
+        // fan policy is handled by the fan module
+        Service{HANDLE_SERVICE(260a0845_e62f_48c6_aef9_04f62ff8bffd), fan::attr_read, fan::attr_write},
+        Service{HANDLE_SERVICE(f62918ab_33b7_4f47_9fba_8ce9de9fecbb), ws2812::attr_read, ws2812::attr_write,
+                true},
+        Service{HANDLE_SERVICE(8d2f6b1a_43c9_4e7d_a05b_6c1e9f3a7d24), relay::attr_read, relay::attr_write},
+};
+
+constexpr uint8_t SERVICE_NONE = 0xFF;
+static_assert(SERVICES.size() < SERVICE_NONE);
+
+// ATT handle -> index into `SERVICES`, so a read/write goes straight to the one handler that can serve it.
+constexpr auto DISPATCH = []() {
+    auto const handles_end = [](Service const& s) { return s.handles.end; };
+    array<uint8_t, handles_end(ranges::max(SERVICES, {}, handles_end)) + 1> table{};
+    table.fill(SERVICE_NONE);
+    for (size_t i = 0; i < SERVICES.size(); ++i) {
+        auto const& s = SERVICES.at(i).handles;
+        if (s.end < s.begin) throw "service handle range is inverted";
+        for (auto handle = s.begin; handle <= s.end; ++handle) {
+            if (table.at(handle) != SERVICE_NONE) throw "service handle ranges overlap";
+            table.at(handle) = uint8_t(i);
+        }
+    }
+    return table;
+}();
+
+Service const* service_for(uint16_t attr) {
+    if (DISPATCH.size() <= attr || DISPATCH.at(attr) == SERVICE_NONE) return nullptr;
+    return &SERVICES.at(DISPATCH.at(attr));
+}
+
 uint16_t attr_read(
         hci_con_handle_t conn, uint16_t attr, uint16_t offset, uint8_t* buffer, uint16_t buffer_size) {
-    constexpr array HANDLERS{
-            configuration::attr_read,
-            display::attr_read,
-            environmental::attr_read,
-            fan::attr_read,
-            ws2812::attr_read,
-    };
-    for (auto handler : HANDLERS)
-        if (auto r = handler(conn, attr, offset, buffer, buffer_size)) return *r;
+    connection::activity(conn, false);
+    if (auto const* service = service_for(attr))
+        if (auto r = service->read(conn, attr, offset, buffer, buffer_size)) return *r;
 
-    printf("WARN - BLE GATT - attr_read unhandled attr 0x%04x\n", int(attr));
+    LOG_DEFERRED("WARN - BLE GATT - attr_read unhandled attr 0x%04x\n", attr);
+    return 0;
+}
+
+int attr_write_value(
+        hci_con_handle_t conn, uint16_t attr, uint16_t offset, uint8_t const* buffer, uint16_t buffer_size) {
+    auto const* service = service_for(attr);
+    connection::activity(conn, service && service->streaming);
+    try {
+        if (service)
+            if (auto r = service->write(conn, attr, offset, buffer, buffer_size)) return *r;
+    } catch (AttrWriteException const& e) {
+        return e.error;
+    }
+
+    LOG_DEFERRED("WARN - BLE GATT - attr_write unhandled attr 0x%04x\n", attr);
+    return 0;
+}
+
+// Prepare Write chunk: `buffer` goes at `offset` of the value being assembled.
+// Only 1 attribute per queue & chunks must arrive in order, which is all a long write ever sends.
+int attr_write_prepare(
+        hci_con_handle_t conn, uint16_t attr, uint16_t offset, uint8_t const* buffer, uint16_t buffer_size) {
+    if (!service_for(attr)) return ATT_ERROR_WRITE_NOT_PERMITTED;
+
+    auto* x = prepared_write(conn);
+    if (!x) {
+        x = prepared_write(HCI_CON_HANDLE_INVALID);
+        if (!x) return ATT_ERROR_PREPARE_QUEUE_FULL;  // every slot in use
+
+        *x = {.conn = conn, .attr = attr};
+    }
+
+    if (x->attr != attr) return ATT_ERROR_REQUEST_NOT_SUPPORTED;
+    if (offset != x->size) return ATT_ERROR_INVALID_OFFSET;
+    if (x->data.size() - x->size < buffer_size) return ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH;
+
+    copy_n(buffer, buffer_size, x->data.begin() + x->size);
+    x->size += buffer_size;
+    connection::activity(conn, false);
     return 0;
 }
 
 int attr_write(hci_con_handle_t conn, uint16_t attr, uint16_t transaction_mode, uint16_t offset,
         uint8_t* buffer, uint16_t buffer_size) {
-    if (buffer_size < offset) return ATT_ERROR_INVALID_OFFSET;
+    switch (transaction_mode) {
+    case ATT_TRANSACTION_MODE_NONE: {
+        if (buffer_size < offset) return ATT_ERROR_INVALID_OFFSET;
 
-    // We don't support any kind of transaction modes.
-    if (transaction_mode != ATT_TRANSACTION_MODE_NONE) {
-        printf("WARN - BLE GATT - attr_write unhandled transaction mode 0x%04x\n", int(transaction_mode));
-        return 0;
+        return attr_write_value(conn, attr, offset, buffer, buffer_size);
     }
 
-    constexpr array HANDLERS{
-            configuration::attr_write,
-            display::attr_write,
-            environmental::attr_write,
-            fan::attr_write,
-            ws2812::attr_write,
-    };
+    case ATT_TRANSACTION_MODE_ACTIVE: return attr_write_prepare(conn, attr, offset, buffer, buffer_size);
 
-    try {
-        for (auto handler : HANDLERS)
-            if (auto r = handler(conn, attr, offset, buffer, buffer_size)) return *r;
-    } catch (AttrWriteException const& e) {
-        return e.error;
+    // Everything was checked as it was queued, the value itself is checked by its handler on execute.
+    case ATT_TRANSACTION_MODE_VALIDATE: return 0;
+
+    case ATT_TRANSACTION_MODE_EXECUTE: {
+        auto* x = prepared_write(conn);
+        if (!x) return 0;  // nothing was queued
+
+        // the module sees a single write of the whole value, the same as if it had fit in one PDU
+        auto const r = attr_write_value(conn, x->attr, 0, x->data.data(), x->size);
+        *x = {};
+        return r;
     }
 
-    printf("WARN - BLE GATT - attr_write unhandled attr 0x%04x\n", int(attr));
-    return 0;
+    case ATT_TRANSACTION_MODE_CANCEL: {
+        prepared_write_release(conn);
+        return 0;
+    }
+
+    default: {
+        LOG_DEFERRED("WARN - BLE GATT - attr_write unhandled transaction mode 0x%04x\n", transaction_mode);
+        return 0;
+    }
+    }
 }
 
 btstack_packet_callback_registration_t g_hci_handler{.callback = &hci_handler};
 
+// The run loop only runs timers & HCI events, a timer of our own is the simplest proof of life.
+constexpr auto HEARTBEAT_PERIOD = 250ms;
+health::Heartbeat g_heartbeat{.name = "btstack", .timeout = 2s};
+btstack_timer_source_t g_heartbeat_timer;
+
+void heartbeat(btstack_timer_source_t* timer) {
+    g_heartbeat.beat();
+    btstack_run_loop_set_timer(timer, chrono::milliseconds(HEARTBEAT_PERIOD).count());
+    btstack_run_loop_add_timer(timer);
+}
+
 }  // namespace
 
 bool init() {
@@ -126,18 +340,34 @@ bool init() {
     l2cap_init();
     sm_init();  // FUTURE WORK: do we even need a security manager? can we ditch this?
 
+    if (!configuration::init()) return false;
+    if (!connection::init()) return false;
+    if (!diagnostics::init()) return false;
+    if (!dfu::init()) return false;
     if (!display::init()) return false;
     if (!environmental::init()) return false;
     if (!fan::init()) return false;
+    if (!relay::init()) return false;
     if (!ws2812::init()) return false;
 
     hci_add_event_handler(&g_hci_handler);
 
+    health::monitor(g_heartbeat);
+    btstack_run_loop_set_timer_handler(&g_heartbeat_timer, heartbeat);
+    btstack_run_loop_set_timer(&g_heartbeat_timer, chrono::milliseconds(HEARTBEAT_PERIOD).count());
+    btstack_run_loop_add_timer(&g_heartbeat_timer);
+
+    g_advert_update_deferred.callback = [](void*) {
+        g_advert_update_pending.store(false, memory_order_release);
+        advert_update();
+    };
+    sensors::observe(advert_update_request);
+
     att_server_init(profile_data, attr_read, attr_write);
     // not interested in attribute events for now, we have no indicator/notify attributes
     // att_server_register_packet_handler(att_handler);
 
-    gap_set_max_number_peripheral_connections(MAX_NR_HCI_CONNECTIONS);
+    // peripheral connection limit is left to `relay`, its peers share the HCI connections w/ hosts
 
     // turn on bluetooth
     if (auto err = hci_power_control(HCI_POWER_ON)) {
@@ -1,38 +1,224 @@
 #include "configuration.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "connection.hpp"
+#include "fan.hpp"
 #include "handler_helpers.hpp"
 #include "nevermore.h"
+#include "relay.hpp"
 #include "sdk/btstack.hpp"
 #include "sensors.hpp"
+#include "settings.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include "utility/fan_policy.hpp"
+#include "ws2812.hpp"
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <optional>
+#include <span>
 
 using namespace std;
 
-#define WS2812_UPDATE_SPAN_UUID 5d91b6ce_7db1_4e06_b8cb_d75e7dd49aae
-
 #define CONFIG_FLAGS_01 d4b66bf4_3d8f_4746_b6a2_8a59d2eac3ce_01
+#define CONNECTION_PROFILE_01 6e3b9f14_0c2a_4d85_b7e1_2a9c5f08d3b6_01
+#define NOTIFY_INTERVAL_01 6636e8ca_4529_46f2_ae54_831c4d757835_01
+#define SENSOR_FILTER_01 3c8f1a6d_9e24_4b7a_8d53_f07e2b91c4a8_01
+#define COMMAND_BATCH_01 0e7d4c1b_58a3_4f26_9b0e_d3c8a1f5726e_01
 
 namespace nevermore::gatt::configuration {
 
+static_assert(handles_within(HANDLE_SERVICE(b5078b20_aea3_4c37_a18f_b370c03f02a6),
+        {HANDLE_ATTR(CONFIG_FLAGS_01, VALUE), HANDLE_ATTR(CONNECTION_PROFILE_01, VALUE),
+                HANDLE_ATTR(NOTIFY_INTERVAL_01, VALUE), HANDLE_ATTR(SENSOR_FILTER_01, VALUE),
+                HANDLE_ATTR(COMMAND_BATCH_01, VALUE)}));
+
 namespace {
 
 constexpr array FLAGS{
         &sensors::g_config.fallback,
         &sensors::g_config.fallback_exhaust_mcu,
+        &sensors::g_config.voc_bme68x,
+        &sensors::g_config.sampling_adaptive,
+};
+
+void flags_apply(uint64_t flags) {
+    for (size_t i = 0; i < FLAGS.size(); ++i)
+        *FLAGS.at(i) = !!(flags & uint64_t(1) << i);
+}
+
+void filter_apply(sensors::Filters const& filter) {
+    taskENTER_CRITICAL();  // read by the sensor tasks
+    sensors::g_config.filter = filter;
+    taskEXIT_CRITICAL();
+}
+
+using AttrWrite = optional<int> (*)(hci_con_handle_t, uint16_t, uint16_t, uint8_t const*, uint16_t);
+using AttrWriteValid = bool (*)(uint16_t, span<uint8_t const>);
+
+// Nothing of ours a batch can write has a value to reject, any of the right size will do.
+bool attr_write_valid(uint16_t, span<uint8_t const>) {
+    return true;
+}
+
+// Stands in for a write to another characteristic. Forwarded to that characteristic's own handler, so a
+// batched setting is validated & persisted exactly like a direct write.
+struct BatchCommand {
+    uint16_t handle;
+    uint8_t size;  // value must be exactly this long
+    AttrWrite write;
+    AttrWriteValid valid;  // checks a value w/o applying it, so a bad item rejects the batch up front
+};
+
+// Indexed by tag - 1. Tags are part of the protocol, append only.
+constexpr array BATCH_COMMANDS{
+        // 1: fan power override
+        BatchCommand{HANDLE_ATTR(FAN_POWER_OVERRIDE, VALUE), sizeof(BLE::Percentage8), fan::attr_write,
+                fan::attr_write_valid},
+        // 2: fan policy cooldown
+        BatchCommand{HANDLE_ATTR(FAN_POLICY_COOLDOWN, VALUE), sizeof(BLE::TimeSecond16), fan::attr_write,
+                fan::attr_write_valid},
+        // 3: fan policy VOC passive max
+        BatchCommand{HANDLE_ATTR(FAN_POLICY_VOC_PASSIVE_MAX, VALUE), sizeof(sensors::VOCIndex),
+                fan::attr_write, fan::attr_write_valid},
+        // 4: fan policy VOC improve min
+        BatchCommand{HANDLE_ATTR(FAN_POLICY_VOC_IMPROVE_MIN, VALUE), sizeof(sensors::VOCIndex),
+                fan::attr_write, fan::attr_write_valid},
+        // 5: WS2812 total components
+        BatchCommand{HANDLE_ATTR(WS2812_TOTAL_COMPONENTS_01, VALUE), sizeof(BLE::Count16),
+                ws2812::attr_write, ws2812::attr_write_valid},
+        // 6: config flags
+        BatchCommand{HANDLE_ATTR(CONFIG_FLAGS_01, VALUE), sizeof(uint64_t), attr_write, attr_write_valid},
+        // 7: fan policy print hint
+        BatchCommand{HANDLE_ATTR(FAN_POLICY_PRINT_HINT, VALUE), sizeof(FanPolicyEnvironmental::Hint),
+                fan::attr_write, fan::attr_write_valid},
+        // 8: filter life reset (new filter installed)
+        BatchCommand{HANDLE_ATTR(FILTER_LIFE, VALUE), sizeof(uint32_t), fan::attr_write,
+                fan::attr_write_valid},
+        // 9: fan fault power
+        BatchCommand{HANDLE_ATTR(FAN_HEALTH, VALUE), sizeof(BLE::Percentage8), fan::attr_write,
+                fan::attr_write_valid},
+        // 10: relay peers
+        BatchCommand{HANDLE_ATTR(RELAY_PEERS_01, VALUE), relay::RELAY_PEERS_MAX * BD_ADDR_LEN,
+                relay::attr_write, relay::attr_write_valid},
+        // 11: fan ramp
+        BatchCommand{HANDLE_ATTR(FAN_RAMP, VALUE), sizeof(uint16_t) + sizeof(uint8_t), fan::attr_write,
+                fan::attr_write_valid},
+        // 12: fan PWM frequency
+        BatchCommand{HANDLE_ATTR(FAN_PWM, VALUE), sizeof(uint32_t), fan::attr_write, fan::attr_write_valid},
+};
+// Positional handles like the rest (see `handles_within`), each must be in a service its `write` serves.
+static_assert(ranges::all_of(BATCH_COMMANDS, [](BatchCommand const& x) {
+    if (x.write == fan::attr_write)
+        return HANDLE_SERVICE(4553d138_1d00_4b6f_bc42_955a89cf8c36).contains(x.handle) ||
+               HANDLE_SERVICE(260a0845_e62f_48c6_aef9_04f62ff8bffd).contains(x.handle);
+    if (x.write == ws2812::attr_write)
+        return HANDLE_SERVICE(f62918ab_33b7_4f47_9fba_8ce9de9fecbb).contains(x.handle);
+    if (x.write == relay::attr_write)
+        return HANDLE_SERVICE(8d2f6b1a_43c9_4e7d_a05b_6c1e9f3a7d24).contains(x.handle);
+
+    return HANDLE_SERVICE(b5078b20_aea3_4c37_a18f_b370c03f02a6).contains(x.handle);
+}));
+
+constexpr size_t BATCH_ITEMS_MAX = 16;
+constexpr uint8_t BATCH_ITEM_SKIPPED = 0xFF;  // batch was rejected before this item was applied
+
+// Outcome of a connection's last batch, an ATT error code per item (0 -> applied).
+struct [[gnu::packed]] BatchStatus {
+    uint8_t count = 0;
+    array<uint8_t, BATCH_ITEMS_MAX> items{};
+};
+
+struct BatchResult {
+    hci_con_handle_t conn = HCI_CON_HANDLE_INVALID;
+    BatchStatus status;
 };
 
+array<BatchResult, MAX_NR_HCI_CONNECTIONS> g_batch_results;  // only touched from the BTstack run loop
+
+BatchResult* batch_result(hci_con_handle_t conn) {
+    auto* it = ranges::find(g_batch_results, conn, &BatchResult::conn);
+    return it == g_batch_results.end() ? nullptr : it;
+}
+
+struct BatchItem {
+    BatchCommand const* command;
+    span<uint8_t const> value;
+};
+
+// Items are [u8 tag, u8 length, value...] back to back. The whole batch is parsed & every value checked by
+// its handler's `attr_write_valid` before any of it is applied: a malformed, unknown, or invalid item rejects
+// all of it. The items are then applied in order, back to back from the one run loop callback, so no other
+// GATT write lands in the middle of a batch. If applying an item still fails (e.g. out of resources) the
+// rest still apply. Returns the first item's error, if any.
+int batch_apply(hci_con_handle_t conn, WriteConsumer& consume) {
+    auto* result = batch_result(conn);
+    if (!result) result = batch_result(HCI_CON_HANDLE_INVALID);
+    if (!result) return ATT_ERROR_INSUFFICIENT_RESOURCES;
+    *result = {.conn = conn};
+    auto& status = result->status;
+
+    array<BatchItem, BATCH_ITEMS_MAX> items{};
+    auto reject = [&](uint8_t error) {
+        status.items.at(status.count++) = error;  // everything before it stays `BATCH_ITEM_SKIPPED`
+        return error;
+    };
+    for (; consume.remaining() != 0; ++status.count) {
+        if (status.count == BATCH_ITEMS_MAX) return ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH;
+        if (consume.remaining() < 2) return reject(ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH);
+
+        uint8_t const tag = consume;
+        uint8_t const length = consume;
+        if (tag == 0 || BATCH_COMMANDS.size() < tag) return reject(ATT_ERROR_REQUEST_NOT_SUPPORTED);
+
+        auto const& command = BATCH_COMMANDS.at(tag - 1);
+        if (length != command.size || consume.remaining() < length)
+            return reject(ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH);
+
+        auto const value = consume.span(length);
+        if (!command.valid(command.handle, value)) return reject(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        status.items.at(status.count) = BATCH_ITEM_SKIPPED;
+        items.at(status.count) = {&command, value};
+    }
+
+    int first_error = 0;
+    for (size_t i = 0; i < status.count; ++i) {
+        auto const& [command, value] = items.at(i);
+        int r = ATT_ERROR_UNLIKELY_ERROR;
+        try {
+            r = command->write(conn, command->handle, 0, value.data(), uint16_t(value.size())).value_or(r);
+        } catch (AttrWriteException const& e) {
+            r = e.error;
+        }
+
+        status.items.at(i) = uint8_t(r);
+        if (r != 0 && first_error == 0) first_error = r;
+    }
+
+    return first_error;
+}
+
 }  // namespace
 
 bool init() {
+    if (auto flags = settings::get<uint64_t>(settings::Key::ConfigFlags)) flags_apply(*flags);
+    if (auto filter = settings::get<sensors::Filters>(settings::Key::SensorFilter); filter && filter->valid())
+        filter_apply(*filter);
     return true;
 }
 
-void disconnected(hci_con_handle_t) {}
+void disconnected(hci_con_handle_t conn) {
+    if (auto* result = batch_result(conn)) *result = {};
+}
 
 optional<uint16_t> attr_read(
-        hci_con_handle_t, uint16_t att_handle, uint16_t offset, uint8_t* buffer, uint16_t buffer_size) {
+        hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t* buffer, uint16_t buffer_size) {
     switch (att_handle) {
         USER_DESCRIBE(CONFIG_FLAGS_01, "Configuration Flags (bitset)")
+        USER_DESCRIBE(CONNECTION_PROFILE_01, "Connection Profile")
+        USER_DESCRIBE(NOTIFY_INTERVAL_01, "Notify Interval (ms, 0xFFFF -> auto)")
+        USER_DESCRIBE(SENSOR_FILTER_01, "Sensor Filter")
+        USER_DESCRIBE(COMMAND_BATCH_01, "Command Batch")
 
         READ_VALUE(CONFIG_FLAGS_01, ([]() -> uint16_t {
             uint64_t flags = 0;
@@ -40,24 +226,58 @@ optional<uint16_t> attr_read(
                 flags |= uint64_t(*FLAGS.at(i)) << i;
             return flags;
         })())
+        READ_VALUE(CONNECTION_PROFILE_01, connection::requested(conn))
+        READ_VALUE(NOTIFY_INTERVAL_01, connection::notify_interval_requested(conn))
+        READ_VALUE(SENSOR_FILTER_01, sensors::g_config.filter)  // only written by BTstack
+        READ_VALUE(COMMAND_BATCH_01, ([&]() {
+            auto const* result = batch_result(conn);
+            return result ? result->status : BatchStatus{};
+        })())
 
     default: return {};
     }
 }
 
-optional<int> attr_write(
-        hci_con_handle_t, uint16_t att_handle, uint16_t offset, uint8_t const* buffer, uint16_t buffer_size) {
+optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t const* buffer,
+        uint16_t buffer_size) {
     if (buffer_size < offset) return ATT_ERROR_INVALID_OFFSET;
     WriteConsumer consume{offset, buffer, buffer_size};
 
     switch (att_handle) {
     case HANDLE_ATTR(CONFIG_FLAGS_01, VALUE): {
         uint64_t const flags = consume;
-        for (size_t i = 0; i < FLAGS.size(); ++i)
-            *FLAGS.at(i) = !!(flags & uint64_t(1) << i);
+        flags_apply(flags);
+        persist(settings::Key::ConfigFlags, flags);
+
+        // fallbacks change what the environmental aggregate reports
+        sensors::mark_dirty();
+        sensors::publish();
+        return 0;
+    }
+
+    case HANDLE_ATTR(CONNECTION_PROFILE_01, VALUE): {
+        if (!connection::request(conn, consume.exactly<connection::Profile>()))
+            return ATT_ERROR_VALUE_NOT_ALLOWED;
+        return 0;
+    }
+
+    case HANDLE_ATTR(NOTIFY_INTERVAL_01, VALUE): {
+        if (!connection::notify_interval_request(conn, consume.exactly<uint16_t>()))
+            return ATT_ERROR_UNLIKELY_ERROR;
+        return 0;
+    }
+
+    case HANDLE_ATTR(SENSOR_FILTER_01, VALUE): {
+        auto const filter = consume.exactly<sensors::Filters>();
+        if (!filter.valid()) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        filter_apply(filter);
+        persist(settings::Key::SensorFilter, filter);
         return 0;
     }
 
+    case HANDLE_ATTR(COMMAND_BATCH_01, VALUE): return batch_apply(conn, consume);
+
     default: return {};
     }
 }
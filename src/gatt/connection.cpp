@@ -0,0 +1,180 @@
+#include "connection.hpp"
+#include "btstack_config.h"
+#include "btstack_run_loop.h"
+#include "config.hpp"
+#include "sdk/gap.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+using namespace std::literals::chrono_literals;
+
+namespace nevermore::gatt::connection {
+
+namespace {
+
+struct Interval {
+    chrono::microseconds min;
+    chrono::microseconds max;
+};
+
+// Indexed by `Profile`. The central is free to refuse/pick something else.
+constexpr array<Interval, 4> INTERVALS{{
+        {},               // `Auto`, never requested as-is
+        {7500us, 15ms},   // `Streaming`
+        {15ms, 30ms},     // `Interactive`
+        {100ms, 200ms},   // `Idle`
+}};
+
+constexpr auto EVALUATE_PERIOD = 1s;
+
+constexpr bool intervals_valid() {
+    for (size_t i = 1; i < INTERVALS.size(); ++i) {
+        auto const& x = INTERVALS.at(i);
+        if (x.min < BT_CONNECTION_INTERVAL_MIN || BT_CONNECTION_INTERVAL_MAX < x.max) return false;
+        if (x.max < x.min) return false;
+        // spec: timeout must exceed `(1 + latency) * interval max * 2`, we never use latency
+        if (BLE_CONNECTION_SUPERVISION_TIMEOUT <= 2 * x.max) return false;
+    }
+    return true;
+}
+static_assert(intervals_valid());
+
+struct State {
+    hci_con_handle_t conn = HCI_CON_HANDLE_INVALID;
+    Profile requested = Profile::Auto;
+    Profile applied = Profile::Auto;  // `Auto` -> nothing requested yet
+    // `btstack_run_loop_get_time_ms`, compared w/ unsigned arithmetic so wrapping is harmless
+    uint32_t activity_at = 0;
+    uint32_t streaming_at = 0;
+    uint16_t notify_interval = NOTIFY_INTERVAL_AUTO;  // ms
+};
+
+// Only touched from the BTstack run loop. No locking required.
+array<State, MAX_NR_HCI_CONNECTIONS> g_connections;
+btstack_timer_source_t g_timer;
+
+uint32_t now_ms() {
+    return btstack_run_loop_get_time_ms();
+}
+
+bool within(uint32_t now, uint32_t at, chrono::milliseconds window) {
+    return uint32_t(now - at) < uint32_t(window.count());
+}
+
+State* find(hci_con_handle_t conn) {
+    for (auto& x : g_connections)
+        if (x.conn == conn) return &x;
+
+    return nullptr;
+}
+
+Profile effective(State const& state, uint32_t now) {
+    if (state.requested != Profile::Auto) return state.requested;
+    if (within(now, state.streaming_at, BLE_CONNECTION_STREAMING_TIMEOUT)) return Profile::Streaming;
+    if (within(now, state.activity_at, BLE_CONNECTION_IDLE_TIMEOUT)) return Profile::Interactive;
+    return Profile::Idle;
+}
+
+void evaluate(State& state, uint32_t now) {
+    auto const profile = effective(state, now);
+    if (profile == state.applied) return;
+
+    auto const& interval = INTERVALS.at(size_t(profile));
+    if (auto err = gap_request_connection_parameter_update(
+                state.conn, interval.min, interval.max, 0, BLE_CONNECTION_SUPERVISION_TIMEOUT)) {
+        printf("WARN - BLE GATT - failed to request connection parameters; err=0x%02x\n", int(err));
+        return;  // retry next evaluation
+    }
+
+    state.applied = profile;
+}
+
+void evaluate_all(btstack_timer_source_t* timer) {
+    auto const now = now_ms();
+    for (auto& x : g_connections)
+        if (x.conn != HCI_CON_HANDLE_INVALID) evaluate(x, now);
+
+    btstack_run_loop_set_timer(timer, chrono::milliseconds(EVALUATE_PERIOD).count());
+    btstack_run_loop_add_timer(timer);
+}
+
+}  // namespace
+
+bool init() {
+    btstack_run_loop_set_timer_handler(&g_timer, evaluate_all);
+    btstack_run_loop_set_timer(&g_timer, chrono::milliseconds(EVALUATE_PERIOD).count());
+    btstack_run_loop_add_timer(&g_timer);
+    return true;
+}
+
+void connected(hci_con_handle_t conn) {
+    auto* state = find(HCI_CON_HANDLE_INVALID);
+    if (!state) {
+        printf("WARN - BLE GATT - no free connection slot for 0x%04x\n", int(conn));
+        return;
+    }
+
+    auto const now = now_ms();
+    // a fresh client is about to discover services & read everything
+    *state = {.conn = conn,
+            .activity_at = now,
+            .streaming_at = now - uint32_t(chrono::milliseconds(BLE_CONNECTION_STREAMING_TIMEOUT).count())};
+    evaluate(*state, now);
+}
+
+void disconnected(hci_con_handle_t conn) {
+    if (auto* state = find(conn)) *state = {};
+}
+
+void activity(hci_con_handle_t conn, bool streaming) {
+    auto* state = find(conn);
+    if (!state) return;
+
+    auto const now = now_ms();
+    state->activity_at = now;
+    if (streaming) state->streaming_at = now;
+    // promote immediately, demotion is left to the timer
+    evaluate(*state, now);
+}
+
+Profile requested(hci_con_handle_t conn) {
+    auto const* state = find(conn);
+    return state ? state->requested : Profile::Auto;
+}
+
+bool request(hci_con_handle_t conn, Profile profile) {
+    if (Profile::Idle < profile) return false;
+
+    auto* state = find(conn);
+    if (!state) return false;
+
+    state->requested = profile;
+    evaluate(*state, now_ms());
+    return true;
+}
+
+chrono::milliseconds notify_interval(hci_con_handle_t conn) {
+    auto const* state = find(conn);
+    if (!state) return 0ms;
+    if (state->notify_interval != NOTIFY_INTERVAL_AUTO) return chrono::milliseconds(state->notify_interval);
+
+    return effective(*state, now_ms()) == Profile::Idle ? BLE_NOTIFY_INTERVAL_IDLE : 0ms;
+}
+
+uint16_t notify_interval_requested(hci_con_handle_t conn) {
+    auto const* state = find(conn);
+    return state ? state->notify_interval : NOTIFY_INTERVAL_AUTO;
+}
+
+bool notify_interval_request(hci_con_handle_t conn, uint16_t interval_ms) {
+    auto* state = find(conn);
+    if (!state) return false;
+
+    state->notify_interval = interval_ms;
+    return true;
+}
+
+}  // namespace nevermore::gatt::connection
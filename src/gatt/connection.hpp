@@ -0,0 +1,41 @@
+#pragma once
+
+#include "bluetooth.h"
+#include <chrono>
+#include <cstdint>
+
+// Per-connection parameter (interval) management.
+// Each central asks for the interval that suits what it's currently doing, so an idle monitor doesn't eat
+// the radio time a streaming client needs.
+namespace nevermore::gatt::connection {
+
+enum class Profile : uint8_t {
+    Auto = 0,         // pick from recent activity (default)
+    Streaming = 1,    // shortest interval, for LED frames
+    Interactive = 2,  // reads/writes, history downloads
+    Idle = 3,         // notifications only, widest interval
+};
+
+bool init();
+void connected(hci_con_handle_t);
+void disconnected(hci_con_handle_t);
+
+// Call on every attribute access by `conn`. `streaming` -> access belongs to a bulk stream (e.g. LED frames).
+void activity(hci_con_handle_t conn, bool streaming);
+
+// The profile `conn` asked for, `Auto` if none.
+Profile requested(hci_con_handle_t);
+// Returns false if `conn` isn't tracked or `profile` is unknown.
+bool request(hci_con_handle_t, Profile profile);
+
+// Minimum time between state change notifications to `conn`, 0 -> unthrottled. Run loop only.
+std::chrono::milliseconds notify_interval(hci_con_handle_t);
+
+// `notify_interval` follows the profile (see `BLE_NOTIFY_INTERVAL_IDLE`) unless the client picked one.
+constexpr uint16_t NOTIFY_INTERVAL_AUTO = UINT16_MAX;
+// What `conn` asked for in ms, `NOTIFY_INTERVAL_AUTO` if nothing.
+uint16_t notify_interval_requested(hci_con_handle_t);
+// Returns false if `conn` isn't tracked.
+bool notify_interval_request(hci_con_handle_t, uint16_t interval_ms);
+
+}  // namespace nevermore::gatt::connection
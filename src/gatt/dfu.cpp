@@ -0,0 +1,289 @@
+#include "dfu.hpp"
+#include "handler_helpers.hpp"
+#include "hardware/flash.h"
+#include "hardware/structs/psm.h"
+#include "hardware/structs/watchdog.h"
+#include "nevermore.h"
+#include "sdk/flash.hpp"
+#include "settings.hpp"
+#include "utility/crc.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+
+using namespace std;
+using namespace std::literals::chrono_literals;
+
+#define DFU_CONTROL_01 5a1f7c3e_2b9d_4e80_a6c4_1e3b8d0f7a52_01
+#define DFU_DATA_01 e83b0d6a_7c21_4f59_9d4e_b2a6f1c7083d_01
+
+// Firmware update over BLE.
+//
+// Flash below the settings is split in two banks. The running image lives in the lower one, a new image is
+// streamed into the upper (staging) one, verified in place, and only then copied over the running image.
+// The copy runs from RAM w/ both cores off flash, then resets into the new image.
+//
+// The copy isn't power-fail safe (there's no second stage loader to fall back on). If power is lost during
+// the ~10s it takes, the bootrom finds a broken boot2 (CRC checked) & drops into BOOTSEL, so USB recovery
+// always works.
+//
+// Opt-in (`BLE_FIRMWARE_UPDATE`), off by default. Writes aren't authenticated & the only check is a CRC the
+// client supplies itself, so anything in BLE range could install its own image.
+
+extern char __flash_binary_end;  // NOLINT(bugprone-reserved-identifier) provided by the SDK's linker script
+
+namespace nevermore::gatt::dfu {
+
+static_assert(handles_within(HANDLE_SERVICE(9c4e2b71_3f0a_4d6e_8b15_a7d2c90e4f36),
+        {HANDLE_ATTR(DFU_CONTROL_01, VALUE), HANDLE_ATTR(DFU_DATA_01, VALUE)}));
+
+namespace {
+
+// Time for the `Apply` write's response to make it out before the radio goes away.
+constexpr auto APPLY_DELAY = 250ms;
+
+enum class State : uint8_t {
+    Idle = 0,
+    Receiving = 1,
+    Received = 2,  // every octet is staged, waiting for `Apply`
+    Failed = 3,    // a chunk was lost/rejected, only `Begin` gets out of this
+};
+
+enum class Op : uint8_t {
+    Begin = 1,  // u32 size, u32 CRC-32 (zlib's) of the image
+    Apply = 2,  // verify the staged image, if good reboot into it
+    Abort = 3,
+};
+
+struct [[gnu::packed]] Status {
+    State state;
+    uint32_t capacity;  // largest accepted image, 0 if updates are disabled or there is no room to stage one
+    uint32_t size;
+    uint32_t received;
+};
+
+// Only touched from the BTstack run loop.
+uint32_t g_staging_offset = 0;
+uint32_t g_staging_size = 0;
+State g_state = State::Idle;
+hci_con_handle_t g_owner = HCI_CON_HANDLE_INVALID;  // connection doing the update
+uint32_t g_size = 0;
+CRC32_t g_crc = 0;
+uint32_t g_received = 0;
+array<uint8_t, FLASH_PAGE_SIZE> g_page{};  // octets since the last programmed page
+btstack_timer_source_t g_apply_timer;
+
+// Scratch for `install`, must be in RAM. Plain array, `install` can't call anything that may not be inlined.
+uint8_t g_install_page[FLASH_PAGE_SIZE];  // NOLINT(cppcoreguidelines-avoid-c-arrays)
+
+uint8_t const* flash_ptr(uint32_t offset) {
+    return reinterpret_cast<uint8_t const*>(XIP_BASE + offset);  // NOLINT(performance-no-int-to-ptr)
+}
+
+// Programs `g_page` (padded w/ 0xFF) at `image_offset` in staging. Sectors are erased as they're reached,
+// so a begin doesn't stall the run loop for the seconds it'd take to erase the whole bank up front.
+bool page_program(uint32_t image_offset) {
+    fill(g_page.begin() + (g_received - image_offset), g_page.end(), uint8_t(0xFF));
+
+    struct Args {
+        uint32_t offset;
+        bool erase;
+    } args{.offset = g_staging_offset + image_offset, .erase = image_offset % FLASH_SECTOR_SIZE == 0};
+
+    return flash_safe(
+            [](void* args_) {
+                auto const& args = *static_cast<Args const*>(args_);
+                if (args.erase) flash_range_erase(args.offset, FLASH_SECTOR_SIZE);
+                flash_range_program(args.offset, g_page.data(), g_page.size());
+            },
+            &args);
+}
+
+bool stage(span<uint8_t const> data) {
+    while (!data.empty()) {
+        auto const at = g_received % FLASH_PAGE_SIZE;
+        auto const n = min<size_t>(data.size(), FLASH_PAGE_SIZE - at);
+        copy_n(data.begin(), n, g_page.begin() + at);
+        g_received += n;
+        data = data.subspan(n);
+
+        if (at + n == FLASH_PAGE_SIZE || g_received == g_size)
+            if (!page_program(g_received - (at + n))) return false;
+    }
+
+    return true;
+}
+
+Status status() {
+    return {.state = g_state, .capacity = g_staging_size, .size = g_size, .received = g_received};
+}
+
+void reset() {
+    g_state = State::Idle;
+    g_owner = HCI_CON_HANDLE_INVALID;
+    g_size = g_received = 0;
+    btstack_run_loop_remove_timer(&g_apply_timer);
+}
+
+// Copies staging over the running image & resets. Everything it touches has to be in RAM (or inlined into
+// it), the code it was loaded from is being overwritten. Runs w/ IRQs off & the other core parked.
+[[noreturn]] void __no_inline_not_in_flash_func(install)(void* size_) {
+    auto const size = uint32_t(uintptr_t(size_));
+    hw_clear_bits(&watchdog_hw->ctrl, WATCHDOG_CTRL_ENABLE_BITS);  // takes far longer than it allows
+
+    for (uint32_t sector = 0; sector < size; sector += FLASH_SECTOR_SIZE) {
+        flash_range_erase(sector, FLASH_SECTOR_SIZE);
+
+        auto const sector_end = size < sector + FLASH_SECTOR_SIZE ? size : sector + FLASH_SECTOR_SIZE;
+        for (uint32_t page = sector; page < sector_end; page += FLASH_PAGE_SIZE) {
+            // XIP is back up between `flash_range_*` calls. Uncached, no stale lines from before the erase.
+            // NOLINTNEXTLINE(performance-no-int-to-ptr)
+            auto const* src = reinterpret_cast<uint8_t const volatile*>(
+                    XIP_NOCACHE_NOALLOC_BASE + g_staging_offset + page);
+            for (size_t i = 0; i < FLASH_PAGE_SIZE; ++i)  // no `memcpy`, that's in flash
+                g_install_page[i] = src[i];
+
+            flash_range_program(page, g_install_page, FLASH_PAGE_SIZE);
+        }
+    }
+
+    watchdog_hw->scratch[4] = 0;  // plain boot, not the bootrom's jump-to-vector
+    hw_set_bits(&watchdog_hw->ctrl, WATCHDOG_CTRL_TRIGGER_BITS);
+    for (;;) {}
+}
+
+void apply(btstack_timer_source_t*) {
+    printf("DFU - installing %u octet image, rebooting\n", unsigned(g_size));
+    // reset everything but the oscillators on trigger, same as `watchdog_reboot`
+    hw_set_bits(&psm_hw->wdsel, PSM_WDSEL_BITS & ~(PSM_WDSEL_ROSC_BITS | PSM_WDSEL_XOSC_BITS));
+    flash_safe(install, reinterpret_cast<void*>(uintptr_t(g_size)));  // NOLINT(performance-no-int-to-ptr)
+    // only here if the other core couldn't be parked, nothing's been touched yet
+    reset();
+}
+
+int control(hci_con_handle_t conn, WriteConsumer& consume) {
+    switch (Op(uint8_t(consume))) {
+    case Op::Begin: {
+        uint32_t const size = consume;
+        CRC32_t const crc = consume;
+        if (consume.remaining() != 0) return ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH;
+        if (g_staging_size == 0) return ATT_ERROR_WRITE_NOT_PERMITTED;  // disabled, or no room for staging
+        if (size == 0 || g_staging_size < size) return ATT_ERROR_VALUE_NOT_ALLOWED;
+        if (g_owner != HCI_CON_HANDLE_INVALID && g_owner != conn) return ATT_ERROR_INSUFFICIENT_RESOURCES;
+
+        reset();
+        g_state = State::Receiving;
+        g_owner = conn;
+        g_size = size;
+        g_crc = crc;
+        printf("DFU - receiving %u octet image\n", unsigned(size));
+        return 0;
+    }
+
+    case Op::Apply: {
+        if (g_owner != conn || g_state != State::Received) return ATT_ERROR_WRITE_NOT_PERMITTED;
+
+        // check what's actually in flash, not what we meant to write
+        if (auto crc = crc32({flash_ptr(g_staging_offset), g_size}); crc != g_crc) {
+            printf("ERR - DFU - staged image CRC 0x%08x, expected 0x%08x\n", unsigned(crc), unsigned(g_crc));
+            g_state = State::Failed;
+            return ATT_ERROR_VALUE_NOT_ALLOWED;
+        }
+
+        btstack_run_loop_set_timer_handler(&g_apply_timer, apply);
+        btstack_run_loop_set_timer(&g_apply_timer, chrono::milliseconds(APPLY_DELAY).count());
+        btstack_run_loop_add_timer(&g_apply_timer);
+        return 0;
+    }
+
+    case Op::Abort: {
+        if (g_owner != conn) return ATT_ERROR_WRITE_NOT_PERMITTED;
+
+        reset();
+        return 0;
+    }
+
+    default: return ATT_ERROR_VALUE_NOT_ALLOWED;
+    }
+}
+
+// [u32 offset, data...]. Usually written w/o response, so any failure sticks in `Status` for the client to
+// find when it checks in after the last chunk.
+int data(hci_con_handle_t conn, WriteConsumer& consume) {
+    if (g_owner != conn || g_state != State::Receiving) return ATT_ERROR_WRITE_NOT_PERMITTED;
+
+    uint32_t const offset = consume;
+    auto const chunk = consume.span(consume.remaining());
+    if (offset != g_received || g_size - g_received < chunk.size()) {
+        printf("ERR - DFU - chunk @ %u, expected %u\n", unsigned(offset), unsigned(g_received));
+        g_state = State::Failed;
+        return ATT_ERROR_INVALID_OFFSET;
+    }
+
+    if (!stage(chunk)) {
+        g_state = State::Failed;
+        return ATT_ERROR_UNLIKELY_ERROR;
+    }
+
+    if (g_received == g_size) g_state = State::Received;
+    return 0;
+}
+
+}  // namespace
+
+bool init() {
+#if !CMAKE_BLE_FIRMWARE_UPDATE
+    printf("DFU - updates over BLE are disabled in this build, see `BLE_FIRMWARE_UPDATE`\n");
+    return true;  // no staging bank, status reports a capacity of 0 & `Begin` is refused
+#endif
+
+    // Staging is the upper half of what's left once the settings have their share. An image never exceeds
+    // the staging bank, so the install copy never reads from what it's already overwritten.
+    auto const reserved = settings::flash_reserved_offset();
+    g_staging_offset = reserved / 2 / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+
+    auto const binary_end = uint32_t(uintptr_t(&__flash_binary_end) - XIP_BASE);
+    if (g_staging_offset < binary_end) {
+        printf("WARN - DFU - firmware is larger than a flash bank, updates over BLE are unavailable\n");
+        return true;
+    }
+
+    g_staging_size = reserved - g_staging_offset;
+    assert(g_staging_size <= g_staging_offset);
+    return true;
+}
+
+void disconnected(hci_con_handle_t conn) {
+    if (g_owner == conn) reset();  // incl. a pending apply, don't reboot out from under nobody
+}
+
+optional<uint16_t> attr_read(
+        hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t* buffer, uint16_t buffer_size) {
+    switch (att_handle) {
+        USER_DESCRIBE(DFU_CONTROL_01, "Firmware Update Control")
+        USER_DESCRIBE(DFU_DATA_01, "Firmware Update Data")
+
+        READ_VALUE(DFU_CONTROL_01, status())
+
+    default: return {};
+    }
+}
+
+optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t const* buffer,
+        uint16_t buffer_size) {
+    if (buffer_size < offset) return ATT_ERROR_INVALID_OFFSET;
+    WriteConsumer consume{offset, buffer, buffer_size};
+
+    switch (att_handle) {
+    case HANDLE_ATTR(DFU_CONTROL_01, VALUE): return control(conn, consume);
+    case HANDLE_ATTR(DFU_DATA_01, VALUE): return data(conn, consume);
+
+    default: return {};
+    }
+}
+
+}  // namespace nevermore::gatt::dfu
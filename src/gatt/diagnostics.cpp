@@ -0,0 +1,47 @@
+#include "diagnostics.hpp"
+#include "../diagnostics.hpp"
+#include "bluetooth.h"
+#include "handler_helpers.hpp"
+#include "nevermore.h"
+#include <cstdint>
+
+using namespace std;
+
+#define TASK_STATS 7a2d4e91_5b0c_4f83_9e16_c84b3f0a2d75_01
+
+namespace nevermore::gatt::diagnostics {
+
+static_assert(handles_within(HANDLE_SERVICE(1f5e8a02_7c34_4b9d_a6e1_3d0f9b27c58e),
+        {HANDLE_ATTR(TASK_STATS, VALUE)}));
+
+namespace {
+
+// Larger than an ATT MTU, so it's read in multiple parts. Snapshot on the first part only, otherwise the
+// parts could straddle a sample window & be from different windows.
+nevermore::diagnostics::Stats g_task_stats_read;
+
+}  // namespace
+
+bool init() {
+    return true;
+}
+
+void disconnected(hci_con_handle_t) {}
+
+optional<uint16_t> attr_read(
+        hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t* buffer, uint16_t buffer_size) {
+    switch (att_handle) {
+        USER_DESCRIBE(TASK_STATS, "Task Stats")
+        READ_VALUE(TASK_STATS,
+                offset == 0 ? (g_task_stats_read = nevermore::diagnostics::snapshot()) : g_task_stats_read);
+
+    default: return {};
+    }
+}
+
+optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t const* buffer,
+        uint16_t buffer_size) {
+    return {};
+}
+
+}  // namespace nevermore::gatt::diagnostics
@@ -1,6 +1,7 @@
 #include "display.hpp"
 #include "../display.hpp"
 #include "bluetooth.h"
+#include "display/stats.hpp"
 #include "handler_helpers.hpp"
 #include "nevermore.h"
 #include "sdk/ble_data_types.hpp"
@@ -11,9 +12,15 @@ using namespace std;
 using namespace BLE;
 
 #define DISPLAY_BRIGHTNESS 2B04_03
+#define DISPLAY_DIAGNOSTICS 8e5d3f42_6a1b_4c7e_9d20_3b7f0c5e91a4_01
 
 namespace nevermore::gatt::display {
 
+namespace stats = nevermore::display::stats;
+
+static_assert(handles_within(HANDLE_SERVICE(7be8ac4b_7eb4_4e09_b134_91a46b622832),
+        {HANDLE_ATTR(DISPLAY_BRIGHTNESS, VALUE), HANDLE_ATTR(DISPLAY_DIAGNOSTICS, VALUE)}));
+
 bool init() {
     return true;
 }
@@ -25,6 +32,8 @@ optional<uint16_t> attr_read(
     switch (att_handle) {
         USER_DESCRIBE(DISPLAY_BRIGHTNESS, "Display Brightness %")
         READ_VALUE(DISPLAY_BRIGHTNESS, Percentage8(nevermore::display::brightness() * 100));
+        USER_DESCRIBE(DISPLAY_DIAGNOSTICS, "Display Diagnostics")
+        READ_VALUE(DISPLAY_DIAGNOSTICS, stats::StatsWire(stats::snapshot()));
 
     default: return {};
     }
@@ -40,7 +49,12 @@ optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t of
         Percentage8 const power = consume;
         if (power == BLE::NOT_KNOWN) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
 
-        nevermore::display::brightness(float(power.value_or(0) / 100.f));
+        nevermore::display::brightness(float(power.fixed<-1>()) / 1000);
+        return 0;
+    }
+
+    case HANDLE_ATTR(DISPLAY_DIAGNOSTICS, VALUE): {
+        stats::reset();
         return 0;
     }
 
@@ -1,57 +1,91 @@
 #include "environmental.hpp"
 #include "config.hpp"
 #include "handler_helpers.hpp"
+#include "hardware/timer.h"
 #include "nevermore.h"
 #include "sdk/ble_data_types.hpp"
 #include "sdk/btstack.hpp"
 #include "sensors.hpp"
-#include "utility/timer.hpp"
+#include "sensors/history.hpp"
+#include "utility/wire.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
 
 using namespace std;
 
 #define VOC_INDEX_UUID 216aa791_97d0_46ac_8752_60bbc00611e1
 #define ENV_AGGREGATE_UUID 75134bec_dd06_49b1_bac2_c15e05fd7199
+#define ENV_AGGREGATE_DELTA_UUID 594e8339_84c9_4a66_ae07_2ea77a62d715
+#define SENSOR_HISTORY_UUID c09c2a3f_c50b_4c0c_b38c_987be39f3b38
+#define ENV_AGGREGATE_STAMPED_UUID 2f0d771a_773a_48e6_8310_ab20abd351a8
+#define SENSOR_CLOCK_UUID 5d1457fb_dd3a_4738_8155_2bb54cca08cc
 
 #define VOC_INDEX_01 216aa791_97d0_46ac_8752_60bbc00611e1_01
 #define VOC_INDEX_02 216aa791_97d0_46ac_8752_60bbc00611e1_02
 #define ENV_AGGREGATE_01 75134bec_dd06_49b1_bac2_c15e05fd7199_01
+#define ENV_AGGREGATE_DELTA_01 594e8339_84c9_4a66_ae07_2ea77a62d715_01
+#define SENSOR_HISTORY_01 c09c2a3f_c50b_4c0c_b38c_987be39f3b38_01
+#define ENV_AGGREGATE_STAMPED_01 2f0d771a_773a_48e6_8310_ab20abd351a8_01
+#define SENSOR_CLOCK_01 5d1457fb_dd3a_4738_8155_2bb54cca08cc_01
 
 namespace nevermore::gatt::environmental {
 
+static_assert(handles_within(HANDLE_SERVICE(ORG_BLUETOOTH_SERVICE_ENVIRONMENTAL_SENSING),
+        {HANDLE_ATTR(BT(TEMPERATURE_01), VALUE), HANDLE_ATTR(BT(TEMPERATURE_02), VALUE),
+                HANDLE_ATTR(BT(TEMPERATURE_03), VALUE), HANDLE_ATTR(BT(HUMIDITY_01), VALUE),
+                HANDLE_ATTR(BT(HUMIDITY_02), VALUE), HANDLE_ATTR(BT(PRESSURE_01), VALUE),
+                HANDLE_ATTR(BT(PRESSURE_02), VALUE), HANDLE_ATTR(VOC_INDEX_01, VALUE),
+                HANDLE_ATTR(VOC_INDEX_02, VALUE), HANDLE_ATTR(ENV_AGGREGATE_01, VALUE),
+                HANDLE_ATTR(ENV_AGGREGATE_DELTA_01, VALUE), HANDLE_ATTR(SENSOR_HISTORY_01, VALUE),
+                HANDLE_ATTR(ENV_AGGREGATE_STAMPED_01, VALUE), HANDLE_ATTR(SENSOR_CLOCK_01, VALUE)}));
+
 namespace {
 
 using ESM = BLE::EnvironmentalSensorMeasurementDesc;
+using nevermore::sensors::Sensors;
+namespace history = nevermore::sensors::history;
+
+// Every Nth delta notification is a keyframe, so a client that missed a notification resyncs.
+constexpr uint8_t DELTA_KEYFRAME_INTERVAL = 32;
+
+// Reads are filtered per sensor & fused across sensors (see `EnvironmentalFilter::set`), none of the ESM
+// sampling functions describe that. When each value was actually measured is in the timestamped aggregate.
 
 // using HTU21D sensor
 const ESM ESM_TEMPERATURE{
-        .sampling = ESM::Sampling::Instantaneous,
+        .sampling = ESM::Sampling::Unspecified,
         .update_interval = SENSOR_UPDATE_PERIOD / 1s,
         .application = ESM::Application::Air,
 };
 
-// using built-in rp2040 temp monitor
+// using built-in rp2040 temp monitor, the mean of a few ms of ADC samples (see `adc_capture_mean`)
 const ESM ESM_TEMPERATURE_MCU{
-        .sampling = ESM::Sampling::Instantaneous,
+        .sampling = ESM::Sampling::ArithmeticMean,
         .update_interval = SENSOR_UPDATE_PERIOD / 1s,
         .application = ESM::Application::Supplementary,
 };
 
 // using HTU21D sensor
 const ESM ESM_HUMIDITY{
-        .sampling = ESM::Sampling::Instantaneous,
+        .sampling = ESM::Sampling::Unspecified,
         .update_interval = SENSOR_UPDATE_PERIOD / 1s,
 };
 
 // pressure: not implemented (no sensors available)
 const ESM ESM_PRESSURE{
-        .sampling = ESM::Sampling::Instantaneous,
+        .sampling = ESM::Sampling::Unspecified,
         .update_interval = SENSOR_UPDATE_PERIOD / 1s,
 };
 
 // using SGP40
 const ESM ESM_VOC_INDEX{
-        .sampling = ESM::Sampling::Instantaneous,
+        .sampling = ESM::Sampling::Unspecified,
         .measure_period = 1,  // for now, we only
         .update_interval = SENSOR_UPDATE_PERIOD / 1s,
         .application = ESM::Application::Supplementary,
@@ -63,36 +97,328 @@ const ESM ESM_VOC_INDEX{
 // nothing to say regarding its endianness.
 const BLE::ValidRange<nevermore::sensors::VOCIndex> VALID_RANGE_VOC_INDEX{.min = 0, .max = 500};
 
+// Built once per notification round, sent to every subscriber. Only touched from the BTstack run loop.
+nevermore::sensors::Sensors g_notify_aggregate_payload;
+
 // NOLINTNEXTLINE(cppcoreguidelines-interfaces-global-init)
-auto g_notify_aggregate = NotifyState<[](hci_con_handle_t conn) {
-    att_server_notify(
-            conn, HANDLE_ATTR(ENV_AGGREGATE_01, VALUE), nevermore::sensors::g_sensors.with_fallbacks());
+auto g_notify_aggregate = NotifyState<
+        [](hci_con_handle_t conn) {
+            att_server_notify(conn, HANDLE_ATTR(ENV_AGGREGATE_01, VALUE), g_notify_aggregate_payload);
+        },
+        []() { g_notify_aggregate_payload = nevermore::sensors::snapshot_resolved(); }>();
+
+// Delta encoded aggregate wire format:
+//  `uint16_t` mask, bit `i` set -> `SENSORS_FIELDS[i]` follows
+//  the selected fields, in declared order, packed
+// A keyframe has every bit set, and is identical to the plain aggregate w/ a mask prefixed.
+#define SENSORS_FIELD(name) WIRE_FIELD(Sensors, name)
+constexpr array SENSORS_FIELDS{
+        SENSORS_FIELD(temperature_intake),
+        SENSORS_FIELD(temperature_exhaust),
+        SENSORS_FIELD(temperature_mcu),
+        SENSORS_FIELD(humidity_intake),
+        SENSORS_FIELD(humidity_exhaust),
+        SENSORS_FIELD(pressure_intake),
+        SENSORS_FIELD(pressure_exhaust),
+        SENSORS_FIELD(voc_index_intake),
+        SENSORS_FIELD(voc_index_exhaust),
+};
+#undef SENSORS_FIELD
+
+static_assert(wire::tight<Sensors>(SENSORS_FIELDS),
+        "`SENSORS_FIELDS` must cover every field of `Sensors`, in order");
+
+using DeltaMask = uint16_t;
+static_assert(SENSORS_FIELDS.size() <= sizeof(DeltaMask) * 8);
+constexpr DeltaMask DELTA_KEYFRAME = (1u << SENSORS_FIELDS.size()) - 1;
+
+struct [[gnu::packed]] DeltaPacket {
+    DeltaMask mask = 0;
+    array<uint8_t, sizeof(Sensors)> fields{};
+};
+
+// What each subscribed client was last told. Slot per connection, same as `NotifyState`.
+struct DeltaClient {
+    hci_con_handle_t conn = HCI_CON_HANDLE_INVALID;
+    Sensors sent;
+    uint8_t until_keyframe = 0;  // 0 -> next notification is a keyframe
+};
+
+array<DeltaClient, MAX_NR_HCI_CONNECTIONS> g_delta_clients;
+
+DeltaClient* delta_client(hci_con_handle_t conn) {
+    for (auto&& x : g_delta_clients)
+        if (x.conn == conn) return &x;
+
+    return nullptr;
+}
+
+// Returns # of bytes of `packet` to send.
+size_t delta_encode(DeltaPacket& packet, Sensors const& current, Sensors const& prev, bool keyframe) {
+    auto const* curr_bytes = reinterpret_cast<uint8_t const*>(&current);
+    auto const* prev_bytes = reinterpret_cast<uint8_t const*>(&prev);
+
+    // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    packet.mask = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < SENSORS_FIELDS.size(); ++i) {
+        auto const& field = SENSORS_FIELDS[i];
+        if (!keyframe && memcmp(curr_bytes + field.offset, prev_bytes + field.offset, field.size) == 0)
+            continue;
+
+        packet.mask |= DeltaMask(1u << i);
+        memcpy(packet.fields.data() + n, curr_bytes + field.offset, field.size);
+        n += field.size;
+    }
+    // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+    return sizeof(packet.mask) + n;
+}
+
+DeltaPacket delta_keyframe() {
+    DeltaPacket packet;
+    delta_encode(packet, nevermore::sensors::snapshot_resolved(), {}, true);
+    return packet;
+}
+
+// NOLINTNEXTLINE(cppcoreguidelines-interfaces-global-init)
+auto g_notify_delta = NotifyState<[](hci_con_handle_t conn) {
+    auto* client = delta_client(conn);
+    if (!client) return;  // unsubscribed since the request was made
+
+    auto const current = nevermore::sensors::snapshot_resolved();
+    auto const keyframe = client->until_keyframe == 0;
+    DeltaPacket packet;
+    auto const n = delta_encode(packet, current, client->sent, keyframe);
+    if (packet.mask == 0) return;  // nothing this client doesn't already know
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    auto const* data = reinterpret_cast<uint8_t const*>(&packet);
+    if (::att_server_notify(conn, HANDLE_ATTR(ENV_AGGREGATE_DELTA_01, VALUE), data, n) != ERROR_CODE_SUCCESS)
+        return;  // not sent -> leave `sent` as is so the changes go out next time
+
+    client->sent = current;
+    client->until_keyframe = keyframe ? DELTA_KEYFRAME_INTERVAL - 1 : client->until_keyframe - 1;
 }>();
 
+// Sensor clock: `time_us_64` + `g_clock_offset`. A host writes its own time to sync it to its time base,
+// there's no drift correction, re-sync every so often. Only touched from the BTstack run loop.
+int64_t g_clock_offset = 0;  // us
+
+uint64_t clock(uint64_t local) {
+    return local + uint64_t(g_clock_offset);
+}
+
+// Timestamped aggregate wire format:
+//  the plain aggregate
+//  `uint64_t` sensor clock as of building it
+//  `uint32_t` per field, in `SENSORS_FIELDS` order: how long before that it was measured, in us
+// Ages past `AGE_NOT_KNOWN` (~71 min), & values never measured, read as `AGE_NOT_KNOWN`.
+// Ages rather than timestamps keep it within a 69 byte ATT MTU.
+constexpr uint32_t AGE_NOT_KNOWN = UINT32_MAX;
+
+struct [[gnu::packed]] AggregateStamped {
+    Sensors sensors;
+    uint64_t now = 0;
+    array<uint32_t, SENSORS_FIELDS.size()> ages{};
+};
+static_assert(sizeof(AggregateStamped) == sizeof(Sensors) + 8 + 4 * SENSORS_FIELDS.size());
+
+AggregateStamped aggregate_stamped() {
+    auto const [sensors, captured] = nevermore::sensors::snapshot_resolved_stamped();
+    auto const now = time_us_64();
+    auto age = [&](uint64_t at) {
+        return at == 0 || now < at ? AGE_NOT_KNOWN : uint32_t(min<uint64_t>(now - at, AGE_NOT_KNOWN));
+    };
+    return {
+            .sensors = sensors,
+            .now = clock(now),
+            .ages = {age(captured.temperature_intake), age(captured.temperature_exhaust),
+                    age(captured.temperature_mcu), age(captured.humidity_intake),
+                    age(captured.humidity_exhaust), age(captured.pressure_intake),
+                    age(captured.pressure_exhaust), age(captured.voc_index_intake),
+                    age(captured.voc_index_exhaust)},
+    };
+}
+
+AggregateStamped g_notify_stamped_payload;  // built once per notification round, like the plain one
+
+// NOLINTNEXTLINE(cppcoreguidelines-interfaces-global-init)
+auto g_notify_stamped = NotifyState<
+        [](hci_con_handle_t conn) {
+            att_server_notify(conn, HANDLE_ATTR(ENV_AGGREGATE_STAMPED_01, VALUE), g_notify_stamped_payload);
+        },
+        []() { g_notify_stamped_payload = aggregate_stamped(); }>();
+
+int clock_sync(WriteConsumer& consume) {
+    auto const host = consume.exactly<uint64_t>();
+    g_clock_offset = int64_t(host - time_us_64());
+    return 0;
+}
+
+int delta_client_configuration(hci_con_handle_t conn, WriteConsumer& consume) {
+    auto r = g_notify_delta.client_configuration(conn, consume);
+    if (r != 0) return r;
+
+    if (auto* client = delta_client(conn)) *client = {};  // (re)subscribing always starts w/ a keyframe
+
+    if (g_notify_delta.registered(conn)) {
+        auto* client = delta_client(HCI_CON_HANDLE_INVALID);
+        assert(client && "should have a slot per connection");
+        if (client) client->conn = conn;
+        g_notify_delta.notify();
+    }
+
+    return 0;
+}
+
+// Sensor history bulk download:
+//  1. client subscribes to notifications
+//  2. client writes a `HistoryRequest`
+//  3. we reply w/ a `HistoryHeader` followed by `count` `history::Sample`s, as one byte stream split
+//     over however many notifications it takes (each filled up to the connection's MTU)
+// A new request replaces any stream in progress. Samples evicted before they're sent are replaced by a
+// sample w/ a timestamp of 0 and no known values, so the stream length always matches the header.
+struct [[gnu::packed]] HistoryRequest {
+    uint8_t resolution;  // index into `history::RESOLUTIONS`
+    uint32_t since;      // only samples w/ a timestamp after this, 0 for everything
+};
+
+struct [[gnu::packed]] HistoryHeader {
+    uint32_t now;  // same clock as `history::Sample::timestamp`
+    uint8_t resolution;
+    uint16_t count;
+};
+
+struct HistoryStream {
+    hci_con_handle_t conn = HCI_CON_HANDLE_INVALID;
+    HistoryHeader header{};
+    uint32_t seq = 0;  // first sample in the stream
+    size_t sent = 0;   // bytes
+
+    [[nodiscard]] size_t size() const {
+        return sizeof(header) + size_t(header.count) * sizeof(history::Sample);
+    }
+
+    // Copies the next (up to) `dst.size()` bytes of the stream, returns # of bytes copied.
+    size_t read(span<uint8_t> dst) const {
+        size_t n = 0;
+        for (auto pos = sent; n < dst.size() && pos < size(); pos = sent + n) {
+            if (pos < sizeof(header)) {
+                n += copy_from(dst.subspan(n), &header, sizeof(header), pos);
+                continue;
+            }
+
+            auto const i = (pos - sizeof(header)) / sizeof(history::Sample);
+            auto const sample = history::get(header.resolution, seq + i).value_or(history::Sample{});
+            n += copy_from(dst.subspan(n), &sample, sizeof(sample),
+                    (pos - sizeof(header)) % sizeof(history::Sample));
+        }
+
+        return n;
+    }
+
+private:
+    static size_t copy_from(span<uint8_t> dst, void const* src, size_t size, size_t offset) {
+        auto const n = min(dst.size(), size - offset);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        memcpy(dst.data(), static_cast<uint8_t const*>(src) + offset, n);
+        return n;
+    }
+};
+
+array<HistoryStream, MAX_NR_HCI_CONNECTIONS> g_history_streams;
+
+HistoryStream* history_stream(hci_con_handle_t conn) {
+    for (auto&& x : g_history_streams)
+        if (x.conn == conn) return &x;
+
+    return nullptr;
+}
+
+void history_stream_release(hci_con_handle_t conn) {
+    if (auto* stream = history_stream(conn)) *stream = {};
+}
+
+void history_send(hci_con_handle_t conn);
+
+// Chunks are chained, each send queues the next, so it's declared ahead of its handler.
+NotifyState<history_send> g_notify_history;
+
+void history_send(hci_con_handle_t conn) {
+    auto* stream = history_stream(conn);
+    if (!stream) return;  // cancelled since the request was made
+
+    constexpr uint16_t ATT_NOTIFY_HEADER_SIZE = 3;  // opcode + attr handle
+    array<uint8_t, HCI_ACL_PAYLOAD_SIZE> chunk{};
+    auto const capacity = min<size_t>(chunk.size(), att_server_get_mtu(conn) - ATT_NOTIFY_HEADER_SIZE);
+    auto const n = stream->read(span{chunk}.first(capacity));
+    if (::att_server_notify(conn, HANDLE_ATTR(SENSOR_HISTORY_01, VALUE), chunk.data(), n) !=
+            ERROR_CODE_SUCCESS) {
+        printf("WARN - BLE GATT - history stream failed, abandoning\n");
+        *stream = {};
+        return;
+    }
+
+    stream->sent += n;
+    if (stream->sent < stream->size()) {
+        g_notify_history.notify(conn);  // more to go
+    } else {
+        *stream = {};  // done
+    }
+}
+
+int history_request(hci_con_handle_t conn, WriteConsumer& consume) {
+    auto const request = consume.exactly<HistoryRequest>();
+    if (history::RESOLUTIONS.size() <= request.resolution) return ATT_ERROR_VALUE_NOT_ALLOWED;
+    if (!g_notify_history.registered(conn)) return ATT_ERROR_WRITE_NOT_PERMITTED;  // nowhere to send it
+
+    auto* stream = history_stream(conn);
+    if (!stream) stream = history_stream(HCI_CON_HANDLE_INVALID);
+    assert(stream && "should have a slot per connection");
+    if (!stream) return ATT_ERROR_INSUFFICIENT_RESOURCES;
+
+    auto const range = history::since(request.resolution, request.since);
+    *stream = {
+            .conn = conn,
+            .header = {.now = history::now(),
+                    .resolution = request.resolution,
+                    .count = uint16_t(range.size())},
+            .seq = range.begin,
+    };
+    g_notify_history.notify(conn);
+    return 0;
+}
+
+int history_client_configuration(hci_con_handle_t conn, WriteConsumer& consume) {
+    auto r = g_notify_history.client_configuration(conn, consume);
+    if (!g_notify_history.registered(conn)) history_stream_release(conn);
+    return r;
+}
+
 }  // namespace
 
 bool init() {
-    // HACK:  We'd like to notify on write changes, but the code base isn't setup
-    //        for that yet. Internally poll and update based on diffs for now.
-    mk_timer("gatt-env-notify", SENSOR_UPDATE_PERIOD / 2.)([](auto*) {
-        auto const& current = nevermore::sensors::g_sensors.with_fallbacks();
-        static nevermore::sensors::Sensors g_prev;
-        if (g_prev != current) {
-            g_prev = current;
-            g_notify_aggregate.notify();
-        }
+    nevermore::sensors::observe([]() {
+        g_notify_aggregate.notify();
+        g_notify_delta.notify();
+        g_notify_stamped.notify();
     });
-
     return true;
 }
 
 void disconnected(hci_con_handle_t conn) {
     g_notify_aggregate.unregister(conn);
+    g_notify_delta.unregister(conn);
+    g_notify_stamped.unregister(conn);
+    if (auto* client = delta_client(conn)) *client = {};
+    g_notify_history.unregister(conn);
+    history_stream_release(conn);
 }
 
 optional<uint16_t> attr_read(
         hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t* buffer, uint16_t buffer_size) {
-    auto sensors = []() { return nevermore::sensors::g_sensors.with_fallbacks(); };
+    auto sensors = []() { return nevermore::sensors::snapshot_resolved(); };
 
     switch (att_handle) {
         // NOLINTBEGIN(bugprone-branch-clone)
@@ -106,6 +432,10 @@ optional<uint16_t> attr_read(
         USER_DESCRIBE(VOC_INDEX_01, "Intake VOC Index")
         USER_DESCRIBE(VOC_INDEX_02, "Exhaust VOC Index")
         USER_DESCRIBE(ENV_AGGREGATE_01, "Aggregated Service Data")
+        USER_DESCRIBE(ENV_AGGREGATE_DELTA_01, "Aggregated Service Data - Delta Encoded")
+        USER_DESCRIBE(SENSOR_HISTORY_01, "Sensor History")
+        USER_DESCRIBE(ENV_AGGREGATE_STAMPED_01, "Aggregated Service Data - Timestamped")
+        USER_DESCRIBE(SENSOR_CLOCK_01, "Sensor Clock (us)")
 
         ESM_DESCRIBE(BT(TEMPERATURE_01), ESM_TEMPERATURE)
         ESM_DESCRIBE(BT(TEMPERATURE_02), ESM_TEMPERATURE)
@@ -131,14 +461,19 @@ optional<uint16_t> attr_read(
         READ_VALUE(VOC_INDEX_01, sensors().voc_index_intake)
         READ_VALUE(VOC_INDEX_02, sensors().voc_index_exhaust)
         READ_VALUE(ENV_AGGREGATE_01, sensors())
+        READ_VALUE(ENV_AGGREGATE_DELTA_01, delta_keyframe())
+        READ_VALUE(ENV_AGGREGATE_STAMPED_01, aggregate_stamped())
+        READ_VALUE(SENSOR_CLOCK_01, clock(time_us_64()))
 
         READ_CLIENT_CFG(ENV_AGGREGATE_01, g_notify_aggregate)
+        READ_CLIENT_CFG(ENV_AGGREGATE_DELTA_01, g_notify_delta)
+        READ_CLIENT_CFG(ENV_AGGREGATE_STAMPED_01, g_notify_stamped)
+        READ_CLIENT_CFG(SENSOR_HISTORY_01, g_notify_history)
 
     default: return {};
     }
 }
 
-// No attrs are writable.
 optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t const* buffer,
         uint16_t buffer_size) {
     if (buffer_size < offset) return ATT_ERROR_INVALID_OFFSET;
@@ -146,6 +481,13 @@ optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t of
 
     switch (att_handle) {
         WRITE_CLIENT_CFG(ENV_AGGREGATE_01, g_notify_aggregate)
+        WRITE_CLIENT_CFG(ENV_AGGREGATE_STAMPED_01, g_notify_stamped)
+        HANDLE_WRITE_EXPR(SENSOR_CLOCK_01, VALUE, clock_sync(consume))
+        HANDLE_WRITE_EXPR(
+                ENV_AGGREGATE_DELTA_01, CLIENT_CONFIGURATION, delta_client_configuration(conn, consume))
+        HANDLE_WRITE_EXPR(
+                SENSOR_HISTORY_01, CLIENT_CONFIGURATION, history_client_configuration(conn, consume))
+        HANDLE_WRITE_EXPR(SENSOR_HISTORY_01, VALUE, history_request(conn, consume))
 
     default: return {};
     }
@@ -1,129 +1,637 @@
 #include "fan.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
 #include "config.hpp"
 #include "handler_helpers.hpp"
+#include "hardware/clocks.h"
+#include "hardware/timer.h"
 #include "nevermore.h"
 #include "sdk/ble_data_types.hpp"
 #include "sdk/btstack.hpp"
 #include "sdk/pwm.hpp"
+#include "sdk/pwm_ramp.hpp"
+#include "sdk/task.hpp"
 #include "sensors.hpp"
 #include "sensors/tachometer.hpp"
+#include "settings.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include "telemetry.hpp"
+#include "timers.h"  // IWYU pragma: keep
+#include "utility/fan_health.hpp"
 #include "utility/fan_policy.hpp"
+#include "utility/filter_life.hpp"
+#include "utility/log.hpp"
+#include "utility/mailbox.hpp"
+#include "utility/pid.hpp"
 #include "utility/timer.hpp"
+#include "utility/wire.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
-#include <limits>
+#include <cstdio>
+#include <span>
+#include <type_traits>
+#include <utility>
 
 using namespace std;
 
-#define FAN_POWER 2B04_01
-#define FAN_POWER_OVERRIDE 2B04_02
-#define TACHOMETER 03f61fe0_9fe7_4516_98e6_056de551687f_01
-// NB: Error prone, but we're the 2nd aggregation char instance in the DB
-#define FAN_AGGREGATE 75134bec_dd06_49b1_bac2_c15e05fd7199_02
-
-#define FAN_POLICY_COOLDOWN 2B16_01
-#define FAN_POLICY_VOC_PASSIVE_MAX 216aa791_97d0_46ac_8752_60bbc00611e1_03
-#define FAN_POLICY_VOC_IMPROVE_MIN 216aa791_97d0_46ac_8752_60bbc00611e1_04
-
 namespace nevermore::gatt::fan {
 
+static_assert(handles_within(HANDLE_SERVICE(4553d138_1d00_4b6f_bc42_955a89cf8c36),
+        {HANDLE_ATTR(FAN_POWER, VALUE), HANDLE_ATTR(FAN_POWER_OVERRIDE, VALUE),
+                HANDLE_ATTR(TACHOMETER, VALUE), HANDLE_ATTR(FAN_AGGREGATE, VALUE),
+                HANDLE_ATTR(FAN_RPM_TARGET, VALUE), HANDLE_ATTR(FAN_RPM_GAINS, VALUE),
+                HANDLE_ATTR(FAN_CHANNELS, VALUE), HANDLE_ATTR(FILTER_LIFE, VALUE),
+                HANDLE_ATTR(FAN_HEALTH, VALUE), HANDLE_ATTR(FAN_RAMP, VALUE),
+                HANDLE_ATTR(FAN_PWM, VALUE)}));
+static_assert(handles_within(HANDLE_SERVICE(260a0845_e62f_48c6_aef9_04f62ff8bffd),
+        {HANDLE_ATTR(FAN_POLICY_COOLDOWN, VALUE), HANDLE_ATTR(FAN_POLICY_VOC_PASSIVE_MAX, VALUE),
+                HANDLE_ATTR(FAN_POLICY_VOC_IMPROVE_MIN, VALUE), HANDLE_ATTR(FAN_POLICY_CURVE, VALUE),
+                HANDLE_ATTR(FAN_POLICY_VOC_TREND, VALUE), HANDLE_ATTR(FAN_POLICY_PRINT, VALUE),
+                HANDLE_ATTR(FAN_POLICY_PRINT_HINT, VALUE)}));
+
 namespace {
 
+using settings::Key;
+
 BLE_DECL_SCALAR(RPM16, uint16_t, 1, 0, 0);
 
-constexpr uint8_t FAN_POLICY_UPDATE_RATE_HZ = 10;
+// The policy itself is evaluated on demand (sensor updates, setting writes, its own deadlines).
+// Only closed loop RPM control needs a steady tick, and only while it's active.
+constexpr uint8_t FAN_RPM_CONTROL_RATE_HZ = 10;
+constexpr auto FAN_RPM_CONTROL_PERIOD = 1.s / FAN_RPM_CONTROL_RATE_HZ;
 
-constexpr uint8_t TACHOMETER_PULSE_PER_REVOLUTION = 2;
-constexpr uint32_t FAN_PWN_HZ = 25'000;
+// Defaults for a typical 12v 5015 blower (~4-5k RPM max): 1000 RPM short -> +40%, closes that in ~1s.
+constexpr PID::Gains FAN_RPM_GAINS_DEFAULT{.kp = 0.0004f, .ki = 0.0008f, .kd = 0};
+// Full range in 2s. Keeps the loop from slamming the fan around on a noisy tachometer/target step.
+constexpr float FAN_RPM_OUTPUT_RATE_MAX = 0.5f;
 
-constexpr auto SLICE_PWM = pwm_gpio_to_slice_num_(PIN_FAN_PWM);
-constexpr auto SLICE_TACHOMETER = pwm_gpio_to_slice_num_(PIN_FAN_TACHOMETER);
-static_assert(pwm_gpio_to_channel_(PIN_FAN_TACHOMETER) == PWM_CHAN_B, "can only read from B channel");
+// Health checks only run while a fan's powered. Well inside `FanHealth::CONFIRM`.
+constexpr auto FAN_HEALTH_PERIOD = 250ms;
+
+constexpr uint8_t TACHOMETER_PULSE_PER_REVOLUTION = 2;
+// 25 kHz is the 4-pin PC fan standard. Some blowers want far slower PWM, or a longer period (-> more levels
+// of duty, see `pwm_divider`) to hold a low RPM steadily. Every fan shares the frequency.
+constexpr uint32_t FAN_PWM_HZ_DEFAULT = 25'000;
+constexpr uint32_t FAN_PWM_HZ_MIN = 10;       // the slowest a slice goes is ~7.5 Hz
+constexpr uint32_t FAN_PWM_HZ_MAX = 100'000;  // 1250 steps of duty at 125 MHz
+
+constexpr bool fan_pwm_hz_valid(uint32_t hz) {
+    return FAN_PWM_HZ_MIN <= hz && hz <= FAN_PWM_HZ_MAX;
+}
 
 // not included in the fan aggregation - technically a separate service
 FanPolicyEnvironmental g_fan_policy;
 
-BLE::Percentage8 g_fan_power = 0;
-BLE::Percentage8 g_fan_power_override;  // not-known -> automatic control
-nevermore::sensors::Tachometer g_tachometer{PIN_FAN_TACHOMETER, TACHOMETER_PULSE_PER_REVOLUTION};
+struct Channel {
+    FanChannel const& pins;  // NOLINT(cppcoreguidelines-avoid-const-or-ref-data-members)
+    nevermore::sensors::Tachometer tachometer{pins.tachometer, TACHOMETER_PULSE_PER_REVOLUTION};
 
-struct Aggregate {
-    BLE::Percentage8 power = g_fan_power;
-    BLE::Percentage8 power_override = g_fan_power_override;
-    RPM16 tachometer = g_tachometer.revolutions_per_second() * 60;
+    BLE::Percentage8 power = 0;
+    BLE::Percentage8 power_override;  // not-known -> automatic control. Only written by the timer task.
+
+    // only touched by the timer task (fan policy & RPM control timers)
+    PID pid{.output_rate_max = FAN_RPM_OUTPUT_RATE_MAX};
+    bool rpm_control_active = false;
+    FanHealth health;  // `health.fault` is a single octet, readers on other tasks never see a torn write
 };
 
-auto g_notify_aggregate = NotifyState<[](hci_con_handle_t conn) {
-    att_server_notify(conn, HANDLE_ATTR(FAN_AGGREGATE, VALUE), Aggregate{});
-}>();
+template <size_t... I>
+array<Channel, sizeof...(I)> channels_mk(index_sequence<I...>) {
+    return {Channel{.pins = PINS_FAN[I]}...};  // NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+}
 
-void fan_power_set(BLE::Percentage8 power) {
-    if (g_fan_power == power) return;
-    g_fan_power = power;
-    g_notify_aggregate.notify();  // `g_fan_power` changed
+// Not movable (tachometers are pinned once started), built in place.
+auto g_channels = channels_mk(make_index_sequence<size(PINS_FAN)>{});
+auto& g_primary = g_channels[0];
 
-    auto scale = power.value_or(0) / 100;  // enable automatic control if `NOT_KNOWN`
-    auto duty = uint16_t(numeric_limits<uint16_t>::max() * scale);
-    pwm_set_gpio_duty(PIN_FAN_PWM, duty);
+// Closed loop mode: automatic control aims for a fraction of `g_fan_rpm_target` instead of a PWM %.
+// Shared by all channels, each runs its own controller against its own tachometer.
+// Written by BTstack, read by the timer task. Guarded by the kernel critical section.
+RPM16 g_fan_rpm_target = 0;  // 0 -> open loop
+PID::Gains g_fan_rpm_gains = FAN_RPM_GAINS_DEFAULT;
+
+struct [[gnu::packed]] Aggregate {
+    BLE::Percentage8 power;
+    BLE::Percentage8 power_override;
+    RPM16 tachometer;
+
+    explicit Aggregate(Channel const& channel = g_primary)
+            : power(channel.power), power_override(channel.power_override),
+              tachometer(RPM16::from_fixed<0>(channel.tachometer.rpm())) {}
+};
+
+// Same layout as the single-fan aggregate, 1 entry per fan channel, in `PINS_FAN` order.
+array<Aggregate, size(PINS_FAN)> channels_aggregate() {
+    return [&]<size_t... I>(index_sequence<I...>) {
+        return array<Aggregate, size(PINS_FAN)>{Aggregate(g_channels[I])...};
+    }(make_index_sequence<size(PINS_FAN)>{});
 }
 
-}  // namespace
+// Channel override write: [u8 channel][Percentage8 override]
+struct [[gnu::packed]] ChannelOverride {
+    static constexpr uint8_t ALL = UINT8_MAX;  // internal only, not accepted over the wire
+
+    uint8_t channel;
+    BLE::Percentage8 power_override;
+};
+
+// Overrides come from BTstack & the UI, but are applied by the timer task (which owns the fan state).
+// Sized for a burst of UI drag events between policy runs.
+constexpr size_t OVERRIDES_PENDING_MAX = 8;
+Mailbox<ChannelOverride, OVERRIDES_PENDING_MAX> g_overrides;
+
+// Print hints come from BTstack, but are applied by the timer task (which owns the policy instance).
+constexpr size_t HINTS_PENDING_MAX = 4;
+Mailbox<FanPolicyEnvironmental::Hint, HINTS_PENDING_MAX> g_hints;
+
+// Carbon saturation estimate. Sampled by the timer task, reset by BTstack. Guarded by the kernel critical
+// section.
+FilterLife g_filter_life;
+// Persisted this often while it's changing, & whenever the fans stop. A power cut loses at most this much.
+constexpr auto FILTER_LIFE_PERSIST_PERIOD = 30min;
+// Longer gaps between policy runs only count for this much (e.g. the clock being set).
+constexpr auto FILTER_LIFE_SAMPLE_GAP_MAX = 1min;
+
+// [Percentage8 remaining, Percentage8 efficiency, Percentage8 fresh filter's efficiency, u32 load,
+//  u32 capacity]. Efficiencies are `NOT_KNOWN` until measured.
+struct [[gnu::packed]] FilterLifeStatus {
+    BLE::Percentage8 remaining;
+    BLE::Percentage8 efficiency;
+    BLE::Percentage8 efficiency_fresh;
+    uint32_t load;
+    uint32_t capacity;
+};
 
-double fan_power() {
-    return g_fan_power.value_or(0);
+FilterLifeStatus filter_life_status() {
+    taskENTER_CRITICAL();
+    auto const x = g_filter_life;
+    taskEXIT_CRITICAL();
+
+    auto percent = [](float x) -> BLE::Percentage8 {
+        if (x < 0) return BLE::NOT_KNOWN;
+        return BLE::Percentage8::from_fixed<-3>(lroundf(x * 100'000));
+    };
+    return {
+            .remaining = percent(x.remaining()),
+            .efficiency = percent(x.state.efficiency),
+            .efficiency_fresh = percent(x.state.efficiency_fresh),
+            .load = x.state.load,
+            .capacity = x.state.capacity,
+    };
 }
 
-void fan_power_override(BLE::Percentage8 power) {
-    if (g_fan_power_override == power) return;
+// While any fan's faulted, running fans that aren't stalled are floored at this. `NOT_KNOWN` -> no floor.
+// Written by BTstack, read by the timer task. Single octet, never torn.
+BLE::Percentage8 g_fan_fault_power = BLE::NOT_KNOWN;
+
+// [Percentage8 fault power, u8 fault per channel (`FanHealth::Fault`), in `PINS_FAN` order]
+struct [[gnu::packed]] HealthStatus {
+    BLE::Percentage8 fault_power;
+    array<FanHealth::Fault, size(PINS_FAN)> faults;
+};
+
+HealthStatus health_status() {
+    HealthStatus x{.fault_power = g_fan_fault_power, .faults = {}};
+    for (size_t i = 0; i < g_channels.size(); ++i)
+        x.faults.at(i) = g_channels.at(i).health.fault;
+    return x;
+}
 
-    g_fan_power_override = power;
-    g_notify_aggregate.notify();
+bool fan_faulted() {
+    return ranges::any_of(g_channels, [](auto& x) { return x.health.fault != FanHealth::Fault::None; });
+}
+
+// How power changes are ramped in by the PWM hardware, instead of stepping the fans (thump & inrush).
+// Sent/persisted as `FanRampWire` [u16 full scale ms, u8 shape] (tail padded in memory).
+struct FanRamp {
+    // 0 -> 100 % takes this long, smaller changes proportionally less. 0 -> step
+    uint16_t full_scale_ms = 1500;
+    PwmRampShape shape = PwmRampShape::EaseIn;
 
-    if (power != BLE::NOT_KNOWN) {
-        fan_power_set(power);  // apply override
+    [[nodiscard]] constexpr bool valid() const {
+        return shape <= PwmRampShape::Smooth;
     }
+};
+
+constexpr array FAN_RAMP_FIELDS{WIRE_FIELD(FanRamp, full_scale_ms), WIRE_FIELD(FanRamp, shape)};
+using FanRampWire = wire::Packed<FanRamp, FAN_RAMP_FIELDS>;
+static_assert(sizeof(FanRampWire) == sizeof(uint16_t) + sizeof(PwmRampShape));
+
+// Written by BTstack, read by the timer task. Guarded by the kernel critical section.
+FanRamp g_fan_ramp;
+
+// Written by BTstack, applied by the timer task (which owns the PWM slices). Single word, never torn.
+uint32_t g_fan_pwm_hz = FAN_PWM_HZ_DEFAULT;
+uint32_t g_fan_pwm_hz_applied = 0;  // only touched by the timer task (& `init`, before it runs)
+
+// [u32 requested Hz, u32 actual Hz, u16 period (duty has this many steps)], as the primary fan runs now
+// Sent as `PwmStatusWire` (tail padded in memory).
+struct PwmStatus {
+    uint32_t hz;
+    uint32_t hz_actual;
+    uint16_t top;
+};
+
+constexpr array PWM_STATUS_FIELDS{
+        WIRE_FIELD(PwmStatus, hz), WIRE_FIELD(PwmStatus, hz_actual), WIRE_FIELD(PwmStatus, top)};
+using PwmStatusWire = wire::Packed<PwmStatus, PWM_STATUS_FIELDS>;
+static_assert(sizeof(PwmStatusWire) == 2 * sizeof(uint32_t) + sizeof(uint16_t));
+
+PwmStatus pwm_status() {
+    auto const divider = pwm_slice_divider(pwm_gpio_to_slice_num_(g_primary.pins.pwm));
+    return {.hz = g_fan_pwm_hz, .hz_actual = divider.hz(clock_get_hz(clk_sys)), .top = uint16_t(divider.top)};
 }
 
-BLE::Percentage8 fan_power_override() {
-    return g_fan_power_override;
+// Built once per notification round, sent to every subscriber. Only touched from the BTstack run loop.
+Aggregate g_notify_aggregate_payload;
+array<Aggregate, size(PINS_FAN)> g_notify_channels_payload;
+HealthStatus g_notify_health_payload;
+
+auto g_notify_aggregate = NotifyState<
+        [](hci_con_handle_t conn) {
+            att_server_notify(conn, HANDLE_ATTR(FAN_AGGREGATE, VALUE), g_notify_aggregate_payload);
+        },
+        []() { g_notify_aggregate_payload = Aggregate{}; }>();
+
+auto g_notify_channels = NotifyState<
+        [](hci_con_handle_t conn) {
+            att_server_notify(conn, HANDLE_ATTR(FAN_CHANNELS, VALUE), g_notify_channels_payload);
+        },
+        []() { g_notify_channels_payload = channels_aggregate(); }>();
+
+auto g_notify_health = NotifyState<
+        [](hci_con_handle_t conn) {
+            att_server_notify(conn, HANDLE_ATTR(FAN_HEALTH, VALUE), g_notify_health_payload);
+        },
+        []() { g_notify_health_payload = health_status(); }>();
+
+void notify(Channel const& channel) {
+    if (&channel == &g_primary) g_notify_aggregate.notify();
+    g_notify_channels.notify();
 }
 
-bool init() {
-    // setup PWM configurations for fan PWM and fan tachometer
-    auto cfg_pwm = pwm_get_default_config();
-    pwm_config_set_freq_hz(cfg_pwm, FAN_PWN_HZ);
-    pwm_init(SLICE_PWM, &cfg_pwm, true);
+TimerHandle_t g_policy_timer = nullptr;   // one-shot, (re)armed for the policy's next deadline & by `poke`
+TimerHandle_t g_control_timer = nullptr;  // periodic, only running while RPM control is active
+TimerHandle_t g_health_timer = nullptr;   // periodic, only running while a fan's powered
+float g_policy = 0;                       // last policy output, only touched by the timer task
+
+// Re-evaluate the policy ASAP. Callable from any task, pokes are coalesced by the timer.
+void poke() {
+    if (g_policy_timer) xTimerChangePeriod(g_policy_timer, 1, 0);
+}
 
-    auto cfg_tachometer = pwm_get_default_config();
-    pwm_config_set_clkdiv_mode(&cfg_tachometer, PWM_DIV_B_FALLING);
-    pwm_init(SLICE_TACHOMETER, &cfg_tachometer, false);
+// PWM level for `power`, `NOT_KNOWN` -> off
+constexpr uint16_t fan_duty(BLE::Percentage8 power) {
+    return uint16_t(power.fixed_or<-1>(0) * UINT16_MAX / 1000);
+}
+static_assert(fan_duty(BLE::Percentage8::from_fixed<0>(100)) == UINT16_MAX);
+static_assert(fan_duty(BLE::NOT_KNOWN) == 0);
+
+// PRECONDITION: called by only the timer task
+// `channel.power` is the target, the PWM level gets there by the ramp (DMA driven, no CPU involved).
+void fan_power_set(Channel& channel, BLE::Percentage8 power) {
+    taskENTER_CRITICAL();
+    auto const before = channel.power;
+    channel.power = power;
+    auto const ramp = g_fan_ramp;
+    taskEXIT_CRITICAL();
+    if (before == power) return;
+
+    auto const duty = fan_duty(power);
+    auto const delta = abs(int32_t(duty) - int32_t(fan_duty(before)));
+    auto const duration = chrono::microseconds(int64_t(ramp.full_scale_ms) * 1000 * delta / UINT16_MAX);
+    pwm_ramp_gpio_duty(channel.pins.pwm, duty, duration, ramp.shape);
+
+    notify(channel);  // `channel.power` changed
+}
+
+// Retimes the fans' slices if the frequency's changed.
+// PRECONDITION: called by only the timer task
+void fan_pwm_update() {
+    uint32_t const hz = g_fan_pwm_hz;
+    if (hz == g_fan_pwm_hz_applied) return;
+    g_fan_pwm_hz_applied = hz;
+
+    auto const divider = pwm_divider(clock_get_hz(clk_sys), hz);
+    // fans can share a slice, retiming it again is harmless
+    for (auto const& channel : g_channels)
+        pwm_slice_set_divider(pwm_gpio_to_slice_num_(channel.pins.pwm), divider);
+    // levels are relative to the period, re-seat them (any ramp in flight is cut short)
+    for (auto const& channel : g_channels)
+        pwm_ramp_gpio_duty(channel.pins.pwm, fan_duty(channel.power), {});
+
+    printf("fan - PWM %u Hz (%u Hz actual), %u steps\n", unsigned(hz),
+            unsigned(divider.hz(clock_get_hz(clk_sys))), unsigned(divider.top));
+}
 
-    // set fan PWM level
-    fan_power_set(g_fan_power);
+// PRECONDITION: called by only the timer task
+// A cleared override is picked back up by the policy run (or RPM control tick) that follows.
+void fan_power_override_apply(Channel& channel, BLE::Percentage8 power) {
+    if (channel.power_override == power) return;
 
-    g_tachometer.start();
+    channel.power_override = power;  // single octet, readers on other tasks never see a torn write
+    notify(channel);
 
-    // HACK:  We'd like to notify on write to tachometer changes, but the code base isn't setup
-    //        for that yet. Internally poll and update based on diffs for now.
-    mk_timer("gatt-fan-tachometer-notify", SENSOR_UPDATE_PERIOD)([](auto*) {
-        static double g_prev;
-        if (g_prev == g_tachometer.revolutions_per_second()) return;
+    if (power != BLE::NOT_KNOWN) fan_power_set(channel, power);  // apply override
+}
 
-        g_prev = g_tachometer.revolutions_per_second();
-        g_notify_aggregate.notify();
+// PRECONDITION: called by only the timer task
+void fan_power_overrides_apply() {
+    g_overrides.drain([](ChannelOverride const& x) {
+        for (size_t i = 0; i < g_channels.size(); ++i)
+            if (x.channel == ChannelOverride::ALL || x.channel == i)
+                fan_power_override_apply(g_channels.at(i), x.power_override);
     });
+}
+
+// Any task. Applied by the timer task's next policy run.
+bool fan_power_override_post(ChannelOverride const& x) {
+    if (!g_overrides.post(x)) {
+        LOG_DEFERRED("WARN - fan - too many pending overrides, dropped one\n");
+        return false;
+    }
+
+    poke();
+    return true;
+}
+
+// PRECONDITION: called by only the timer task
+// Maps the policy's output [0, 1] to a channel's fan power [0, 1].
+// What RPM control aims for, the target is full scale (policy at 1).
+float rpm_setpoint(RPM16 target, float policy) {
+    return float(target.raw_value) * policy;
+}
+
+float fan_power_automatic(Channel& channel, float policy, RPM16 target, PID::Gains const& gains) {
+    if (policy < channel.pins.stage) policy = 0;  // not enough demand to bring this fan in yet
+
+    if (target == 0 || policy <= 0) {
+        channel.rpm_control_active = false;
+        return policy;  // open loop, or we want the fan off anyways
+    }
+
+    if (!channel.rpm_control_active) {
+        // pick up from wherever the fan is now
+        channel.pid.reset(float(channel.power.fixed_or<-1>(0)) / 1000);
+        channel.rpm_control_active = true;
+    }
+
+    auto const rpm = float(channel.tachometer.rpm());
+    auto const period_sec = chrono::duration<float>(FAN_RPM_CONTROL_PERIOD).count();
+    channel.pid.gains = gains;
+    return channel.pid(rpm_setpoint(target, policy), rpm, period_sec);
+}
+
+// PRECONDITION: called by only the timer task
+void health_update() {
+    bool changed = false;
+    for (size_t i = 0; i < g_channels.size(); ++i) {
+        auto& channel = g_channels.at(i);
+        auto const fault_old = channel.health.fault;
+
+        auto const duty = float(channel.power.fixed_or<-1>(0)) / 1000;
+        auto const fault = channel.health(duty, channel.tachometer.rpm(), FAN_HEALTH_PERIOD);
+        if (fault == fault_old) continue;
+
+        changed = true;
+        switch (fault) {
+        case FanHealth::Fault::None: printf("fan - channel %u recovered\n", unsigned(i)); break;
+        case FanHealth::Fault::Stall: printf("WARN - fan - channel %u stalled\n", unsigned(i)); break;
+        case FanHealth::Fault::Clog: printf("WARN - fan - channel %u clogged\n", unsigned(i)); break;
+        }
+    }
+
+    if (!changed) return;
+
+    g_notify_health.notify();
+    poke();  // (un)apply the fault power floor
+}
+
+// Applies `g_policy` to every channel w/o an override.
+// PRECONDITION: called by only the timer task
+void fan_apply() {
+    taskENTER_CRITICAL();
+    auto const target = g_fan_rpm_target;
+    auto const gains = g_fan_rpm_gains;
+    taskEXIT_CRITICAL();
+
+    BLE::Percentage8 const fault_power = g_fan_fault_power;
+    bool const floored = fault_power != BLE::NOT_KNOWN && fan_faulted();
+    auto const floor = floored ? float(fault_power.value_or(0) / 100) : 0.f;
+
+    bool rpm_control_active = false;
+    for (auto& channel : g_channels) {
+        if (channel.power_override != BLE::NOT_KNOWN) {
+            channel.rpm_control_active = false;  // restart from the override's power once it's cleared
+            continue;
+        }
+
+        auto power = fan_power_automatic(channel, g_policy, target, gains);  // [0, 1]
+        // Only while filtering anyways, a fault shouldn't keep the fans running forever.
+        // Nothing to gain driving a stalled fan harder, it'd only cook its windings.
+        if (0 < power && power < floor && channel.health.fault != FanHealth::Fault::Stall) {
+            power = floor;
+            channel.rpm_control_active = false;  // don't wind up against the floor
+        }
+        fan_power_set(channel, BLE::Percentage8::from_fixed<-3>(lroundf(power * 100'000)));
+        rpm_control_active |= channel.rpm_control_active;
+    }
+
+    for (size_t i = 0; i < g_channels.size(); ++i) {
+        auto const& channel = g_channels.at(i);
+        telemetry::record(telemetry::Fan{
+                .channel = uint8_t(i),
+                .duty = fan_duty(channel.power),
+                .rpm = uint16_t(min<uint32_t>(channel.tachometer.rpm(), UINT16_MAX)),
+                .rpm_target = channel.rpm_control_active ? uint16_t(lroundf(rpm_setpoint(target, g_policy)))
+                                                         : uint16_t(0),
+        });
+    }
+
+    if (rpm_control_active != bool(xTimerIsTimerActive(g_control_timer))) {
+        if (rpm_control_active)
+            xTimerStart(g_control_timer, 0);
+        else
+            xTimerStop(g_control_timer, 0);
+    }
+
+    bool const powered = ranges::any_of(g_channels, [](auto& x) { return 0 < x.power.value_or(0); });
+    if (powered != bool(xTimerIsTimerActive(g_health_timer))) {
+        if (powered) {
+            xTimerStart(g_health_timer, 0);
+        } else {
+            xTimerStop(g_health_timer, 0);
+            health_update();  // stopped fans have no faults, clear them now
+        }
+    }
+}
+
+// Charges the filter w/ what the fans did since the last policy run, at the sensors' current readings.
+// PRECONDITION: called by only the timer task
+void filter_life_update(chrono::system_clock::time_point now) {
+    static auto g_sampled_at = now;
+    static auto g_persisted_at = now;
+    static bool g_running = false;
+
+    auto const dt = clamp<chrono::system_clock::duration>(now - g_sampled_at, {}, FILTER_LIFE_SAMPLE_GAP_MAX);
+    g_sampled_at = now;
+
+    float duty = 0;
+    for (auto const& channel : g_channels)
+        duty += float(channel.power.value_or(0) / 100);
+    duty /= float(g_channels.size());
+
+    auto const sensors = nevermore::sensors::snapshot();
+    taskENTER_CRITICAL();
+    g_filter_life(duty, sensors.voc_index_intake, sensors.voc_index_exhaust, dt);
+    auto const state = g_filter_life.state;
+    taskEXIT_CRITICAL();
+
+    // Unchanged values don't touch flash, so an idle controller doesn't wear it.
+    bool const running = 0 < duty;
+    if ((g_running && !running) || FILTER_LIFE_PERSIST_PERIOD <= now - g_persisted_at) {
+        g_persisted_at = now;
+        if (!settings::set(Key::FilterLife, state))
+            LOG_DEFERRED("WARN - fan - failed to persist filter life\n");
+    }
+    g_running = running;
+}
 
-    mk_timer("fan-policy", 1.s / FAN_POLICY_UPDATE_RATE_HZ)([](auto*) {
-        static auto g_instance = g_fan_policy.instance();
-        if (g_fan_power_override != BLE::NOT_KNOWN) return;
+// PRECONDITION: called by only the timer task
+void policy_update() {
+    // private copy, the curve is too big to be written atomically
+    static FanPolicyEnvironmental g_params;
+    static auto g_instance = g_params.instance();
+
+    taskENTER_CRITICAL();
+    g_params = g_fan_policy;
+    taskEXIT_CRITICAL();
+
+    fan_pwm_update();
+    // before the policy, overrides cleared by these are back under automatic control this round
+    fan_power_overrides_apply();
+
+    auto const now = chrono::system_clock::now();
+    filter_life_update(now);  // before the policy changes the fans, they've been running as-is until now
+    g_hints.drain([&](auto const& x) { g_instance.hint(x, now); });
+    auto const sensors = nevermore::sensors::snapshot_stamped();
+    auto const now_us = time_us_64();
+    g_policy = g_instance(sensors.fresh(now_us, SENSOR_STALE_AFTER), now);
+
+    // cooldown/spin-up ending (or a reading going stale) won't come with a sensor update, wake ourselves up
+    auto deadline = g_instance.deadline(now);
+    if (auto const stale_at = sensors.stale_at(now_us, SENSOR_STALE_AFTER); stale_at != UINT64_MAX) {
+        auto const stale_in = chrono::microseconds(int64_t(stale_at - now_us));
+        deadline = min(deadline, now + chrono::ceil<chrono::system_clock::duration>(stale_in));
+    }
+    if (deadline != chrono::system_clock::time_point::max()) {
+        auto const ticks = to_ticks(chrono::ceil<chrono::microseconds>(deadline - now));
+        xTimerChangePeriod(g_policy_timer, max<TickType_t>(ticks, 1), 0);
+    }
+
+    // RPM control picks up the new policy on its next tick, don't disturb its cadence
+    if (!xTimerIsTimerActive(g_control_timer)) fan_apply();
 
-        fan_power_set(g_instance(nevermore::sensors::g_sensors) * 100);
+    // Idle & clean (as far as the policy's concerned) -> sensors may slow down until something changes.
+    bool const running = 0 < g_policy || ranges::any_of(g_channels, [](auto& x) {
+        return x.power_override != BLE::NOT_KNOWN && 0 < x.power_override;
     });
+    nevermore::sensors::sampling_demand(nevermore::sensors::SamplingDemand::Filtering, running);
+    nevermore::sensors::sampling_demand(nevermore::sensors::SamplingDemand::Printing, g_instance.printing());
+}
+
+}  // namespace
+
+BLE::Percentage8 fan_power() {
+    BLE::Percentage8 const power = g_primary.power;
+    return power == BLE::NOT_KNOWN ? BLE::Percentage8::from_raw(0) : power;
+}
+
+void fan_power_override(BLE::Percentage8 power) {
+    fan_power_override_post({.channel = ChannelOverride::ALL, .power_override = power});
+}
+
+BLE::Percentage8 fan_power_override() {
+    return g_primary.power_override;
+}
+
+float filter_life_remaining() {
+    taskENTER_CRITICAL();
+    auto const x = g_filter_life;
+    taskEXIT_CRITICAL();
+    return x.remaining();
+}
+
+bool init() {
+    auto load = [](Key key, auto& dst) {
+        if (auto x = settings::get<remove_reference_t<decltype(dst)>>(key)) dst = *x;
+    };
+    load(Key::FanPolicyCooldown, g_fan_policy.cooldown);
+    load(Key::FanPolicyVocPassiveMax, g_fan_policy.voc_passive_max);
+    load(Key::FanPolicyVocImproveMin, g_fan_policy.voc_improve_min);
+    load(Key::FanPolicyCurve, g_fan_policy.curve);
+    if (!g_fan_policy.curve.valid()) g_fan_policy.curve = FanPolicyEnvironmental{}.curve;
+    load(Key::FanPolicyVocTrend, g_fan_policy.voc_trend);
+    if (!g_fan_policy.voc_trend.valid()) g_fan_policy.voc_trend = {};
+    load(Key::FanPolicyPrint, g_fan_policy.print);
+    if (!g_fan_policy.print.valid()) g_fan_policy.print = {};
+    load(Key::FanRpmTarget, g_fan_rpm_target);
+    load(Key::FanRpmGains, g_fan_rpm_gains);
+    if (!g_fan_rpm_gains.valid()) g_fan_rpm_gains = FAN_RPM_GAINS_DEFAULT;
+    load(Key::FilterLife, g_filter_life.state);
+    if (!g_filter_life.state.valid()) g_filter_life = {};
+    load(Key::FanFaultPower, g_fan_fault_power);
+    FanRampWire ramp{g_fan_ramp};  // keeps the default if nothing's persisted
+    load(Key::FanRamp, ramp);
+    g_fan_ramp = ramp.unpack();
+    if (!g_fan_ramp.valid()) g_fan_ramp = {};
+    load(Key::FanPwmHz, g_fan_pwm_hz);
+    if (!fan_pwm_hz_valid(g_fan_pwm_hz)) g_fan_pwm_hz = FAN_PWM_HZ_DEFAULT;
+
+    // setup PWM configuration for fan PWM (tachometer is GPIO IRQ driven)
+    // Fans can share a slice, re-initing it w/ the same config is harmless.
+    auto cfg_pwm = pwm_get_default_config();
+    pwm_config_set_freq_hz(cfg_pwm, g_fan_pwm_hz);
+    g_fan_pwm_hz_applied = g_fan_pwm_hz;
+    for (auto& channel : g_channels)
+        pwm_init(pwm_gpio_to_slice_num_(channel.pins.pwm), &cfg_pwm, true);
+
+    for (auto& channel : g_channels) {
+        pwm_set_gpio_duty(channel.pins.pwm, 0);  // start off, the policy takes it from here
+        pwm_ramp_init(channel.pins.pwm);         // failing that, power changes step instead
+
+        // can't capture in a plain fn ptr; any channel's tachometer changing is worth both notifications
+        channel.tachometer.observe([]() {
+            g_notify_aggregate.notify();
+            g_notify_channels.notify();
+        });
+        channel.tachometer.start();
+    }
+
+    // created stopped, `fan_apply` starts it once there's something to control
+    g_control_timer = xTimerCreate("fan-rpm", to_ticks_safe(FAN_RPM_CONTROL_PERIOD), pdTRUE, nullptr,
+            [](TimerHandle_t) { fan_apply(); });
+    // created stopped, `fan_apply` starts it while any fan's powered
+    g_health_timer = xTimerCreate("fan-health", to_ticks_safe(FAN_HEALTH_PERIOD), pdTRUE, nullptr,
+            [](TimerHandle_t) { health_update(); });
+    // one-shot, starts immediately to evaluate the initial state
+    g_policy_timer = mk_timer("fan-policy", TICK_PERIOD, true)([](auto*) { policy_update(); });
+    if (!g_control_timer || !g_health_timer || !g_policy_timer) {
+        printf("ERR - fan - failed to create timers\n");
+        return false;
+    }
+
+    nevermore::sensors::observe(poke);
 
     return true;
 }
 
 void disconnected(hci_con_handle_t conn) {
     g_notify_aggregate.unregister(conn);
+    g_notify_channels.unregister(conn);
+    g_notify_health.unregister(conn);
 }
 
 optional<uint16_t> attr_read(
@@ -133,40 +641,181 @@ optional<uint16_t> attr_read(
         USER_DESCRIBE(FAN_POWER_OVERRIDE, "Fan % - Override")
         USER_DESCRIBE(TACHOMETER, "Fan RPM")
         USER_DESCRIBE(FAN_AGGREGATE, "Aggregated Service Data")
+        USER_DESCRIBE(FAN_RPM_TARGET, "Fan RPM - Target (0 -> control fan % directly)")
+        USER_DESCRIBE(FAN_RPM_GAINS, "Fan RPM - PID Gains (Kp, Ki, Kd)")
+        USER_DESCRIBE(FAN_CHANNELS, "Fan Channels - Aggregated Service Data")
+        USER_DESCRIBE(FILTER_LIFE, "Filter Life (write capacity to reset for a new filter, 0 -> default)")
+        USER_DESCRIBE(FAN_HEALTH, "Fan Health - fault power & fault per fan")
+        USER_DESCRIBE(FAN_RAMP, "Fan % ramp - full scale ms (0 -> step) & shape")
+        USER_DESCRIBE(FAN_PWM, "Fan PWM - Hz (write), actual Hz & duty steps")
 
         USER_DESCRIBE(FAN_POLICY_COOLDOWN, "How long to continue filtering after conditions are acceptable")
         USER_DESCRIBE(FAN_POLICY_VOC_PASSIVE_MAX, "Filter if any VOC sensor reaches this threshold")
         USER_DESCRIBE(FAN_POLICY_VOC_IMPROVE_MIN, "Filter if intake exceeds exhaust by this threshold")
+        USER_DESCRIBE(FAN_POLICY_CURVE, "Fan % while filtering, by VOC index")
+        USER_DESCRIBE(FAN_POLICY_VOC_TREND, "Filter if intake VOC is trending towards the threshold")
+        USER_DESCRIBE(FAN_POLICY_PRINT, "Fan % floor & post-print scrub time for hinted prints")
+        USER_DESCRIBE(FAN_POLICY_PRINT_HINT, "Print lifecycle hint from the host")
 
-        READ_VALUE(FAN_POWER, g_fan_power)
-        READ_VALUE(FAN_POWER_OVERRIDE, g_fan_power_override)
+        READ_VALUE(FAN_POWER, g_primary.power)
+        READ_VALUE(FAN_POWER_OVERRIDE, g_primary.power_override)
         READ_VALUE(TACHOMETER, Aggregate{}.tachometer)
-        READ_VALUE(FAN_AGGREGATE, Aggregate{});  // default init populate from global state
+        READ_VALUE(FAN_AGGREGATE, Aggregate{});  // default init populate from primary channel
+        READ_VALUE(FAN_RPM_TARGET, g_fan_rpm_target)
+        READ_VALUE(FAN_RPM_GAINS, g_fan_rpm_gains)
+        READ_VALUE(FAN_CHANNELS, channels_aggregate())
+        READ_VALUE(FILTER_LIFE, filter_life_status())
+        READ_VALUE(FAN_HEALTH, health_status())
+        READ_VALUE(FAN_RAMP, FanRampWire(g_fan_ramp))  // only written by BTstack
+        READ_VALUE(FAN_PWM, PwmStatusWire(pwm_status()))
 
         READ_VALUE(FAN_POLICY_COOLDOWN, g_fan_policy.cooldown)
         READ_VALUE(FAN_POLICY_VOC_PASSIVE_MAX, g_fan_policy.voc_passive_max)
         READ_VALUE(FAN_POLICY_VOC_IMPROVE_MIN, g_fan_policy.voc_improve_min)
+        READ_VALUE(FAN_POLICY_CURVE, g_fan_policy.curve)
+        READ_VALUE(FAN_POLICY_VOC_TREND, g_fan_policy.voc_trend)
+        READ_VALUE(FAN_POLICY_PRINT, g_fan_policy.print)
 
         READ_CLIENT_CFG(FAN_AGGREGATE, g_notify_aggregate)
+        READ_CLIENT_CFG(FAN_CHANNELS, g_notify_channels)
+        READ_CLIENT_CFG(FAN_HEALTH, g_notify_health)
 
     default: return {};
     }
 }
 
-optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t const* buffer,
+namespace {
+
+optional<int> attr_write_(hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t const* buffer,
         uint16_t buffer_size) {
     if (buffer_size < offset) return ATT_ERROR_INVALID_OFFSET;
     WriteConsumer consume{offset, buffer, buffer_size};
 
     switch (att_handle) {
-        WRITE_VALUE(FAN_POLICY_COOLDOWN, g_fan_policy.cooldown)
-        WRITE_VALUE(FAN_POLICY_VOC_PASSIVE_MAX, g_fan_policy.voc_passive_max)
-        WRITE_VALUE(FAN_POLICY_VOC_IMPROVE_MIN, g_fan_policy.voc_improve_min)
+        WRITE_VALUE_PERSISTED(FAN_POLICY_COOLDOWN, Key::FanPolicyCooldown, g_fan_policy.cooldown)
+        WRITE_VALUE_PERSISTED(
+                FAN_POLICY_VOC_PASSIVE_MAX, Key::FanPolicyVocPassiveMax, g_fan_policy.voc_passive_max)
+        WRITE_VALUE_PERSISTED(
+                FAN_POLICY_VOC_IMPROVE_MIN, Key::FanPolicyVocImproveMin, g_fan_policy.voc_improve_min)
 
         WRITE_CLIENT_CFG(FAN_AGGREGATE, g_notify_aggregate)
+        WRITE_CLIENT_CFG(FAN_CHANNELS, g_notify_channels)
+        WRITE_CLIENT_CFG(FAN_HEALTH, g_notify_health)
 
     case HANDLE_ATTR(FAN_POWER_OVERRIDE, VALUE): {
-        fan_power_override((BLE::Percentage8)consume);
+        BLE::Percentage8 const power = consume;
+        if (!fan_power_override_post({.channel = ChannelOverride::ALL, .power_override = power}))
+            return ATT_ERROR_INSUFFICIENT_RESOURCES;
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_CHANNELS, VALUE): {
+        auto const value = consume.exactly<ChannelOverride>();
+        if (g_channels.size() <= value.channel) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        if (!fan_power_override_post(value)) return ATT_ERROR_INSUFFICIENT_RESOURCES;
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_RPM_TARGET, VALUE): {
+        auto const target = consume.exactly<RPM16>();
+        taskENTER_CRITICAL();
+        g_fan_rpm_target = target;
+        taskEXIT_CRITICAL();
+        persist(Key::FanRpmTarget, target);
+        return 0;
+    }
+
+    // new filter installed
+    case HANDLE_ATTR(FILTER_LIFE, VALUE): {
+        auto capacity = consume.exactly<uint32_t>();
+        if (capacity == 0) capacity = FilterLife::CAPACITY_DEFAULT;
+        FilterLife const fresh{.state = {.capacity = capacity}};
+
+        taskENTER_CRITICAL();
+        g_filter_life = fresh;
+        taskEXIT_CRITICAL();
+        persist(Key::FilterLife, fresh.state);
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_HEALTH, VALUE): {
+        auto const power = consume.exactly<BLE::Percentage8>();
+        g_fan_fault_power = power;  // single octet, applied by the policy run `attr_write` pokes
+        persist(Key::FanFaultPower, power);
+        g_notify_health.notify();
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_RAMP, VALUE): {
+        auto const ramp = consume.exactly<FanRampWire>().unpack();
+        if (!ramp.valid()) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        taskENTER_CRITICAL();
+        g_fan_ramp = ramp;
+        taskEXIT_CRITICAL();
+        persist(Key::FanRamp, FanRampWire(ramp));
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_PWM, VALUE): {
+        auto const hz = consume.exactly<uint32_t>();
+        if (!fan_pwm_hz_valid(hz)) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        g_fan_pwm_hz = hz;  // applied by the policy run `attr_write` pokes
+        persist(Key::FanPwmHz, hz);
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_POLICY_CURVE, VALUE): {
+        auto const curve = consume.exactly<FanPolicyEnvironmental::Curve>();
+        if (!curve.valid()) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        taskENTER_CRITICAL();
+        g_fan_policy.curve = curve;
+        taskEXIT_CRITICAL();
+        persist(Key::FanPolicyCurve, curve);
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_POLICY_VOC_TREND, VALUE): {
+        auto const trend = consume.exactly<FanPolicyEnvironmental::Trend>();
+        if (!trend.valid()) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        taskENTER_CRITICAL();
+        g_fan_policy.voc_trend = trend;
+        taskEXIT_CRITICAL();
+        persist(Key::FanPolicyVocTrend, trend);
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_POLICY_PRINT, VALUE): {
+        auto const print = consume.exactly<FanPolicyEnvironmental::Print>();
+        if (!print.valid()) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        taskENTER_CRITICAL();
+        g_fan_policy.print = print;
+        taskEXIT_CRITICAL();
+        persist(Key::FanPolicyPrint, print);
+        return 0;
+    }
+
+    case HANDLE_ATTR(FAN_POLICY_PRINT_HINT, VALUE): {
+        auto const hint = consume.exactly<FanPolicyEnvironmental::Hint>();
+        if (!hint.valid()) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        if (!g_hints.post(hint)) return ATT_ERROR_INSUFFICIENT_RESOURCES;
+        return 0;  // applied by the policy run `attr_write` pokes
+    }
+
+    case HANDLE_ATTR(FAN_RPM_GAINS, VALUE): {
+        auto const gains = consume.exactly<PID::Gains>();
+        if (!gains.valid()) throw AttrWriteException(ATT_ERROR_VALUE_NOT_ALLOWED);
+
+        taskENTER_CRITICAL();
+        g_fan_rpm_gains = gains;
+        taskEXIT_CRITICAL();
+        persist(Key::FanRpmGains, gains);
         return 0;
     }
 
@@ -174,4 +823,37 @@ optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t of
     }
 }
 
+}  // namespace
+
+optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t const* buffer,
+        uint16_t buffer_size) {
+    auto const result = attr_write_(conn, att_handle, offset, buffer, buffer_size);
+    if (result == 0) poke();  // any setting might've changed the policy's output
+    return result;
+}
+
+bool attr_write_valid(uint16_t att_handle, span<uint8_t const> value) {
+    WriteConsumer consume{0, value.data(), uint16_t(value.size())};
+    try {
+        switch (att_handle) {
+        case HANDLE_ATTR(FAN_CHANNELS, VALUE):
+            return consume.exactly<ChannelOverride>().channel < g_channels.size();
+        case HANDLE_ATTR(FAN_RAMP, VALUE): return consume.exactly<FanRampWire>().unpack().valid();
+        case HANDLE_ATTR(FAN_PWM, VALUE): return fan_pwm_hz_valid(consume.exactly<uint32_t>());
+        case HANDLE_ATTR(FAN_POLICY_CURVE, VALUE):
+            return consume.exactly<FanPolicyEnvironmental::Curve>().valid();
+        case HANDLE_ATTR(FAN_POLICY_VOC_TREND, VALUE):
+            return consume.exactly<FanPolicyEnvironmental::Trend>().valid();
+        case HANDLE_ATTR(FAN_POLICY_PRINT, VALUE):
+            return consume.exactly<FanPolicyEnvironmental::Print>().valid();
+        case HANDLE_ATTR(FAN_POLICY_PRINT_HINT, VALUE):
+            return consume.exactly<FanPolicyEnvironmental::Hint>().valid();
+        case HANDLE_ATTR(FAN_RPM_GAINS, VALUE): return consume.exactly<PID::Gains>().valid();
+        default: return true;
+        }
+    } catch (AttrWriteException const&) {
+        return false;
+    }
+}
+
 }  // namespace nevermore::gatt::fan
@@ -4,6 +4,29 @@
 #include "sdk/ble_data_types.hpp"
 #include <cstdint>
 #include <optional>
+#include <span>
+
+// Characteristic aliases, also used by services forwarding writes to ours (i.e. the command batch).
+#define FAN_POWER 2B04_01
+#define FAN_POWER_OVERRIDE 2B04_02
+#define TACHOMETER 03f61fe0_9fe7_4516_98e6_056de551687f_01
+// 2nd aggregation char instance in the DB, checked against the service below
+#define FAN_AGGREGATE 75134bec_dd06_49b1_bac2_c15e05fd7199_02
+#define FAN_RPM_TARGET 03c52c19_588b_4ac8_b963_be8177b10971_01
+#define FAN_RPM_GAINS 2f1c7b0e_5a3d_4e8b_b6f9_71d0c4a2e853_01
+#define FAN_CHANNELS b3e7a1c4_2d6f_4f0a_8c51_9e4d7b2a6f13_01
+#define FILTER_LIFE b3bcb7eb_d401_416f_9b1a_8e7ae9bee492_01
+#define FAN_HEALTH a7c53e19_6d2b_4f80_9e4a_3b1f8c0d52e7_01
+#define FAN_RAMP 4e9a2c17_8b3d_4f61_a0c5_d27e8f1b6a39_01
+#define FAN_PWM c6f2a9d4_1e7b_4a35_8c02_9b5d3e7f1a68_01
+
+#define FAN_POLICY_COOLDOWN 2B16_01
+#define FAN_POLICY_VOC_PASSIVE_MAX 216aa791_97d0_46ac_8752_60bbc00611e1_03
+#define FAN_POLICY_VOC_IMPROVE_MIN 216aa791_97d0_46ac_8752_60bbc00611e1_04
+#define FAN_POLICY_CURVE 5c6a2e91_7f3b_4d08_a1e4_8b6d2f9c0a37_01
+#define FAN_POLICY_VOC_TREND 9a4f0d27_3c81_4b6e_8f52_e1d7a06b3c94_01
+#define FAN_POLICY_PRINT 7b9bb0c2_1af0_42f2_a31e_30278ffc5f05_01
+#define FAN_POLICY_PRINT_HINT fd8fb287_cb14_4bd2_995b_ab52db50600e_01
 
 namespace nevermore::gatt::fan {
 
@@ -13,13 +36,21 @@ std::optional<uint16_t> attr_read(
 std::optional<int> attr_write(
         hci_con_handle_t, uint16_t att_handle, uint16_t offset, uint8_t const* buffer, uint16_t buffer_size);
 
+// Whether `attr_write` would accept `value` for `att_handle`, w/o applying anything. Only checks the value,
+// applying can still fail (e.g. out of resources). Lets a command batch check every item before applying any.
+bool attr_write_valid(uint16_t att_handle, std::span<uint8_t const> value);
+
 bool init();
 void disconnected(hci_con_handle_t);
 
-// Current fan power. [0, 100]
-double fan_power();
+// Current fan power. [0, 100], never `NOT_KNOWN`
+BLE::Percentage8 fan_power();
 
-void fan_power_override(BLE::Percentage8 power);  // `NOT_KNOWN` to clear override
+// `NOT_KNOWN` to clear override. Any task, returns immediately & is applied by the fan policy's next run.
+void fan_power_override(BLE::Percentage8 power);
 BLE::Percentage8 fan_power_override();
 
+// Estimated fraction of the carbon filter's life left, [0, 1]. Any task.
+float filter_life_remaining();
+
 }  // namespace nevermore::gatt::fan
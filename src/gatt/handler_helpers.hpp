@@ -4,12 +4,18 @@
 #include "bluetooth.h"
 #include "btstack_config.h"
 #include "btstack_defines.h"
+#include "btstack_run_loop.h"
+#include "connection.hpp"
 #include "hci.h"
 #include "sdk/btstack.hpp"  // IWYU pragma: keep [doesn't find overloads]
+#include "settings.hpp"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <initializer_list>
 #include <span>
 #include <type_traits>
 
@@ -21,6 +27,10 @@ constexpr uint16_t GATT_CLIENT_CFG_NOTIFY_FLAG = 0b0000'0001;
 #define HANDLE_ATTR_(attr, kind) ATT_CHARACTERISTIC_##attr##_##kind##_HANDLE
 #define HANDLE_ATTR(attr, kind) HANDLE_ATTR_(attr, kind)
 
+// Pasted directly, SIG names (e.g. `ORG_BLUETOOTH_SERVICE_ENVIRONMENTAL_SENSING`) are macros themselves.
+#define HANDLE_SERVICE(service) \
+    ::nevermore::gatt::HandleRange{ATT_SERVICE_##service##_START_HANDLE, ATT_SERVICE_##service##_END_HANDLE}
+
 #define HANDLE_READ_BLOB(attr, kind, expr) \
     case HANDLE_ATTR(attr, kind): return att_read_callback_handle_blob(expr, offset, buffer, buffer_size);
 #define HANDLE_WRITE_EXPR(attr, kind, expr) \
@@ -36,6 +46,40 @@ constexpr uint16_t GATT_CLIENT_CFG_NOTIFY_FLAG = 0b0000'0001;
     HANDLE_WRITE_EXPR(attr, CLIENT_CONFIGURATION, handler.client_configuration(conn, consume))
 #define WRITE_VALUE(attr, dst) \
     case HANDLE_ATTR(attr, VALUE): dst = consume.exactly<decltype(dst)>(); return 0;
+#define WRITE_VALUE_PERSISTED(attr, key, dst) \
+    case HANDLE_ATTR(attr, VALUE): dst = consume.exactly<decltype(dst)>(); persist(key, dst); return 0;
+
+// A service's slice of the ATT DB, both ends inclusive.
+struct HandleRange {
+    uint16_t begin;
+    uint16_t end;
+
+    [[nodiscard]] constexpr bool contains(uint16_t handle) const {
+        return begin <= handle && handle <= end;
+    }
+};
+
+// Handles come from `nevermore.h`, which BTstack generates from `nevermore.gatt`. A UUID w/ several
+// instances in the DB is only told apart by position (e.g. `2B04_02` is the 2nd `2B04`), so reordering the
+// DB silently points an alias at someone else's characteristic. Modules check every handle they serve
+// against the service they serve it from, listed in `nevermore.gatt` order, making that a build error. So is
+// a handle claimed twice, or two aliases swapped (e.g. `FAN_POWER`/`FAN_POWER_OVERRIDE` as `2B04_02`/`_01`).
+// NB: Moving a characteristic past another of the same UUID still needs its aliases updating by hand.
+[[nodiscard]] constexpr bool handles_within(HandleRange service, std::initializer_list<uint16_t> handles) {
+    if (service.end < service.begin) return false;
+
+    for (auto const* it = handles.begin(); it != handles.end(); ++it) {
+        if (!service.contains(*it)) return false;
+        if (it != handles.begin() && *it <= *(it - 1)) return false;  // out of DB order, or listed twice
+    }
+    return true;
+}
+
+// Not worth failing the write over, the value still applies until the next reboot.
+template <typename A>
+void persist(settings::Key key, A const& value) {
+    if (!settings::set(key, value)) printf("WARN - BLE GATT - failed to persist setting %u\n", unsigned(key));
+}
 
 struct AttrWriteException {
     int error;
@@ -96,7 +140,14 @@ private:
     }
 };
 
-template <void (*Handler)(hci_con_handle_t)>
+// `Prepare` (optional) runs once per `notify()`, on the BTstack run loop, before any `Handler` for it.
+// Lets a payload shared by every subscriber be built once per change instead of once per connection.
+// `att_server_notify` copies the payload out immediately, so `Handler` can send straight from it.
+//
+// `notify()` is throttled per connection to `connection::notify_interval`. Changes within a connection's
+// interval are folded into one notification at the end of it, & `Handler` builds it when it's sent, so
+// it's always the latest state. A slow central only ever has 1 notification of ours queued.
+template <void (*Handler)(hci_con_handle_t), void (*Prepare)() = nullptr>
 struct NotifyState {
     static_assert(Handler != nullptr);
     std::array<btstack_context_callback_registration_t, MAX_NR_HCI_CONNECTIONS> callbacks{};
@@ -106,8 +157,32 @@ struct NotifyState {
             cb.callback = [](void* ctx) { Handler(hci_con_handle_t(uintptr_t(ctx))); };
             cb.context = reinterpret_cast<void*>(HCI_CON_HANDLE_INVALID);
         }
+
+        for (auto& x : throttles) {
+            btstack_run_loop_set_timer_handler(&x.timer, [](btstack_timer_source_t* timer) {
+                auto& self = *static_cast<NotifyState*>(btstack_run_loop_get_timer_context(timer));
+                for (size_t i = 0; i < self.throttles.size(); ++i) {
+                    if (&self.throttles.at(i).timer != timer) continue;
+
+                    self.throttles.at(i).deferred = false;
+                    self.request(i, btstack_run_loop_get_time_ms());
+                }
+            });
+            btstack_run_loop_set_timer_context(&x.timer, this);
+        }
+
+        deferred.callback = [](void* self_) {
+            auto& self = *static_cast<NotifyState*>(self_);
+            self.deferred_pending.store(false, std::memory_order_release);
+            self.notify_all();
+        };
+        deferred.context = this;
     }
 
+    // Pinned in place: `deferred` points back at us.
+    NotifyState(NotifyState const&) = delete;
+    NotifyState& operator=(NotifyState const&) = delete;
+
     [[nodiscard]] bool registered(hci_con_handle_t conn) const {
         return std::ranges::any_of(callbacks, [&](auto&& cb) { return conn == uintptr_t(cb.context); });
     }
@@ -130,23 +205,36 @@ struct NotifyState {
         assert(hci_connection && "should still have HCI info?");
         if (!hci_connection) return false;  // malformed handle?
 
-        for (auto& cb : callbacks) {
+        for (size_t i = 0; i < callbacks.size(); ++i) {
+            auto& cb = callbacks.at(i);
             if (conn != uintptr_t(cb.context)) continue;
 
             // remove any pending notification requests
             btstack_linked_list_remove(&hci_connection->att_server.notification_requests,
                     reinterpret_cast<btstack_linked_item_t*>(&cb));
-            cb.context = nullptr;  // unassign slot
+            auto& throttle = throttles.at(i);
+            if (throttle.deferred) btstack_run_loop_remove_timer(&throttle.timer);
+            throttle.deferred = false;
+            cb.context = reinterpret_cast<void*>(HCI_CON_HANDLE_INVALID);  // unassign slot
             return true;
         }
 
         return false;
     }
 
+    // Safe to call from any task. BTstack isn't thread safe, so the request is made from its run loop.
+    // Repeated calls before that happens are coalesced.
     void notify() {
+        if (deferred_pending.exchange(true, std::memory_order_acq_rel)) return;  // already queued
+
+        btstack_run_loop_execute_on_main_thread(&deferred);
+    }
+
+    // Only notify `conn`, if registered. Safe to call from within `Handler` to queue another notification.
+    // Not throttled, it's for a stream the client asked for (e.g. a download), not for state changes.
+    void notify(hci_con_handle_t conn) {
         for (auto&& cb : callbacks)
-            if (uintptr_t(cb.context) != HCI_CON_HANDLE_INVALID)
-                att_server_request_to_send_notification(&cb, hci_con_handle_t(uintptr_t(cb.context)));
+            if (conn == uintptr_t(cb.context)) att_server_request_to_send_notification(&cb, conn);
     }
 
     [[nodiscard]] uint16_t client_configuration(hci_con_handle_t conn) const {
@@ -164,6 +252,61 @@ struct NotifyState {
 
         return 0;
     }
+
+private:
+    // Per slot in `callbacks`. Only touched from the BTstack run loop.
+    struct Throttle {
+        btstack_timer_source_t timer{};
+        uint32_t requested_at = 0;  // `btstack_run_loop_get_time_ms`, wrapping is harmless
+        bool requested = false;     // ever, so the first notification is never held back
+        bool deferred = false;      // `timer` is armed
+    };
+
+    btstack_context_callback_registration_t deferred{};
+    std::atomic<bool> deferred_pending = false;
+    std::array<Throttle, MAX_NR_HCI_CONNECTIONS> throttles{};
+
+    void request(size_t i, uint32_t now) {
+        auto& cb = callbacks.at(i);
+        auto const conn = hci_con_handle_t(uintptr_t(cb.context));
+        if (conn == HCI_CON_HANDLE_INVALID) return;
+
+        auto& throttle = throttles.at(i);
+        throttle.requested_at = now;
+        throttle.requested = true;
+        att_server_request_to_send_notification(&cb, conn);
+    }
+
+    void notify_all() {
+        if constexpr (Prepare != nullptr) {
+            if (!std::ranges::any_of(callbacks, [](auto&& cb) {
+                    return uintptr_t(cb.context) != HCI_CON_HANDLE_INVALID;
+                }))
+                return;  // nobody to tell, don't bother building it
+
+            Prepare();
+        }
+
+        auto const now = btstack_run_loop_get_time_ms();
+        for (size_t i = 0; i < callbacks.size(); ++i) {
+            auto const conn = hci_con_handle_t(uintptr_t(callbacks.at(i).context));
+            if (conn == HCI_CON_HANDLE_INVALID) continue;
+
+            auto& throttle = throttles.at(i);
+            if (throttle.deferred) continue;  // already coming, & it'll carry this change too
+
+            auto const interval = uint32_t(connection::notify_interval(conn).count());
+            auto const since = now - throttle.requested_at;
+            if (!throttle.requested || interval <= since) {
+                request(i, now);
+                continue;
+            }
+
+            throttle.deferred = true;
+            btstack_run_loop_set_timer(&throttle.timer, interval - since);
+            btstack_run_loop_add_timer(&throttle.timer);
+        }
+    }
 };
 
 }  // namespace nevermore::gatt
@@ -0,0 +1,547 @@
+#include "relay.hpp"
+#include "ble/gatt_client.h"
+#include "bluetooth_gatt.h"
+#include "btstack_event.h"
+#include "btstack_run_loop.h"
+#include "gap.h"
+#include "handler_helpers.hpp"
+#include "nevermore.h"
+#include "sdk/ble_data_types.hpp"
+#include "sdk/gap.hpp"
+#include "sensors.hpp"
+#include "settings.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+
+using namespace std;
+
+// Relay mode: we connect out (as a central) to an allow-list of other controllers, subscribe to their env &
+// fan aggregates, & fold those into one notification. A host watching a whole rack then needs 1 connection
+// instead of 1 per controller. Off while the list is empty.
+//
+// Peers are plain controllers, nothing changes on their end. Only a peer's own state is relayed, never what
+// it relays itself, so relays listing each other can't loop.
+//
+// Everything here is only touched from the BTstack run loop.
+
+namespace nevermore::gatt::relay {
+
+static_assert(handles_within(HANDLE_SERVICE(8d2f6b1a_43c9_4e7d_a05b_6c1e9f3a7d24),
+        {HANDLE_ATTR(RELAY_PEERS_01, VALUE), HANDLE_ATTR(RELAY_AGGREGATE_01, VALUE)}));
+static_assert(RELAY_PEERS_MAX <= MAX_NR_GATT_CLIENTS);
+static_assert(RELAY_PEERS_MAX < MAX_NR_HCI_CONNECTIONS, "leave a connection for the host");
+
+namespace {
+
+using settings::Key;
+
+// Only scanning while a listed peer isn't connected.
+constexpr auto SCAN_INTERVAL = 200ms;
+constexpr auto SCAN_WINDOW = 50ms;
+// The peer went away between its advert & our connection request.
+constexpr auto CONNECT_TIMEOUT = 5s;
+// A peer that failed to connect or set up is left alone this long. Keeps one that always refuses (e.g. it's
+// out of connection slots, or isn't a controller at all) from hogging the radio.
+constexpr auto RETRY_BACKOFF = 30s;
+
+// 128 bit UUIDs, big endian (as BTstack takes them)
+constexpr array<uint8_t, 16> UUID_SERVICE_FAN{
+        0x45, 0x53, 0xd1, 0x38, 0x1d, 0x00, 0x4b, 0x6f, 0xbc, 0x42, 0x95, 0x5a, 0x89, 0xcf, 0x8c, 0x36};
+constexpr array<uint8_t, 16> UUID_CHAR_AGGREGATE{
+        0x75, 0x13, 0x4b, 0xec, 0xdd, 0x06, 0x49, 0xb1, 0xba, 0xc2, 0xc1, 0x5e, 0x05, 0xfd, 0x71, 0x99};
+
+// In `bd_addr_t` order (as printed). All zero -> unused.
+using Address = array<uint8_t, BD_ADDR_LEN>;
+using Peers = array<Address, RELAY_PEERS_MAX>;
+
+// A peer's fan service aggregate
+struct [[gnu::packed]] FanAggregate {
+    BLE::Percentage8 power;
+    BLE::Percentage8 power_override;
+    uint16_t rpm = 0;
+};
+
+enum class PeerState : uint8_t {
+    Searching = 0,   // waiting to see its advert
+    Connecting = 1,  // incl. discovery & subscribing
+    Connected = 2,   // aggregates are live
+};
+
+// [u8 index in the peer list, u8 state, `Sensors` (as the env aggregate), fan aggregate]
+struct [[gnu::packed]] PeerRecord {
+    uint8_t index = 0;
+    PeerState state = PeerState::Searching;
+    sensors::Sensors sensors;  // not-known until the peer's sent it
+    FanAggregate fan;
+};
+
+// Connection setup, 1 GATT query at a time, in this order.
+enum class Step : uint8_t {
+    ServiceEnvironmental,
+    CharEnvironmental,
+    ServiceFan,
+    CharFan,
+    SubscribeEnvironmental,
+    SubscribeFan,
+    ReadEnvironmental,  // notifications only come on change, start out w/ the current state
+    ReadFan,
+    Done,
+};
+
+struct Peer {
+    Address addr{};
+    hci_con_handle_t conn = HCI_CON_HANDLE_INVALID;
+    Step step = Step::Done;
+    uint32_t retry_at_ms = 0;  // `btstack_run_loop_get_time_ms`, wrapping is harmless
+    gatt_client_service_t service{};  // the one `step` is looking into
+    gatt_client_characteristic_t env{};
+    gatt_client_characteristic_t fan{};
+    gatt_client_notification_t env_listener{};
+    gatt_client_notification_t fan_listener{};
+    PeerRecord record;
+
+    [[nodiscard]] bool listed() const {
+        return addr != Address{};
+    }
+};
+
+array<Peer, RELAY_PEERS_MAX> g_peers;
+Peers g_peers_listed{};   // as written, for reads
+Peer* g_connecting = nullptr;  // BTstack only does 1 outgoing connection at a time
+btstack_timer_source_t g_connect_timer;
+bool g_scanning = false;
+
+btstack_packet_callback_registration_t g_hci_handler;
+
+struct Records {
+    array<PeerRecord, RELAY_PEERS_MAX> records;
+    size_t count = 0;
+
+    [[nodiscard]] uint8_t const* data() const {
+        return reinterpret_cast<uint8_t const*>(records.data());
+    }
+
+    [[nodiscard]] uint16_t size() const {
+        return uint16_t(count * sizeof(PeerRecord));
+    }
+};
+
+// Listed peers only, in list order.
+Records records() {
+    Records x;
+    for (auto const& peer : g_peers)
+        if (peer.listed()) x.records.at(x.count++) = peer.record;
+    return x;
+}
+
+Records g_notify_payload;  // built once per notification round, sent to every subscriber
+
+// Next record of `g_notify_payload` to send a connection. A payload longer than the connection's MTU allows
+// goes out as several notifications of whole records, each queueing the next. Reset by each new round.
+struct AggregateCursor {
+    hci_con_handle_t conn = HCI_CON_HANDLE_INVALID;
+    size_t next = 0;
+};
+
+array<AggregateCursor, MAX_NR_HCI_CONNECTIONS> g_notify_cursors;
+
+AggregateCursor* aggregate_cursor(hci_con_handle_t conn) {
+    auto* it = ranges::find(g_notify_cursors, conn, &AggregateCursor::conn);
+    return it == g_notify_cursors.end() ? nullptr : it;
+}
+
+void aggregate_send(hci_con_handle_t conn);
+
+// Chunks are chained, each send queues the next, so it's declared ahead of its handler.
+auto g_notify_aggregate = NotifyState<aggregate_send, []() {
+    g_notify_payload = records();
+    g_notify_cursors = {};
+}>();
+
+void aggregate_send(hci_con_handle_t conn) {
+    constexpr uint16_t ATT_NOTIFY_HEADER_SIZE = 3;  // opcode + attr handle
+
+    auto const& x = g_notify_payload;
+    auto* cursor = aggregate_cursor(conn);
+    auto const begin = cursor ? cursor->next : 0;
+    if (x.count <= begin) return;
+
+    auto const mtu = att_server_get_mtu(conn);
+    auto const fit = (mtu - ATT_NOTIFY_HEADER_SIZE) / sizeof(PeerRecord);
+    if (fit == 0) {
+        printf("WARN - relay - MTU %u is too small for a peer record, needs %u\n", unsigned(mtu),
+                unsigned(ATT_NOTIFY_HEADER_SIZE + sizeof(PeerRecord)));
+        return;
+    }
+
+    auto const end = min(x.count, begin + fit);
+    auto const* data = x.data() + begin * sizeof(PeerRecord);
+    if (::att_server_notify(conn, HANDLE_ATTR(RELAY_AGGREGATE_01, VALUE), data,
+                uint16_t((end - begin) * sizeof(PeerRecord))) != ERROR_CODE_SUCCESS)
+        return;  // the rest go out w/ the next round
+
+    if (end == x.count) {
+        if (cursor) *cursor = {};
+        return;
+    }
+
+    if (!cursor) cursor = aggregate_cursor(HCI_CON_HANDLE_INVALID);
+    assert(cursor && "should have a slot per connection");
+    if (!cursor) return;
+
+    *cursor = {.conn = conn, .next = end};
+    g_notify_aggregate.notify(conn);  // more to go
+}
+
+Peer* peer_by_conn(hci_con_handle_t conn) {
+    auto* it = ranges::find(g_peers, conn, &Peer::conn);
+    return it == g_peers.end() ? nullptr : it;
+}
+
+void scan_update() {
+    bool const wanted = !g_connecting && ranges::any_of(g_peers, [](Peer const& x) {
+        return x.listed() && x.conn == HCI_CON_HANDLE_INVALID;
+    });
+    if (wanted == g_scanning) return;
+
+    g_scanning = wanted;
+    if (wanted)
+        gap_start_scan();
+    else
+        gap_stop_scan();
+}
+
+void backoff(Peer& peer) {
+    peer.retry_at_ms = btstack_run_loop_get_time_ms() + uint32_t(chrono::milliseconds(RETRY_BACKOFF).count());
+}
+
+// Tears down the connection, `disconnected` resets the peer once it's gone.
+void fail(Peer& peer, char const* why) {
+    printf("WARN - relay - peer %s %s, retrying in %us\n", bd_addr_to_str(peer.addr.data()), why,
+            unsigned(chrono::seconds(RETRY_BACKOFF).count()));
+    backoff(peer);
+    gap_disconnect(peer.conn);
+}
+
+void gatt_handler(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size);
+
+void advance(Peer& peer) {
+    uint8_t err = ERROR_CODE_SUCCESS;
+    switch (peer.step) {
+    case Step::ServiceEnvironmental:
+        err = gatt_client_discover_primary_services_by_uuid16(
+                gatt_handler, peer.conn, ORG_BLUETOOTH_SERVICE_ENVIRONMENTAL_SENSING);
+        break;
+    case Step::ServiceFan:
+        err = gatt_client_discover_primary_services_by_uuid128(
+                gatt_handler, peer.conn, UUID_SERVICE_FAN.data());
+        break;
+    case Step::CharEnvironmental:
+    case Step::CharFan:
+        err = gatt_client_discover_characteristics_for_service_by_uuid128(
+                gatt_handler, peer.conn, &peer.service, UUID_CHAR_AGGREGATE.data());
+        break;
+    case Step::SubscribeEnvironmental:
+    case Step::SubscribeFan:
+        err = gatt_client_write_client_characteristic_configuration(gatt_handler, peer.conn,
+                peer.step == Step::SubscribeFan ? &peer.fan : &peer.env,
+                GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
+        break;
+    case Step::ReadEnvironmental:
+    case Step::ReadFan:
+        err = gatt_client_read_value_of_characteristic(
+                gatt_handler, peer.conn, peer.step == Step::ReadFan ? &peer.fan : &peer.env);
+        break;
+    case Step::Done: {
+        printf("relay - peer %s connected\n", bd_addr_to_str(peer.addr.data()));
+        peer.record.state = PeerState::Connected;
+        g_notify_aggregate.notify();
+        return;
+    }
+    }
+
+    if (err != ERROR_CODE_SUCCESS) fail(peer, "GATT query failed");
+}
+
+// Value of an aggregate, from a read or a notification.
+void received(Peer& peer, uint16_t value_handle, uint8_t const* value, uint16_t size) {
+    if (value_handle == peer.env.value_handle && size == sizeof(peer.record.sensors))
+        memcpy(&peer.record.sensors, value, size);
+    else if (value_handle == peer.fan.value_handle && size == sizeof(peer.record.fan))
+        memcpy(&peer.record.fan, value, size);
+    else
+        return;  // older/newer peer w/ another layout, don't relay garbage
+
+    g_notify_aggregate.notify();
+}
+
+// Query complete for `peer.step`, moves on to the next one.
+void completed(Peer& peer, uint8_t att_status) {
+    if (att_status != ATT_ERROR_SUCCESS) return fail(peer, "GATT query failed");
+
+    switch (peer.step) {
+    case Step::ServiceEnvironmental:
+    case Step::ServiceFan: {
+        if (peer.service.end_group_handle == 0) return fail(peer, "isn't a controller");
+    } break;
+    case Step::CharEnvironmental: {
+        if (peer.env.value_handle == 0) return fail(peer, "isn't a controller");
+        gatt_client_listen_for_characteristic_value_updates(
+                &peer.env_listener, gatt_handler, peer.conn, &peer.env);
+    } break;
+    case Step::CharFan: {
+        if (peer.fan.value_handle == 0) return fail(peer, "isn't a controller");
+        gatt_client_listen_for_characteristic_value_updates(
+                &peer.fan_listener, gatt_handler, peer.conn, &peer.fan);
+    } break;
+    default: break;
+    }
+
+    peer.service = {};
+    peer.step = Step(uint8_t(peer.step) + 1);
+    advance(peer);
+}
+
+void gatt_handler(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size) {
+    UNUSED(channel);
+    UNUSED(size);
+    if (packet_type != HCI_EVENT_PACKET) return;
+
+    switch (hci_event_packet_get_type(packet)) {
+    case GATT_EVENT_SERVICE_QUERY_RESULT: {
+        if (auto* peer = peer_by_conn(gatt_event_service_query_result_get_handle(packet)))
+            gatt_event_service_query_result_get_service(packet, &peer->service);
+    } break;
+
+    case GATT_EVENT_CHARACTERISTIC_QUERY_RESULT: {
+        if (auto* peer = peer_by_conn(gatt_event_characteristic_query_result_get_handle(packet)))
+            gatt_event_characteristic_query_result_get_characteristic(
+                    packet, peer->step == Step::CharFan ? &peer->fan : &peer->env);
+    } break;
+
+    case GATT_EVENT_CHARACTERISTIC_VALUE_QUERY_RESULT: {
+        if (auto* peer = peer_by_conn(gatt_event_characteristic_value_query_result_get_handle(packet)))
+            received(*peer, gatt_event_characteristic_value_query_result_get_value_handle(packet),
+                    gatt_event_characteristic_value_query_result_get_value(packet),
+                    gatt_event_characteristic_value_query_result_get_value_length(packet));
+    } break;
+
+    case GATT_EVENT_NOTIFICATION: {
+        if (auto* peer = peer_by_conn(gatt_event_notification_get_handle(packet)))
+            received(*peer, gatt_event_notification_get_value_handle(packet),
+                    gatt_event_notification_get_value(packet),
+                    gatt_event_notification_get_value_length(packet));
+    } break;
+
+    case GATT_EVENT_QUERY_COMPLETE: {
+        if (auto* peer = peer_by_conn(gatt_event_query_complete_get_handle(packet)))
+            completed(*peer, gatt_event_query_complete_get_att_status(packet));
+    } break;
+    }
+}
+
+void advertised(uint8_t const* packet) {
+    if (g_connecting) return;
+
+    Address addr;
+    gap_event_advertising_report_get_address(packet, addr.data());
+    auto* peer = ranges::find(g_peers, addr, &Peer::addr);
+    if (peer == g_peers.end() || peer->conn != HCI_CON_HANDLE_INVALID) return;
+    if (int32_t(btstack_run_loop_get_time_ms() - peer->retry_at_ms) < 0) return;  // backing off
+
+    g_connecting = peer;
+    scan_update();  // BTstack won't connect while scanning
+    auto const addr_type = bd_addr_type_t(gap_event_advertising_report_get_address_type(packet));
+    if (auto err = gap_connect(addr.data(), addr_type)) {
+        printf("WARN - relay - failed to connect to %s; err=0x%02x\n", bd_addr_to_str(addr.data()), int(err));
+        g_connecting = nullptr;
+        backoff(*peer);
+        scan_update();
+        return;
+    }
+
+    peer->record.state = PeerState::Connecting;
+    btstack_run_loop_set_timer(&g_connect_timer, chrono::milliseconds(CONNECT_TIMEOUT).count());
+    btstack_run_loop_add_timer(&g_connect_timer);
+    g_notify_aggregate.notify();
+}
+
+// Our outgoing connection request completed (or was cancelled).
+void connected(uint8_t const* packet) {
+    auto* peer = g_connecting;
+    if (!peer) return;
+
+    g_connecting = nullptr;
+    btstack_run_loop_remove_timer(&g_connect_timer);
+
+    auto const conn = hci_subevent_le_connection_complete_get_connection_handle(packet);
+    Address addr;
+    hci_subevent_le_connection_complete_get_peer_address(packet, addr.data());
+
+    if (hci_subevent_le_connection_complete_get_status(packet) != ERROR_CODE_SUCCESS) {
+        printf("WARN - relay - couldn't connect to %s\n", bd_addr_to_str(peer->addr.data()));
+        backoff(*peer);
+        peer->record.state = PeerState::Searching;
+        g_notify_aggregate.notify();
+    } else if (addr != peer->addr) {
+        gap_disconnect(conn);  // list changed while connecting, no longer wanted
+    } else {
+        peer->conn = conn;
+        peer->step = Step::ServiceEnvironmental;
+        advance(*peer);
+    }
+
+    scan_update();
+}
+
+void peer_disconnected(hci_con_handle_t conn) {
+    auto* peer = peer_by_conn(conn);
+    if (!peer) return;
+
+    printf("relay - peer %s disconnected\n", bd_addr_to_str(peer->addr.data()));
+    gatt_client_stop_listening_for_characteristic_value_updates(&peer->env_listener);
+    gatt_client_stop_listening_for_characteristic_value_updates(&peer->fan_listener);
+    auto const index = peer->record.index;
+    *peer = {.addr = peer->addr, .retry_at_ms = peer->retry_at_ms, .record = {.index = index}};
+    g_notify_aggregate.notify();
+    scan_update();
+}
+
+void hci_handler(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size) {
+    UNUSED(channel);
+    UNUSED(size);
+    if (packet_type != HCI_EVENT_PACKET) return;
+
+    switch (hci_event_packet_get_type(packet)) {
+    case GAP_EVENT_ADVERTISING_REPORT: advertised(packet); break;
+
+    case HCI_EVENT_LE_META: {
+        if (hci_event_le_meta_get_subevent_code(packet) != HCI_SUBEVENT_LE_CONNECTION_COMPLETE) break;
+        if (hci_subevent_le_connection_complete_get_role(packet) != HCI_ROLE_MASTER) break;  // a host
+        connected(packet);
+    } break;
+
+    case HCI_EVENT_DISCONNECTION_COMPLETE: {
+        peer_disconnected(hci_event_disconnection_complete_get_connection_handle(packet));
+    } break;
+    }
+}
+
+// No address listed twice, unused (all zero) slots aside.
+bool peers_valid(Peers const& peers) {
+    for (auto it = peers.begin(); it != peers.end(); ++it)
+        if (*it != Address{} && find(peers.begin(), it, *it) != it) return false;
+
+    return true;
+}
+
+void peers_apply(Peers const& peers) {
+    auto const now = btstack_run_loop_get_time_ms();
+    for (size_t i = 0; i < g_peers.size(); ++i) {
+        auto& peer = g_peers.at(i);
+        if (peer.addr == peers.at(i)) continue;
+
+        if (peer.conn != HCI_CON_HANDLE_INVALID) gap_disconnect(peer.conn);
+        if (g_connecting == &peer) gap_connect_cancel();
+        // a connection to the old address still in flight is torn down/cancelled & then forgotten
+        peer.addr = peers.at(i);
+        peer.retry_at_ms = now;
+        peer.record = {.index = uint8_t(i)};
+    }
+    g_peers_listed = peers;
+
+    // every peer takes up a connection that'd otherwise be free for a host
+    auto const listed = ranges::count_if(g_peers, [](Peer const& x) { return x.listed(); });
+    gap_set_max_number_peripheral_connections(int(MAX_NR_HCI_CONNECTIONS - listed));
+
+    g_notify_aggregate.notify();
+    scan_update();
+}
+
+}  // namespace
+
+bool init() {
+    gatt_client_init();
+
+    for (size_t i = 0; i < g_peers.size(); ++i)
+        g_peers.at(i).record.index = uint8_t(i);
+
+    btstack_run_loop_set_timer_handler(&g_connect_timer, [](btstack_timer_source_t*) {
+        if (g_connecting) gap_connect_cancel();  // completes (w/ an error) through `connected`
+    });
+
+    g_hci_handler.callback = &hci_handler;
+    hci_add_event_handler(&g_hci_handler);
+
+    gap_set_scan_parameters(GapScan::Passive, SCAN_INTERVAL, SCAN_WINDOW);
+
+    Peers peers{};
+    if (auto x = settings::get<Peers>(Key::RelayPeers)) peers = *x;
+    peers_apply(peers);
+    return true;
+}
+
+void disconnected(hci_con_handle_t conn) {
+    g_notify_aggregate.unregister(conn);
+    if (auto* cursor = aggregate_cursor(conn)) *cursor = {};
+}
+
+optional<uint16_t> attr_read(
+        hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t* buffer, uint16_t buffer_size) {
+    switch (att_handle) {
+        USER_DESCRIBE(RELAY_PEERS_01, "Relay - Peer Addresses")
+        USER_DESCRIBE(RELAY_AGGREGATE_01, "Relay - Aggregated Peer Data")
+
+        READ_VALUE(RELAY_PEERS_01, g_peers_listed)
+
+    case HANDLE_ATTR(RELAY_AGGREGATE_01, VALUE): {
+        auto const x = records();
+        return ::att_read_callback_handle_blob(x.data(), x.size(), offset, buffer, buffer_size);
+    }
+
+        READ_CLIENT_CFG(RELAY_AGGREGATE_01, g_notify_aggregate)
+
+    default: return {};
+    }
+}
+
+optional<int> attr_write(hci_con_handle_t conn, uint16_t att_handle, uint16_t offset, uint8_t const* buffer,
+        uint16_t buffer_size) {
+    if (buffer_size < offset) return ATT_ERROR_INVALID_OFFSET;
+    WriteConsumer consume{offset, buffer, buffer_size};
+
+    switch (att_handle) {
+        WRITE_CLIENT_CFG(RELAY_AGGREGATE_01, g_notify_aggregate)
+
+    case HANDLE_ATTR(RELAY_PEERS_01, VALUE): {
+        auto const peers = consume.exactly<Peers>();
+        if (!peers_valid(peers)) return ATT_ERROR_VALUE_NOT_ALLOWED;
+
+        peers_apply(peers);
+        persist(Key::RelayPeers, peers);
+        return 0;
+    }
+
+    default: return {};
+    }
+}
+
+bool attr_write_valid(uint16_t att_handle, span<uint8_t const> value) {
+    WriteConsumer consume{0, value.data(), uint16_t(value.size())};
+    try {
+        switch (att_handle) {
+        case HANDLE_ATTR(RELAY_PEERS_01, VALUE): return peers_valid(consume.exactly<Peers>());
+        default: return true;
+        }
+    } catch (AttrWriteException const&) {
+        return false;
+    }
+}
+
+}  // namespace nevermore::gatt::relay
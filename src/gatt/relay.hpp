@@ -0,0 +1,31 @@
+#pragma once
+
+#include "bluetooth.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+// Characteristic aliases, also used by services forwarding writes to ours (i.e. the command batch).
+#define RELAY_PEERS_01 1b7e3c95_d26a_4f08_8e4b_2a9c7d5f0e13_01
+#define RELAY_AGGREGATE_01 e4a9d273_5f1c_4b86_9d0e_73b2c8a1f546_01
+
+namespace nevermore::gatt::relay {
+
+// Peers a relay can watch at once. Each holds a GATT client & an HCI connection.
+constexpr size_t RELAY_PEERS_MAX = 4;
+
+std::optional<uint16_t> attr_read(
+        hci_con_handle_t, uint16_t att_handle, uint16_t offset, uint8_t* buffer, uint16_t buffer_size);
+
+std::optional<int> attr_write(
+        hci_con_handle_t, uint16_t att_handle, uint16_t offset, uint8_t const* buffer, uint16_t buffer_size);
+
+// Whether `attr_write` would accept `value` for `att_handle`, w/o applying anything. Only checks the value,
+// applying can still fail (e.g. out of resources). Lets a command batch check every item before applying any.
+bool attr_write_valid(uint16_t att_handle, std::span<uint8_t const> value);
+
+bool init();
+void disconnected(hci_con_handle_t);
+
+}  // namespace nevermore::gatt::relay
@@ -1,9 +1,12 @@
 #include "ws2812.hpp"
 #include "../ws2812.hpp"
+#include "../ws2812/effects.hpp"
+#include "config.hpp"
 #include "handler_helpers.hpp"
 #include "nevermore.h"
 #include "sdk/ble_data_types.hpp"
 #include "sdk/btstack.hpp"
+#include "settings.hpp"
 #include <cstdint>
 #include <span>
 
@@ -20,13 +23,14 @@ using namespace std;
 using namespace std::literals::chrono_literals;
 #endif
 
-#define WS2812_UPDATE_SPAN_UUID 5d91b6ce_7db1_4e06_b8cb_d75e7dd49aae
-
-#define WS2812_UPDATE_SPAN_01 5d91b6ce_7db1_4e06_b8cb_d75e7dd49aae_01
-#define WS2812_TOTAL_COMPONENTS_01 2AEA_01
-
 namespace nevermore::gatt::ws2812 {
 
+static_assert(handles_within(HANDLE_SERVICE(f62918ab_33b7_4f47_9fba_8ce9de9fecbb),
+        {HANDLE_ATTR(WS2812_TOTAL_COMPONENTS_01, VALUE), HANDLE_ATTR(WS2812_UPDATE_SPAN_01, VALUE),
+                HANDLE_ATTR(WS2812_UPDATE_SPANS_01, VALUE), HANDLE_ATTR(WS2812_UPDATE_SPANS_16_01, VALUE),
+                HANDLE_ATTR(WS2812_UPDATE_SPANS_16_STAGED_01, VALUE), HANDLE_ATTR(WS2812_EFFECT_01, VALUE),
+                HANDLE_ATTR(WS2812_CORRECTION_01, VALUE)}));
+
 namespace {
 
 struct [[gnu::packed]] UpdateSpanHeader {
@@ -34,6 +38,12 @@ struct [[gnu::packed]] UpdateSpanHeader {
     uint8_t length;
 };
 
+// Chains longer than 256 components need more than an octet to address.
+struct [[gnu::packed]] UpdateSpanHeader16 {
+    uint16_t offset;
+    uint16_t length;
+};
+
 void DBG_update_rate_log() {
 #if DEBUG_NEOPIXEL_UPDATE_RATE_LOG
     constexpr auto LOG_DELAY = 1s;
@@ -58,9 +68,38 @@ void DBG_update_rate_log() {
 #endif
 }
 
+// 0+ spans back to back, each `Header` followed by `length` octets of data.
+// `commit` -> present everything staged so far as a frame, even if this write has no spans of its own.
+template <typename Header>
+int update_spans(WriteConsumer& consume, bool commit = true) {
+    // Walk every header before applying anything, a truncated write shouldn't half apply.
+    for (auto check = consume; check.remaining();) {
+        Header header = check;
+        check.span(header.length);  // throws if truncated
+    }
+
+    bool ok = true;
+    while (consume.remaining()) {
+        Header header = consume;
+        ok &= nevermore::ws2812::write(header.offset, consume.span(header.length));
+    }
+
+    if (commit) nevermore::ws2812::commit();  // one frame for the lot, even if some didn't apply
+    return ok ? 0 : ATT_ERROR_VALUE_NOT_ALLOWED;
+}
+
 }  // namespace
 
 bool init() {
+    if (auto count = settings::get<BLE::Count16>(settings::Key::WS2812ComponentsTotal))
+        nevermore::ws2812::setup(size_t(double(*count)));
+
+    if (auto effect = settings::get<nevermore::ws2812::effects::Params>(settings::Key::WS2812Effect))
+        nevermore::ws2812::effects::set(*effect);
+
+    if (auto correction = settings::get<nevermore::ws2812::Correction>(settings::Key::WS2812Correction))
+        nevermore::ws2812::correction_set(*correction);
+
     return true;
 }
 
@@ -71,7 +110,14 @@ optional<uint16_t> attr_read(
     switch (att_handle) {
         USER_DESCRIBE(WS2812_TOTAL_COMPONENTS_01, "Total # of components (i.e. octets) in the WS2812 chain.")
         USER_DESCRIBE(WS2812_UPDATE_SPAN_01, "Update a span of the WS2812 chain.")
-
+        USER_DESCRIBE(WS2812_UPDATE_SPANS_01, "Update several spans of the WS2812 chain at once.")
+        USER_DESCRIBE(WS2812_UPDATE_SPANS_16_01, "Update several spans of the WS2812 chain at once (16-bit).")
+        USER_DESCRIBE(WS2812_UPDATE_SPANS_16_STAGED_01, "Stage span updates for the next frame (16-bit).")
+        USER_DESCRIBE(WS2812_EFFECT_01, "On-device effect (kind 0 -> none, host controls the chain).")
+        USER_DESCRIBE(WS2812_CORRECTION_01, "Output brightness & gamma, applied on-device.")
+
+        READ_VALUE(WS2812_EFFECT_01, nevermore::ws2812::effects::get())
+        READ_VALUE(WS2812_CORRECTION_01, nevermore::ws2812::correction())
         READ_VALUE(WS2812_TOTAL_COMPONENTS_01, ([]() -> uint16_t {
             // -1 because 0xFFFF is reserved as not-known for a BLE::Count16
             return min<size_t>(nevermore::ws2812::components_total(), UINT16_MAX - 1);
@@ -92,6 +138,24 @@ optional<int> attr_write(
         if (count == BLE::NOT_KNOWN) return ATT_ERROR_VALUE_NOT_ALLOWED;
         if (!nevermore::ws2812::setup(size_t(double(count)))) return ATT_ERROR_VALUE_NOT_ALLOWED;
 
+        persist(settings::Key::WS2812ComponentsTotal, count);
+
+        return 0;
+    }
+
+    case HANDLE_ATTR(WS2812_EFFECT_01, VALUE): {
+        auto const effect = consume.exactly<nevermore::ws2812::effects::Params>();
+        if (!nevermore::ws2812::effects::set(effect)) return ATT_ERROR_VALUE_NOT_ALLOWED;
+
+        persist(settings::Key::WS2812Effect, effect);
+        return 0;
+    }
+
+    case HANDLE_ATTR(WS2812_CORRECTION_01, VALUE): {
+        auto const correction = consume.exactly<nevermore::ws2812::Correction>();
+        if (!nevermore::ws2812::correction_set(correction)) return ATT_ERROR_VALUE_NOT_ALLOWED;
+
+        persist(settings::Key::WS2812Correction, correction);
         return 0;
     }
 
@@ -108,8 +172,39 @@ optional<int> attr_write(
         return 0;
     }
 
+    case HANDLE_ATTR(WS2812_UPDATE_SPANS_01, VALUE): {
+        DBG_update_rate_log();
+        return update_spans<UpdateSpanHeader>(consume);
+    }
+
+    case HANDLE_ATTR(WS2812_UPDATE_SPANS_16_01, VALUE): {
+        DBG_update_rate_log();
+        return update_spans<UpdateSpanHeader16>(consume);
+    }
+
+    case HANDLE_ATTR(WS2812_UPDATE_SPANS_16_STAGED_01, VALUE): {
+        return update_spans<UpdateSpanHeader16>(consume, false);
+    }
+
     default: return {};
     }
 }
 
+bool attr_write_valid(uint16_t att_handle, span<uint8_t const> value) {
+    WriteConsumer consume{0, value.data(), uint16_t(value.size())};
+    try {
+        switch (att_handle) {
+        case HANDLE_ATTR(WS2812_TOTAL_COMPONENTS_01, VALUE): {
+            auto const count = consume.exactly<BLE::Count16>();
+            return count != BLE::NOT_KNOWN && size_t(double(count)) <= WS2812_COMPONENTS_MAX;
+        }
+        case HANDLE_ATTR(WS2812_EFFECT_01, VALUE):
+            return consume.exactly<nevermore::ws2812::effects::Params>().valid();
+        default: return true;
+        }
+    } catch (AttrWriteException const&) {
+        return false;
+    }
+}
+
 }  // namespace nevermore::gatt::ws2812
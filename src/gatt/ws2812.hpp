@@ -3,6 +3,18 @@
 #include "bluetooth.h"
 #include <cstdint>
 #include <optional>
+#include <span>
+
+// Characteristic aliases, also used by services forwarding writes to ours (i.e. the command batch).
+#define WS2812_UPDATE_SPAN_UUID 5d91b6ce_7db1_4e06_b8cb_d75e7dd49aae
+
+#define WS2812_UPDATE_SPAN_01 5d91b6ce_7db1_4e06_b8cb_d75e7dd49aae_01
+#define WS2812_UPDATE_SPANS_01 c7e2a4d1_8b3f_4f6a_9e05_1d2c3b4a5f60_01
+#define WS2812_UPDATE_SPANS_16_01 e1f04b7a_26c9_4d3e_b58a_7c0d9e2f4a16_01
+#define WS2812_UPDATE_SPANS_16_STAGED_01 4b8d2c6e_91a7_4f3b_8e0d_5c2a7f1b9e38_01
+#define WS2812_EFFECT_01 8f3a6d12_4c7b_4e91_a2d5_0b9e6c1f7a43_01
+#define WS2812_CORRECTION_01 5da2357b_818e_4166_9625_97ea9a656a3b_01
+#define WS2812_TOTAL_COMPONENTS_01 2AEA_01
 
 namespace nevermore::gatt::ws2812 {
 
@@ -12,6 +24,10 @@ std::optional<uint16_t> attr_read(
 std::optional<int> attr_write(
         hci_con_handle_t, uint16_t att_handle, uint16_t offset, uint8_t const* buffer, uint16_t buffer_size);
 
+// Whether `attr_write` would accept `value` for `att_handle`, w/o applying anything. Only checks the value,
+// applying can still fail (e.g. out of resources). Lets a command batch check every item before applying any.
+bool attr_write_valid(uint16_t att_handle, std::span<uint8_t const> value);
+
 bool init();
 void disconnected(hci_con_handle_t);
 
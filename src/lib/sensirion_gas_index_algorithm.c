@@ -118,6 +118,27 @@ static fix16_t fix16_mul(fix16_t inArg0, fix16_t inArg1) {
 #endif
 }
 
+#if CMAKE_GAS_INDEX_FAST_FIXMATH
+// Nevermore: Bit-exact w/ the restoring division below (incl. rounding & overflow).
+// The RP2040 SDK (`pico_divider`) routes 64-bit division through the SIO hardware divider,
+// which beats the bit-at-a-time loop on an M0+.
+static fix16_t fix16_div(fix16_t a, fix16_t b) {
+    if (b == 0)
+        return (fix16_t)FIX16_MINIMUM;
+
+    uint32_t const abs_a = (uint32_t)((a >= 0) ? a : (-a));
+    uint32_t const abs_b = (uint32_t)((b >= 0) ? b : (-b));
+    uint64_t const quotient = (((uint64_t)abs_a << 16) + abs_b / 2) / abs_b;
+
+#ifndef FIXMATH_NO_OVERFLOW
+    if (quotient > 0x7FFFFFFF)
+        return (fix16_t)FIX16_OVERFLOW;
+#endif
+
+    fix16_t result = (fix16_t)quotient;
+    return ((a < 0) != (b < 0)) ? -result : result;
+}
+#else
 static fix16_t fix16_div(fix16_t a, fix16_t b) {
     // This uses the basic binary restoring division algorithm.
     // It appears to be faster to do the whole division manually than
@@ -186,6 +207,7 @@ static fix16_t fix16_div(fix16_t a, fix16_t b) {
 
     return result;
 }
+#endif
 
 static fix16_t fix16_sqrt(fix16_t x) {
     // It is assumed that x is not negative
@@ -272,7 +294,22 @@ static fix16_t fix16_exp(fix16_t x) {
 
     res = FIX16_ONE;
     arg = FIX16_ONE;
+#if CMAKE_GAS_INDEX_FAST_FIXMATH
+    // Nevermore: Integer part by lookup instead of up to 11 sequential multiplies.
+    // Table holds exactly what the multiply loop below produces, so results are bit-exact.
+    {
+        static const fix16_t exp_pos_int[11] = {65536, 178145, 484247, 1316317, 3578114, 9726305,
+            26438791, 71867957, 195357013, 531034471, 1443498777};
+        static const fix16_t exp_neg_int[12] = {65536, 24109, 8869, 3263, 1200, 441, 162, 60, 22, 8, 3, 1};
+        int32_t n = x >> 16;
+        res = (exp_values == exp_pos_values) ? exp_pos_int[n] : exp_neg_int[n];
+        x -= n * FIX16_ONE;
+    }
+    arg >>= 3;
+    for (i = 1; i < NUM_EXP_VALUES; i++) {
+#else
     for (i = 0; i < NUM_EXP_VALUES; i++) {
+#endif
         while (x >= arg) {
             res = fix16_mul(res, exp_values[i]);
             x -= arg;
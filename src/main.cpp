@@ -1,17 +1,26 @@
 #include "FreeRTOS.h"  // IWYU pragma: keep
+#include "benchmark.hpp"
 #include "btstack_run_loop.h"
 #include "config.hpp"
+#include "diagnostics.hpp"
 #include "display.hpp"
 #include "gatt.hpp"
 #include "hardware/adc.h"
 #include "hardware/gpio.h"
 #include "hardware/i2c.h"
+#include "pico/async_context_freertos.h"
 #include "pico/cyw43_arch.h"
 #include "pico/stdio.h"
+#include "sdk/adc.hpp"
 #include "sdk/i2c.hpp"
 #include "sdk/spi.hpp"
 #include "sensors.hpp"
+#include "settings.hpp"
 #include "task.h"  // IWYU pragma: keep
+#include "telemetry.hpp"
+#include "timers.h"
+#include "utility/health.hpp"
+#include "utility/log.hpp"
 #include "utility/task.hpp"
 #include "utility/timer.hpp"
 #include "ws2812.hpp"
@@ -24,6 +33,11 @@
 
 using namespace nevermore;
 
+// BTstack's run loop is the CYW43 async context's task, not the `main` task (that only parks in
+// `btstack_run_loop_execute`). GATT requests & notifications are handled there, ahead of sensors & display.
+// Other tasks hand work to it w/ `btstack_run_loop_execute_on_main_thread`, which wakes it w/ a notification.
+static_assert(ASYNC_CONTEXT_DEFAULT_FREERTOS_TASK_PRIORITY == UBaseType_t(Priority::Communication));
+
 extern "C" {
 void vApplicationTickHook() {}
 
@@ -34,10 +48,28 @@ void vApplicationStackOverflowHook(TaskHandle_t Task, char* pcTaskName) {
 void vApplicationMallocFailedHook() {
     panic("PANIC - heap alloc failed\n");
 }
+
+// W/ static allocation enabled the kernel asks for its own tasks' memory instead of taking it from the heap.
+// (SMP: only core 0's idle task asks, the other core's gets a minimal one the kernel allocates itself.)
+void vApplicationGetIdleTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* stack_depth) {
+    static TaskStorage<configMINIMAL_STACK_SIZE> g_idle;
+    *tcb = &g_idle.tcb;
+    *stack = g_idle.stack.data();
+    *stack_depth = g_idle.stack.size();
+}
+
+void vApplicationGetTimerTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* stack_depth) {
+    static TaskStorage<configTIMER_TASK_STACK_DEPTH> g_timer;
+    *tcb = &g_timer.tcb;
+    *stack = g_timer.stack.data();
+    *stack_depth = g_timer.stack.size();
+}
 }
 
 namespace {
 
+TaskStorage<1024> g_main_task;
+
 // so far PIN config can be statically checked, so no risk of runtime error
 void pins_setup() {
     // Leave pins {0, 1} set to UART TX/RX.
@@ -52,9 +84,12 @@ void pins_setup() {
         gpio_pull_up(pin);
     }
 
-    gpio_set_function(PIN_FAN_PWM, GPIO_FUNC_PWM);
-    gpio_set_function(PIN_FAN_TACHOMETER, GPIO_FUNC_PWM);
-    gpio_pull_up(PIN_FAN_TACHOMETER);
+    for (auto&& fan : PINS_FAN) {
+        gpio_set_function(fan.pwm, GPIO_FUNC_PWM);
+        gpio_set_function(fan.tachometer, GPIO_FUNC_SIO);  // edges are timestamped by a GPIO IRQ
+        gpio_set_dir(fan.tachometer, false);
+        gpio_pull_up(fan.tachometer);
+    }
 
     // we're setting up the WS2812 controller on PIO0
     gpio_set_function(PIN_NEOPIXEL_DATA_IN, GPIO_FUNC_PIO0);
@@ -85,11 +120,11 @@ void pins_setup() {
 }  // namespace
 
 int main() {
-    for (auto& lock : g_i2c_locks)
-        lock = xSemaphoreCreateMutex();
+    i2c_workers_init();
 
     stdio_init_all();
     adc_init();
+    adc_capture_init();
     pins_setup();
 
     // GCC 12.2.1 bug: -Werror=format reports that `I2C_BAUD_RATE` is a `long unsigned int`.
@@ -107,18 +142,35 @@ int main() {
     printf("SPI bus %d running at %u baud/s (requested %u baud/s)\n", spi_gpio_bus_num(PINS_DISPLAY_SPI[0]),
             spi_init(spi, SPI_BAUD_RATE_DISPLAY), unsigned(SPI_BAUD_RATE_DISPLAY));
 
-    mk_task("main", Priority::Idle, 1024)([]() {
+    // Everything is init-ed from core 0, which means IRQs are enabled on core 0 (bar those put on core 1 via
+    // `on_core`, i.e. the display's DMA completion).
+    mk_task("main", Priority::Idle, g_main_task, Core::C0)([]() {
+        // created by the scheduler w/o an affinity, keep timer callbacks off the display's core
+        vTaskCoreAffinitySet(xTimerGetTimerDaemonTaskHandle(), UBaseType_t(Core::C0));
+
         if (auto err = cyw43_arch_init()) {
             panic("ERR - cyw43_arch_init failed = 0x%08x\n", err);
         }
 
+        if (!logging::init()) return;
+        // load before anyone looks at their settings
+        if (!settings::init()) return;
+        if (!diagnostics::init()) return;
+        if (!telemetry::init()) return;
+
         ws2812::init();
         // display must be init before sensors b/c some sensors are display input devices
         if (!display::init_with_ui()) return;
+#if CMAKE_BENCHMARK
+        // nothing else running, so the numbers aren't skewed by sensor/BT work
+        benchmark::suite();  // !! NO-RETURN
+#endif
+        // after the benchmark, it keeps the display busy. All monitored so far are idle or already beating.
+        if (!health::init()) return;
         if (!sensors::init()) return;
         if (!gatt::init()) return;
 
-        mk_timer("led-blink", SENSOR_UPDATE_PERIOD)([](TimerHandle_t) {
+        mk_periodic("led-blink", SENSOR_UPDATE_PERIOD)([]() {
             static bool led_on = false;
             led_on = !led_on;
             cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, led_on);
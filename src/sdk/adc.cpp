@@ -0,0 +1,137 @@
+#include "adc.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/timer.h"
+#include "task.h"  // IWYU pragma: keep
+#include <array>
+#include <bit>
+#include <cstdio>
+
+using namespace std;
+
+namespace nevermore {
+
+namespace {
+
+constexpr uint8_t ADC_GPIO_BASE = 26;
+constexpr uint8_t ADC_RESOLUTION_BITS = 12;
+
+static_assert(has_single_bit(ADC_CAPTURE_DEPTH));
+
+// `ADC_CAPTURE_DEPTH` rounds of the round robin, each round's samples in ascending input order.
+// Only the first `ADC_CAPTURE_DEPTH * popcount(g_inputs)` entries are in use.
+array<uint16_t, ADC_CAPTURE_DEPTH * ADC_INPUTS> g_ring{};
+// Whenever the data channel's done with the ring, the control channel writes this to its write address
+// (triggering it), so it starts over at the top w/o dropping a sample.
+uint16_t* g_ring_top = g_ring.data();
+
+uint g_dma_data = 0;
+uint g_dma_control = 0;
+bool g_initialised = false;
+
+// guarded by the kernel critical section
+uint8_t g_inputs = 0;         // bitset of enabled inputs
+uint64_t g_filled_at_us = 0;  // ring holds nothing but the current round robin's samples from here on
+
+// PRECONDITION: in critical section, `g_inputs != 0`
+void UNSAFE_restart() {
+    adc_run(false);
+    // let an in-flight conversion land before draining, or it'd skew the interleaving
+    while (!(adc_hw->cs & ADC_CS_READY_BITS))
+        tight_loop_contents();
+
+    // data may complete (& chain to control) as it's aborted, so abort it once more after control
+    dma_channel_abort(g_dma_data);
+    dma_channel_abort(g_dma_control);
+    dma_channel_abort(g_dma_data);
+    adc_fifo_drain();
+
+    auto const n = uint32_t(popcount(g_inputs));
+    adc_select_input(uint(countr_zero(g_inputs)));
+    adc_set_round_robin(g_inputs);
+    dma_channel_set_trans_count(g_dma_data, n * ADC_CAPTURE_DEPTH, false);
+    dma_channel_set_write_addr(g_dma_data, g_ring.data(), true);
+    adc_run(true);
+
+    g_filled_at_us = time_us_64() + uint64_t(n) * ADC_CAPTURE_DEPTH * 1'000'000 / ADC_CAPTURE_RATE_HZ;
+}
+
+}  // namespace
+
+void adc_capture_init() {
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(float(clock_get_hz(clk_adc) / ADC_CAPTURE_RATE_HZ - 1));
+
+    g_dma_data = uint(dma_claim_unused_channel(true));
+    g_dma_control = uint(dma_claim_unused_channel(true));
+
+    auto data = dma_channel_get_default_config(g_dma_data);
+    channel_config_set_transfer_data_size(&data, DMA_SIZE_16);
+    channel_config_set_read_increment(&data, false);
+    channel_config_set_write_increment(&data, true);
+    channel_config_set_dreq(&data, DREQ_ADC);
+    channel_config_set_chain_to(&data, g_dma_control);
+    dma_channel_configure(g_dma_data, &data, g_ring.data(), &adc_hw->fifo, 0, false);
+
+    auto control = dma_channel_get_default_config(g_dma_control);
+    channel_config_set_transfer_data_size(&control, DMA_SIZE_32);
+    channel_config_set_read_increment(&control, false);
+    channel_config_set_write_increment(&control, false);
+    dma_channel_configure(
+            g_dma_control, &control, &dma_hw->ch[g_dma_data].al2_write_addr_trig, &g_ring_top, 1, false);
+
+    g_initialised = true;
+}
+
+bool adc_capture_enable(uint8_t input) {
+    if (ADC_INPUTS <= input) return false;
+    if (!g_initialised) {
+        printf("ERR - ADC - `adc_capture_init` hasn't been called\n");
+        return false;
+    }
+#ifdef CYW43_USES_VSYS_PIN
+    if (ADC_GPIO_BASE + input == PICO_VSYS_PIN) {
+        printf("ERR - ADC - input %u is shared w/ the CYW43, can't capture it\n", unsigned(input));
+        return false;
+    }
+#endif
+
+    if (input == ADC_INPUT_TEMPERATURE)
+        adc_set_temp_sensor_enabled(true);
+    else
+        adc_gpio_init(ADC_GPIO_BASE + input);
+
+    taskENTER_CRITICAL();
+    if (!(g_inputs & (1u << input))) {
+        g_inputs |= uint8_t(1u << input);
+        UNSAFE_restart();
+    }
+    taskEXIT_CRITICAL();
+    return true;
+}
+
+optional<uint16_t> adc_capture_mean(uint8_t input) {
+    if (ADC_INPUTS <= input) return {};
+
+    taskENTER_CRITICAL();
+    auto const inputs = g_inputs;
+    auto const filled_at = g_filled_at_us;
+    taskEXIT_CRITICAL();
+    if (!(inputs & (1u << input)) || time_us_64() < filled_at) return {};
+
+    auto const n = size_t(popcount(inputs));
+    uint32_t sum = 0;
+    for (auto i = size_t(popcount(inputs & ((1u << input) - 1))); i < n * ADC_CAPTURE_DEPTH; i += n)
+        sum += g_ring[i];  // NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+
+    taskENTER_CRITICAL();
+    bool const restarted = filled_at != g_filled_at_us;  // ring was rearranged under us
+    taskEXIT_CRITICAL();
+    if (restarted) return {};
+
+    return uint16_t(sum * (1u << (16 - ADC_RESOLUTION_BITS)) / ADC_CAPTURE_DEPTH);
+}
+
+}  // namespace nevermore
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Free running ADC capture, shared by every ADC user.
+// The ADC round robins over the enabled inputs, DMA streams the conversions into a ring holding the last
+// `ADC_CAPTURE_DEPTH` samples of each. Readers average the ring whenever they like, no IRQs or blocking
+// conversions involved, and the average is far less noisy than any single conversion.
+namespace nevermore {
+
+// 0-3 -> GPIO 26-29, 4 -> on-chip temperature sensor
+constexpr uint8_t ADC_INPUTS = 5;
+constexpr uint8_t ADC_INPUT_TEMPERATURE = 4;
+// Samples per input averaged by `adc_capture_mean`. Power of 2, the mean is a shift.
+constexpr size_t ADC_CAPTURE_DEPTH = 64;
+// Conversions per second, shared by all enabled inputs.
+constexpr uint32_t ADC_CAPTURE_RATE_HZ = 4'000;
+
+// Claims the DMA channels (panics if none are left). Call once, after `adc_init`.
+void adc_capture_init();
+
+// Adds `input` to the round robin (the ADC pin's GPIO is set up for it). Any task, idempotent.
+// Capture restarts, so every input's mean is unavailable until the ring has refilled (a few ms).
+// Returns false if `input` can't be captured (e.g. GPIO 29 belongs to the CYW43 on a Pico W).
+bool adc_capture_enable(uint8_t input);
+
+// Mean of `input`'s last `ADC_CAPTURE_DEPTH` samples, scaled to 16 bits (the 12 bit conversions'
+// oversampled 4 bits below). `nullopt` if it isn't enabled, or the ring hasn't filled since (re)starting.
+// Any task.
+std::optional<uint16_t> adc_capture_mean(uint8_t input);
+
+}  // namespace nevermore
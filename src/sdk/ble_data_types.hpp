@@ -56,7 +56,7 @@ struct [[gnu::packed]] uint24_t {
     }
 
     constexpr operator uint32_t() const {
-        return octets[0] | (octets[1] >> 8) | (octets[2] >> 16);
+        return octets[0] | (octets[1] << 8) | (octets[2] << 16);
     }
 };
 static_assert(sizeof(uint24_t) == 3);
@@ -159,6 +159,30 @@ constexpr double raw_to_repr_coeff(int M, int d, int b) {
     return M * pow(10., d) * pow(2., b);
 }
 
+// Exact `10^exp10 * 2^exp2` as a fraction, for rescaling integers at compile time.
+struct FixedRatio {
+    int64_t num = 1;
+    int64_t den = 1;
+};
+
+constexpr FixedRatio fixed_ratio(int32_t exp10, int32_t exp2) {
+    FixedRatio r;
+    for (; exp10 < 0; ++exp10)
+        r.den *= 10;
+    for (; exp10 > 0; --exp10)
+        r.num *= 10;
+    for (; exp2 < 0; ++exp2)
+        r.den *= 2;
+    for (; exp2 > 0; --exp2)
+        r.num *= 2;
+    return r;
+}
+
+// `n / d` rounded half away from zero, `0 < d`
+constexpr int64_t div_round(int64_t n, int64_t d) {
+    return n < 0 ? -((-n + d / 2) / d) : (n + d / 2) / d;
+}
+
 template <typename Unit, typename Raw_, int32_t M_ = 1, int32_t D = 0, int32_t B = 0,
         auto NOT_KNOWN_VALUE = nullptr>
 struct [[gnu::packed]] Scalar {
@@ -182,7 +206,7 @@ struct [[gnu::packed]] Scalar {
     Raw raw_value;
 
     constexpr Scalar() {
-        if constexpr (has_not_known<Scalar>)
+        if constexpr (!std::is_null_pointer_v<decltype(NOT_KNOWN_VALUE)>)
             raw_value = NOT_KNOWN_VALUE;
         else
             raw_value = {};
@@ -196,6 +220,41 @@ struct [[gnu::packed]] Scalar {
 
     constexpr Scalar(double value) : raw_value(static_cast<Raw>(value / scale)) {}
 
+    // Integer path, w/o any floating point (soft-float on the RP2040).
+    // `value` is in units of `10^E`, e.g. `Temperature::from_fixed<-2>(2150)` -> 21.5 C.
+    // Rounds to the nearest raw value. Out of range values saturate, but never to `NOT_KNOWN`.
+    template <int32_t E>
+    static constexpr Scalar from_fixed(int64_t value) {
+        constexpr auto r = fixed_ratio(E - d, -b);
+        constexpr auto num = M < 0 ? -r.num : r.num;
+        constexpr auto den = r.den * (M < 0 ? -M : M);
+        constexpr auto lo = int64_t(std::numeric_limits<Raw>::lowest());
+        constexpr auto hi = int64_t(std::numeric_limits<Raw>::max());
+
+        auto raw = div_round(value * num, den);
+        if (raw < lo) raw = lo + (raw_is_not_known(lo) ? 1 : 0);
+        if (hi < raw) raw = hi - (raw_is_not_known(hi) ? 1 : 0);
+
+        if constexpr (std::is_same_v<Raw, uint24_t>)
+            return from_raw(Raw(uint32_t(raw)));
+        else
+            return from_raw(static_cast<Raw>(raw));
+    }
+
+    // Value in units of `10^E`, rounded. `NOT_KNOWN` isn't special cased, see `fixed_or`.
+    template <int32_t E>
+    [[nodiscard]] constexpr int64_t fixed() const {
+        constexpr auto r = fixed_ratio(d - E, b);
+        return div_round(int64_t(raw_value) * M * r.num, r.den);
+    }
+
+    template <int32_t E>
+    [[nodiscard]] constexpr int64_t fixed_or(int64_t x) const
+        requires(has_not_known<Scalar>)
+    {
+        return *this == NOT_KNOWN ? x : fixed<E>();
+    }
+
     constexpr explicit operator double() const {
         if constexpr (has_not_known<Scalar>) {
             if (*this == NOT_KNOWN) return std::numeric_limits<double>::signaling_NaN();
@@ -212,6 +271,14 @@ struct [[gnu::packed]] Scalar {
 
     // sadly, because we're not doing `<=> = default`, we don't get the free definitions for <, ==, etc..
     constexpr bool operator==(Scalar const&) const = default;
+
+private:
+    static constexpr bool raw_is_not_known(int64_t raw) {
+        if constexpr (!std::is_null_pointer_v<decltype(NOT_KNOWN_VALUE)>)
+            return raw == int64_t(Raw(NOT_KNOWN_VALUE));
+        else
+            return false;
+    }
 };
 
 template <typename Unit, typename Raw, int32_t M, int32_t D, int32_t B, auto NKV>
@@ -268,6 +335,23 @@ BLE_DECL_SCALAR_OPTIONAL(TimeSecond32, uint32_t, 1, 0, 0, 0xFFFF'FFFFu);
 
 constexpr Pressure PRESSURE_1_ATMOSPHERE{101.325 * 1000};  // 101.325 kPa
 
+namespace internal {
+
+static_assert(Temperature::from_fixed<-2>(2150).raw_value == 2150);
+static_assert(Temperature::from_fixed<-3>(-21505).raw_value == -2151);  // half away from zero
+static_assert(Temperature::from_fixed<0>(-1000) == Temperature::from_raw(-0x7FFF));  // saturates, not to NKV
+static_assert(Pressure::from_fixed<0>(101325) == PRESSURE_1_ATMOSPHERE);
+static_assert(Humidity::from_fixed<-3>(45678).raw_value == 4568);
+static_assert(Percentage8::from_fixed<-1>(505).raw_value == 101);  // 0.5 % steps
+static_assert(Percentage8::from_fixed<0>(200).raw_value == 0xFE);
+static_assert(Percentage8::from_raw(101).fixed<-1>() == 505);
+static_assert(Percentage8::from_raw(101).fixed<0>() == 51);
+static_assert(Percentage8{NOT_KNOWN}.fixed_or<0>(-1) == -1);
+static_assert(TimeMilli24::from_fixed<0>(70).fixed<-3>() == 70'000);  // uses all 3 octets
+static_assert(TimeMilli24::from_fixed<0>(20'000).fixed<-3>() == 0xFF'FFFE);
+
+}  // namespace internal
+
 //////////////////////////////////////////////
 // Common Utility Characteristics
 //////////////////////////////////////////////
@@ -0,0 +1,19 @@
+#include "dma.hpp"
+#include "hardware/dma.h"
+#include <cassert>
+
+namespace nevermore {
+
+uint dma_channel_claim_with_irq(Core core, irq_handler_t handler) {
+    assert(core == Core::C0 || core == Core::C1);
+    auto const index = dma_irq_index(core);
+    auto const irq = DMA_IRQ_0 + index;
+    auto const channel = uint(dma_claim_unused_channel(true));
+
+    irq_set_exclusive_handler(irq, handler);  // vector table is shared, only the enable is per core
+    dma_irqn_set_channel_enabled(index, channel, true);
+    on_core(core, [&] { irq_set_enabled(irq, true); });
+    return channel;
+}
+
+}  // namespace nevermore
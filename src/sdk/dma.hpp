@@ -0,0 +1,22 @@
+#pragma once
+
+#include "hardware/irq.h"
+#include "utility/task.hpp"
+#include <cstdint>
+
+// DMA channels w/ a completion IRQ. Each core has its own line, DMA_IRQ_0 is handled on core 0 & DMA_IRQ_1
+// on core 1, so a driver's line follows its affinity (see `nevermore::Core`). A line has exactly one
+// (exclusive) handler, so a completion runs only its owner's handler instead of every driver that shares it.
+namespace nevermore {
+
+// Index of `core`'s line, for the `dma_irqn_*` SDK calls.
+constexpr uint dma_irq_index(Core core) {
+    return core == Core::C1 ? 1 : 0;
+}
+
+// Claims an unused channel & routes its completions to `core`'s line, w/ `handler` as that line's only
+// handler. Panics if no channel is left or the line is already taken. `core` must be `C0` or `C1`.
+// Call from a task, it's briefly moved onto `core` to enable the line in that core's NVIC.
+uint dma_channel_claim_with_irq(Core core, irq_handler_t handler);
+
+}  // namespace nevermore
@@ -0,0 +1,15 @@
+#include "flash.hpp"
+#include "pico/error.h"
+#include "pico/flash.h"
+#include <cstdint>
+#include <cstdio>
+
+namespace nevermore {
+
+bool flash_safe(void (*go)(void*), void* param) {
+    auto r = flash_safe_execute(go, param, UINT32_MAX);
+    if (r != PICO_OK) printf("ERR - flash - flash_safe_execute failed (code %+d)\n", r);
+    return r == PICO_OK;
+}
+
+}  // namespace nevermore
@@ -0,0 +1,9 @@
+#pragma once
+
+namespace nevermore {
+
+// Erase/program stall XIP, so the other core has to be parked (in RAM) while they're running.
+// Runs `go(param)` w/ it parked. Returns false (& logs why) if it couldn't be, `go` didn't run.
+bool flash_safe(void (*go)(void*), void* param);
+
+}  // namespace nevermore
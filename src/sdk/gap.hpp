@@ -13,6 +13,20 @@ constexpr auto BT_ADVERTISEMENT_INTERVAL_TICK = 625us;
 // Cannot advertise more frequently than every 100ms.
 constexpr auto BT_ADVERTISEMENT_INTERVAL_MIN = 100ms;
 
+// Connection intervals are in units of 1.25 ms, supervision timeouts in units of 10 ms.
+constexpr auto BT_CONNECTION_INTERVAL_TICK = 1250us;
+constexpr auto BT_CONNECTION_INTERVAL_MIN = 7500us;
+constexpr auto BT_CONNECTION_INTERVAL_MAX = 4s;
+constexpr auto BT_SUPERVISION_TIMEOUT_TICK = 10ms;
+
+// Scan intervals & windows are in units of 0.625 ms.
+constexpr auto BT_SCAN_INTERVAL_TICK = 625us;
+
+enum class GapScan : uint8_t {
+    Passive = 0,  // adverts only, no scan requests
+    Active = 1,
+};
+
 template <typename Dur0, typename Dur1>
 void gap_advertisements_set_params(Dur0 const& advert_min, Dur1 const& advert_max) {
     assert(BT_ADVERTISEMENT_INTERVAL_MIN <= advert_min && "can't advertise faster than 100ms");
@@ -22,4 +36,24 @@ void gap_advertisements_set_params(Dur0 const& advert_min, Dur1 const& advert_ma
             advert_max / BT_ADVERTISEMENT_INTERVAL_TICK, 0, 0, null_addr, 0b0111, 0x00);
 }
 
+template <typename Dur0, typename Dur1, typename Dur2>
+int gap_request_connection_parameter_update(hci_con_handle_t conn, Dur0 const& interval_min,
+        Dur1 const& interval_max, uint16_t latency, Dur2 const& supervision_timeout) {
+    assert(BT_CONNECTION_INTERVAL_MIN <= interval_min && "connection interval too short");
+    assert(interval_max <= BT_CONNECTION_INTERVAL_MAX && "connection interval too long");
+    assert(interval_min <= interval_max);
+
+    return ::gap_request_connection_parameter_update(conn, interval_min / BT_CONNECTION_INTERVAL_TICK,
+            interval_max / BT_CONNECTION_INTERVAL_TICK, latency,
+            supervision_timeout / BT_SUPERVISION_TIMEOUT_TICK);
+}
+
+template <typename Dur0, typename Dur1>
+void gap_set_scan_parameters(GapScan type, Dur0 const& interval, Dur1 const& window) {
+    assert(window <= interval && "scan window can't be longer than its interval");
+
+    ::gap_set_scan_parameters(
+            uint8_t(type), interval / BT_SCAN_INTERVAL_TICK, window / BT_SCAN_INTERVAL_TICK);
+}
+
 }  // namespace nevermore
@@ -1,7 +1,417 @@
 #include "i2c.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "config.hpp"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "pico/platform.h"
+#include "queue.h"
+#include "sdk/task.hpp"
+#include "sdk/timer.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include "utility/health.hpp"
+#include "utility/task.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <span>
+
+using namespace std;
 
 namespace nevermore {
 
-SemaphoreHandle_t g_i2c_locks[NUM_I2CS];
+namespace {
+
+// Transfers are done by DMA, the worker only sleeps while waiting for them.
+constexpr uint32_t I2C_WORKER_STACK_DEPTH = configMINIMAL_STACK_SIZE;
+// Each client has at most one outstanding request, so this is really a bound on # of devices per bus.
+constexpr UBaseType_t I2C_WORKER_QUEUE_LENGTH = 8;
+// Max # of bytes (written + read) in a DMA'd transfer. Anything larger falls back to the
+// (CPU polled) SDK routines. That only happens for a few Bosch calibration reads during init.
+constexpr size_t I2C_DMA_COMMANDS_MAX = 64;
+// ~2.5 ms for a full `I2C_DMA_COMMANDS_MAX` transfer @ 400 kbit/s, plus plenty of clock-stretching slack.
+constexpr auto I2C_DMA_TIMEOUT = 20ms;
+// Per direction, for the CPU polled fallback. Those are at most a couple hundred bytes.
+constexpr auto I2C_BLOCKING_TIMEOUT = 50ms;
+// Bus recovery: 9 clocks lets a device finish whatever byte (+ ACK) it thinks it's in the middle of.
+constexpr uint I2C_RECOVERY_CLOCKS = 9;
+constexpr auto I2C_RECOVERY_HALF_PERIOD = 5us;  // ~100 kHz, fine for anything on the bus
+constexpr auto I2C_RECOVERY_STRETCH_MAX = 1ms;  // a device may hold SCL low a while before letting go
+// Two fully populated muxes, across both buses.
+constexpr size_t I2C_MUX_CHANNELS_MAX = 2 * TCA9548A_CHANNELS;
+
+struct Worker {
+    i2c_inst_t* bus = nullptr;
+    QueueHandle_t queue = nullptr;
+    TaskHandle_t task = nullptr;
+    TaskStorage<I2C_WORKER_STACK_DEPTH> task_memory{};
+    uint dma_tx = 0;
+    uint dma_rx = 0;
+
+    // Last route selected. Dirty -> a select failed, the muxes' state is unknown & it must be re-issued.
+    I2C_Route selected{};
+    bool selected_dirty = false;
+
+    // written by ISR
+    volatile bool finished = false;
+    volatile bool aborted = false;
+
+    // `IC_DATA_CMD` words, one of `g_dma_commands`.
+    span<uint16_t> commands;
+
+    // Beats per transaction, so the budget is one transaction's timeouts (& delay), not a whole queue's.
+    health::Heartbeat heartbeat;
+};
+
+array<Worker, NUM_I2CS> g_workers;
+
+// DMA sources for the workers. Written as halfwords, the upper half of the reg is reserved/read-only.
+// In SCRATCH_X, so the DMA reads don't contend w/ core 0's accesses to main SRAM (or its stack in
+// SCRATCH_Y). Core 1's boot/IRQ stack is the only other tenant, the linker fails the build if they overlap.
+__scratch_x("i2c_dma") array<array<uint16_t, I2C_DMA_COMMANDS_MAX>, NUM_I2CS> g_dma_commands{};
+
+// Handles are a copy of their bus's instance (so the SDK sees the real hardware), plus a route.
+// The SDK's `i2c_hw_index` compares pointers, a copy isn't either of `i2c0`/`i2c1`, so keep which it copied.
+struct MuxChannel {
+    i2c_inst_t inst;
+    I2C_Route route;
+    uint8_t root;  // `i2c_hw_index` of the bus behind it
+};
+
+// Append only, entries are immutable once `g_mux_channels_count` covers them.
+array<MuxChannel, I2C_MUX_CHANNELS_MAX> g_mux_channels{};
+atomic<size_t> g_mux_channels_count = 0;
 
+MuxChannel const* mux_channel(i2c_inst_t const& bus) {
+    auto const* end = g_mux_channels.cbegin() + g_mux_channels_count.load(memory_order_acquire);
+    auto const* it = find_if(g_mux_channels.cbegin(), end, [&](auto& x) { return &x.inst == &bus; });
+    return it == end ? nullptr : it;
 }
+
+Worker& worker(i2c_inst_t& bus) {
+    return g_workers.at(i2c_hw_index(&i2c_root(bus)));
+}
+
+template <uint BUS>
+void __isr __not_in_flash("i2c") i2c_irq_handler() {
+    auto& w = g_workers[BUS];
+    auto* hw = i2c_get_hw(w.bus);
+    auto const status = hw->intr_stat;
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        (void)hw->clr_tx_abrt;
+        w.aborted = true;
+    }
+    // abort is always followed by a stop, so always wait for it before declaring the bus free
+    if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+        (void)hw->clr_stop_det;
+        w.finished = true;
+        hw->intr_mask = 0;
+
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(w.task, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);  // NOLINT
+    }
+}
+
+// A device that was reset/browned-out mid-read can be left holding SDA low, waiting to clock out the rest
+// of its byte. Nothing can start a transfer until it lets go, so bit-bang SCL until it does, then issue a
+// stop so everyone's back to idle. The controller is reset too, it may be stuck mid-transfer.
+void recover(Worker& w) {
+    auto const bus = i2c_hw_index(w.bus);
+    GPIO_Pin sda = PIN_MAX;
+    GPIO_Pin scl = PIN_MAX;
+    for (auto pin : PINS_I2C) {
+        if (i2c_gpio_bus_num(pin) != bus) continue;
+        (i2c_gpio_kind(pin) == I2C_Pin::SDA ? sda : scl) = pin;
+    }
+    assert(sda != PIN_MAX && scl != PIN_MAX && "bus in use, but `PINS_I2C` doesn't have its pins?");
+
+    i2c_deinit(w.bus);
+
+    // open drain: drive low, or release & let the pull-up take it high
+    auto drive_low = [](GPIO_Pin pin, bool low) { gpio_set_dir(pin, low); };
+    auto scl_release = [&] {
+        drive_low(scl, false);
+        for (auto const until = time_64u() + I2C_RECOVERY_STRETCH_MAX; !gpio_get(scl) && time_64u() < until;)
+            tight_loop_contents();
+        busy_wait_us_32(I2C_RECOVERY_HALF_PERIOD / 1us);
+    };
+    for (auto pin : {sda, scl}) {
+        gpio_put(pin, false);
+        drive_low(pin, false);
+        gpio_set_function(pin, GPIO_FUNC_SIO);
+    }
+
+    for (uint i = 0; i < I2C_RECOVERY_CLOCKS && !gpio_get(sda); ++i) {
+        drive_low(scl, true);
+        busy_wait_us_32(I2C_RECOVERY_HALF_PERIOD / 1us);
+        scl_release();
+    }
+
+    // stop: SDA rises while SCL is high
+    drive_low(scl, true);
+    drive_low(sda, true);
+    busy_wait_us_32(I2C_RECOVERY_HALF_PERIOD / 1us);
+    scl_release();
+    drive_low(sda, false);
+    busy_wait_us_32(I2C_RECOVERY_HALF_PERIOD / 1us);
+
+    bool const released = gpio_get(sda) && gpio_get(scl);
+    for (auto pin : {sda, scl})
+        gpio_set_function(pin, GPIO_FUNC_I2C);
+    i2c_init(w.bus, I2C_BAUD_RATE);
+    i2c_get_hw(w.bus)->intr_mask = 0;
+
+    w.selected_dirty = true;  // a select may have been cut short, the muxes' state is unknown
+    if (released)
+        LOG_DEFERRED("WARN - I2C - bus %u timed out, recovered\n", bus);
+    else
+        LOG_DEFERRED("ERR - I2C - bus %u timed out & is still held low (wiring? dead device?)\n", bus);
+}
+
+// Write `write` then read into `read`, w/ a repeated start between them and a stop at the end.
+bool transfer_blocking(Worker& w, uint8_t addr, span<uint8_t const> write, span<uint8_t> read) {
+    constexpr auto TIMEOUT_US = uint(I2C_BLOCKING_TIMEOUT / 1us);
+    auto done = [&](int r, size_t n) {
+        if (r == PICO_ERROR_TIMEOUT) recover(w);
+        return r == int(n);
+    };
+
+    if (!write.empty()) {
+        auto r = i2c_write_timeout_us(w.bus, addr, write.data(), write.size(), !read.empty(), TIMEOUT_US);
+        if (!done(r, write.size())) return false;
+    }
+
+    if (!read.empty()) {
+        auto r = i2c_read_timeout_us(w.bus, addr, read.data(), read.size(), false, TIMEOUT_US);
+        if (!done(r, read.size())) return false;
+    }
+
+    return true;
+}
+
+// Same as `transfer_blocking`, except the CPU is free while the transfer happens.
+bool transfer(Worker& w, uint8_t addr, span<uint8_t const> write, span<uint8_t> read) {
+    auto const n = write.size() + read.size();
+    if (n == 0) return true;
+    if (w.commands.size() < n) return transfer_blocking(w, addr, write, read);
+
+    // Every byte read needs a read cmd issued, which is what drives SCL for the read.
+    size_t i = 0;
+    for (auto x : write)
+        w.commands[i++] = x;
+    for (size_t j = 0; j < read.size(); ++j) {
+        auto const restart = j == 0 && !write.empty();
+        w.commands[i++] = I2C_IC_DATA_CMD_CMD_BITS | (restart ? I2C_IC_DATA_CMD_RESTART_BITS : 0);
+    }
+    w.commands[n - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+    auto* hw = i2c_get_hw(w.bus);
+    hw->enable = 0;  // target address can only be changed while disabled
+    hw->tar = addr;
+    hw->enable = 1;
+
+    (void)hw->clr_intr;
+    w.finished = false;
+    w.aborted = false;
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+
+    if (!read.empty()) {
+        auto c = dma_channel_get_default_config(w.dma_rx);
+        channel_config_set_dreq(&c, i2c_get_dreq(w.bus, false));
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        dma_channel_configure(w.dma_rx, &c, read.data(), &hw->data_cmd, read.size(), true);
+    }
+
+    auto c = dma_channel_get_default_config(w.dma_tx);
+    channel_config_set_dreq(&c, i2c_get_dreq(w.bus, true));
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(w.dma_tx, &c, &hw->data_cmd, w.commands.data(), n, true);
+
+    for (auto const timeout = time_64u() + I2C_DMA_TIMEOUT; !w.finished && time_64u() < timeout;)
+        ulTaskNotifyTake(pdTRUE, to_ticks(timeout - time_64u()));
+
+    hw->intr_mask = 0;
+    if (!w.finished || w.aborted) {
+        // Abort flushes the TX FIFO, the channels would be left waiting on DREQs forever.
+        dma_channel_abort(w.dma_tx);
+        dma_channel_abort(w.dma_rx);
+        // A NACK (abort) is just a device saying no. No stop at all -> something is holding the bus.
+        if (!w.finished) recover(w);
+        return false;
+    }
+
+    // The last byte is in the RX FIFO by the time the stop is detected, DMA is a few cycles at most.
+    if (!read.empty()) dma_channel_wait_for_finish_blocking(w.dma_rx);
+    return true;
+}
+
+bool mux_select(Worker& w, uint8_t mux_addr, uint8_t channels) {
+    return transfer(w, mux_addr, {&channels, 1}, {});
+}
+
+// Skipped if `to` is already selected, which is nearly always the case.
+bool route(Worker& w, I2C_Route const& to) {
+    if (!w.selected_dirty && w.selected == to) return true;
+
+    w.selected_dirty = true;
+    // leave the old mux w/ nothing selected, its devices would shadow any by the same address elsewhere
+    if (w.selected.mux_addr != 0 && w.selected.mux_addr != to.mux_addr) {
+        if (!mux_select(w, w.selected.mux_addr, 0)) return false;
+    }
+    if (to.mux_addr != 0 && !mux_select(w, to.mux_addr, to.channels)) return false;
+
+    w.selected = to;
+    w.selected_dirty = false;
+    return true;
+}
+
+bool execute(Worker& w, I2C_Transaction const& txn) {
+    if (txn.delay <= 0us) return transfer(w, txn.addr, txn.write, txn.read);
+
+    // device needs time to process the write before it'll respond, stop & give up the bus in between
+    if (!transfer(w, txn.addr, txn.write, {})) return false;
+    task_delay(txn.delay);
+    return transfer(w, txn.addr, {}, txn.read);
+}
+
+// `done` must be the last thing touched, the request may be destroyed as soon as it is visible.
+void complete(I2C_Request& request) {
+    auto* task = request.task;
+    if (request.executor) request.executor->schedule(*request.waiter);
+    request.done.store(true, memory_order_release);
+    if (task) xTaskNotifyGive(task);
+}
+
+[[noreturn]] void worker_run(void* worker_) {
+    auto& worker = *reinterpret_cast<Worker*>(worker_);
+    health::monitor(worker.heartbeat);
+    for (;;) {
+        worker.heartbeat.idle();  // nothing queued is fine
+        I2C_Request* request = nullptr;
+        if (!xQueueReceive(worker.queue, &request, portMAX_DELAY)) continue;
+        assert(request);
+
+        // a failed select could leave the batch going to whatever devices happen to be reachable, don't
+        worker.heartbeat.beat();
+        request->ok = route(worker, request->route);
+        for (auto it = request->batch.begin(); request->ok && it != request->batch.end(); ++it) {
+            worker.heartbeat.beat();
+            request->ok = execute(worker, *it);
+        }
+
+        complete(*request);
+    }
+}
+
+}  // namespace
+
+void i2c_workers_init() {
+    irq_handler_t const handlers[NUM_I2CS]{i2c_irq_handler<0>, i2c_irq_handler<1>};
+    char const* const names[NUM_I2CS]{"i2c0", "i2c1"};
+    for (auto* bus : {i2c0, i2c1}) {
+        auto const idx = i2c_hw_index(bus);
+        auto& w = g_workers.at(idx);
+        assert(!w.queue && "already initialised");
+        w.bus = bus;
+        w.commands = g_dma_commands.at(idx);
+        w.heartbeat.name = names[idx];
+        w.queue = xQueueCreate(I2C_WORKER_QUEUE_LENGTH, sizeof(I2C_Request*));
+        assert(w.queue);
+        w.dma_tx = dma_claim_unused_channel(true);
+        w.dma_rx = dma_claim_unused_channel(true);
+        w.task = Task(worker_run, "i2c", w.task_memory, &w, Priority::Sensors).release();
+
+        i2c_get_hw(bus)->intr_mask = 0;
+        irq_set_exclusive_handler(I2C0_IRQ + idx, handlers[idx]);
+        irq_set_enabled(I2C0_IRQ + idx, true);
+    }
+}
+
+void i2c_submit(i2c_inst_t& bus, I2C_Request& request) {
+    auto& w = worker(bus);
+    assert(w.queue && "`i2c_workers_init` not called");
+    assert(!request.done);
+
+    auto const* channel = mux_channel(bus);
+    request.route = channel ? channel->route : I2C_Route{};
+
+    auto* p = &request;
+    xQueueSend(w.queue, &p, portMAX_DELAY);
+}
+
+bool i2c_mux_exists(i2c_inst_t& bus, uint8_t mux_addr) {
+    // Root route, so every mux is already left w/ nothing selected & this doesn't change the worker's view.
+    uint8_t const none = 0;
+    uint8_t control = 0xFF;
+    if (!i2c_transfer_blocking(i2c_root(bus), mux_addr, {&none, 1}, {})) return false;
+    if (!i2c_transfer_blocking(i2c_root(bus), mux_addr, {}, {&control, 1})) return false;
+
+    return control == 0;
+}
+
+i2c_inst_t* i2c_mux_channel(i2c_inst_t& bus, uint8_t mux_addr, uint8_t channel) {
+    assert(channel < TCA9548A_CHANNELS);
+    auto& root = i2c_root(bus);
+    I2C_Route const route{.mux_addr = mux_addr, .channels = uint8_t(1u << channel)};
+
+    taskENTER_CRITICAL();  // probes for both buses run concurrently
+    auto const n = g_mux_channels_count.load(memory_order_relaxed);
+    auto* it = find_if(g_mux_channels.begin(), g_mux_channels.begin() + n,
+            [&](auto& x) { return x.inst.hw == root.hw && x.route == route; });
+    if (it == g_mux_channels.begin() + n && n < g_mux_channels.size()) {
+        *it = {.inst = root, .route = route, .root = uint8_t(i2c_hw_index(&root))};
+        g_mux_channels_count.store(n + 1, memory_order_release);
+    }
+    taskEXIT_CRITICAL();
+
+    return it == g_mux_channels.end() ? nullptr : &it->inst;
+}
+
+i2c_inst_t& i2c_root(i2c_inst_t& bus) {
+    auto const* channel = mux_channel(bus);
+    if (!channel) return bus;
+
+    return channel->root == 0 ? *i2c0 : *i2c1;
+}
+
+bool i2c_transfer_blocking(i2c_inst_t& bus, span<I2C_Transaction const> batch) {
+    if (batch.empty()) return true;
+
+    I2C_Request request{.batch = batch, .task = xTaskGetCurrentTaskHandle()};
+    i2c_submit(bus, request);
+    // Notifications are shared w/ other users (e.g. the executors), so only trust `done`.
+    while (!request.done.load(memory_order_acquire))
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    return request.ok;
+}
+
+bool i2c_transfer_blocking(i2c_inst_t& bus, uint8_t addr, span<uint8_t const> write, span<uint8_t> read) {
+    I2C_Transaction const txn{.addr = addr, .write = write, .read = read};
+    return i2c_transfer_blocking(bus, {&txn, 1});
+}
+
+I2C_Awaiter::~I2C_Awaiter() {
+    if (!request.waiter) return;  // never submitted
+
+    // Either we were cancelled mid-flight (rare), or the worker is between scheduling us and
+    // marking the request as done (a handful of instructions). Either way, just yield.
+    while (!request.done.load(memory_order_acquire))
+        taskYIELD();
+
+    request.executor->unlink(waiter);  // in case we're being destroyed while scheduled
+}
+
+Coroutine<bool> i2c_transfer(i2c_inst_t& bus, uint8_t addr, span<uint8_t const> write, span<uint8_t> read) {
+    I2C_Transaction const txn{.addr = addr, .write = write, .read = read};
+    co_return co_await i2c_transfer(bus, {&txn, 1});
+}
+
+}  // namespace nevermore
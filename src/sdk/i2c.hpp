@@ -1,16 +1,26 @@
 #pragma once
 
-#include "FreeRTOS.h"
+#include "FreeRTOS.h"  // IWYU pragma: keep
 #include "hardware/i2c.h"
-#include "semphr.h"  // IWYU pragma: keep [doesn't notice `SemaphoreHandle_t`]
+#include "utility/coroutine.hpp"
 #include "utility/crc.hpp"
+#include "utility/executor.hpp"
+#include "utility/log.hpp"
 #include "utility/packed_tuple.hpp"
-#include "utility/scope_guard.hpp"
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
 #include <cstdio>
 #include <optional>
+#include <span>
 #include <type_traits>
 
-// NB: These variants are lock guarded to prevent both cores from using the same bus.
+// NB: All traffic goes through a per-bus worker task, which owns the bus.
+//     Transactions in a batch are executed back-to-back, nothing else can sneak in between them.
+//     Transfers are DMA driven, so neither the caller nor the worker burn CPU while they're in flight.
+//     Devices behind a TCA9548A mux are reached through a per-channel handle (see `i2c_mux_channel`), the
+//     worker selects the channel before the batch.
 
 namespace nevermore {
 
@@ -24,13 +34,6 @@ constexpr I2C_Pin i2c_gpio_kind(uint8_t pin) {
     return I2C_Pin(pin % 2);
 }
 
-extern SemaphoreHandle_t g_i2c_locks[NUM_I2CS];
-
-inline auto i2c_guard(i2c_inst_t& i2c) {
-    auto& lock = g_i2c_locks[&i2c == i2c0 ? 0 : 1];  // NOLINT
-    return ScopeGuard{[&] { xSemaphoreGive(lock); }};
-}
-
 // I2C reserves some addresses for special purposes.
 // These are any addresses of the form: 000 0xxx, 111 1xxx
 constexpr bool i2c_address_reserved(uint8_t addr) {
@@ -39,36 +42,162 @@ constexpr bool i2c_address_reserved(uint8_t addr) {
     return masked == 0 || masked == MASK;
 }
 
+// Write `write`, wait `delay`, then read into `read`. Either span may be empty.
+// W/o a delay the read follows w/ a repeated start, otherwise the write is terminated w/ a stop.
+struct I2C_Transaction {
+    uint8_t addr;
+    std::span<uint8_t const> write;
+    std::span<uint8_t> read;
+    std::chrono::microseconds delay{};
+};
+
+// Which mux channel, if any, a request goes through.
+struct I2C_Route {
+    uint8_t mux_addr = 0;  // 0 -> the bus itself, all muxes are left w/ no channel selected
+    uint8_t channels = 0;  // bit mask, TCA9548A control register
+
+    constexpr bool operator==(I2C_Route const&) const = default;
+};
+
+struct I2C_Request {
+    std::span<I2C_Transaction const> batch;
+    bool ok = false;  // true IIF every transaction fully completed. Stops at first failure.
+    std::atomic<bool> done = false;
+    I2C_Route route{};  // filled in by `i2c_submit`
+
+    // completion, exactly one of these is set
+    Executor* executor = nullptr;
+    Executor::Waiter* waiter = nullptr;
+    TaskHandle_t task = nullptr;
+};
+
+// Must be called once before the scheduler is started.
+void i2c_workers_init();
+
+// TCA9548A: 8 channel I2C switch, up to 8 of them per bus (0x70 - 0x77).
+constexpr uint8_t TCA9548A_ADDRESS = 0x70;  // A[2:0] strapped low
+constexpr uint8_t TCA9548A_CHANNELS = 8;
+
+// From task context. Talk to a mux only through these, the worker caches which channel is selected.
+bool i2c_mux_exists(i2c_inst_t&, uint8_t mux_addr = TCA9548A_ADDRESS);
+// Returns a handle for `channel` of the mux, usable anywhere a bus is. Requests through it are routed to
+// that channel; the select is only issued when the bus's previous request went elsewhere.
+// Handles live forever & are shared by repeat calls. Returns nullptr if out of handles.
+i2c_inst_t* i2c_mux_channel(i2c_inst_t&, uint8_t mux_addr, uint8_t channel);
+// The hardware bus behind `bus`: itself, unless it's a mux channel handle.
+// Resolve a handle through this before `i2c_hw_index`, it only recognises `i2c0`/`i2c1` themselves.
+i2c_inst_t& i2c_root(i2c_inst_t& bus);
+
+// Queues `request` on the bus's worker, which signals completion via its executor/task.
+void i2c_submit(i2c_inst_t&, I2C_Request&);
+
+// From task context. Can be called from a coroutine, but will block the whole executor.
+bool i2c_transfer_blocking(i2c_inst_t&, std::span<I2C_Transaction const>);
+bool i2c_transfer_blocking(
+        i2c_inst_t& i2c, uint8_t addr, std::span<uint8_t const> write, std::span<uint8_t> read);
+
+struct [[nodiscard]] I2C_Awaiter {
+    I2C_Awaiter(i2c_inst_t& i2c, std::span<I2C_Transaction const> batch) : i2c(i2c) {
+        request.batch = batch;
+    }
+    I2C_Awaiter(I2C_Awaiter const&) = delete;
+    I2C_Awaiter& operator=(I2C_Awaiter const&) = delete;
+
+    // If our coroutine is destroyed mid-flight we must not leave the worker a dangling request.
+    ~I2C_Awaiter();
+
+    bool await_ready() const {
+        return request.batch.empty();
+    }
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> caller) {
+        waiter.handle = caller;
+        request.executor = caller.promise().executor;
+        request.waiter = &waiter;
+        i2c_submit(i2c, request);
+    }
+
+    [[nodiscard]] bool await_resume() const {
+        return request.batch.empty() || request.ok;
+    }
+
+private:
+    i2c_inst_t& i2c;  // NOLINT(cppcoreguidelines-avoid-const-or-ref-data-members)
+    I2C_Request request;
+    Executor::Waiter waiter;
+};
+
+// `batch` must outlive the `co_await`.
+inline I2C_Awaiter i2c_transfer(i2c_inst_t& i2c, std::span<I2C_Transaction const> batch) {
+    return {i2c, batch};
+}
+
+// Writes `write` and then reads into `read` as a single transaction (repeated start between them).
+// Either may be empty. Returns true IIF every byte was transferred.
+Coroutine<bool> i2c_transfer(
+        i2c_inst_t& i2c, uint8_t addr, std::span<uint8_t const> write, std::span<uint8_t> read);
+
+template <typename A, typename B>
+Coroutine<bool> i2c_transfer(i2c_inst_t& i2c, uint8_t addr, A const& write, B& read)
+    requires(!std::is_pointer_v<A> && !std::is_pointer_v<B>)
+{
+    return i2c_transfer(i2c, addr, std::span{reinterpret_cast<uint8_t const*>(&write), sizeof(A)},
+            std::span{reinterpret_cast<uint8_t*>(&read), sizeof(B)});
+}
+
+// Returns # of bytes written, or `PICO_ERROR_GENERIC`.
 template <typename A>
-int i2c_write_blocking(i2c_inst_t& i2c, uint8_t addr, A const& blob, bool nostop = false)
+int i2c_write_blocking(i2c_inst_t& i2c, uint8_t addr, A const& blob)
     requires(!std::is_pointer_v<A>)
 {
-    auto _ = i2c_guard(i2c);
-    return i2c_write_blocking(&i2c, addr, reinterpret_cast<uint8_t const*>(&blob), sizeof(A), nostop);
+    if (!i2c_transfer_blocking(i2c, addr, {reinterpret_cast<uint8_t const*>(&blob), sizeof(A)}, {}))
+        return PICO_ERROR_GENERIC;
+
+    return sizeof(A);
 }
 
+// Returns # of bytes read, or `PICO_ERROR_GENERIC`.
 template <typename A>
-int i2c_read_blocking(i2c_inst_t& i2c, uint8_t addr, A& blob, bool nostop = false)
+int i2c_read_blocking(i2c_inst_t& i2c, uint8_t addr, A& blob)
     requires(!std::is_pointer_v<A>)
 {
-    auto _ = i2c_guard(i2c);
-    return i2c_read_blocking(&i2c, addr, reinterpret_cast<uint8_t*>(&blob), sizeof(A), nostop);
+    if (!i2c_transfer_blocking(i2c, addr, {}, {reinterpret_cast<uint8_t*>(&blob), sizeof(A)}))
+        return PICO_ERROR_GENERIC;
+
+    return sizeof(A);
+}
+
+template <CRC8_t CRC_INIT, typename... A>
+std::optional<PackedTuple<A...>> i2c_crc_verified(ResponseCRC<PackedTuple<A...>, CRC_INIT> const& response) {
+    if (!response.verify()) {
+        LOG_DEFERRED("CRC failed\n");  // really should show up in a log if they've noise in their wiring
+        return {};
+    }
+
+    return response.data;
 }
 
 template <CRC8_t CRC_INIT, typename... A>
-std::optional<PackedTuple<A...>> i2c_read_blocking_crc(i2c_inst_t& i2c, uint8_t addr, bool nostop = false) {
+std::optional<PackedTuple<A...>> i2c_read_blocking_crc(i2c_inst_t& i2c, uint8_t addr) {
     static_assert(sizeof(PackedTuple<A...>) == (sizeof(A) + ...));  // sancheck packing
 
     ResponseCRC<PackedTuple<A...>, CRC_INIT> response;
-    auto ret = i2c_read_blocking(i2c, addr, response, nostop);
+    auto ret = i2c_read_blocking(i2c, addr, response);
     if (sizeof(response) != ret) return {};
 
-    if (!response.verify()) {
-        printf("CRC failed\n");  // really should show up in a log if they've noise in their wiring
-        return {};
-    }
+    return i2c_crc_verified(response);
+}
 
-    return response.data;
+template <CRC8_t CRC_INIT, typename... A>
+Coroutine<std::optional<PackedTuple<A...>>> i2c_read_crc(i2c_inst_t& i2c, uint8_t addr) {
+    static_assert(sizeof(PackedTuple<A...>) == (sizeof(A) + ...));  // sancheck packing
+
+    ResponseCRC<PackedTuple<A...>, CRC_INIT> response;
+    auto const into = std::span{reinterpret_cast<uint8_t*>(&response), sizeof(response)};
+    if (!co_await i2c_transfer(i2c, addr, std::span<uint8_t const>{}, into)) co_return std::nullopt;
+
+    co_return i2c_crc_verified(response);
 }
 
 }  // namespace nevermore
@@ -13,6 +13,50 @@ constexpr pwm_chan pwm_gpio_to_channel_(uint8_t gpio) {
     return gpio & 1u ? PWM_CHAN_B : PWM_CHAN_A;
 }
 
+// Largest counter period, - 1 so a level of `top` is still 100% duty.
+constexpr uint32_t PWM_TOP_MAX = UINT16_MAX - 1;
+// Slowest divider, 8.4 fixed point
+constexpr uint32_t PWM_DIV16_MAX = (UINT8_MAX << 4) | 0b1111;
+
+// Counter period (`top`, levels [0, top] span 0-100% duty) & clock divider (8.4 fixed point) for a slice.
+struct PwmDivider {
+    uint32_t div16 = 16;
+    uint32_t top = PWM_TOP_MAX;
+
+    [[nodiscard]] constexpr uint32_t hz(uint32_t source_hz) const {
+        auto const period16 = uint64_t(div16) * top;
+        return uint32_t((16 * uint64_t(source_hz) + period16 / 2) / period16);
+    }
+};
+
+// Best resolution at `freq_hz`: the smallest divider that fits the period in `PWM_TOP_MAX`, & the period
+// rounded as accurately as that divider allows. Clamped to the slowest/fastest the slice can go.
+// stolen/derived from: https://github.com/micropython/micropython/blob/master/ports/rp2/machine_pwm.c
+constexpr PwmDivider pwm_divider(uint32_t source_hz, uint32_t freq_hz) {
+    // Returns: floor((16*F + offset) / div16)
+    auto const slice_hz = [&](uint64_t offset, uint64_t div16) -> uint64_t {
+        // 64 bit, 16*F + offset overflows 32 bits
+        return (16 * uint64_t(source_hz) + offset) / div16;
+    };
+    auto const slice_hz_ceil = [&](uint64_t div16) { return slice_hz(div16 - 1, div16); };
+    auto const slice_hz_round = [&](uint64_t div16) { return slice_hz(div16 / 2, div16); };
+
+    if (freq_hz == 0) return {.div16 = PWM_DIV16_MAX, .top = PWM_TOP_MAX};
+    auto const top = (uint64_t(source_hz) + freq_hz / 2) / freq_hz;
+    if (top < PWM_TOP_MAX) return {.div16 = 16, .top = uint32_t(top < 2 ? 2 : top)};
+
+    // Constraint: 16*F/(div16*freq) < TOP_MAX
+    auto const div16 = slice_hz_ceil(uint64_t(PWM_TOP_MAX) * freq_hz);
+    if (PWM_DIV16_MAX < div16) return {.div16 = PWM_DIV16_MAX, .top = PWM_TOP_MAX};
+
+    auto const top_div = slice_hz_round(div16 * freq_hz);
+    return {.div16 = uint32_t(div16), .top = uint32_t(top_div < PWM_TOP_MAX ? top_div : PWM_TOP_MAX)};
+}
+static_assert(pwm_divider(125'000'000, 25'000).div16 == 16 && pwm_divider(125'000'000, 25'000).top == 5'000);
+static_assert(pwm_divider(125'000'000, 25).top <= PWM_TOP_MAX);
+static_assert(pwm_divider(125'000'000, 25).hz(125'000'000) == 25);
+static_assert(pwm_divider(125'000'000, 1).div16 == PWM_DIV16_MAX);  // slowest it goes (~7.5 Hz)
+
 // Return the level while accounting for the slice's current top.
 uint16_t pwm_gpio_duty(uint8_t gpio, uint16_t duty);
 
@@ -21,4 +65,12 @@ void pwm_set_gpio_duty(uint8_t gpio, uint16_t duty);
 
 void pwm_config_set_freq_hz(pwm_config& c, uint32_t freq_hz);
 
+// Retimes a running slice. Levels are relative to the period, the caller re-applies its duties after.
+void pwm_slice_set_divider(uint slice_num, PwmDivider);
+
+// As the slice runs now.
+PwmDivider pwm_slice_divider(uint slice_num);
+// Counter wraps per second, as the slice runs now (halved in phase correct mode).
+uint32_t pwm_slice_wrap_hz(uint slice_num);
+
 }  // namespace nevermore
@@ -0,0 +1,134 @@
+#include "pwm_ramp.hpp"
+#include "hardware/dma.h"
+#include "hardware/pwm.h"
+#include "pwm.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+namespace nevermore {
+
+namespace {
+
+constexpr uint8_t SLICE_UNCLAIMED = UINT8_MAX;
+
+struct Engine {
+    uint8_t slice = SLICE_UNCLAIMED;
+    uint dma_data = 0;     // paced by the slice's wrap, writes the current step to CC `trans_count` times
+    uint dma_control = 0;  // re-triggers `dma_data` w/ the next step's address
+    array<uint16_t, 2> target{};  // level, by `pwm_chan`
+    // CC images (channel A in the low half, B in the high), a ramp of `n` steps takes the last `n`
+    array<uint32_t, PWM_RAMP_STEPS> steps{};
+    // Fed to the data channel's read address trigger, 1 per step. The null ends the ramp, a null trigger
+    // doesn't start the channel.
+    array<uint32_t const*, PWM_RAMP_STEPS + 1> chain{};
+};
+
+// Only touched by the task that owns the slices.
+array<Engine, PWM_RAMP_SLICES_MAX> g_engines;
+
+Engine* engine(uint8_t slice) {
+    auto it = ranges::find(g_engines, slice, &Engine::slice);
+    return it == g_engines.end() ? nullptr : &*it;
+}
+
+void stop(Engine const& x) {
+    // data may complete (& chain to control) as it's aborted, so abort it once more after control
+    dma_channel_abort(x.dma_data);
+    dma_channel_abort(x.dma_control);
+    dma_channel_abort(x.dma_data);
+}
+
+constexpr uint32_t cc_pack(uint16_t a, uint16_t b) {
+    return uint32_t(b) << 16 | a;
+}
+
+}  // namespace
+
+bool pwm_ramp_init(uint8_t gpio) {
+    auto const slice = pwm_gpio_to_slice_num_(gpio);
+    if (engine(slice)) return true;
+
+    auto* x = engine(SLICE_UNCLAIMED);
+    if (!x) {
+        printf("WARN - PWM - no ramp engines left for slice %u, it'll step instead\n", unsigned(slice));
+        return false;
+    }
+
+    auto const data = dma_claim_unused_channel(false);
+    auto const control = dma_claim_unused_channel(false);
+    if (data < 0 || control < 0) {
+        if (0 <= data) dma_channel_unclaim(uint(data));
+        if (0 <= control) dma_channel_unclaim(uint(control));
+        printf("WARN - PWM - no DMA channels left for slice %u, it'll step instead\n", unsigned(slice));
+        return false;
+    }
+
+    x->slice = slice;
+    x->dma_data = uint(data);
+    x->dma_control = uint(control);
+    for (size_t i = 0; i < x->steps.size(); ++i)
+        x->chain.at(i) = &x->steps.at(i);
+    x->chain.back() = nullptr;
+
+    auto& hw = pwm_hw->slice[slice];  // NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+    x->target = {uint16_t(hw.cc), uint16_t(hw.cc >> 16)};
+
+    auto cfg_data = dma_channel_get_default_config(x->dma_data);
+    channel_config_set_transfer_data_size(&cfg_data, DMA_SIZE_32);  // CC can't take narrow writes
+    channel_config_set_read_increment(&cfg_data, false);
+    channel_config_set_write_increment(&cfg_data, false);
+    channel_config_set_dreq(&cfg_data, DREQ_PWM_WRAP0 + slice);
+    channel_config_set_chain_to(&cfg_data, x->dma_control);
+    dma_channel_configure(x->dma_data, &cfg_data, &hw.cc, x->steps.data(), 1, false);
+
+    auto cfg_control = dma_channel_get_default_config(x->dma_control);
+    channel_config_set_transfer_data_size(&cfg_control, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg_control, true);
+    channel_config_set_write_increment(&cfg_control, false);
+    dma_channel_configure(x->dma_control, &cfg_control, &dma_hw->ch[x->dma_data].al3_read_addr_trig,
+            x->chain.data(), 1, false);
+    return true;
+}
+
+void pwm_ramp_gpio_duty(uint8_t gpio, uint16_t duty, chrono::microseconds duration, PwmRampShape shape) {
+    auto const slice = pwm_gpio_to_slice_num_(gpio);
+    auto const level = pwm_gpio_duty(gpio, duty);
+    auto* x = engine(slice);
+    if (!x) {
+        pwm_set_gpio_level(gpio, level);
+        return;
+    }
+
+    stop(*x);
+    auto& hw = pwm_hw->slice[slice];  // NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+    uint32_t const cc = hw.cc;        // wherever the last ramp got to
+    x->target.at(pwm_gpio_to_channel_(gpio)) = level;
+
+    auto const wraps = uint64_t(max<int64_t>(duration.count(), 0)) * pwm_slice_wrap_hz(slice) / 1'000'000;
+    auto const n = size_t(min<uint64_t>(wraps, PWM_RAMP_STEPS));
+    if (n < 2) {
+        hw.cc = cc_pack(x->target[0], x->target[1]);
+        return;
+    }
+
+    auto const lerp = [](uint16_t from, uint16_t to, float f) {
+        return uint16_t(int32_t(from) + lroundf(float(int32_t(to) - int32_t(from)) * f));
+    };
+    auto const from_a = uint16_t(cc);
+    auto const from_b = uint16_t(cc >> 16);
+    auto const first = x->steps.size() - n;
+    for (size_t i = 0; i < n; ++i) {
+        auto const f = pwm_ramp_shape(shape, float(i + 1) / float(n));
+        x->steps.at(first + i) = cc_pack(lerp(from_a, x->target[0], f), lerp(from_b, x->target[1], f));
+    }
+    x->steps.back() = cc_pack(x->target[0], x->target[1]);  // exactly, whatever the rounding
+
+    dma_channel_set_trans_count(x->dma_data, uint32_t(wraps / n), false);
+    dma_channel_set_read_addr(x->dma_control, &x->chain.at(first), true);
+}
+
+}  // namespace nevermore
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Hardware duty ramps. A DMA channel paced by the slice's wrap DREQ writes a precomputed ramp into the
+// slice's CC register, a 2nd (control) channel steps it through the ramp. Once started, a ramp runs to the
+// end w/o any IRQs or CPU time.
+namespace nevermore {
+
+enum class PwmRampShape : uint8_t {
+    Linear = 0,
+    EaseIn = 1,  // slow start, eases a stopped fan's inrush & the thump of it spinning up
+    Smooth = 2,  // slow start & finish
+};
+
+// Each ramping slice takes 2 DMA channels, that's all we can spare.
+constexpr size_t PWM_RAMP_SLICES_MAX = 2;
+// Steps per ramp, each held for an equal number of PWM periods.
+constexpr size_t PWM_RAMP_STEPS = 32;
+
+// Fraction of the way along a ramp of `shape` at `t` [0, 1].
+constexpr float pwm_ramp_shape(PwmRampShape shape, float t) {
+    switch (shape) {
+    case PwmRampShape::Linear: break;
+    case PwmRampShape::EaseIn: return t * t;
+    case PwmRampShape::Smooth: return t * t * (3 - 2 * t);
+    }
+    return t;
+}
+static_assert(pwm_ramp_shape(PwmRampShape::EaseIn, 0) == 0 && pwm_ramp_shape(PwmRampShape::EaseIn, 1) == 1);
+static_assert(pwm_ramp_shape(PwmRampShape::Smooth, 0) == 0 && pwm_ramp_shape(PwmRampShape::Smooth, 1) == 1);
+static_assert(pwm_ramp_shape(PwmRampShape::Smooth, .5f) == .5f);
+static_assert(pwm_ramp_shape(PwmRampShape::EaseIn, .5f) < pwm_ramp_shape(PwmRampShape::Linear, .5f));
+
+// Claims `gpio`'s slice a ramp engine, idempotent. Call after the slice is configured.
+// Returns false if there are no engines or DMA channels left, `pwm_ramp_gpio_duty` then steps instead.
+bool pwm_ramp_init(uint8_t gpio);
+
+// Ramps `gpio`'s duty (accounting for the slice's top, see `pwm_set_gpio_duty`) from wherever it is now
+// (mid-ramp or not) to `duty` over about `duration`. Zero duration (or no engine) -> set immediately.
+// A ramp in flight on the slice's other channel is carried on to its target, re-timed to finish w/ this one.
+// PRECONDITION: slices are only ramped/set by a single task.
+void pwm_ramp_gpio_duty(uint8_t gpio, uint16_t duty, std::chrono::microseconds duration,
+        PwmRampShape shape = PwmRampShape::Linear);
+
+}  // namespace nevermore
@@ -0,0 +1,28 @@
+#include "task.hpp"
+#include "pico/time.h"
+
+using namespace std;
+
+namespace nevermore {
+
+void task_delay_alarm(chrono::microseconds delay) {
+    // The handle is all the callback needs, nothing on our stack is touched after we've been woken.
+    auto const id = add_alarm_in_us(
+            delay / 1us,
+            [](alarm_id_t, void* task) -> int64_t {
+                BaseType_t woken = pdFALSE;
+                vTaskNotifyGiveIndexedFromISR(TaskHandle_t(task), TASK_NOTIFY_INDEX_DELAY, &woken);
+                portYIELD_FROM_ISR(woken);  // NOLINT
+                return 0;                   // 0 -> no repeat
+            },
+            xTaskGetCurrentTaskHandle(), false);
+    if (id == 0) return;  // already elapsed
+    if (id < 0) {         // out of alarm slots
+        busy_wait(delay);
+        return;
+    }
+
+    ulTaskNotifyTakeIndexed(TASK_NOTIFY_INDEX_DELAY, pdTRUE, portMAX_DELAY);
+}
+
+}  // namespace nevermore
@@ -3,39 +3,60 @@
 #include "FreeRTOS.h"  // IWYU pragma: keep
 #include "sdk/timer.hpp"
 #include "task.h"  // IWYU pragma: keep [vTaskDelay, and others]
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <limits>
 #include <ratio>
 
 namespace nevermore {
 
+static_assert(1'000'000 % configTICK_RATE_HZ == 0, "tick period must be a whole # of microseconds");
+constexpr std::chrono::microseconds TICK_PERIOD{1'000'000 / configTICK_RATE_HZ};
+
+// Task notification index reserved for `task_delay_alarm`. Index 0 belongs to everyone else
+// (executors, I2C workers, ...).
+constexpr UBaseType_t TASK_NOTIFY_INDEX_DELAY = 1;
+static_assert(TASK_NOTIFY_INDEX_DELAY < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+// Reserved for a task blocked on another's reply (e.g. `ui::call`), whatever it's using index 0 for.
+constexpr UBaseType_t TASK_NOTIFY_INDEX_REPLY = 2;
+static_assert(TASK_NOTIFY_INDEX_REPLY < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+
 template <typename A, typename Ratio>
 consteval TickType_t to_ticks_safe(std::chrono::duration<A, Ratio> delay, bool allow_underflow = false) {
-    using namespace std::literals::chrono_literals;
+    auto delay_us = std::chrono::duration_cast<std::chrono::duration<int64_t, std::micro>>(delay);
+    if (delay_us.count() <= 0) throw "invalid delay value";
 
-    auto delay_ms = std::chrono::duration_cast<std::chrono::duration<int64_t, std::milli>>(delay);
-    if (delay_ms.count() <= 0) throw "invalid delay value";
-    if (std::numeric_limits<TickType_t>::max() < delay_ms.count()) throw "invalid delay value";
-
-    auto delay_ticks = pdMS_TO_TICKS(delay_ms / 1ms);
+    // truncates, same as `pdMS_TO_TICKS`, but w/o the intermediate overflow or ms granularity
+    auto delay_ticks = delay_us / TICK_PERIOD;
+    if (std::numeric_limits<TickType_t>::max() < delay_ticks) throw "invalid delay value";
     if (!allow_underflow && delay_ticks == 0) throw "delay too small for tick rate";
 
-    return delay_ticks;
+    return TickType_t(delay_ticks);
+}
+
+// Runtime counterpart to `to_ticks_safe`. Rounds up so a delay is never shorter than requested.
+inline TickType_t to_ticks(std::chrono::microseconds delay) {
+    if (delay.count() <= 0) return 0;
+
+    auto ticks = (uint64_t(delay.count()) * configTICK_RATE_HZ + 999'999) / 1'000'000;
+    return TickType_t(std::min<uint64_t>(ticks, portMAX_DELAY - 1));
 }
 
+// Sleeps for less than a tick w/o spinning, a hardware alarm wakes the task back up.
+// Falls back to busy waiting if no alarm is available.
+void task_delay_alarm(std::chrono::microseconds delay);
+
+// Never returns early. Sub-tick delays are handled by `task_delay_alarm`.
 template <typename A, typename Period>
 void task_delay(std::chrono::duration<A, Period> delay) {
-    if (delay <= std::chrono::duration<A, Period>(0)) return;
-
-    auto delay_ms = std::chrono::duration_cast<std::chrono::duration<int64_t, std::milli>>(delay);
-    if (delay_ms.count() <= 0) {  // too small for task-delay -> busy wait instead
-        busy_wait(delay);
-        return;
-    }
+    auto const delay_us = std::chrono::ceil<std::chrono::microseconds>(delay);
+    if (delay_us <= std::chrono::microseconds(0)) return;
+    if (delay_us < TICK_PERIOD) return task_delay_alarm(delay_us);
 
-    assert(delay_ms.count() <= std::numeric_limits<TickType_t>::max());
-    vTaskDelay(pdMS_TO_TICKS(delay_ms.count()));
+    // +1 b/c we're already part way into the current tick, `vTaskDelay(n)` can be up to a tick short
+    vTaskDelay(std::min<TickType_t>(to_ticks(delay_us), portMAX_DELAY - 2) + 1);
 }
 
 }  // namespace nevermore
@@ -12,6 +12,19 @@ inline std::chrono::microseconds time_64u() {
     return std::chrono::microseconds{time_us_64()};  // no worries about unsigned
 }
 
+// `std::chrono` clock over the 1 MHz hardware timer. Safe from either core & from ISRs.
+struct TimerClock {
+    using duration = std::chrono::microseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<TimerClock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() {
+        return time_point{time_64u()};
+    }
+};
+
 template <typename T, typename U>
 void busy_wait(std::chrono::duration<T, U> dur) {
     busy_wait_us(dur / 1us);
@@ -1,30 +1,46 @@
 #include "sensors.hpp"
-#include "hardware/adc.h"
+#include "FreeRTOS.h"  // IWYU pragma: keep
 #include "hardware/i2c.h"
+#include "sdk/adc.hpp"
 #include "sdk/ble_data_types.hpp"
+#include "sdk/i2c.hpp"
+#include "sdk/task.hpp"
 #include "sdk/timer.hpp"
+#include "semphr.h"
 #include "sensors/async_sensor.hpp"
 #include "sensors/bme280.hpp"
 #include "sensors/bme68x.hpp"
 #include "sensors/cst816s.hpp"
 #include "sensors/environmental.hpp"
+#include "sensors/history.hpp"
 #include "sensors/htu2xd.hpp"
 #include "sensors/sgp40.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include "utility/seqlock.hpp"
+#include "utility/task.hpp"
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <cstdio>
-#include <vector>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <utility>
 
 using namespace std;
+using namespace std::literals::chrono_literals;
 
 namespace nevermore::sensors {
 
 Sensors g_sensors;
-Config g_config;
+Captured g_captured;
 
 namespace {
 
-constexpr uint32_t ADC_CHANNEL_TEMP_SENSOR = 4;
+// One per GATT service that cares, plus a bit of slack.
+constexpr size_t OBSERVERS_MAX = 4;
 
 constexpr auto SENSOR_POWER_ON_DELAY = max({
         BME280_POWER_ON_DELAY,
@@ -33,92 +49,338 @@ constexpr auto SENSOR_POWER_ON_DELAY = max({
         SGP40_POWER_ON_DELAY,
 });
 
-using VecSensors = vector<unique_ptr<Sensor>>;
+// Each bus is probed by its own short lived task, concurrently w/ the other bus & the rest of init.
+// I2C traffic goes through per-bus workers, so the buses don't contend.
+constexpr uint32_t PROBE_STACK_DEPTH = 1024;
 
-VecSensors g_sensors_intake;
-VecSensors g_sensors_exhaust;
+// Afterwards the hot-plug supervisor re-probes empty addresses, so a sensor that was loose at boot (or that
+// dropped out & gave up) comes back w/o a power cycle. It has its own task, so live sensors on the same bus
+// carry on while it probes; their transfers interleave w/ its through the bus worker.
+constexpr auto HOTPLUG_PERIOD = 5s;
+// Per address, doubled after each probe that finds nothing & each time a sensor there gives up.
+constexpr auto HOTPLUG_RETRY_MIN = 10s;
+constexpr auto HOTPLUG_RETRY_MAX = 10min;
+
+// Probes sharing an I2C address share a slot, at most one of them can be present.
+struct Probe {
+    using Make = unique_ptr<SensorPeriodic> (*)(i2c_inst_t&, EnvironmentalFilter);
+
+    uint8_t slot;
+    // Touch controller: only probed at boot. It registers w/ LVGL, & it shares its reset pin w/ the other
+    // bus, so probing it would reset a live one.
+    bool boot_only;
+    Make mk;
+};
+
+// Only drivers in the manifest are instantiated, the rest aren't referenced & needn't be linked at all.
+template <SensorDriver DRIVER>
+constexpr Probe probe_of() {
+    using enum SensorDriver;
+    if constexpr (DRIVER == HTU2xD) return {.slot = 0, .boot_only = false, .mk = htu2xd};
+    if constexpr (DRIVER == BME280) return {.slot = 1, .boot_only = false, .mk = bme280};
+    if constexpr (DRIVER == BME68x) return {.slot = 1, .boot_only = false, .mk = bme68x};
+    if constexpr (DRIVER == SGP40) return {.slot = 2, .boot_only = false, .mk = sgp40};
+    if constexpr (DRIVER == CST816S)
+        return {.slot = 3,
+                .boot_only = true,
+                .mk = [](i2c_inst_t& bus, EnvironmentalFilter) -> unique_ptr<SensorPeriodic> {
+                    return sensors::CST816S::mk(bus);
+                }};
+}
+
+// order matters since they'll be updated in whatever order they were found/probed for
+constexpr auto PROBES = []<size_t... I>(index_sequence<I...>) {
+    return array<Probe, sizeof...(I)>{probe_of<SENSOR_DRIVERS[I]>()...};
+}(make_index_sequence<size(SENSOR_DRIVERS)>{});
+constexpr size_t SLOTS_MAX = 4;
+static_assert(ranges::all_of(PROBES, [](auto& x) { return x.slot < SLOTS_MAX; }));
+
+struct Slot {
+    unique_ptr<SensorPeriodic> sensor;  // driver instances come from their pools, never the heap
+    chrono::microseconds found_at{};
+    chrono::microseconds retry_at{};
+    chrono::microseconds retry_delay = HOTPLUG_RETRY_MIN;
+};
+
+// The bus itself, or one channel of a TCA9548A on it. Each is its own address space.
+struct Segment {
+    i2c_inst_t* i2c = nullptr;
+    array<char, 8> name{};  // for logging, e.g. `I2C0` or `I2C0.3`
+    array<Slot, SLOTS_MAX> slots{};
+
+    [[nodiscard]] bool occupied(uint8_t slot) const {
+        return !!slots.at(slot).sensor;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return ranges::none_of(slots, [](auto& x) { return !!x.sensor; });
+    }
+
+    void backoff(uint8_t slot_index, chrono::microseconds now) {
+        auto& slot = slots.at(slot_index);
+        slot.retry_at = now + slot.retry_delay;
+        slot.retry_delay = min<chrono::microseconds>(slot.retry_delay * 2, HOTPLUG_RETRY_MAX);
+    }
+};
+
+// Everything on a bus, mux channels included, feeds that bus's side. Redundant sensors are fused.
+struct Bus {
+    i2c_inst_t& i2c;  // NOLINT(cppcoreguidelines-avoid-const-or-ref-data-members)
+    EnvironmentalFilter::Kind side;
+    // [0] is the bus itself, then any mux channels.
+    // Written by the bus's probe task, then only by the supervisor once `probed` is set.
+    array<Segment, 1 + TCA9548A_CHANNELS> segments_storage{};
+    uint8_t segments_count = 0;
+    atomic<bool> probed = false;
+    TaskStorage<PROBE_STACK_DEPTH> probe_task{};
+
+    [[nodiscard]] span<Segment> segments() {
+        return span{segments_storage}.first(segments_count);
+    }
+
+    void segment_add(Segment segment) {
+        segments_storage.at(segments_count++) = std::move(segment);
+    }
+};
+
+array<Bus, 2> g_buses{{
+        {.i2c = *i2c0, .side = EnvironmentalFilter::Kind::Intake},
+        {.i2c = *i2c1, .side = EnvironmentalFilter::Kind::Exhaust},
+}};
+TaskStorage<PROBE_STACK_DEPTH> g_supervise_task;
+
+// Touch controllers on both buses share the reset pin, so only one may be probed at a time.
+SemaphoreHandle_t g_touch_probe_lock = nullptr;
+
+array<Observer, OBSERVERS_MAX> g_observers{};
+atomic<size_t> g_observers_count = 0;
+atomic<bool> g_dirty = false;
+atomic<bool> g_dirty_captured = false;  // only capture times moved, values are unchanged
+atomic<uint8_t> g_sampling_demands = 0;  // `SamplingDemand` bitset
+
+struct Published {
+    Sensors raw;
+    Sensors resolved;
+    Captured captured;  // of `raw`, resolved on demand (few readers care)
+};
+
+SeqLock<Published> g_published;
+
+// `raw` is a 16 bit scaled mean (see `adc_capture_mean`). All integer, no soft-float.
+constexpr BLE::Temperature mcu_temperature(uint16_t raw) {
+    constexpr int64_t VREF_UV = 3'300'000;
+    // The temp sensor measures the Vbe voltage of a biased bipolar diode, connected to ADC input 4.
+    // Typically, Vbe = 0.706V at 27c, with a slope of -1.721mV (0.001721) per degree.
+    auto const vbe_uv = int64_t(raw) * VREF_UV / 65536;
+    return BLE::Temperature::from_fixed<-3>(27'000 - (vbe_uv - 706'000) * 1'000 / 1'721);
+}
+static_assert(mcu_temperature(14'021) == BLE::Temperature::from_fixed<-2>(26'99));  // ~0.706 V
 
 struct McuTemperature final : SensorPeriodic {
     [[nodiscard]] char const* name() const override {
         return "MCU Temperature";
     }
 
-    void read() override {
-        nevermore::sensors::g_sensors.temperature_mcu = measure();
-    }
+    Coroutine<> read() override {
+        auto const raw = adc_capture_mean(ADC_INPUT_TEMPERATURE);
+        if (!raw) co_return;  // capture (re)started moments ago, keep the last reading
+
+        auto const temperature = mcu_temperature(*raw);
+        taskENTER_CRITICAL();
+        bool const changed = temperature != nevermore::sensors::g_sensors.temperature_mcu;
+        nevermore::sensors::g_sensors.temperature_mcu = temperature;
+        nevermore::sensors::g_captured.temperature_mcu = time_us_64();
+        taskEXIT_CRITICAL();
+        if (changed)
+            mark_dirty();
+        else
+            mark_captured();
 
-private:
-    static double measure() {
-        // ref https://github.com/raspberrypi/pico-micropython-examples/blob/master/adc/temperature.py
-        constexpr auto SCALE_COEFFICIENT = 3.3 / 65535;
-        constexpr uint32_t BITS = 12;
-
-        adc_select_input(ADC_CHANNEL_TEMP_SENSOR);
-        uint32_t raw32 = adc_read();
-        // Scale raw reading to 16 bit value using a Taylor expansion (for 8 <= bits <= 16)
-        uint16_t raw16 = raw32 << (16 - BITS) | raw32 >> (2 * BITS - 16);
-        auto reading = raw16 * SCALE_COEFFICIENT;
-        // The temp sensor measures the Vbe voltage of a biased bipolar diode, connected to ADC channel 4.
-        // Typically, Vbe = 0.706V at 27c, with a slope of -1.721mV (0.001721) per degree.
-        auto deg_c = 27 - (reading - 0.706) / 0.001721;
-        return deg_c;
+        co_return;
     }
 } g_mcu_temperature_sensor;
 
-VecSensors sensors_init_bus(i2c_inst_t& bus, EnvironmentalFilter state) {
-    VecSensors sensors;
-    auto probe_for = [&](auto p) {
-        if (!p) return;
-        printf("Found %s\n", p->name());
-        p->start();
-        sensors.push_back(std::move(p));
-    };
+bool probe_for(Bus const& bus, Segment& segment, Probe const& probe) {
+    if (segment.occupied(probe.slot)) return false;
+
+    if (probe.boot_only) xSemaphoreTake(g_touch_probe_lock, portMAX_DELAY);
+    auto p = probe.mk(*segment.i2c, {bus.side});
+    if (probe.boot_only) xSemaphoreGive(g_touch_probe_lock);
+    if (!p) return false;
+
+    printf("%s - found %s\n", segment.name.data(), p->name());
+    p->start();
+    auto& slot = segment.slots.at(probe.slot);
+    slot.sensor = std::move(p);
+    slot.found_at = time_64u();
+    return true;
+}
+
+Segment mk_segment(i2c_inst_t& i2c, optional<uint8_t> channel = {}) {
+    Segment x{.i2c = &i2c};
+    auto const bus_num = i2c_hw_index(&i2c_root(i2c));
+    if (channel)
+        snprintf(x.name.data(), x.name.size(), "I2C%u.%u", bus_num, unsigned(*channel));
+    else
+        snprintf(x.name.data(), x.name.size(), "I2C%u", bus_num);
+    return x;
+}
+
+void probe(void* bus_) {
+    auto& bus = *reinterpret_cast<Bus*>(bus_);
+    task_delay(SENSOR_POWER_ON_DELAY);
+
+    auto const bus_num = i2c_hw_index(&bus.i2c);
+    printf("I2C%u - initializing sensors...\n", bus_num);
+    bus.segment_add(mk_segment(bus.i2c));
+    if (i2c_mux_exists(bus.i2c)) {
+        printf("I2C%u - found TCA9548A\n", bus_num);
+        for (uint8_t i = 0; i < TCA9548A_CHANNELS; ++i)
+            if (auto* channel = i2c_mux_channel(bus.i2c, TCA9548A_ADDRESS, i))
+                bus.segment_add(mk_segment(*channel, i));
+    }
+
+    auto const now = time_64u();
+    bool found = false;
+    for (auto& segment : bus.segments()) {
+        bool const root = &segment == &bus.segments().front();
+        for (auto const& x : PROBES)
+            if (root || !x.boot_only) probe_for(bus, segment, x);
+
+        for (uint8_t i = 0; i < SLOTS_MAX; ++i)
+            if (!segment.occupied(i)) segment.backoff(i, now);
+
+        found = found || !segment.empty();
+    }
+
+    if (!found) printf("!! I2C%u - no sensors found?\n", bus_num);
+
+    bus.probed.store(true, memory_order_release);  // hand `segments` over to the supervisor
+    vTaskDelete(nullptr);
+}
+
+void supervise_segment(Bus const& bus, Segment& segment, chrono::microseconds now) {
+    // A sensor only gives up once its coroutine is done w/ it, so it's safe to destroy here.
+    // Destroying it hands its instance back to the driver's pool for whatever is found next.
+    for (uint8_t i = 0; i < SLOTS_MAX; ++i) {
+        auto& slot = segment.slots.at(i);
+        if (!slot.sensor || !slot.sensor->gave_up()) continue;
+
+        printf("WARN - %s - lost %s, will re-probe\n", segment.name.data(), slot.sensor->name());
+        slot.sensor.reset();
+        // it was healthy for a good while, treat it as a fresh failure rather than a flapping sensor
+        if (HOTPLUG_RETRY_MAX < now - slot.found_at) slot.retry_delay = HOTPLUG_RETRY_MIN;
+        segment.backoff(i, now);
+    }
+
+    for (uint8_t i = 0; i < SLOTS_MAX; ++i) {
+        if (segment.occupied(i) || now < segment.slots.at(i).retry_at) continue;
+
+        bool tried = false;
+        for (auto const& x : PROBES) {
+            if (x.slot != i || x.boot_only) continue;
+
+            tried = true;
+            if (probe_for(bus, segment, x)) break;
+        }
 
-    // order matters since they'll be updated in whatever order they were found/probed for
-    probe_for(htu2xd(bus, state));
-    probe_for(bme280(bus, state));
-    probe_for(bme68x(bus, state));
-    probe_for(sgp40(bus, state));
-    probe_for(CST816S::mk(bus));
+        if (tried && !segment.occupied(i)) segment.backoff(i, now);
+    }
+}
+
+void supervise(void*) {
+    for (;;) {
+        task_delay(HOTPLUG_PERIOD);
 
-    if (sensors.empty()) printf("!! No sensors found?\n");
-    return sensors;
+        auto const now = time_64u();
+        for (auto& bus : g_buses)
+            if (bus.probed.load(memory_order_acquire))
+                for (auto& segment : bus.segments())
+                    supervise_segment(bus, segment, now);
+    }
 }
 
 }  // namespace
 
-Sensors Sensors::with_fallbacks(Config const& config) const {
-    EnvironmentalFilter intake{EnvironmentalFilter::Kind::Intake};
-    EnvironmentalFilter exhaust{EnvironmentalFilter::Kind::Exhaust};
-    auto apply = [&]<typename A>(A& x, EnvironmentalFilter side) { x = side.get<A>(*this, config); };
-    Sensors sensors = *this;
-    apply(sensors.temperature_intake, intake);
-    apply(sensors.humidity_intake, intake);
-    apply(sensors.pressure_intake, intake);
-    apply(sensors.voc_index_intake, intake);
-    apply(sensors.temperature_exhaust, exhaust);
-    apply(sensors.humidity_exhaust, exhaust);
-    apply(sensors.pressure_exhaust, exhaust);
-    apply(sensors.voc_index_exhaust, exhaust);
-    return sensors;
+void observe(Observer observer) {
+    assert(observer);
+    auto const i = g_observers_count.load(memory_order_relaxed);
+    assert(i < g_observers.size() && "too many observers, bump `OBSERVERS_MAX`");
+    g_observers.at(i) = observer;
+    g_observers_count.store(i + 1, memory_order_release);  // publish the slot before it's visible
 }
 
-bool init() {
-    adc_select_input(ADC_CHANNEL_TEMP_SENSOR);
-    adc_set_temp_sensor_enabled(true);
-    g_mcu_temperature_sensor.start();
+Sensors snapshot() {
+    return g_published.load().raw;
+}
 
-    printf("Waiting %u ms for sensor init\n", unsigned(SENSOR_POWER_ON_DELAY / 1ms));
-    busy_wait(SENSOR_POWER_ON_DELAY);
+Sensors snapshot_resolved() {
+    return g_published.load().resolved;
+}
+
+uint32_t snapshot_version() {
+    return g_published.version();
+}
 
-    printf("I2C0 - initializing sensors...\n");
-    g_sensors_intake = sensors_init_bus(*i2c0, {EnvironmentalFilter::Kind::Intake});
+Stamped snapshot_stamped() {
+    auto const x = g_published.load();
+    return {.sensors = x.raw, .captured = x.captured};
+}
+
+Stamped snapshot_resolved_stamped() {
+    auto const x = g_published.load();
+    return {.sensors = x.resolved, .captured = x.captured.with_fallbacks(x.raw)};
+}
+
+void mark_dirty() {
+    g_dirty.store(true, memory_order_relaxed);
+}
+
+void mark_captured() {
+    g_dirty_captured.store(true, memory_order_relaxed);
+}
+
+void publish() {
+    bool const changed = g_dirty.exchange(false, memory_order_acq_rel);
+    bool const captured = g_dirty_captured.exchange(false, memory_order_acq_rel);
+    if (!changed && !captured) return;
+
+    // The critical section serialises publishers (sensor executor & BTstack, on config changes) and keeps
+    // `g_sensors` still while it's copied. Resolving is only a few compares, cheap enough to do inside.
+    taskENTER_CRITICAL();
+    g_published.store({.raw = g_sensors, .resolved = g_sensors.with_fallbacks(), .captured = g_captured});
+    taskEXIT_CRITICAL();
+
+    // Fresh capture times alone don't need telling anyone; readers see them on their next snapshot.
+    if (!changed) return;
+
+    auto const n = g_observers_count.load(memory_order_acquire);
+    for (size_t i = 0; i < n; ++i)
+        g_observers[i]();
+}
+
+void sampling_demand(SamplingDemand demand, bool raised) {
+    if (raised)
+        g_sampling_demands.fetch_or(uint8_t(demand), memory_order_relaxed);
+    else
+        g_sampling_demands.fetch_and(uint8_t(~uint8_t(demand)), memory_order_relaxed);
+}
+
+bool sampling_slow() {
+    return g_config.sampling_adaptive && g_sampling_demands.load(memory_order_relaxed) == 0;
+}
+
+bool init() {
+    if (!adc_capture_enable(ADC_INPUT_TEMPERATURE)) return false;
+    g_mcu_temperature_sensor.start();
 
-    printf("I2C1 - initializing sensors...\n");
-    g_sensors_exhaust = sensors_init_bus(*i2c1, {EnvironmentalFilter::Kind::Exhaust});
+    // Returns w/o waiting on the probes, sensors start publishing as they're found.
+    g_touch_probe_lock = xSemaphoreCreateMutex();  // we panic on alloc failures, no need to handle null
+    for (auto& bus : g_buses)
+        Task(probe, "sensor-probe", bus.probe_task, &bus, Priority::Sensors).release();
+    Task(supervise, "sensor-hotplug", g_supervise_task, nullptr, Priority::Low).release();
 
-    // wait again b/c probing might be implemented by sending a reset command to the sensor
-    busy_wait(SENSOR_POWER_ON_DELAY);
+    if (!history::init()) return false;
 
     return true;
 }
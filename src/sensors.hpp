@@ -1,6 +1,8 @@
 #pragma once
 
 #include "sdk/ble_data_types.hpp"
+#include "sensors/filter.hpp"
+#include <chrono>
 #include <cstdint>
 
 namespace nevermore::sensors {
@@ -13,6 +15,14 @@ struct Config {
     // StealthMax MCU is positioned inside the exhaust airflow.
     // Disabled by default because not all Nevermores are StealthMaxes.
     bool fallback_exhaust_mcu = false;
+    // Derive the VOC index from a BME68x's gas sensor, for units w/o an SGP40.
+    // Disabled by default because it'd fight w/ an SGP40 on the same side.
+    bool voc_bme68x = false;
+    // Sample every `SENSOR_UPDATE_PERIOD_SLOW` instead of every `SENSOR_UPDATE_PERIOD` while nothing needs
+    // fast readings (see `SamplingDemand`). Cuts I2C traffic, CPU & BME68x heater time while idle.
+    bool sampling_adaptive = true;
+    // Applied by `EnvironmentalFilter::set`, per sensor.
+    Filters filter;
 };
 
 extern Config g_config;
@@ -32,12 +42,83 @@ struct [[gnu::packed]] Sensors {
     VOCIndex voc_index_intake;
     VOCIndex voc_index_exhaust;
 
+    // Prefer `snapshot_resolved`, this is what `publish` uses to produce it.
     [[nodiscard]] Sensors with_fallbacks(Config const& config = g_config) const;
 
     auto operator<=>(Sensors const&) const = default;
 };
 
+// When each of `Sensors`' fields was last measured, in us since boot (`time_us_64`). 0 -> never.
+// Stamped as the driver hands the read over, i.e. right after its bus transfer. Withdrawals are stamped too.
+// Drops (e.g. a filtered out glitch) aren't, a sensor stuck on dropped reads ages like a silent one.
+// Mirrors `Sensors`.
+struct Captured {
+    uint64_t temperature_intake = 0;
+    uint64_t temperature_exhaust = 0;
+    uint64_t temperature_mcu = 0;
+    uint64_t humidity_intake = 0;
+    uint64_t humidity_exhaust = 0;
+    uint64_t pressure_intake = 0;
+    uint64_t pressure_exhaust = 0;
+    uint64_t voc_index_intake = 0;
+    uint64_t voc_index_exhaust = 0;
+
+    // Follows `Sensors::with_fallbacks`: a value borrowed from elsewhere carries its source's timestamp.
+    [[nodiscard]] Captured with_fallbacks(Sensors const& raw, Config const& config = g_config) const;
+};
+
+struct Stamped {
+    Sensors sensors;
+    Captured captured;
+
+    // `sensors` w/ every value measured more than `max_age` before `now` (us, `time_us_64`) as not-known.
+    // PRECONDITION: no fallbacks applied, fallbacks would hide where a value came from.
+    [[nodiscard]] Sensors fresh(uint64_t now, std::chrono::microseconds max_age) const;
+    // Earliest time after `now` one of `fresh`'s known values goes stale. `UINT64_MAX` -> none will.
+    [[nodiscard]] uint64_t stale_at(uint64_t now, std::chrono::microseconds max_age) const;
+};
+
+// Working copy, written by the sensor tasks through `EnvironmentalFilter::set` (or under a critical section).
+// Everyone else should read the published view through `snapshot`/`snapshot_resolved`.
 extern Sensors g_sensors;
+// Working copy of when `g_sensors`' fields were measured, written alongside them.
+extern Captured g_captured;
+
+// Consistent copy of `g_sensors` as of the last `publish`, w/o fallbacks applied. Lock-free, O(1).
+Sensors snapshot();
+// As `snapshot`, w/ fallbacks already applied (resolved once per `publish`, not once per reader).
+Sensors snapshot_resolved();
+// Changes whenever a `publish` changes the snapshot (sensor update, or `g_config` change).
+// Lets readers skip re-deriving anything from an unchanged snapshot.
+uint32_t snapshot_version();
+// As `snapshot`/`snapshot_resolved`, w/ the matching capture timestamps.
+Stamped snapshot_stamped();
+Stamped snapshot_resolved_stamped();
+
+// Called after `g_sensors` (or `g_config`) changes, from whichever task made the change.
+// Changes made during a single sensor read are coalesced into one call, so keep observers cheap.
+using Observer = void (*)();
+void observe(Observer);
+
+// Record that `g_sensors`/`g_config` changed. Observers aren't told until the next `publish`.
+void mark_dirty();
+// Record that a reading arrived but matched the last one. Only its capture time is republished,
+// observers aren't told.
+void mark_captured();
+// Publish changes since the last `publish`, if any, & tell the observers about them.
+// Done after every periodic sensor read.
+void publish();
+
+// Reasons to sample at the full rate. Each is raised/cleared by its owner, any raised one is enough.
+enum class SamplingDemand : uint8_t {
+    Filtering = 1 << 0,  // fans are running (policy or override)
+    Printing = 1 << 1,   // host says a print is running
+};
+
+// Any task.
+void sampling_demand(SamplingDemand, bool raised);
+// True -> sensors w/o their own `update_period` sample every `SENSOR_UPDATE_PERIOD_SLOW`. Any task.
+[[nodiscard]] bool sampling_slow();
 
 // Sensors are registered as periodic workers for the context.
 bool init();
@@ -1,7 +1,14 @@
 #include "async_sensor.hpp"
+#include "sdk/timer.hpp"
+#include "sensors.hpp"
+#include "telemetry.hpp"
 #include "utility/task.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <new>
 
 using namespace std;
 
@@ -11,28 +18,79 @@ namespace {
 
 constexpr uint32_t SENSOR_STACK_DEPTH = 1024;
 
+// Sensors spend nearly all their time waiting on their device, so rather than giving each one
+// its own (mostly idle) stack they all run as coroutines on the one task.
+TaskStorage<SENSOR_STACK_DEPTH> g_executor_task;
+Executor g_executor{"sensors", Priority::Sensors, g_executor_task};
+
+}  // namespace
+
+chrono::milliseconds SensorPeriodic::update_period() const {
+    return sampling_slow() ? SENSOR_UPDATE_PERIOD_SLOW : SENSOR_UPDATE_PERIOD;
 }
 
 void SensorPeriodic::start() {
-    if (task) return;  // already started
+    if (job) return;  // already started
 
-    // honestly coroutines would probably be nicer than allocating big stacks...
-    auto go = [](void* self_) {
-        auto* self = reinterpret_cast<SensorPeriodic*>(self_);
-        auto last_wake = xTaskGetTickCount();
-        for (;;) {
-            self->read();
+    job = g_executor.spawn(run());
+    // out of roots, give up like a failing sensor so the hot-plug supervisor frees & later re-probes it
+    if (!job) dead.store(true, memory_order_release);
+}
 
-            auto delay_ticks = pdMS_TO_TICKS(self->update_period() / 1ms);
-            xTaskDelayUntil(&last_wake, delay_ticks);
-        }
-    };
+void SensorPeriodic::stop() {
+    if (!job) return;
 
-    task = Task(go, name(), SENSOR_STACK_DEPTH, this, Priority::Sensors);
+    g_executor.cancel(job);
+    job = {};
 }
 
-void SensorPeriodic::stop() {
-    task = {};
+void SensorPeriodic::telemetry_record(chrono::microseconds duration) const {
+    telemetry::SensorRead x{.name = {}, .duration_us = uint32_t(duration.count())};
+    strncpy(x.name.data(), name(), x.name.size());
+    telemetry::record(x);
+}
+
+Coroutine<> SensorPeriodic::run() {
+    constexpr auto PERIODS_MAX = uint32_t(SENSOR_UPDATE_PERIOD_SLOW / SENSOR_UPDATE_PERIOD);
+
+    auto next = time_64u();
+    auto previous = next;
+    for (;;) {
+        auto const failures_before = failures;
+        auto const started = time_64u();
+        // first read (`started == previous`) & sub-period updates count as 1
+        auto const elapsed = started - previous + chrono::microseconds(SENSOR_UPDATE_PERIOD) / 2;  // rounded
+        periods = uint32_t(clamp<int64_t>(elapsed / SENSOR_UPDATE_PERIOD, 1, PERIODS_MAX));
+        previous = started;
+        try {
+            co_await read();
+        } catch (bad_alloc const&) {
+            failed();  // a frame somewhere down the chain didn't fit, already logged
+        }
+        telemetry_record(time_64u() - started);
+        if (failures == failures_before) failures = 0;
+
+        if (FAILURES_MAX <= failures) {
+            printf("WARN - %s - %u failed reads in a row, giving up\n", name(), unsigned(failures));
+            forget();
+            publish();
+            job = {};  // the executor frees the root once we return
+            dead.store(true, memory_order_release);  // last, the supervisor may destroy us after this
+            co_return;
+        }
+
+        publish();  // one notification for everything this read changed
+
+        auto const period_start = next;
+        next += update_period();
+        // overran (or waited on an event for a while), don't try to catch up by bursting
+        if (auto now = time_64u(); next < now) next = now;
+        // Slow periods are waited out in fast sized steps, cut short if sampling speeds up meanwhile.
+        for (auto now = time_64u(); now < next; now = time_64u()) {
+            co_await delay_until(min<chrono::microseconds>(next, now + SENSOR_UPDATE_PERIOD));
+            next = min<chrono::microseconds>(next, max(period_start + update_period(), now));
+        }
+    }
 }
 
 }  // namespace nevermore::sensors
@@ -1,10 +1,19 @@
 #pragma once
 
 #include "config.hpp"
-#include "utility/task.hpp"
+#include "utility/coroutine.hpp"
+#include "utility/executor.hpp"
+#include "utility/pool.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 
 namespace nevermore::sensors {
 
+// Instances of each driver, they're drawn from a static `Pooled` per driver rather than the heap.
+// Two of a kind per side (e.g. one on the bus & one behind a mux), redundant sensors are fused anyways.
+constexpr size_t SENSOR_POOL_SIZE = 4;
+
 struct Sensor {
     virtual ~Sensor() = default;
 
@@ -13,23 +22,54 @@ struct Sensor {
 
 // A sensor that schedules itself for periodic updates via an async context.
 // Useful for sensors that take a long time (10ms+) to measure/respond.
+// All periodic sensors share a single executor task, so `read` must `co_await` instead of blocking.
 // NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
 struct SensorPeriodic : Sensor {
     SensorPeriodic() = default;
     SensorPeriodic(SensorPeriodic const&) = delete;  // copying is almost certainly a mistake
     SensorPeriodic(SensorPeriodic&&) = delete;       // not safe to move b/c we're pinned once registered
 
-    [[nodiscard]] virtual std::chrono::milliseconds update_period() const {
-        return SENSOR_UPDATE_PERIOD;
-    }
+    // Re-read while waiting, so a sensor waiting out a slow period picks up a switch to fast sampling
+    // w/in `SENSOR_UPDATE_PERIOD`.
+    [[nodiscard]] virtual std::chrono::milliseconds update_period() const;
 
     virtual void start();
     virtual void stop();
 
+    // Consecutive failed reads before the sensor gives up & stops itself. The hot-plug supervisor then
+    // destroys it & re-probes the address, so a sensor that drops out can come back w/o a power cycle.
+    static constexpr uint32_t FAILURES_MAX = 10;
+
+    // Safe to call from any task. Once true the sensor has stopped for good & may be destroyed.
+    [[nodiscard]] bool gave_up() const {
+        return dead.load(std::memory_order_acquire);
+    }
+
 protected:
-    virtual void read() = 0;
+    virtual Coroutine<> read() = 0;
+
+    // Call from `read` when it fails. Any read that doesn't call it resets the count.
+    void failed() {
+        failures += 1;
+    }
+
+    // Called once on giving up, so the sensor can stop claiming values it's no longer measuring.
+    virtual void forget() {}
+
+    // # of `SENSOR_UPDATE_PERIOD`s since the previous read, [1, slow/fast ratio]. Algorithms that step once
+    // per `SENSOR_UPDATE_PERIOD` (e.g. the gas index) hold a slow sample for every step it spans.
+    [[nodiscard]] uint32_t read_periods() const {
+        return periods;
+    }
+
+private:
+    Coroutine<> run();
+    void telemetry_record(std::chrono::microseconds duration) const;
 
-    Task task;  // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
+    Executor::Job job{};
+    uint32_t failures = 0;  // only touched by the executor
+    uint32_t periods = 1;   // only touched by the executor
+    std::atomic<bool> dead = false;
 };
 
 }  // namespace nevermore::sensors
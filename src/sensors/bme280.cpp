@@ -1,10 +1,14 @@
 #include "bme280.hpp"
+#include "config.hpp"
 #include "hardware/i2c.h"
 #include "lib/bme280.h"
 #include "sdk/ble_data_types.hpp"
 #include "sdk/i2c.hpp"
+#include "sdk/task.hpp"
+#include "utility/log.hpp"
 #include <chrono>
 #include <cstdint>
+#include <type_traits>
 #include <utility>
 
 using namespace std;
@@ -13,6 +17,7 @@ namespace nevermore::sensors {
 
 // don't want to include the big library header via our own header, so just double check it matches here
 static_assert(BME280_POWER_ON_DELAY == chrono::microseconds(BME280_STARTUP_DELAY));
+static_assert(is_integral_v<decltype(bme280_data::temperature)>, "expected `BME280_32BIT_ENABLE`");
 
 namespace {
 
@@ -20,19 +25,39 @@ namespace {
 // Assume LSB of 0 for now.
 constexpr uint8_t BME280_ADDRESS = 0b0111'0110;
 
+// Forced mode: one conversion per `read`, the chip sleeps the rest of the time (no self-heating from
+// converting in the background). Oversampling is as high as fits in `MEASURE_BUDGET`.
+// No IIR filter, that's done in software w/ the other sensors (see `sensors/filter.hpp`).
+// datasheet typical (absolute), for fusing w/ other sensors on the same side
+constexpr Accuracy BME280_ACCURACY{.temperature = 1'00, .humidity = 3'00, .pressure = 1'000'0};
+
+constexpr auto MEASURE_BUDGET = SENSOR_UPDATE_PERIOD / 10;
+
 constexpr bme280_settings BME280_SETTINGS{
         .osr_p = BME280_OVERSAMPLING_1X,
         .osr_t = BME280_OVERSAMPLING_1X,
         .osr_h = BME280_OVERSAMPLING_1X,
-        .filter = BME280_FILTER_COEFF_2,
-        // TODO: base this off of sampling period
-        .standby_time = BME280_STANDBY_TIME_250_MS,
+        .filter = BME280_FILTER_COEFF_OFF,
+        .standby_time = BME280_STANDBY_TIME_0_5_MS,  // unused in forced mode
 };
 
+// Highest oversampling (same for all channels) that measures within `budget`, along w/ its measure time.
+pair<bme280_settings, chrono::microseconds> settings_for(chrono::microseconds budget) {
+    auto settings = BME280_SETTINGS;
+    uint32_t delay_us = 0;
+    for (uint8_t osr = BME280_OVERSAMPLING_16X; BME280_OVERSAMPLING_1X <= osr; --osr) {
+        settings.osr_p = settings.osr_t = settings.osr_h = osr;
+        bme280_cal_meas_delay(&delay_us, &settings);
+        if (chrono::microseconds(delay_us) <= budget) break;
+    }
+
+    return {settings, chrono::microseconds(delay_us)};
+}
+
 BME280_INTF_RET_TYPE i2c_read(uint8_t reg_addr, uint8_t* reg_data, uint32_t len, void* intf_ptr) {
     auto* bus = reinterpret_cast<i2c_inst_t*>(intf_ptr);
-    if (1 != i2c_write_blocking(*bus, BME280_ADDRESS, reg_addr)) return BME280_E_COMM_FAIL;
-    if (int(len) != i2c_read_blocking(bus, BME280_ADDRESS, reg_data, len, false)) return BME280_E_COMM_FAIL;
+    if (!i2c_transfer_blocking(*bus, BME280_ADDRESS, {&reg_addr, 1}, {reg_data, len}))
+        return BME280_E_COMM_FAIL;
 
     return BME280_OK;
 }
@@ -44,7 +69,7 @@ BME280_INTF_RET_TYPE i2c_write(uint8_t reg_addr, const uint8_t* reg_data, uint32
     uint8_t buf[len + 1];
     buf[0] = reg_addr;
     memcpy(buf + 1, reg_data, len);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
-    if (int(sizeof(buf)) != i2c_write_blocking(bus, BME280_ADDRESS, buf, sizeof(buf), false))
+    if (!i2c_transfer_blocking(*bus, BME280_ADDRESS, {buf, sizeof(buf)}, {}))
         return BME280_E_COMM_FAIL;
 
     return BME280_OK;
@@ -56,7 +81,7 @@ optional<bme280_dev> init(i2c_inst_t& bus) {
             .intf_ptr = &bus,
             .read = i2c_read,
             .write = i2c_write,
-            .delay_us = [](uint32_t delay_us, void*) { busy_wait_us_32(delay_us); },
+            .delay_us = [](uint32_t delay_us, void*) { task_delay(chrono::microseconds(delay_us)); },
     };
 
     if (auto r = bme280_init(&dev); r != BME280_OK) {
@@ -68,42 +93,57 @@ optional<bme280_dev> init(i2c_inst_t& bus) {
         return {};
     }
 
-    if (auto r = bme280_set_sensor_settings(BME280_SEL_ALL_SETTINGS, &BME280_SETTINGS, &dev);
-            r != BME280_OK) {
+    // stays in sleep mode, `read` forces each conversion
+    auto const [settings, _] = settings_for(MEASURE_BUDGET);
+    if (auto r = bme280_set_sensor_settings(BME280_SEL_ALL_SETTINGS, &settings, &dev); r != BME280_OK) {
         printf("ERR - BME280 - failed to set device settings (code %+d).\n", r);
         return {};
     }
 
-    if (auto r = bme280_set_sensor_mode(BME280_POWERMODE_NORMAL, &dev); r < 0) {
-        printf("ERR - BME280 - failed to set normal mode (code %+d).\n", r);
-        return {};
-    }
-
     return dev;
 }
 
-// This could update more/less frequently, based on the update period (see `bme280_cal_meas_delay`).
-// Current update period of 1s should be more than enough to compute results.
-struct BME280 final : SensorPeriodic {
+struct BME280 final : SensorPeriodic, Pooled<BME280, SENSOR_POOL_SIZE> {
     EnvironmentalFilter side;
     bme280_dev dev;
+    chrono::microseconds measure_time = settings_for(MEASURE_BUDGET).second;
 
-    BME280(bme280_dev dev, EnvironmentalFilter side) : side(side), dev(dev) {}
+    BME280(bme280_dev dev, EnvironmentalFilter side) : side(side), dev(dev) {
+        this->side.accuracy = BME280_ACCURACY;
+    }
 
     [[nodiscard]] char const* name() const override {
         return "BME280";
     }
 
-    void read() override {
+    Coroutine<> read() override {
+        // chip returns to sleep once the conversion is done, so this never has to put it to sleep first
+        if (auto r = bme280_set_sensor_mode(BME280_POWERMODE_FORCED, &dev); r < 0) {
+            LOG_DEFERRED("ERR - BME280 - failed to force a measurement: %d\n", r);
+            failed();
+            co_return;
+        }
+
+        co_await delay(measure_time);  // other sensors get the executor in the meantime
+
         bme280_data comp_data{};
         if (auto r = bme280_get_sensor_data(BME280_ALL, &comp_data, &dev); r < 0) {
-            printf("ERR - BME280 - failed read: %d\n", r);
-            return;
+            LOG_DEFERRED("ERR - BME280 - failed read: %d\n", r);
+            failed();
+            co_return;
         }
 
-        side.set(BLE::Temperature(comp_data.temperature));
-        side.set(BLE::Humidity(comp_data.humidity));
-        side.set(BLE::Pressure(comp_data.pressure));
+        // integer compensation (`BME280_32BIT_ENABLE`): 0.01 C, Pa, 1/1024 %
+        side.set(BLE::Temperature::from_fixed<-2>(comp_data.temperature));
+        side.set(BLE::Humidity::from_fixed<-2>((comp_data.humidity * 100 + 512) / 1024));
+        side.set(BLE::Pressure::from_fixed<0>(comp_data.pressure));
+    }
+
+protected:
+    void forget() override {
+        side.set(BLE::Temperature(BLE::NOT_KNOWN));
+        side.set(BLE::Humidity(BLE::NOT_KNOWN));
+        side.set(BLE::Pressure(BLE::NOT_KNOWN));
     }
 };
 
@@ -2,10 +2,17 @@
 #include "bme68x.hpp"
 #include "hardware/i2c.h"
 #include "lib/bme68x_defs.h"
+#include "lib/sensirion_gas_index_algorithm.h"
 #include "sdk/ble_data_types.hpp"
 #include "sdk/i2c.hpp"
+#include "sdk/task.hpp"
+#include "utility/log.hpp"
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <type_traits>
 #include <utility>
 
 using namespace std;
@@ -14,6 +21,7 @@ namespace nevermore::sensors {
 
 // don't want to include the big library header via our own header, so just double check it matches here
 static_assert(BME68x_POWER_ON_DELAY == chrono::microseconds(BME68X_PERIOD_RESET));
+static_assert(is_integral_v<decltype(bme68x_data::temperature)>, "expected `BME68X_DO_NOT_USE_FPU`");
 
 namespace {
 
@@ -21,6 +29,10 @@ namespace {
 // Assume LSB of 0 for now.
 constexpr uint8_t BME68x_ADDRESS = 0b0111'0110;
 
+// datasheet typical (absolute), for fusing w/ other sensors on the same side
+// Gas has no spec. It's the same algorithm as the SGP40's, but a less dedicated sensor, trust it less.
+constexpr Accuracy BME68x_ACCURACY{.temperature = 50, .humidity = 3'00, .pressure = 600'0, .voc_index = 30};
+
 constexpr auto BME68x_MODE = BME68X_FORCED_MODE;
 
 bme68x_conf BME68x_SETTINGS{
@@ -28,14 +40,34 @@ bme68x_conf BME68x_SETTINGS{
         .os_temp = BME68X_OS_1X,
         .os_pres = BME68X_OS_1X,
         .filter = BME68X_FILTER_SIZE_1,
-        // TODO: base this off of sampling period
-        .odr = BME68X_ODR_250_MS,
+        .odr = BME68X_ODR_NONE,  // unused in forced mode
+};
+
+struct HeaterStep {
+    uint16_t temperature;  // [C]
+    uint16_t duration;     // [ms]
+};
+
+// Gas channel (`Config::voc_bme68x`) heater profile, stepped through by each `read`, one forced conversion
+// per step. Only the last step's gas resistance is used, any earlier ones condition the hot plate (e.g. a
+// ramp). 320 C for 150 ms is Bosch's usual VOC measurement point.
+constexpr array HEATER_PROFILE{
+        HeaterStep{.temperature = 320, .duration = 150},
 };
 
+// The gas index algorithm expects an SGP40 style raw signal: falls w/ VOCs, linear in log(resistance).
+// MOX resistance also falls w/ VOCs, so scale its log. The algorithm tracks the signal's own mean &
+// variance, so only the rough magnitude matters (~34k ticks @ 100 kOhm, close to a clean air SGP40).
+constexpr float SRAW_PER_LN_OHM = 3000;
+
+int32_t gas_sraw(float resistance) {
+    return clamp(int32_t(SRAW_PER_LN_OHM * logf(max(resistance, 1.f))), int32_t(0), int32_t(UINT16_MAX));
+}
+
 BME68X_INTF_RET_TYPE i2c_read(uint8_t reg_addr, uint8_t* reg_data, uint32_t len, void* intf_ptr) {
     auto* bus = reinterpret_cast<i2c_inst_t*>(intf_ptr);
-    if (1 != i2c_write_blocking(*bus, BME68x_ADDRESS, reg_addr)) return BME68X_E_COM_FAIL;
-    if (int(len) != i2c_read_blocking(bus, BME68x_ADDRESS, reg_data, len, false)) return BME68X_E_COM_FAIL;
+    if (!i2c_transfer_blocking(*bus, BME68x_ADDRESS, {&reg_addr, 1}, {reg_data, len}))
+        return BME68X_E_COM_FAIL;
 
     return BME68X_OK;
 }
@@ -47,7 +79,7 @@ BME68X_INTF_RET_TYPE i2c_write(uint8_t reg_addr, const uint8_t* reg_data, uint32
     uint8_t buf[len + 1];
     buf[0] = reg_addr;
     memcpy(buf + 1, reg_data, len);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
-    if (int(sizeof(buf)) != i2c_write_blocking(bus, BME68x_ADDRESS, buf, sizeof(buf), false))
+    if (!i2c_transfer_blocking(*bus, BME68x_ADDRESS, {buf, sizeof(buf)}, {}))
         return BME68X_E_COM_FAIL;
 
     return BME68X_OK;
@@ -59,7 +91,7 @@ optional<bme68x_dev> init(i2c_inst_t& bus) {
             .intf = BME68X_I2C_INTF,
             .read = i2c_read,
             .write = i2c_write,
-            .delay_us = [](uint32_t delay_us, void*) { busy_wait_us_32(delay_us); },
+            .delay_us = [](uint32_t delay_us, void*) { task_delay(chrono::microseconds(delay_us)); },
     };
 
     if (auto r = bme68x_init(&dev); r != BME68X_OK) {
@@ -76,47 +108,103 @@ optional<bme68x_dev> init(i2c_inst_t& bus) {
         return {};
     }
 
-    // Disable the heater; we are not current using the device's gas sensor.
-    // (It doesn't detect the VOCs we're interested in, and we don't want to override any attached SGP40s.)
-    bme68x_heatr_conf heater_cfg{.enable = false};
-
+    // Heater starts off, `read` configures it for each conversion. The gas channel is opt-in: it's a
+    // pretty poor match for the VOCs we're interested in, & we don't want to override any attached SGP40s.
+    bme68x_heatr_conf heater_cfg{.enable = BME68X_DISABLE};
     if (auto r = bme68x_set_heatr_conf(BME68x_MODE, &heater_cfg, &dev); r != BME68X_OK) {
         printf("ERR - BME68x - failed to set device heater settings (code %+d).\n", r);
         return {};
     }
 
-    if (auto r = bme68x_set_op_mode(BME68x_MODE, &dev); r != BME68X_OK) {
-        printf("ERR - BME68x - failed to set device mode (code %+d).\n", r);
-        return {};
-    }
-
     return dev;
 }
 
-// This could update more/less frequently, based on the update period (see `bme280_cal_meas_delay`).
-// Current update period of 1s should be more than enough to compute results.
-struct BME68x final : SensorPeriodic {
+struct BME68x final : SensorPeriodic, Pooled<BME68x, SENSOR_POOL_SIZE> {
     EnvironmentalFilter side;
     bme68x_dev dev;
+    GasIndexAlgorithmParams gas_index_algorithm{};
 
-    BME68x(bme68x_dev dev, EnvironmentalFilter side) : side(side), dev(dev) {}
+    BME68x(bme68x_dev dev, EnvironmentalFilter side) : side(side), dev(dev) {
+        this->side.accuracy = BME68x_ACCURACY;
+        GasIndexAlgorithm_init(&gas_index_algorithm, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
+    }
 
     [[nodiscard]] char const* name() const override {
         return "BME68x";
     }
 
-    void read() override {
-        bme68x_data comp_data{};
+    // One forced conversion, w/ the heater at `step` (or off). The heater ramp & conversion are awaited, so
+    // neither the bus nor the executor are held in the meantime.
+    Coroutine<bool> measure(HeaterStep const* step, bme68x_data& data) {
+        bme68x_heatr_conf heater{
+                .enable = uint8_t(step ? BME68X_ENABLE : BME68X_DISABLE),
+                .heatr_temp = step ? step->temperature : uint16_t(0),
+                .heatr_dur = step ? step->duration : uint16_t(0),
+        };
+        if (auto r = bme68x_set_heatr_conf(BME68x_MODE, &heater, &dev); r != BME68X_OK) {
+            LOG_DEFERRED("ERR - BME68x - failed to set heater: %d\n", r);
+            co_return false;
+        }
+
+        if (auto r = bme68x_set_op_mode(BME68x_MODE, &dev); r != BME68X_OK) {
+            LOG_DEFERRED("ERR - BME68x - failed to force a measurement: %d\n", r);
+            co_return false;
+        }
+
+        co_await delay(chrono::microseconds(bme68x_get_meas_dur(BME68x_MODE, &BME68x_SETTINGS, &dev)) +
+                       chrono::milliseconds(heater.heatr_dur));
+
         uint8_t n_fields = 0;
-        if (auto r = bme68x_get_data(BME68x_MODE, &comp_data, &n_fields, &dev); r < 0) {
-            printf("ERR - BME68x - failed read: %d\n", r);
-            return;
+        if (auto r = bme68x_get_data(BME68x_MODE, &data, &n_fields, &dev); r < 0) {
+            LOG_DEFERRED("ERR - BME68x - failed read: %d\n", r);
+            co_return false;
+        }
+
+        co_return n_fields != 0;
+    }
+
+    Coroutine<> read() override {
+        bool const gas = g_config.voc_bme68x;
+
+        bme68x_data comp_data{};
+        bool ok = true;
+        if (!gas) {
+            ok = co_await measure(nullptr, comp_data);
+        } else {
+            for (auto const& step : HEATER_PROFILE)
+                if (!(ok = co_await measure(&step, comp_data))) break;
+        }
+        if (!ok) {
+            failed();
+            co_return;
+        }
+
+        // integer compensation (`BME68X_DO_NOT_USE_FPU`): 0.01 C, Pa, 0.001 %
+        side.set(BLE::Temperature::from_fixed<-2>(comp_data.temperature));
+        side.set(BLE::Humidity::from_fixed<-3>(comp_data.humidity));
+        side.set(BLE::Pressure::from_fixed<0>(comp_data.pressure));
+
+        if (!gas) co_return;
+        if (!(comp_data.status & BME68X_GASM_VALID_MSK) || !(comp_data.status & BME68X_HEAT_STAB_MSK)) {
+            LOG_DEFERRED("WARN - BME68x - gas measurement invalid (heater unstable?)\n");
+            co_return;
         }
-        if (n_fields == 0) return;
 
-        side.set(BLE::Temperature(comp_data.temperature));
-        side.set(BLE::Humidity(comp_data.humidity));
-        side.set(BLE::Pressure(comp_data.pressure));
+        int32_t gas_index{};
+        auto const sraw = gas_sraw(float(comp_data.gas_resistance));
+        for (uint32_t i = 0; i < read_periods(); ++i)  // held for each 1s step a slow sample spans
+            GasIndexAlgorithm_process(&gas_index_algorithm, sraw, &gas_index);
+        if (gas_index == 0) co_return;  // 0 -> index not available (still learning)
+
+        side.set(VOCIndex::from_fixed<0>(gas_index));
+    }
+
+protected:
+    void forget() override {
+        side.set(BLE::Temperature(BLE::NOT_KNOWN));
+        side.set(BLE::Humidity(BLE::NOT_KNOWN));
+        side.set(BLE::Pressure(BLE::NOT_KNOWN));
+        if (g_config.voc_bme68x) side.set(VOCIndex(BLE::NOT_KNOWN));
     }
 };
 
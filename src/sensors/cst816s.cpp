@@ -1,11 +1,15 @@
 #include "cst816s.hpp"
 #include "FreeRTOS.h"  // IWYU pragma: keep
 #include "config.hpp"
+#include "display.hpp"
 #include "hardware/gpio.h"
 #include "hardware/i2c.h"
 #include "lvgl.h"  // IWYU pragma: keep
+#include "pico/platform.h"
 #include "sdk/i2c.hpp"
-#include "timers.h"  // IWYU pragma: keep [xTimerPend....]
+#include "task.h"  // IWYU pragma: keep
+#include "ui.hpp"
+#include "utility/log.hpp"
 #include <algorithm>
 #include <array>
 #include <cassert>
@@ -92,7 +96,7 @@ enum class Cmd : uint8_t {
 }
 
 template <typename A = uint8_t>
-optional<A> reg_read(i2c_inst_t& bus, Cmd const cmd, bool nostop = false) {
+optional<A> reg_read(i2c_inst_t& bus, Cmd const cmd) {
     if (1 != i2c_write_blocking(bus, ADDRESS, cmd)) return {};
 
     A result{};
@@ -108,7 +112,7 @@ bool reg_write(i2c_inst_t& bus, Cmd const cmd, uint8_t value) {
 
 optional<uint8_t> reg_write(i2c_inst_t& bus, Cmd const cmd, uint8_t value, uint8_t mask) {
     if (mask != 0xFF) {
-        auto r = reg_read(bus, cmd, true);
+        auto r = reg_read(bus, cmd);
         if (!r) {
             printf("failed to read current\n");
             return {};
@@ -150,23 +154,41 @@ struct InstanceMetadata {
 
     lv_indev_drv_t driver{};  // `user_data` must point to CST816S instance
     lv_indev_t* device = nullptr;
+    // A touch landed while the display slept. It only wakes the display, & is reported as released
+    // until lifted so it can't poke whatever is under it, that wasn't visible.
+    bool waking = false;
 
 private:
-    static void read(lv_indev_drv_t* driver, lv_indev_data_t* data) {
-        assert(driver);
-        assert(data);
-        if (!(driver && data)) return;
-
-        auto* self = reinterpret_cast<CST816S*>(driver->user_data);
-        assert(self);
-        if (!self) return;
-
-        data->point = {.x = lv_coord_t(self->state.x), .y = lv_coord_t(self->state.y)};
-        data->state = self->state.touch == CST816S::Touch::Up ? LV_INDEV_STATE_REL : LV_INDEV_STATE_PR;
-    }
+    static void read(lv_indev_drv_t* driver, lv_indev_data_t* data);
 };
 array<InstanceMetadata, NUM_I2CS> g_instances;
 
+void InstanceMetadata::read(lv_indev_drv_t* driver, lv_indev_data_t* data) {
+    assert(driver);
+    assert(data);
+    if (!(driver && data)) return;
+
+    auto* self = reinterpret_cast<CST816S*>(driver->user_data);
+    assert(self);
+    if (!self) return;
+
+    auto* instance = ranges::find_if(g_instances, [&](auto& x) { return &x.driver == driver; });
+    assert(instance != g_instances.end());
+    if (instance == g_instances.end()) return;
+
+    // buffered mode: hand LVGL one event per call, it calls straight back while `continue_reading`
+    auto const state = self->event_pop().value_or(self->latest());
+    auto const pressed = state.touch != CST816S::Touch::Up;
+    if (pressed && display::power() == display::Power::Sleep) instance->waking = true;
+    if (!pressed) instance->waking = false;
+    // LVGL only counts pressed reports as activity, wake it ourselves
+    if (instance->waking) lv_disp_trig_activity(nullptr);
+
+    data->point = {.x = lv_coord_t(state.x), .y = lv_coord_t(state.y)};
+    data->state = pressed && !instance->waking ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
+    data->continue_reading = self->events_pending();
+}
+
 struct RegisterInterruptCallback {
     RegisterInterruptCallback() {
         // NOT IDEMPOTENT. Will consume a shared interrupt handler each time.
@@ -175,47 +197,31 @@ struct RegisterInterruptCallback {
                 PIN_TOUCH_INTERRUPT, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &isr);
     }
 
-    static void isr(uint gpio, [[maybe_unused]] uint32_t event_mask) {
+    static void __not_in_flash_func(isr)(uint gpio, [[maybe_unused]] uint32_t event_mask) {
         assert(gpio == PIN_TOUCH_INTERRUPT);
         if (gpio != PIN_TOUCH_INTERRUPT) return;
 
-        /* The actual processing is to be deferred to a task.  Request the
-        vProcessInterface() callback function is executed, passing in the
-        number of the interface that needs processing.  The interface to
-        service is passed in the second parameter.  The first parameter is
-        not used in this case. */
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        xTimerPendFunctionCallFromISR(handle_isr, {}, {}, &xHigherPriorityTaskWoken);
-
-        /* If xHigherPriorityTaskWoken is now set to pdTRUE then a context
-        switch should be requested.  The macro used is port specific and will
-        be either portYIELD_FROM_ISR() or portEND_SWITCHING_ISR() - refer to
-        the documentation page for the port being used. */
-        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);  // NOLINT
-    }
-
-    static void handle_isr(void*, uint32_t) {
+        // straight to the sensor executor's task, no detour through the timer task
         for (auto& instance : g_instances)
-            if (auto* p = reinterpret_cast<CST816S*>(instance.driver.user_data)) p->interrupt();
+            if (auto* p = reinterpret_cast<CST816S*>(instance.driver.user_data)) p->interrupt_from_isr();
     }
 } g_register_interrupt_callback;
 
-}  // namespace
-
-CST816S::CST816S(i2c_inst_t& bus) : bus(&bus) {
+// PRECONDITION: on the display task
+void instance_register(void* self) {
     if (auto* it = ranges::find_if(g_instances, [](auto& x) { return x.driver.user_data == nullptr; });
             it != g_instances.end()) {
         assert(!it->device);
-        it->driver.user_data = this;
+        it->driver.user_data = self;
         it->device = lv_indev_drv_register(&it->driver);
         assert(it->device && "failed to create LVGL input device");
     } else
         assert(false && "unable to register CST816S, too many exist");
 }
 
-// Ostensibly we'll never be destroyed, but hey, it's cheap to handle.
-CST816S::~CST816S() {
-    if (auto* it = ranges::find_if(g_instances, [&](auto& x) { return x.driver.user_data == this; });
+// PRECONDITION: on the display task
+void instance_unregister(void* self) {
+    if (auto* it = ranges::find_if(g_instances, [&](auto& x) { return x.driver.user_data == self; });
             it != g_instances.end()) {
         if (it->device) lv_indev_delete(it->device);
         it->device = nullptr;
@@ -223,11 +229,23 @@ CST816S::~CST816S() {
     }
 }
 
-void CST816S::interrupt() {
-    task.resume();
+}  // namespace
+
+// probed after the UI is running, so LVGL must be touched from the display task
+CST816S::CST816S(i2c_inst_t& bus) : bus(&bus) {
+    ui::call(instance_register, this);
+}
+
+// Ostensibly we'll never be destroyed, but hey, it's cheap to handle.
+CST816S::~CST816S() {
+    ui::call(instance_unregister, this);
+}
+
+void __not_in_flash("cst816s") CST816S::interrupt_from_isr() {
+    interrupted.set_from_isr();
 }
 
-void CST816S::read() {
+Coroutine<> CST816S::read() {
     struct [[gnu::packed]] Batch {
         // for now we don't care/bother to populate these
         // uint8_t gesture;
@@ -236,17 +254,26 @@ void CST816S::read() {
         uint16_t y;
     };
 
-    auto read = reg_read<Batch>(*bus, Cmd::XPOS_H);
-    if (!read) {
-        printf("ERR - CST816S - failed to read state\n");
-        return;
+    co_await interrupted;  // nothing to do until the device tells us something changed
+
+    Batch read{};
+    if (!co_await i2c_transfer(*bus, ADDRESS, Cmd::XPOS_H, read)) {
+        LOG_DEFERRED("ERR - CST816S - failed to read state\n");
+        co_return;
     }
 
-    state.x = byteswap(read->x) & 0x0FFF;        // read in BE, need it in LE order
-    state.y = byteswap(read->y) & 0x0FFF;        // read in BE, need it in LE order
-    state.touch = Touch((read->x & 0xFF) >> 6);  // hi 2 bits in `x` are the event
-    // state.gesture = Gesture(read->gesture);
-    task.suspend();  // wait until next time we're called...
+    State const latest{
+            .x = uint16_t(byteswap(read.x) & 0x0FFF),  // read in BE, need it in LE order
+            .y = uint16_t(byteswap(read.y) & 0x0FFF),  // read in BE, need it in LE order
+            .touch = Touch((read.x & 0xFF) >> 6),      // hi 2 bits in `x` are the event
+            // .gesture = Gesture(read.gesture),
+    };
+
+    taskENTER_CRITICAL();  // `SeqLock` writer requirement
+    state.store(latest);
+    taskEXIT_CRITICAL();
+    // full -> LVGL is `EVENTS_MAX` reads behind, drop the event. `state` still has it to catch up to.
+    events.push(latest);
 }
 
 unique_ptr<CST816S> CST816S::mk(i2c_inst_t& bus) {
@@ -2,9 +2,13 @@
 
 #include "async_sensor.hpp"
 #include "hardware/i2c.h"
+#include "utility/seqlock.hpp"
+#include "utility/spsc_queue.hpp"
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <optional>
 
 namespace nevermore::sensors {
 
@@ -12,7 +16,8 @@ namespace nevermore::sensors {
 // There doesn't seem to be an official SDK for this device, so this was cobbled
 // from various sources. (Zephyr, WaveShare samples, etc..)
 
-struct CST816S final : SensorPeriodic {
+// Only the one display, so only the one touch controller.
+struct CST816S final : SensorPeriodic, Pooled<CST816S, 1> {
     static std::unique_ptr<CST816S> mk(i2c_inst_t&);
 
     enum class Touch : uint8_t {
@@ -40,7 +45,8 @@ struct CST816S final : SensorPeriodic {
         // Gesture gesture = Gesture::None;
     };
 
-    State state;  // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
+    // Reads between LVGL input polls are queued, so quick taps & the path of a drag aren't lost.
+    static constexpr size_t EVENTS_MAX = 8;
 
     CST816S() = delete;
     CST816S(CST816S const&) = delete;
@@ -51,17 +57,34 @@ struct CST816S final : SensorPeriodic {
         return "CST816S";
     }
 
-    void interrupt();
+    // Called from the touch GPIO ISR.
+    void interrupt_from_isr();
 
+    // Consumer side, LVGL's input device read callback only.
+    // Oldest unread event. `nullopt` -> caught up, `latest` is the current state.
+    [[nodiscard]] std::optional<State> event_pop() {
+        return events.pop();
+    }
+    [[nodiscard]] bool events_pending() const {
+        return !events.empty();
+    }
+    [[nodiscard]] State latest() const {
+        return state.load();
+    }
+
+    // Minimum time between reads. Reads are otherwise only done on interrupt.
     [[nodiscard]] std::chrono::milliseconds update_period() const override {
         return 5ms;
     }
 
 protected:
-    void read() override;
+    Coroutine<> read() override;
 
 private:
     i2c_inst_t* bus;
+    Event interrupted;
+    SpscQueue<State, EVENTS_MAX> events;  // produced by `read`, consumed by LVGL
+    SeqLock<State> state;                 // latest read, even if the queue was full
 
     CST816S(i2c_inst_t&);
 };
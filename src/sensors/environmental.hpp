@@ -1,43 +1,165 @@
 #pragma once
 
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "hardware/timer.h"
 #include "sdk/ble_data_types.hpp"
 #include "sensors.hpp"
+#include "sensors/filter.hpp"
+#include "sensors/fusion.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include "telemetry.hpp"
+#include <cstdint>
+#include <optional>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 
 namespace nevermore::sensors {
 
+// Datasheet typical accuracy of a driver's device, in each quantity's raw units.
+// Redundant sensors on a side are fused, weighted by 1/accuracy^2.
+struct Accuracy {
+    uint16_t temperature = 1'00;  // 1 C
+    uint16_t humidity = 3'00;     // 3 %
+    uint16_t pressure = 1'000'0;  // 1 hPa
+    uint16_t voc_index = 30;
+};
+
 struct EnvironmentalFilter {
     enum class Kind { Intake, Exhaust };
     Kind kind;
+    Accuracy accuracy{};  // set by the driver
+    // Per instance, so each sensor filters its own reads.
+    std::tuple<FilterState<BLE::Temperature>, FilterState<BLE::Humidity>, FilterState<BLE::Pressure>,
+            FilterState<VOCIndex>>
+            filters{};
 
     // The Right Thing(TM) would be to have refs to config/service-data.
     // For now, just use `EnvironmentalService::g_sensors` and `EnvironmentalService::g_config`.
 
+    // Where `get` takes its value from.
+    enum class Source : uint8_t { None, Main, Other, Mcu };
+
     template <typename A>
         requires(!std::is_reference_v<A>)
     A get(Sensors const& sensors = g_sensors, Config const& config = g_config) const {
-        return get_<A>(sensors, config);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        auto [main, other] = pick(const_cast<Sensors&>(sensors));
+        switch (source<A>(sensors, config)) {
+        case Source::Main: return std::get<A&>(main);
+        case Source::Other: return std::get<A&>(other);
+        case Source::Mcu: {
+            if constexpr (std::is_same_v<A, BLE::Temperature>) return sensors.temperature_mcu;
+        } break;
+        case Source::None: break;
+        }
+        return BLE::NOT_KNOWN;
+    }
+
+    template <typename A>
+        requires(!std::is_reference_v<A>)
+    Source source(Sensors const& sensors = g_sensors, Config const& config = g_config) const {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        auto [main, _] = pick(const_cast<Sensors&>(sensors));
+        if (std::get<A&>(main) != BLE::NOT_KNOWN) return Source::Main;
+        if (config.fallback) return Source::Other;
+        return Source::None;
     }
 
+    // When the value `get` returns was measured. A not-known one w/o a source is when this side lost it.
     template <typename A>
-    void set(A x, Sensors& sensors = g_sensors) {
+        requires(!std::is_reference_v<A>)
+    uint64_t captured(
+            Captured const& x, Sensors const& sensors = g_sensors, Config const& config = g_config) const {
+        constexpr auto Q = size_t(quantity<A>());
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        auto [main, other] = pick(const_cast<Captured&>(x));
+        switch (source<A>(sensors, config)) {
+        case Source::Other: return std::get<Q>(other);
+        case Source::Mcu: return x.temperature_mcu;
+        case Source::Main:
+        case Source::None: break;
+        }
+        return std::get<Q>(main);
+    }
+
+    // Runs `x` through this instance's filter for `A` first, glitches are dropped.
+    // Then fuses it w/ any other sensors on this side measuring `A`, & publishes the result.
+    // Not-known withdraws this instance, the others carry on w/o it.
+    template <typename A>
+    void set(A x, Sensors& sensors = g_sensors, Captured& captured = g_captured) {
+        taskENTER_CRITICAL();  // `g_config` is written by BTstack
+        auto const channel = filter_channel<A>(g_config.filter);
+        taskEXIT_CRITICAL();
+
+        auto const filtered = std::get<FilterState<A>>(filters)(channel, x);
+        if (!filtered) {
+            telemetry_record(x, {}, {});
+            return;
+        }
+
+        std::optional<int64_t> raw;
+        if (*filtered != BLE::NOT_KNOWN) raw = filtered->raw_value;
+        auto const fused =
+                fusion::contribute(size_t(kind), quantity<A>(), this, raw, accuracy_of<A>(accuracy));
+        telemetry_record(x, raw, fused);
+        x = fused ? A::from_raw(typename A::Raw(*fused)) : A(BLE::NOT_KNOWN);
+
+        taskENTER_CRITICAL();  // vs. `publish`, some fields are multi-byte & unaligned
         auto [main, _] = pick(sensors);
-        std::get<A&>(main) = x;
+        auto& dst = std::get<A&>(main);
+        bool const changed = dst != x;
+        dst = x;
+        std::get<size_t(quantity<A>())>(std::get<0>(pick(captured))) = time_us_64();
+        taskEXIT_CRITICAL();
+
+        // Republish even if unchanged, else the capture time would go stale & the reading be dropped.
+        if (changed)
+            mark_dirty();
+        else
+            mark_captured();
     }
 
 private:
     using Side = std::tuple<BLE::Temperature&, BLE::Humidity&, BLE::Pressure&, VOCIndex&>;
+    // in `fusion::Quantity` order, as `Side`
+    using SideCaptured = std::tuple<uint64_t&, uint64_t&, uint64_t&, uint64_t&>;
 
     template <typename A>
-        requires(!std::is_reference_v<A>)
-    A get_(Sensors const& sensors = g_sensors, Config const& config = g_config) const {
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
-        auto [main, other] = pick(const_cast<Sensors&>(sensors));
-        if (auto value = std::get<A&>(main); value != BLE::NOT_KNOWN) return value;
-        if (auto value = std::get<A&>(other); config.fallback) return value;
-        return BLE::NOT_KNOWN;
+    static FilterChannel filter_channel(Filters const& x) {
+        if constexpr (std::is_same_v<A, BLE::Temperature>) return x.temperature;
+        if constexpr (std::is_same_v<A, BLE::Humidity>) return x.humidity;
+        if constexpr (std::is_same_v<A, BLE::Pressure>) return x.pressure;
+        if constexpr (std::is_same_v<A, VOCIndex>) return x.voc_index;
+    }
+
+    template <typename A>
+    void telemetry_record(A read, std::optional<int64_t> filtered, std::optional<int64_t> fused) const {
+        auto wire = [](std::optional<int64_t> x) { return x ? int32_t(*x) : telemetry::NOT_KNOWN; };
+        telemetry::record(telemetry::Sample{
+                .side = uint8_t(kind),
+                .quantity = uint8_t(quantity<A>()),
+                .source = telemetry::source_id(this),
+                .raw = read == BLE::NOT_KNOWN ? telemetry::NOT_KNOWN : int32_t(read.raw_value),
+                .filtered = wire(filtered),
+                .fused = wire(fused),
+        });
+    }
+
+    template <typename A>
+    static constexpr fusion::Quantity quantity() {
+        if constexpr (std::is_same_v<A, BLE::Temperature>) return fusion::Quantity::Temperature;
+        if constexpr (std::is_same_v<A, BLE::Humidity>) return fusion::Quantity::Humidity;
+        if constexpr (std::is_same_v<A, BLE::Pressure>) return fusion::Quantity::Pressure;
+        if constexpr (std::is_same_v<A, VOCIndex>) return fusion::Quantity::VOCIndex;
+    }
+
+    template <typename A>
+    static uint16_t accuracy_of(Accuracy const& x) {
+        if constexpr (std::is_same_v<A, BLE::Temperature>) return x.temperature;
+        if constexpr (std::is_same_v<A, BLE::Humidity>) return x.humidity;
+        if constexpr (std::is_same_v<A, BLE::Pressure>) return x.pressure;
+        if constexpr (std::is_same_v<A, VOCIndex>) return x.voc_index;
     }
 
     [[nodiscard]] std::tuple<Side, Side> pick(Sensors& sensors = g_sensors) const {
@@ -53,24 +175,37 @@ private:
 
         std::unreachable();  // stupid lack of case analysis
     }
+
+    [[nodiscard]] std::tuple<SideCaptured, SideCaptured> pick(Captured& x) const {
+        SideCaptured intake{x.temperature_intake, x.humidity_intake, x.pressure_intake, x.voc_index_intake};
+        SideCaptured exhaust{
+                x.temperature_exhaust, x.humidity_exhaust, x.pressure_exhaust, x.voc_index_exhaust};
+
+        switch (kind) {
+        case Kind::Intake: return {intake, exhaust};
+        case Kind::Exhaust: return {exhaust, intake};
+        }
+
+        std::unreachable();
+    }
 };
 
 // special: exhaust can prefer to fall back too the MCU temperature (always known) instead of intake
 template <>
-inline BLE::Temperature EnvironmentalFilter::get<BLE::Temperature>(
+inline EnvironmentalFilter::Source EnvironmentalFilter::source<BLE::Temperature>(
         Sensors const& sensors, Config const& config) const {
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
     auto [main, other] = pick(const_cast<Sensors&>(sensors));
-    if (auto value = std::get<BLE::Temperature&>(main); value != BLE::NOT_KNOWN) return value;
+    if (std::get<BLE::Temperature&>(main) != BLE::NOT_KNOWN) return Source::Main;
     // Exhaust falls back to MCU first, if enabled
-    if (g_config.fallback_exhaust_mcu && kind == Kind::Exhaust) return sensors.temperature_mcu;
+    if (config.fallback_exhaust_mcu && kind == Kind::Exhaust) return Source::Mcu;
     // No other fallbacks allowed
-    if (!g_config.fallback) return BLE::NOT_KNOWN;
+    if (!config.fallback) return Source::None;
     // Fall back to other side
-    if (auto value = std::get<BLE::Temperature&>(other); value != BLE::NOT_KNOWN) return value;
+    if (std::get<BLE::Temperature&>(other) != BLE::NOT_KNOWN) return Source::Other;
     // we're intake, have no value, and neither does exhaust -> double fallback to MCU
-    if (g_config.fallback_exhaust_mcu) return sensors.temperature_mcu;
-    return BLE::NOT_KNOWN;
+    if (config.fallback_exhaust_mcu) return Source::Mcu;
+    return Source::None;
 }
 
 }  // namespace nevermore::sensors
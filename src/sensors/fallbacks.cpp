@@ -0,0 +1,80 @@
+#include "environmental.hpp"
+#include "sensors.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+// Hardware independent, so it's also part of the host build (see `host/`).
+namespace nevermore::sensors {
+
+Config g_config;
+
+Sensors Sensors::with_fallbacks(Config const& config) const {
+    EnvironmentalFilter intake{EnvironmentalFilter::Kind::Intake};
+    EnvironmentalFilter exhaust{EnvironmentalFilter::Kind::Exhaust};
+    auto apply = [&]<typename A>(A& x, EnvironmentalFilter side) { x = side.get<A>(*this, config); };
+    Sensors sensors = *this;
+    apply(sensors.temperature_intake, intake);
+    apply(sensors.humidity_intake, intake);
+    apply(sensors.pressure_intake, intake);
+    apply(sensors.voc_index_intake, intake);
+    apply(sensors.temperature_exhaust, exhaust);
+    apply(sensors.humidity_exhaust, exhaust);
+    apply(sensors.pressure_exhaust, exhaust);
+    apply(sensors.voc_index_exhaust, exhaust);
+    return sensors;
+}
+
+Captured Captured::with_fallbacks(Sensors const& raw, Config const& config) const {
+    EnvironmentalFilter intake{EnvironmentalFilter::Kind::Intake};
+    EnvironmentalFilter exhaust{EnvironmentalFilter::Kind::Exhaust};
+    Captured x = *this;
+    x.temperature_intake = intake.captured<BLE::Temperature>(*this, raw, config);
+    x.humidity_intake = intake.captured<BLE::Humidity>(*this, raw, config);
+    x.pressure_intake = intake.captured<BLE::Pressure>(*this, raw, config);
+    x.voc_index_intake = intake.captured<VOCIndex>(*this, raw, config);
+    x.temperature_exhaust = exhaust.captured<BLE::Temperature>(*this, raw, config);
+    x.humidity_exhaust = exhaust.captured<BLE::Humidity>(*this, raw, config);
+    x.pressure_exhaust = exhaust.captured<BLE::Pressure>(*this, raw, config);
+    x.voc_index_exhaust = exhaust.captured<VOCIndex>(*this, raw, config);
+    return x;
+}
+
+namespace {
+
+// `f(value, captured at)` for each of `sensors`' fields
+template <typename S, typename F>
+void each_stamped(S& sensors, Captured const& captured, F&& f) {
+    f(sensors.temperature_intake, captured.temperature_intake);
+    f(sensors.temperature_exhaust, captured.temperature_exhaust);
+    f(sensors.temperature_mcu, captured.temperature_mcu);
+    f(sensors.humidity_intake, captured.humidity_intake);
+    f(sensors.humidity_exhaust, captured.humidity_exhaust);
+    f(sensors.pressure_intake, captured.pressure_intake);
+    f(sensors.pressure_exhaust, captured.pressure_exhaust);
+    f(sensors.voc_index_intake, captured.voc_index_intake);
+    f(sensors.voc_index_exhaust, captured.voc_index_exhaust);
+}
+
+}  // namespace
+
+Sensors Stamped::fresh(uint64_t now, chrono::microseconds max_age) const {
+    Sensors x = sensors;
+    each_stamped(x, captured, [&]<typename A>(A& value, uint64_t at) {
+        if (value != BLE::NOT_KNOWN && at + uint64_t(max_age.count()) < now) value = A(BLE::NOT_KNOWN);
+    });
+    return x;
+}
+
+uint64_t Stamped::stale_at(uint64_t now, chrono::microseconds max_age) const {
+    uint64_t earliest = UINT64_MAX;
+    each_stamped(sensors, captured, [&]<typename A>(A const& value, uint64_t at) {
+        auto const stale = at + uint64_t(max_age.count());
+        if (value != BLE::NOT_KNOWN && now <= stale) earliest = min(earliest, stale + 1);
+    });
+    return earliest;
+}
+
+}  // namespace nevermore::sensors
@@ -0,0 +1,55 @@
+#include "filter.hpp"
+#include "sdk/ble_data_types.hpp"
+#include <array>
+#include <cstddef>
+#include <optional>
+
+// Hardware independent, so it's also part of the host build (see `host/`).
+namespace nevermore::sensors {
+
+// Filter Tests
+
+namespace {
+
+using BLE::Temperature;
+
+constexpr FilterChannel MEDIAN{.kind = FilterChannel::Kind::Median, .window = 3, .outlier_max = 0};
+constexpr FilterChannel EWMA{.kind = FilterChannel::Kind::EWMA, .window = 4, .outlier_max = 0};
+constexpr FilterChannel GATED{.kind = FilterChannel::Kind::None, .window = 1, .outlier_max = 100};
+
+// Feeds `reads` (raw values) through a fresh filter, returns the raw values published (-1 -> dropped).
+template <size_t N>
+constexpr std::array<int, N> run(FilterChannel const& channel, std::array<int16_t, N> const& reads) {
+    FilterState<Temperature> state;
+    std::array<int, N> out{};
+    for (size_t i = 0; i < N; ++i) {
+        auto const x = state(channel, Temperature::from_raw(reads.at(i)));
+        out.at(i) = x ? x->raw_value : -1;
+    }
+    return out;
+}
+
+}  // namespace
+
+// Median rejects a single spike outright.
+static_assert(run(MEDIAN, std::array<int16_t, 5>{10, 10, 900, 10, 10}) == std::array{10, 10, 10, 10, 10});
+// ... & follows a real step after `window / 2 + 1` reads.
+static_assert(run(MEDIAN, std::array<int16_t, 4>{10, 10, 50, 50}) == std::array{10, 10, 10, 50});
+// EWMA seeds w/ the first read, then moves `1 / window` of the way per read.
+static_assert(run(EWMA, std::array<int16_t, 3>{100, 200, 200}) == std::array{100, 125, 144});
+// Outliers are dropped, unless they keep coming.
+static_assert(run(GATED, std::array<int16_t, 5>{10, 500, 20, 500, 500}) == std::array{10, -1, 20, -1, -1});
+static_assert(run(GATED, std::array<int16_t, 4>{10, 500, 500, 500}) == std::array{10, -1, -1, 500});
+// Not-known is passed straight through & restarts the filter.
+static_assert([] {
+    FilterState<Temperature> state;
+    (void)state(GATED, Temperature::from_raw(10));
+    if (state(GATED, BLE::NOT_KNOWN) != Temperature(BLE::NOT_KNOWN)) return false;
+    return state(GATED, Temperature::from_raw(500)) == Temperature::from_raw(500);
+}());
+
+static_assert(Filters{}.valid());
+static_assert(!FilterChannel{.window = 0}.valid());
+static_assert(!FilterChannel{.window = FilterChannel::WINDOW_MAX + 1}.valid());
+
+}  // namespace nevermore::sensors
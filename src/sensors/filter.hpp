@@ -0,0 +1,120 @@
+#pragma once
+
+#include "sdk/ble_data_types.hpp"
+#include "utility/wire.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// Per channel smoothing between a driver's read & it being published.
+// Works on the scalars' raw values, so it's all integer.
+namespace nevermore::sensors {
+
+// Requirements:
+// * Must be tightly laid out, sent as-is by the sensor filter characteristic (as part of `Filters`).
+struct FilterChannel {
+    enum class Kind : uint8_t {
+        None = 0,    // publish reads as-is
+        Median = 1,  // median of the last `window` reads
+        EWMA = 2,    // exponential moving average, time constant of `window` reads
+    };
+
+    static constexpr uint8_t WINDOW_MAX = 7;
+
+    Kind kind = Kind::None;
+    uint8_t window = 1;  // [1, WINDOW_MAX] reads
+    // A read this far (in the channel's raw units, e.g. 0.01 C) from the last published value is dropped as a
+    // glitch (e.g. a loose wire), unless `OUTLIER_STREAK` arrive in a row. Then it's a real step change.
+    // 0 -> disabled
+    uint16_t outlier_max = 0;
+
+    static constexpr uint8_t OUTLIER_STREAK = 3;
+
+    [[nodiscard]] constexpr bool valid() const {
+        return kind <= Kind::EWMA && 1 <= window && window <= WINDOW_MAX;
+    }
+};
+static_assert(wire::tight<FilterChannel>({WIRE_FIELD(FilterChannel, kind), WIRE_FIELD(FilterChannel, window),
+        WIRE_FIELD(FilterChannel, outlier_max)}));
+
+// Requirements:
+// * Must be tightly laid out, sent as-is by the sensor filter characteristic & persisted.
+struct Filters {
+    using Kind = FilterChannel::Kind;
+
+    FilterChannel temperature{Kind::Median, 3, 5'00};   // 5 C
+    FilterChannel humidity{Kind::Median, 3, 10'00};     // 10 %
+    FilterChannel pressure{Kind::Median, 3, 1'000'0};   // 1 kPa
+    FilterChannel voc_index{Kind::None, 1, 0};          // SGP40's gas index algorithm is already smoothed
+
+    [[nodiscard]] constexpr bool valid() const {
+        return temperature.valid() && humidity.valid() && pressure.valid() && voc_index.valid();
+    }
+};
+static_assert(wire::tight<Filters>({WIRE_FIELD(Filters, temperature), WIRE_FIELD(Filters, humidity),
+        WIRE_FIELD(Filters, pressure), WIRE_FIELD(Filters, voc_index)}));
+
+template <typename A>
+struct FilterState {
+    using Raw = typename A::Raw;
+
+    std::array<Raw, FilterChannel::WINDOW_MAX> samples{};  // ring, newest at `next - 1`
+    uint8_t next = 0;
+    uint8_t count = 0;  // saturates at `samples.size()`
+    uint8_t rejected = 0;
+    int64_t ewma_q8 = 0;
+    std::optional<Raw> last;  // last published
+
+    // Returns the value to publish. `nullopt` -> drop this read, keep publishing the last value.
+    // A not-known read is published as-is, & starts the filter over.
+    constexpr std::optional<A> operator()(FilterChannel const& channel, A x) {
+        if constexpr (BLE::has_not_known<A>) {
+            if (x == BLE::NOT_KNOWN) {
+                *this = {};
+                return x;
+            }
+        }
+
+        auto const raw = x.raw_value;
+        if (last && channel.outlier_max != 0) {
+            auto const delta = int64_t(raw) - int64_t(*last);
+            if (channel.outlier_max < (delta < 0 ? -delta : delta)) {
+                if (++rejected < FilterChannel::OUTLIER_STREAK) return {};
+
+                *this = {};  // it's a real step, don't drag the old history into it
+            }
+        }
+        rejected = 0;
+
+        samples.at(next) = raw;
+        next = uint8_t((next + 1) % samples.size());
+        count = uint8_t(std::min<size_t>(count + 1, samples.size()));
+
+        auto const window = std::clamp<uint8_t>(channel.window, 1, FilterChannel::WINDOW_MAX);
+        Raw out = raw;
+        switch (channel.kind) {
+        case FilterChannel::Kind::None: break;
+        case FilterChannel::Kind::Median: {
+            auto const n = std::min(count, window);
+            std::array<Raw, FilterChannel::WINDOW_MAX> recent{};
+            for (size_t i = 0; i < n; ++i)
+                recent.at(i) = samples.at((next + samples.size() - 1 - i) % samples.size());
+            std::nth_element(recent.begin(), recent.begin() + n / 2, recent.begin() + n);
+            out = recent.at(n / 2);
+        } break;
+        case FilterChannel::Kind::EWMA: {
+            if (count == 1)
+                ewma_q8 = int64_t(raw) * 256;
+            else
+                ewma_q8 += (int64_t(raw) * 256 - ewma_q8) / window;
+            out = Raw((ewma_q8 + 128) >> 8);
+        } break;
+        }
+
+        last = out;
+        return A::from_raw(out);
+    }
+};
+
+}  // namespace nevermore::sensors
@@ -0,0 +1,86 @@
+#include "fusion.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "sdk/timer.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include <array>
+#include <cstdio>
+#include <utility>
+
+using namespace std;
+
+namespace nevermore::sensors::fusion {
+
+namespace {
+
+// Warn once a sensor has disagreed w/ the others for this many fusions in a row.
+constexpr uint8_t OUTLIER_WARN = 30;
+
+constexpr array<char const*, SIDES> SIDE_NAMES{"intake", "exhaust"};
+constexpr array<char const*, QUANTITIES> QUANTITY_NAMES{"temperature", "humidity", "pressure", "VOC index"};
+
+// Guarded by the kernel critical section, sensors are fused from the executor & withdrawn from elsewhere.
+array<array<array<Contribution, CONTRIBUTORS_MAX>, QUANTITIES>, SIDES> g_contributions;
+
+// Fusion Tests
+
+constexpr array<char, CONTRIBUTORS_MAX> OWNERS{};  // stand-ins, only their addresses matter
+
+constexpr Contribution mk(size_t owner, int64_t raw, uint16_t accuracy, chrono::microseconds at = 0s) {
+    return {.owner = &OWNERS.at(owner), .raw = raw, .accuracy = accuracy, .at = at};
+}
+
+template <size_t N>
+constexpr optional<int64_t> run(array<Contribution, N> xs, chrono::microseconds now = 0s) {
+    return fuse(xs, now);
+}
+
+static_assert(!run(array<Contribution, 2>{}));
+static_assert(run(array{mk(0, 2000, 30)}) == 2000);
+// equal accuracy -> plain mean
+static_assert(run(array{mk(0, 2000, 50), mk(1, 2100, 50)}) == 2050);
+// 1/x^2: the 30 is ~11x the weight of the 100
+static_assert(run(array{mk(0, 2000, 30), mk(1, 2100, 100)}) == 2008);
+// 2 disagreeing, no majority -> both count
+static_assert(run(array{mk(0, 2000, 50), mk(1, 3000, 50)}) == 2500);
+// 3, one way off -> outvoted
+static_assert(run(array{mk(0, 2000, 50), mk(1, 2020, 50), mk(2, 3000, 50)}) == 2010);
+// stale contributors don't count
+static_assert(run(array{mk(0, 2000, 50, 0s), mk(1, 2100, 50, 40s)}, 40s) == 2100);
+// negative values round to nearest too
+static_assert(run(array{mk(0, -1000, 50), mk(1, -1001, 50)}) == -1001);
+
+}  // namespace
+
+optional<int64_t> contribute(size_t side, Quantity quantity, void const* owner, optional<int64_t> raw,
+        uint16_t accuracy) {
+    auto const now = time_64u();
+    auto& xs = g_contributions.at(side).at(to_underlying(quantity));
+
+    taskENTER_CRITICAL();
+    auto* slot = find_if(xs.begin(), xs.end(), [&](auto& x) { return x.owner == owner; });
+    if (slot == xs.end() && raw) slot = find_if(xs.begin(), xs.end(), [](auto& x) { return !x.owner; });
+
+    bool const full = slot == xs.end() && raw;
+    if (slot != xs.end()) {
+        if (raw)
+            *slot = {.owner = owner, .raw = *raw, .accuracy = accuracy, .at = now,
+                    .outlier_streak = slot->owner ? slot->outlier_streak : uint8_t(0)};
+        else
+            *slot = {};
+    }
+
+    auto const fused = fuse(xs, now);
+    bool const outlier = slot != xs.end() && slot->owner && slot->outlier_streak == OUTLIER_WARN;
+    taskEXIT_CRITICAL();
+
+    if (full)
+        printf("WARN - fusion - more than %u %s %s sensors, ignoring one\n", unsigned(CONTRIBUTORS_MAX),
+                SIDE_NAMES.at(side), QUANTITY_NAMES.at(to_underlying(quantity)));
+    if (outlier)
+        printf("WARN - fusion - an %s %s sensor keeps disagreeing w/ the others (failing?)\n",
+                SIDE_NAMES.at(side), QUANTITY_NAMES.at(to_underlying(quantity)));
+
+    return fused;
+}
+
+}  // namespace nevermore::sensors::fusion
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+// Combines redundant sensors on the same side (e.g. an HTU2xD & a BME280 both measuring temperature) into
+// one published value, instead of whichever wrote last winning.
+// Works on the scalars' raw values, after each sensor's own filter.
+namespace nevermore::sensors::fusion {
+
+using namespace std::literals::chrono_literals;
+
+enum class Quantity : uint8_t { Temperature, Humidity, Pressure, VOCIndex };
+
+constexpr size_t SIDES = 2;
+constexpr size_t QUANTITIES = 4;
+constexpr size_t CONTRIBUTORS_MAX = 4;  // per side & quantity
+
+// A contributor that hasn't reported in this long is left out (its sensor is stuck or gone).
+constexpr auto STALE_AFTER = 30s;
+// A contributor further than this many times (its accuracy + the median's) from the median is left out.
+// Only applied w/ 3+ contributors, w/ 2 there's no telling which one is wrong.
+constexpr int64_t OUTLIER_SPREAD = 2;
+
+struct Contribution {
+    void const* owner = nullptr;  // nullptr -> free
+    int64_t raw = 0;
+    uint16_t accuracy = 1;  // datasheet typical, in the quantity's raw units
+    std::chrono::microseconds at{};
+    uint8_t outlier_streak = 0;  // health: consecutive fusions it was left out of as an outlier
+};
+
+// Inverse variance, scaled to stay integral for any accuracy we'd see.
+constexpr int64_t weight(uint16_t accuracy) {
+    int64_t const x = std::max<uint16_t>(accuracy, 1);
+    return (int64_t(1) << 24) / (x * x);
+}
+
+// Returns the weighted average of the healthy contributors, updating their health as it goes.
+// `nullopt` -> none are healthy.
+constexpr std::optional<int64_t> fuse(std::span<Contribution> xs, std::chrono::microseconds now) {
+    std::array<Contribution*, CONTRIBUTORS_MAX> live{};
+    size_t n = 0;
+    for (auto& x : xs)
+        if (x.owner && now - x.at <= STALE_AFTER && n < live.size()) live.at(n++) = &x;
+    if (n == 0) return {};
+
+    auto by_value = live;
+    std::sort(by_value.begin(), by_value.begin() + n, [](auto* a, auto* b) { return a->raw < b->raw; });
+    auto const& median = *by_value.at((n - 1) / 2);
+
+    int64_t sum = 0;
+    int64_t weights = 0;
+    for (size_t i = 0; i < n; ++i) {
+        auto& x = *live.at(i);
+        auto const delta = x.raw < median.raw ? median.raw - x.raw : x.raw - median.raw;
+        if (3 <= n && OUTLIER_SPREAD * (x.accuracy + median.accuracy) < delta) {
+            x.outlier_streak = uint8_t(std::min(x.outlier_streak + 1, int(UINT8_MAX)));
+            continue;
+        }
+
+        x.outlier_streak = 0;
+        sum += x.raw * weight(x.accuracy);
+        weights += weight(x.accuracy);
+    }
+
+    // the median is never an outlier, so `weights` isn't 0
+    return (sum < 0 ? sum - weights / 2 : sum + weights / 2) / weights;
+}
+
+// Records `owner`'s latest read (`nullopt` -> it has none, withdraw it) & returns the side's fused value.
+// Safe to call from any task.
+std::optional<int64_t> contribute(
+        size_t side, Quantity, void const* owner, std::optional<int64_t> raw, uint16_t accuracy);
+
+}  // namespace nevermore::sensors::fusion
@@ -0,0 +1,108 @@
+#include "history.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "sdk/timer.hpp"
+#include "task.h"
+#include "utility/timer.hpp"
+#include <cassert>
+#include <numeric>
+#include <span>
+
+using namespace std;
+
+namespace nevermore::sensors::history {
+
+namespace {
+
+constexpr auto SAMPLE_PERIOD = RESOLUTIONS[0].period;
+
+static_assert(
+        []() {
+            for (auto&& x : RESOLUTIONS)
+                if (x.capacity == 0 || x.period % SAMPLE_PERIOD != 0s) return false;
+            return true;
+        }(),
+        "every resolution period must be a multiple of the finest");
+
+constexpr size_t SAMPLES_TOTAL =
+        accumulate(RESOLUTIONS.begin(), RESOLUTIONS.end(), size_t(0), [](size_t acc, Resolution const& x) {
+            return acc + x.capacity;
+        });
+
+array<Sample, SAMPLES_TOTAL> g_samples;
+
+struct Ring {
+    span<Sample> samples;
+    uint32_t end = 0;  // seq # of the next sample to be recorded
+
+    [[nodiscard]] uint32_t begin() const {
+        return end < samples.size() ? 0 : end - samples.size();
+    }
+};
+
+// guarded by the kernel critical section: written by the timer task, read by BTstack
+array<Ring, RESOLUTIONS.size()> g_rings = []() {
+    array<Ring, RESOLUTIONS.size()> rings;
+    size_t offset = 0;
+    for (size_t i = 0; i < RESOLUTIONS.size(); ++i) {
+        rings.at(i).samples = span{g_samples}.subspan(offset, RESOLUTIONS.at(i).capacity);
+        offset += RESOLUTIONS.at(i).capacity;
+    }
+    return rings;
+}();
+
+void record() {
+    static uint32_t g_ticks = 0;
+    Sample const sample{.timestamp = now(), .sensors = snapshot_resolved()};
+
+    taskENTER_CRITICAL();
+    for (size_t i = 0; i < RESOLUTIONS.size(); ++i) {
+        if (g_ticks % (RESOLUTIONS.at(i).period / SAMPLE_PERIOD) != 0) continue;
+
+        auto& ring = g_rings.at(i);
+        ring.samples[ring.end % ring.samples.size()] = sample;
+        ring.end += 1;
+    }
+    taskEXIT_CRITICAL();
+
+    g_ticks += 1;
+}
+
+}  // namespace
+
+uint32_t now() {
+    return uint32_t(chrono::duration_cast<chrono::seconds>(time_64u()).count());
+}
+
+Range since(uint8_t resolution, uint32_t timestamp) {
+    if (RESOLUTIONS.size() <= resolution) return {};
+
+    auto const& ring = g_rings.at(resolution);
+    taskENTER_CRITICAL();
+    // timestamps are ascending, so skip the prefix at/before `timestamp`
+    Range range{.begin = ring.begin(), .end = ring.end};
+    auto at = [&](uint32_t seq) -> Sample const& { return ring.samples[seq % ring.samples.size()]; };
+    while (range.begin < range.end && at(range.begin).timestamp <= timestamp)
+        range.begin += 1;
+    taskEXIT_CRITICAL();
+
+    return range;
+}
+
+optional<Sample> get(uint8_t resolution, uint32_t seq) {
+    if (RESOLUTIONS.size() <= resolution) return {};
+
+    auto const& ring = g_rings.at(resolution);
+    optional<Sample> sample;
+    taskENTER_CRITICAL();
+    if (ring.begin() <= seq && seq < ring.end) sample = ring.samples[seq % ring.samples.size()];
+    taskEXIT_CRITICAL();
+
+    return sample;
+}
+
+bool init() {
+    record();  // don't leave the first period empty
+    return mk_periodic("sensor-history", SAMPLE_PERIOD)(record);
+}
+
+}  // namespace nevermore::sensors::history
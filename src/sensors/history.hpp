@@ -0,0 +1,51 @@
+#pragma once
+
+#include "sensors.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace nevermore::sensors::history {
+
+using namespace std::literals::chrono_literals;
+
+struct [[gnu::packed]] Sample {
+    uint32_t timestamp;  // seconds since boot
+    Sensors sensors;     // w/ fallbacks applied, same as the environmental aggregate
+};
+
+struct Resolution {
+    std::chrono::seconds period;
+    uint16_t capacity;
+};
+
+// Finest first, each period must be a multiple of the first.
+// ~13 KiB total, covering 30 min @ 10s, 4 h @ 1 min, and 24 h @ 15 min.
+constexpr std::array RESOLUTIONS{
+        Resolution{.period = 10s, .capacity = 180},
+        Resolution{.period = 1min, .capacity = 240},
+        Resolution{.period = 15min, .capacity = 96},
+};
+
+// Samples are numbered sequentially per resolution, w/ only the last `capacity` retained.
+struct Range {
+    uint32_t begin = 0;
+    uint32_t end = 0;
+
+    [[nodiscard]] uint32_t size() const {
+        return end - begin;
+    }
+};
+
+// Retained samples w/ a timestamp after `timestamp`.
+Range since(uint8_t resolution, uint32_t timestamp);
+// `nullopt` if `seq` has since been evicted (or hasn't been recorded yet).
+std::optional<Sample> get(uint8_t resolution, uint32_t seq);
+
+uint32_t now();  // seconds since boot, same clock as `Sample::timestamp`
+
+// Starts recording samples.
+bool init();
+
+}  // namespace nevermore::sensors::history
@@ -2,11 +2,13 @@
 #include "config.hpp"
 #include "sdk/ble_data_types.hpp"
 #include "sdk/i2c.hpp"
-#include "sdk/timer.hpp"
+#include "utility/log.hpp"
 #include <bit>
 #include <cassert>
 #include <cstdint>
 #include <cstdio>
+#include <optional>
+#include <span>
 #include <tuple>
 #include <utility>
 
@@ -33,8 +35,12 @@ enum class Cmd : uint8_t {
     SOFT_RESET = 0xFE,
 };
 
-constexpr double HTU2xD_HUMIDITY_COMPENSATION_ZERO_POINT = 25;
-constexpr double HTU2xD_HUMIDITY_COMPENSATION_COEFFICIENT = -0.15;
+// datasheet typical, for fusing w/ other sensors on the same side
+constexpr Accuracy HTU2xD_ACCURACY{.temperature = 30, .humidity = 2'00};
+
+// Measurements are in 0.01 units (C, %) throughout, integer only.
+constexpr int32_t HTU2xD_HUMIDITY_COMPENSATION_ZERO_POINT = 25'00;
+constexpr int32_t HTU2xD_HUMIDITY_COMPENSATION_COEFFICIENT = -15;  // 0.01 % per C
 
 // 50ms @ 14 bits, 25ms @ 13 bits, 13ms @ 12 bits, 7ms @ 11 bits
 constexpr auto HTU2xD_MEASURE_TEMPERATURE_DELAY = 50ms;
@@ -53,92 +59,107 @@ static_assert(0x79 == htu2xd_crc(span{array<uint8_t const, 1>{0xDC}}));
 static_assert(0x7C == htu2xd_crc(span{array<uint8_t const, 2>{0x68, 0x3A}}));
 static_assert(0x6B == htu2xd_crc(span{array<uint8_t const, 2>{0x4E, 0x85}}));
 
-double htu2xd_humidity_compensated(double humidity_uncompensated, double temperature) {
+int32_t htu2xd_humidity_compensated(int32_t humidity_uncompensated, int32_t temperature) {
     auto bias = (HTU2xD_HUMIDITY_COMPENSATION_ZERO_POINT - temperature) *
-                HTU2xD_HUMIDITY_COMPENSATION_COEFFICIENT;
-    return clamp(humidity_uncompensated + bias, 0., 100.);
+                HTU2xD_HUMIDITY_COMPENSATION_COEFFICIENT / 100;
+    return clamp(humidity_uncompensated + bias, 0, 100'00);
 }
 
 bool htu2xd_reset(i2c_inst_t& bus) {
-    return 1 == i2c_write_blocking(bus, HTU1xD_I2C_ADDRESS, Cmd::SOFT_RESET, false);
+    return 1 == i2c_write_blocking(bus, HTU1xD_I2C_ADDRESS, Cmd::SOFT_RESET);
 }
 
-// Once a measure is enqueued, call await to retrieve the value.
+// Once a measure is enqueued, call `htu2xd_read_compensated` to retrieve the value.
 // You cannot interweave multiple measurements to the same device.
 // Returns `false` on failure to enqueue.
-bool htu2xd_issue(i2c_inst_t& bus, HTU2xD_Measure kind) {
+Coroutine<bool> htu2xd_issue(i2c_inst_t& bus, HTU2xD_Measure kind) {
     Cmd cmd;
     switch (kind) {
     case HTU2xD_Measure::Temperature: cmd = Cmd::MEASURE_TEMPERATURE_NON_BLOCKING; break;
     case HTU2xD_Measure::Humidity: cmd = Cmd::MEASURE_HUMIDITY_NON_BLOCKING; break;
     }
 
-    if (auto r = i2c_write_blocking(bus, HTU1xD_I2C_ADDRESS, cmd); r < 0) {
-        printf("ERR - HTU2xD - failed to issue read: %d\n", r);
-        return false;
+    auto const write = span{reinterpret_cast<uint8_t const*>(&cmd), sizeof(cmd)};
+    if (!co_await i2c_transfer(bus, HTU1xD_I2C_ADDRESS, write, {})) {
+        LOG_DEFERRED("ERR - HTU2xD - failed to issue read\n");
+        co_return false;
     }
 
-    return true;
+    co_return true;
 }
 
-optional<tuple<HTU2xD_Measure, double>> htu2xd_read_compensated(
-        i2c_inst_t& bus, double temperature = HTU2xD_HUMIDITY_COMPENSATION_ZERO_POINT) {
+Coroutine<optional<tuple<HTU2xD_Measure, int32_t>>> htu2xd_read_compensated(
+        i2c_inst_t& bus, int32_t temperature = HTU2xD_HUMIDITY_COMPENSATION_ZERO_POINT) {
     // in either case we're waiting for the same kind of payload
-    auto response = i2c_read_blocking_crc<0, uint16_t>(bus, HTU1xD_I2C_ADDRESS);
-    if (!response) return {};
+    auto response = co_await i2c_read_crc<0, uint16_t>(bus, HTU1xD_I2C_ADDRESS);
+    if (!response) co_return nullopt;
     auto const data = byteswap(get<0>(*response));
 
     [[maybe_unused]] auto const reserved_flag = (data & 0b01) == 0b01;  // should be zero
     auto const is_humidity = (data & 0b10) == 0b10;
-    auto const datum_f = (data & ~0b11) / double(1 << 16);
+    auto const datum = int32_t(data & ~0b11);  // [0, 1) in 1/2^16ths
 
     // printf("HTU2xD read-back: 0x%04x [0x%02x]\n", int(data), int(result.checksum));
     // printf("HTU2xD status: kind=%s reserved=%c (expected 0)\n", is_humidity ? "HUM" : "TEMP",
     //         reserved_flag ? '1' : '0');
-    // printf("HTU2xD value=%f\n", is_humidity ? (-6 + 125 * datum_f) : (-46.85 + 175.72 * datum_f));
+    // printf("HTU2xD datum=0x%04x\n", int(datum));
 
     if (is_humidity) {
-        // printf("HTY2xD temp = %f\n", temperature);
-        // printf("HTU2xD compensated = %f\n", htu2xd_humidity_compensated(-6 + 125 * datum_f, temperature));
-        return tuple{HTU2xD_Measure::Humidity, htu2xd_humidity_compensated(-6 + 125 * datum_f, temperature)};
+        // printf("HTY2xD temp = %d\n", int(temperature));
+        auto const uncompensated = -6'00 + ((125'00 * datum + (1 << 15)) >> 16);
+        auto humidity = htu2xd_humidity_compensated(uncompensated, temperature);
+        co_return tuple{HTU2xD_Measure::Humidity, humidity};
     }
 
-    return tuple{HTU2xD_Measure::Temperature, -46.85 + 175.72 * datum_f};
+    co_return tuple{HTU2xD_Measure::Temperature, -46'85 + ((175'72 * datum + (1 << 15)) >> 16)};
 }
 
-struct HTU2xDSensor final : SensorPeriodic {
+struct HTU2xDSensor final : SensorPeriodic, Pooled<HTU2xDSensor, SENSOR_POOL_SIZE> {
     i2c_inst_t& bus;  // NOLINT(cppcoreguidelines-avoid-const-or-ref-data-members)
     EnvironmentalFilter side;
 
-    HTU2xDSensor(i2c_inst_t& bus, EnvironmentalFilter side) : bus(bus), side(side) {}
+    HTU2xDSensor(i2c_inst_t& bus, EnvironmentalFilter side) : bus(bus), side(side) {
+        this->side.accuracy = HTU2xD_ACCURACY;
+    }
 
     [[nodiscard]] char const* name() const override {
         return "HTU2xD";
     }
 
-    // TODO: This is a multi-query sensor: we can't batch read issues and then batch read-backs
-    //       Ideally we'd like to be able to chain issue/read pairs.
-    //       For now, just bite the bullet, we're spending ~66ms blocked.
-    void read() override {
-        auto htu2xd_fetch = [&](auto kind, auto delay) {
-            htu2xd_issue(bus, kind);
-            busy_wait(delay);  // must busy wait, can't sleep inside an interrupt handler
-
-            // the sensor could return either data. take what we can get.
-            auto response = htu2xd_read_compensated(
-                    bus, side.get<Temperature>().value_or(HTU2xD_HUMIDITY_COMPENSATION_ZERO_POINT));
-            if (!response) return;
-
-            auto [response_kind, value] = *response;
-            assert(kind == response_kind && "htu2xd_fetch - response kind mismatch");
-            switch (response_kind) {
-            case HTU2xD_Measure::Temperature: side.set(Temperature(value)); break;
-            case HTU2xD_Measure::Humidity: side.set(Humidity(value)); break;
-            }
-        };
-
-        htu2xd_fetch(HTU2xD_Measure::Temperature, HTU2xD_MEASURE_TEMPERATURE_DELAY);
-        htu2xd_fetch(HTU2xD_Measure::Humidity, HTU2xD_MEASURE_HUMIDITY_DELAY);
+    // This is a multi-query sensor, and it can only run one conversion at a time.
+    // Conversions are chained back-to-back, and the bus & executor are free while each one runs.
+    // (HTU2xDs on separate buses overlap their conversions.)
+    Coroutine<> read() override {
+        bool ok = co_await fetch(HTU2xD_Measure::Temperature, HTU2xD_MEASURE_TEMPERATURE_DELAY);
+        ok = co_await fetch(HTU2xD_Measure::Humidity, HTU2xD_MEASURE_HUMIDITY_DELAY) && ok;  // still try
+        if (!ok) failed();  // once per read, however many of its fetches failed
+    }
+
+protected:
+    void forget() override {
+        side.set(Temperature(NOT_KNOWN));
+        side.set(Humidity(NOT_KNOWN));
+    }
+
+private:
+    // Returns `false` on failure.
+    Coroutine<bool> fetch(HTU2xD_Measure kind, chrono::milliseconds conversion_time) {
+        if (!co_await htu2xd_issue(bus, kind)) co_return false;
+
+        co_await delay(conversion_time);
+
+        // the sensor could return either data. take what we can get.
+        auto response = co_await htu2xd_read_compensated(
+                bus, int32_t(side.get<Temperature>().fixed_or<-2>(HTU2xD_HUMIDITY_COMPENSATION_ZERO_POINT)));
+        if (!response) co_return false;
+
+        auto [response_kind, value] = *response;
+        assert(kind == response_kind && "HTU2xD - response kind mismatch");
+        switch (response_kind) {
+        case HTU2xD_Measure::Temperature: side.set(Temperature::from_fixed<-2>(value)); break;
+        case HTU2xD_Measure::Humidity: side.set(Humidity::from_fixed<-2>(value)); break;
+        }
+        co_return true;
     }
 };
 
@@ -5,11 +5,15 @@
 #include "sdk/i2c.hpp"
 #include "sensors/async_sensor.hpp"
 #include "sensors/environmental.hpp"
+#include "utility/log.hpp"
 #include "utility/numeric_suffixes.hpp"
 #include "utility/packed_tuple.hpp"
 #include <bit>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <optional>
+#include <span>
 #include <utility>
 
 #define DBG_SGP40_TEMP_HUMIDITY_BREAKDOWN 0
@@ -30,6 +34,17 @@ namespace {
 
 constexpr uint8_t SGP40_ADDRESS = 0x59;
 
+// spec says max delay of 30ms for a raw measurement, and 320ms for the self-test
+// datasheet typical (+/- 15 index points), for fusing w/ other sensors on the same side
+constexpr Accuracy SGP40_ACCURACY{.voc_index = 15};
+
+constexpr auto SGP40_MEASURE_DELAY = 30ms;
+constexpr auto SGP40_SELF_TEST_DELAY = 320ms;
+
+// Measuring is split into issue/await/collect, so only the conversion itself has to fit in a period.
+static_assert(SGP40_MEASURE_DELAY < chrono::milliseconds(SENSOR_UPDATE_PERIOD) / 4,
+        "SGP40 measure must fit within a quarter of `SENSOR_UPDATE_PERIOD` (the debug breakdown's period)");
+
 // clangd bug: crash if `byteswap` is used w/o `std::` prefix in enum RHS.
 // SGP40 wants its cmds in BE order
 enum class Cmd : uint16_t {
@@ -47,7 +62,7 @@ bool sgp4x_heater_off(i2c_inst_t& bus) {
 bool sgp40_self_test(i2c_inst_t& bus) {
     if (2 != i2c_write_blocking(bus, SGP40_ADDRESS, Cmd::SGP40_SELF_TEST)) return false;
 
-    task_delay(320ms);  // spec says max delay of 320ms
+    task_delay(SGP40_SELF_TEST_DELAY);
 
     auto response = i2c_read_blocking_crc<0xFF, uint8_t, uint8_t>(bus, SGP40_ADDRESS);
     if (!response) return false;
@@ -62,35 +77,38 @@ bool sgp40_self_test(i2c_inst_t& bus) {
     return false;
 }
 
-bool sgp40_measure_issue(i2c_inst_t& bus, double temperature, double humidity) {
-    auto to_tick = [](double n, double min, double max) {
-        return byteswap(uint16_t((clamp(n, min, max) - min) / (max - min) * UINT16_MAX));
+// `temperature` & `humidity` in 0.01 units
+Coroutine<bool> sgp40_measure_issue(i2c_inst_t& bus, int64_t temperature, int64_t humidity) {
+    auto to_tick = [](int64_t n, int64_t min, int64_t max) {
+        return byteswap(uint16_t((clamp(n, min, max) - min) * UINT16_MAX / (max - min)));
     };
 
-    auto temperature_tick = to_tick(temperature, -45, 130);
-    auto humidity_tick = to_tick(humidity, 0, 100);
+    auto temperature_tick = to_tick(temperature, -45'00, 130'00);
+    auto humidity_tick = to_tick(humidity, 0, 100'00);
     PackedTuple cmd{Cmd::SGP40_MEASURE, temperature_tick, crc8(temperature_tick, 0xFF), humidity_tick,
             crc8(humidity_tick, 0xFF)};
-    return sizeof(cmd) == i2c_write_blocking(bus, SGP40_ADDRESS, cmd);
+    auto const write = span{reinterpret_cast<uint8_t const*>(&cmd), sizeof(cmd)};
+    co_return co_await i2c_transfer(bus, SGP40_ADDRESS, write, {});
 }
 
-bool sgp40_measure_issue(i2c_inst_t& bus, Temperature const& temperature, Humidity const& humidity) {
-    return sgp40_measure_issue(bus, temperature.value_or(25), humidity.value_or(50));
+Coroutine<bool> sgp40_measure_issue(
+        i2c_inst_t& bus, Temperature const& temperature, Humidity const& humidity) {
+    return sgp40_measure_issue(bus, temperature.fixed_or<-2>(25'00), humidity.fixed_or<-2>(50'00));
 }
 
-optional<uint16_t> sgp40_measure_read(i2c_inst_t& bus) {
-    auto response = i2c_read_blocking_crc<0xFF, uint16_t>(bus, SGP40_ADDRESS);
-    if (!response) return false;
+Coroutine<optional<uint16_t>> sgp40_measure_read(i2c_inst_t& bus) {
+    auto response = co_await i2c_read_crc<0xFF, uint16_t>(bus, SGP40_ADDRESS);
+    if (!response) co_return nullopt;
 
     auto&& [voc_raw] = *response;
-    return byteswap(voc_raw);
+    co_return byteswap(voc_raw);
 }
 
 bool sgp40_exists(i2c_inst_t& bus) {
     return sgp4x_heater_off(bus);  // FUTURE WORK: better way of doing this?
 }
 
-struct SGP40 final : SensorPeriodic {
+struct SGP40 final : SensorPeriodic, Pooled<SGP40, SENSOR_POOL_SIZE> {
     i2c_inst_t& bus;  // NOLINT(cppcoreguidelines-avoid-const-or-ref-data-members)
     GasIndexAlgorithmParams gas_index_algorithm{};
     EnvironmentalFilter side;
@@ -100,11 +118,12 @@ struct SGP40 final : SensorPeriodic {
     array<uint16_t, 4> history{};
 
     [[nodiscard]] chrono::milliseconds update_period() const override {
-        return SENSOR_UPDATE_PERIOD / 4;
+        return chrono::milliseconds(SENSOR_UPDATE_PERIOD) / 4;  // NB: `1s / 4 == 0s`
     }
 #endif
 
     SGP40(i2c_inst_t& bus, EnvironmentalFilter side) : bus(bus), side(side) {
+        this->side.accuracy = SGP40_ACCURACY;
         GasIndexAlgorithm_init(&gas_index_algorithm, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
     }
 
@@ -112,7 +131,7 @@ struct SGP40 final : SensorPeriodic {
         return "SGP40";
     }
 
-    bool issue() {
+    Coroutine<bool> issue() {
 #if DBG_SGP40_TEMP_HUMIDITY_BREAKDOWN
         switch (state) {
         case 0: break;
@@ -124,18 +143,20 @@ struct SGP40 final : SensorPeriodic {
         return sgp40_measure_issue(bus, side.get<Temperature>(), side.get<Humidity>());
     }
 
-    void read() override {
-        if (!issue()) {
-            printf("ERR - SGP40 - failed read request\n");
-            return;
+    Coroutine<> read() override {
+        if (!co_await issue()) {
+            LOG_DEFERRED("ERR - SGP40 - failed read request\n");
+            failed();
+            co_return;
         }
 
-        task_delay(320ms);
+        co_await delay(SGP40_MEASURE_DELAY);
 
-        auto voc_raw = sgp40_measure_read(bus);
+        auto voc_raw = co_await sgp40_measure_read(bus);
         if (!voc_raw) {
-            printf("ERR - SGP40 - failed read\n");
-            return;
+            LOG_DEFERRED("ERR - SGP40 - failed read\n");
+            failed();
+            co_return;
         }
 
 #if DBG_SGP40_TEMP_HUMIDITY_BREAKDOWN
@@ -150,12 +171,19 @@ struct SGP40 final : SensorPeriodic {
 #endif
 
         // ~330 us during steady-state, ~30 us during startup blackout
+        // The algo steps in 1s, a slow sample is held for each step it spans (keeps its time constants).
         int32_t gas_index{};
-        GasIndexAlgorithm_process(&gas_index_algorithm, *voc_raw, &gas_index);
+        for (uint32_t i = 0; i < read_periods(); ++i)
+            GasIndexAlgorithm_process(&gas_index_algorithm, *voc_raw, &gas_index);
         assert(0 <= gas_index && gas_index <= 500 && "result out of range?");
-        if (gas_index == 0) return;  // 0 -> index not available
+        if (gas_index == 0) co_return;  // 0 -> index not available
+
+        side.set(VOCIndex::from_fixed<0>(gas_index));
+    }
 
-        side.set(VOCIndex(gas_index));
+protected:
+    void forget() override {
+        side.set(VOCIndex(NOT_KNOWN));
     }
 };
 
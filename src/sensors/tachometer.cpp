@@ -0,0 +1,124 @@
+#include "tachometer.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+#include "pico/platform.h"
+#include "task.h"  // IWYU pragma: keep
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+namespace nevermore::sensors {
+
+namespace {
+
+constexpr size_t TACHOMETERS_MAX = 4;
+
+constexpr auto STALL_TIMEOUT_US = uint32_t(Tachometer::STALL_TIMEOUT / 1us);
+constexpr auto EDGE_PERIOD_MIN_US = uint32_t(Tachometer::EDGE_PERIOD_MIN / 1us);
+
+// Every fan's tachometer pin. They all share the one raw handler, the SDK only passes the bank's other pins
+// (e.g. the CST816S's) on to its default callback.
+constexpr uint32_t TACHOMETER_PINS_MASK = [] {
+    uint32_t mask = 0;
+    for (auto&& fan : PINS_FAN)
+        mask |= 1u << fan.tachometer;
+    return mask;
+}();
+
+// Only touched by `start` (before the pin's IRQ is enabled), read by the ISR.
+array<Tachometer*, TACHOMETERS_MAX> g_tachometers{};
+
+}  // namespace
+
+struct TachometerISR {
+    // Raw handler, shares the bank IRQ w/ the SDK's callback (used by the CST816S).
+    // Only acknowledges our own pins' events. Every fan edge lands here, so it (& `edge`) run from RAM.
+    static void __isr __not_in_flash_func(isr)() {
+        auto const now = time_us_32();
+        for (auto* tachometer : g_tachometers) {
+            if (!tachometer) break;
+            if (!(gpio_get_irq_event_mask(tachometer->pin) & GPIO_IRQ_EDGE_FALL)) continue;
+
+            gpio_acknowledge_irq(tachometer->pin, GPIO_IRQ_EDGE_FALL);
+            tachometer->edge(now);
+        }
+    }
+};
+
+void Tachometer::start() {
+    if (ranges::find(g_tachometers, this) == g_tachometers.end()) {
+        auto* const it = ranges::find(g_tachometers, nullptr);
+        assert(it != g_tachometers.end() && "too many tachometers, bump `TACHOMETERS_MAX`");
+        if (it == g_tachometers.end()) {
+            printf("ERR - Tachometer - too many tachometers, ignoring pin %u\n", unsigned(pin));
+            return;
+        }
+
+        assert((TACHOMETER_PINS_MASK >> pin & 1) && "tachometer pin isn't one of `PINS_FAN`'s");
+        // one shared handler serves every tachometer, claim all their pins up front
+        if (it == g_tachometers.begin())
+            gpio_add_raw_irq_handler_masked(TACHOMETER_PINS_MASK, TachometerISR::isr);
+        *it = this;
+        gpio_set_irq_enabled(pin, GPIO_IRQ_EDGE_FALL, true);
+    }
+
+    SensorPeriodic::start();
+}
+
+void __not_in_flash("tachometer") Tachometer::edge(uint32_t now_us) {
+    auto const saved = taskENTER_CRITICAL_FROM_ISR();
+    auto const period = now_us - edge_last_us;
+    if (!edge_seen || STALL_TIMEOUT_US < period) {
+        // (re)starting from a stop, the gap since the last edge isn't a period
+        periods_us.fill(0);  // `periods_sum_us` is only kept up to date by subtracting these
+        periods_sum_us = 0;
+        periods_count = 0;
+        periods_next = 0;
+        edge_last_us = now_us;
+        edge_seen = true;
+    } else if (EDGE_PERIOD_MIN_US <= period) {
+        auto& slot = periods_us.at(periods_next);
+        periods_sum_us += period - slot;  // `slot` is 0 until the filter fills up
+        slot = period;
+        periods_next = (periods_next + 1) % periods_us.size();
+        periods_count = min<uint32_t>(periods_count + 1, periods_us.size());
+        edge_last_us = now_us;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+uint32_t Tachometer::rpm() const {
+    taskENTER_CRITICAL();
+    auto const since_edge = time_us_32() - edge_last_us;
+    auto sum = periods_sum_us;
+    auto count = periods_count;
+    bool const seen = edge_seen;
+    taskEXIT_CRITICAL();
+
+    if (!seen || count == 0 || STALL_TIMEOUT_US < since_edge) return 0;
+
+    // Still waiting on an edge for longer than the average period -> the fan is slowing down.
+    // Count the partial period so the reading decays instead of holding the old speed until the next edge.
+    if (count * since_edge > sum) {
+        sum += since_edge;
+        count += 1;
+    }
+
+    // `count` pulses over `sum` us, rounded
+    auto const den = uint64_t(sum) * pulses_per_revolution;
+    return uint32_t((count * 60'000'000ull + den / 2) / den);
+}
+
+Coroutine<> Tachometer::read() {
+    auto const now = rpm();
+    if (now != rpm_last) {
+        rpm_last = now;
+        if (observer) observer();
+    }
+
+    co_return;
+}
+
+}  // namespace nevermore::sensors
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "async_sensor.hpp"
-#include "sdk/pwm.hpp"
+#include "config.hpp"
+#include <array>
+#include <cassert>
 #include <chrono>
 #include <cstdint>
 
@@ -9,49 +11,63 @@ namespace nevermore::sensors {
 
 using namespace std::literals::chrono_literals;
 
+// Timestamps falling edges from a GPIO IRQ & derives RPM from the period between them (averaged over the
+// last few edges). Readings are fresh as of the last edge, rather than a gate window's worth stale.
 struct Tachometer final : SensorPeriodic {
-    constexpr static auto TACHOMETER_READ_PERIOD = SENSOR_UPDATE_PERIOD;
-    static_assert(100ms <= TACHOMETER_READ_PERIOD && "need at least 100ms to get a good sampling");
+    // Only how often observers are told about changes, `rpm` is always current.
+    constexpr static auto TACHOMETER_READ_PERIOD = 250ms;
+    // No edge for this long -> the fan is stopped. Also bounds the lowest measurable speed
+    // (1 pulse per timeout, e.g. 30 RPM for a 2 pulse per revolution fan).
+    constexpr static auto STALL_TIMEOUT = 1s;
+    // Edges closer together than this are noise (e.g. PWM coupling onto the tach line), not the fan.
+    // ~60k RPM @ 2 pulses per revolution, far beyond any fan we'd drive.
+    constexpr static auto EDGE_PERIOD_MIN = 500us;
+    // # of periods in the moving average. A couple of revolutions for a typical 2 pulse fan.
+    constexpr static size_t FILTER_PERIODS = 8;
 
     Tachometer(GPIO_Pin pin, uint32_t pulses_per_revolution = 1)
-            : slice_num(pwm_gpio_to_slice_num_(pin)), pulses_per_revolution(pulses_per_revolution) {
-        assert(pwm_gpio_to_channel(pin) == PWM_CHAN_B && "tachometers must run on a B channel");
+            : pin(pin), pulses_per_revolution(pulses_per_revolution) {
         assert(0 < pulses_per_revolution);
     }
 
-    [[nodiscard]] double revolutions_per_second() const {
-        return revolutions_per_second_;
-    }
+    // Safe to call from any task. Integer only, it's read by the fan control loop & every BLE update.
+    [[nodiscard]] uint32_t rpm() const;
 
     [[nodiscard]] char const* name() const override {
         return "Tachometer";
     }
 
-protected:
-    void read() override {
-        pwm_set_counter(slice_num, 0);
-        begin = std::chrono::steady_clock::now();
-        pwm_set_enabled(slice_num, true);
-
-        task_delay(TACHOMETER_READ_PERIOD);
+    [[nodiscard]] std::chrono::milliseconds update_period() const override {
+        return TACHOMETER_READ_PERIOD;
+    }
 
-        pwm_set_enabled(slice_num, false);
-        auto end = std::chrono::steady_clock::now();
+    // Called from the sensor task whenever a read changes the (whole #) RPM.
+    void observe(void (*observer)()) {
+        this->observer = observer;
+    }
 
-        auto duration_sec =
-                std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1>>>(end - begin);
-        auto count = pwm_get_counter(slice_num);
-        revolutions_per_second_ = count / duration_sec.count() / pulses_per_revolution;
+    void start() override;
 
-        // printf("tachometer_measure dur=%f s cnt=%d rev-per-sec=%f rpm=%f\n",
-        //    duration_sec.count(), int(count), revolutions_per_second_, revolutions_per_second_ * 60);
-    }
+protected:
+    Coroutine<> read() override;
 
 private:
-    uint slice_num;
+    friend struct TachometerISR;
+
+    void edge(uint32_t now_us);  // called from the GPIO IRQ
+
+    GPIO_Pin pin;
     uint pulses_per_revolution;
-    double revolutions_per_second_ = 0;
-    std::chrono::steady_clock::time_point begin{};
+    uint32_t rpm_last = 0;  // last value observers were told about
+    void (*observer)() = nullptr;
+
+    // Written by the ISR, guarded by the kernel critical section.
+    std::array<uint32_t, FILTER_PERIODS> periods_us{};
+    uint32_t periods_sum_us = 0;
+    uint32_t periods_count = 0;
+    uint32_t periods_next = 0;
+    uint32_t edge_last_us = 0;
+    bool edge_seen = false;
 };
 
 }  // namespace nevermore::sensors
@@ -0,0 +1,281 @@
+#include "settings.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "hardware/flash.h"
+#include "pico/btstack_flash_bank.h"
+#include "sdk/flash.hpp"
+#include "semphr.h"
+#include "utility/crc.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// Log structured key/value store, spread over a few flash sectors to level wear.
+//
+// Each sector starts w/ a `SectorHeader`, followed by `Record`s appended in write order. The latest record
+// for a key wins. Once the active sector is full we move to the next (oldest) sector, erase it, and copy
+// every live value over before appending again. So the newest sector always holds the full state, and a
+// torn write (power loss) can only lose the value that was being written.
+
+extern char __flash_binary_end;  // NOLINT(bugprone-reserved-identifier) provided by the SDK's linker script
+
+namespace nevermore::settings {
+
+namespace {
+
+constexpr uint32_t SECTORS = 4;
+constexpr uint32_t REGION_SIZE = SECTORS * FLASH_SECTOR_SIZE;
+// BTstack's TLV bank sits at the end of flash (by default), we go right before it.
+constexpr uint32_t REGION_OFFSET = PICO_FLASH_BANK_STORAGE_OFFSET - REGION_SIZE;
+static_assert(REGION_OFFSET % FLASH_SECTOR_SIZE == 0);
+
+constexpr uint32_t SECTOR_MAGIC = 0x3156'4B4E;  // "NKV1"
+constexpr uint16_t KEY_ERASED = 0xFFFF;
+constexpr size_t ENTRIES_MAX = 24;
+
+struct [[gnu::packed]] SectorHeader {
+    uint32_t magic;
+    uint32_t seq;  // incremented on every sector change, newest sector has the highest
+};
+
+struct [[gnu::packed]] RecordHeader {
+    uint16_t key;
+    uint8_t size;
+    CRC8_t crc;  // over `key`, `size`, and the value
+
+    [[nodiscard]] CRC8_t compute_crc(span<uint8_t const> value) const {
+        return crc8(value, crc8(size, crc8(key, 0xFF)));
+    }
+};
+
+static_assert(
+        sizeof(SectorHeader) + ENTRIES_MAX * (sizeof(RecordHeader) + VALUE_SIZE_MAX) <= FLASH_SECTOR_SIZE,
+        "every live value has to fit in a single sector for compaction");
+
+struct Entry {
+    Key key;
+    uint8_t size;
+    array<uint8_t, VALUE_SIZE_MAX> value;
+
+    [[nodiscard]] span<uint8_t const> data() const {
+        return span{value}.first(size);
+    }
+};
+
+// guarded by `g_lock`
+SemaphoreHandle_t g_lock = nullptr;
+array<Entry, ENTRIES_MAX> g_entries{};
+size_t g_entries_size = 0;
+optional<uint32_t> g_active;  // sector being appended to, none if nothing has been written yet
+uint32_t g_active_seq = 0;
+uint32_t g_write_pos = 0;  // offset within active sector
+
+struct Lock {
+    Lock() {
+        xSemaphoreTake(g_lock, portMAX_DELAY);
+    }
+    ~Lock() {
+        xSemaphoreGive(g_lock);
+    }
+};
+
+uint32_t sector_offset(uint32_t sector) {
+    return REGION_OFFSET + sector * FLASH_SECTOR_SIZE;
+}
+
+uint8_t const* flash_ptr(uint32_t offset) {
+    return reinterpret_cast<uint8_t const*>(XIP_BASE + offset);  // NOLINT(performance-no-int-to-ptr)
+}
+
+template <typename A>
+A flash_read(uint32_t offset) {
+    A x;
+    memcpy(&x, flash_ptr(offset), sizeof(A));
+    return x;
+}
+
+bool flash_erase_sector(uint32_t sector) {
+    auto offset = sector_offset(sector);
+    return flash_safe([](void* offset_) { flash_range_erase(uintptr_t(offset_), FLASH_SECTOR_SIZE); },
+            reinterpret_cast<void*>(uintptr_t(offset)));  // NOLINT(performance-no-int-to-ptr)
+}
+
+// Flash is programmed a page at a time. Programming only ever clears bits, so padding the rest of the
+// page w/ 0xFF leaves whatever is already there intact.
+bool flash_program(uint32_t offset, span<uint8_t const> data) {
+    struct Page {
+        uint32_t offset;
+        array<uint8_t, FLASH_PAGE_SIZE> data;
+    };
+
+    while (!data.empty()) {
+        Page page{.offset = offset - offset % FLASH_PAGE_SIZE};
+        page.data.fill(0xFF);
+        auto const begin = offset - page.offset;
+        auto const n = min<size_t>(data.size(), FLASH_PAGE_SIZE - begin);
+        copy_n(data.begin(), n, page.data.begin() + begin);
+
+        auto ok = flash_safe(
+                [](void* page_) {
+                    auto& page = *static_cast<Page*>(page_);
+                    flash_range_program(page.offset, page.data.data(), page.data.size());
+                },
+                &page);
+        if (!ok) return false;
+
+        offset += n;
+        data = data.subspan(n);
+    }
+
+    return true;
+}
+
+Entry* entry(Key key) {
+    auto* const end = g_entries.begin() + g_entries_size;
+    auto* it = find_if(g_entries.begin(), end, [&](auto& x) { return x.key == key; });
+    return it == end ? nullptr : it;
+}
+
+bool cache(Key key, span<uint8_t const> value) {
+    auto* x = entry(key);
+    if (!x) {
+        if (g_entries_size == g_entries.size()) {
+            printf("ERR - settings - too many keys, bump `ENTRIES_MAX`\n");
+            return false;
+        }
+
+        x = &g_entries.at(g_entries_size++);
+        x->key = key;
+    }
+
+    x->size = uint8_t(value.size());
+    copy(value.begin(), value.end(), x->value.begin());
+    return true;
+}
+
+bool append(uint32_t sector, uint32_t& pos, Entry const& entry) {
+    RecordHeader header{.key = uint16_t(entry.key), .size = entry.size, .crc = 0};
+    header.crc = header.compute_crc(entry.data());
+
+    array<uint8_t, sizeof(RecordHeader) + VALUE_SIZE_MAX> record{};
+    memcpy(record.data(), &header, sizeof(header));
+    copy(entry.data().begin(), entry.data().end(), record.begin() + sizeof(header));
+    auto const size = sizeof(header) + entry.size;
+    assert(pos + size <= FLASH_SECTOR_SIZE);
+
+    if (!flash_program(sector_offset(sector) + pos, span{record}.first(size))) return false;
+    pos += size;
+    return true;
+}
+
+// Move to the next sector and copy all live values into it.
+bool rollover() {
+    auto const sector = g_active ? (*g_active + 1) % SECTORS : 0;
+    auto const seq = g_active_seq + 1;
+    if (!flash_erase_sector(sector)) return false;
+
+    SectorHeader const header{.magic = SECTOR_MAGIC, .seq = seq};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (!flash_program(sector_offset(sector), {reinterpret_cast<uint8_t const*>(&header), sizeof(header)}))
+        return false;
+
+    g_active = sector;
+    g_active_seq = seq;
+    g_write_pos = sizeof(SectorHeader);
+    for (size_t i = 0; i < g_entries_size; ++i)
+        if (!append(sector, g_write_pos, g_entries.at(i))) return false;
+
+    return true;
+}
+
+// Returns offset of the first unused byte, or `FLASH_SECTOR_SIZE` if the sector has junk in it.
+uint32_t replay(uint32_t sector) {
+    auto const base = sector_offset(sector);
+    uint32_t pos = sizeof(SectorHeader);
+    for (;;) {
+        if (FLASH_SECTOR_SIZE < pos + sizeof(RecordHeader)) return pos;  // full
+
+        auto const header = flash_read<RecordHeader>(base + pos);
+        if (header.key == KEY_ERASED) return pos;  // end of log
+
+        auto const size = sizeof(header) + header.size;
+        if (VALUE_SIZE_MAX < header.size || FLASH_SECTOR_SIZE < pos + size) break;
+
+        span const value{flash_ptr(base + pos + sizeof(header)), header.size};
+        if (header.crc != header.compute_crc(value)) break;  // torn write
+
+        cache(Key(header.key), value);
+        pos += size;
+    }
+
+    printf("WARN - settings - sector %u has a corrupt record @ 0x%04x\n", unsigned(sector), unsigned(pos));
+    return FLASH_SECTOR_SIZE;  // don't append after junk, roll over on the next write instead
+}
+
+}  // namespace
+
+bool init() {
+    assert(!g_lock && "already initialised");
+    auto const binary_end = uint32_t(uintptr_t(&__flash_binary_end) - XIP_BASE);
+    if (REGION_OFFSET < binary_end) {
+        printf("ERR - settings - firmware overlaps the settings region\n");
+        return false;
+    }
+
+    g_lock = xSemaphoreCreateMutex();  // we panic on alloc failures, no need to handle null
+
+    // Replay oldest to newest. Normally only the newest matters, but if a rollover was interrupted then
+    // older sectors still have the values that didn't make it across.
+    array<pair<uint32_t, uint32_t>, SECTORS> valid{};  // (seq, sector)
+    size_t valid_size = 0;
+    for (uint32_t i = 0; i < SECTORS; ++i) {
+        auto const header = flash_read<SectorHeader>(sector_offset(i));
+        if (header.magic == SECTOR_MAGIC) valid.at(valid_size++) = {header.seq, i};
+    }
+
+    sort(valid.begin(), valid.begin() + valid_size);
+    for (size_t i = 0; i < valid_size; ++i) {
+        auto [seq, sector] = valid.at(i);
+        g_active = sector;
+        g_active_seq = seq;
+        g_write_pos = replay(sector);
+    }
+
+    printf("settings - loaded %u value(s)\n", unsigned(g_entries_size));
+    return true;
+}
+
+uint32_t flash_reserved_offset() {
+    return REGION_OFFSET;
+}
+
+optional<size_t> get(Key key, span<uint8_t> dst) {
+    assert(g_lock && "`settings::init` not called");
+    Lock _;
+    auto const* x = entry(key);
+    if (!x) return {};
+
+    copy_n(x->value.begin(), min<size_t>(x->size, dst.size()), dst.begin());
+    return x->size;
+}
+
+bool set(Key key, span<uint8_t const> value) {
+    assert(g_lock && "`settings::init` not called");
+    assert(value.size() <= VALUE_SIZE_MAX);
+    if (VALUE_SIZE_MAX < value.size()) return false;
+
+    Lock _;
+    if (auto const* x = entry(key); x && ranges::equal(x->data(), value)) return true;  // unchanged
+    if (!cache(key, value)) return false;
+
+    auto const& x = *entry(key);
+    if (g_active && g_write_pos + sizeof(RecordHeader) + x.size <= FLASH_SECTOR_SIZE)
+        return append(*g_active, g_write_pos, x);
+
+    return rollover();  // copies `x` along w/ everything else
+}
+
+}  // namespace nevermore::settings
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+namespace nevermore::settings {
+
+// Persisted by number, never renumber or reuse a key.
+enum class Key : uint16_t {
+    ConfigFlags = 1,
+    FanPolicyCooldown = 2,
+    FanPolicyVocPassiveMax = 3,
+    FanPolicyVocImproveMin = 4,
+    WS2812ComponentsTotal = 5,
+    FanRpmTarget = 6,
+    FanRpmGains = 7,
+    FanPolicyCurve = 8,
+    FanPolicyVocTrend = 9,
+    WS2812Effect = 10,
+    SensorFilter = 11,
+    WS2812Correction = 12,
+    FanPolicyPrint = 13,
+    FilterLife = 14,
+    FanFaultPower = 15,
+    RelayPeers = 16,
+    FanRamp = 17,
+    FanPwmHz = 18,
+};
+
+constexpr size_t VALUE_SIZE_MAX = 24;
+
+// Loads the store from flash. Must be called before any `get`/`set`.
+bool init();
+
+// Settings (& BTstack's TLV bank after them) own flash from this offset to the end of flash.
+uint32_t flash_reserved_offset();
+
+// Returns the stored value's size (copying at most `dst.size()` bytes), or `nullopt` if none is stored.
+std::optional<size_t> get(Key key, std::span<uint8_t> dst);
+// Returns false if the value couldn't be persisted. Writing an unchanged value is a no-op (no flash wear).
+bool set(Key key, std::span<uint8_t const> value);
+
+template <typename A>
+    requires(std::is_trivially_copyable_v<A> && sizeof(A) <= VALUE_SIZE_MAX)
+std::optional<A> get(Key key) {
+    A value;
+    auto n = get(key, {reinterpret_cast<uint8_t*>(&value), sizeof(A)});
+    if (n != sizeof(A)) return {};  // missing, or stored by a firmware w/ a different layout
+
+    return value;
+}
+
+template <typename A>
+    requires(std::is_trivially_copyable_v<A> && sizeof(A) <= VALUE_SIZE_MAX)
+bool set(Key key, A const& value) {
+    return set(key, {reinterpret_cast<uint8_t const*>(&value), sizeof(A)});
+}
+
+}  // namespace nevermore::settings
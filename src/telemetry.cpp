@@ -0,0 +1,119 @@
+#include "telemetry.hpp"
+
+#if CMAKE_TELEMETRY
+
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "pico/stdio_usb.h"
+#include "pico/time.h"
+#include "queue.h"
+#include "task.h"  // IWYU pragma: keep
+#include "utility/cobs.hpp"
+#include "utility/crc.hpp"
+#include "utility/task.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+
+using namespace std;
+
+namespace nevermore::telemetry {
+
+namespace {
+
+constexpr uint32_t TELEMETRY_STACK_DEPTH = configMINIMAL_STACK_SIZE;
+// A burst of ~1s of sensor reads & fan ticks, USB CDC drains far faster than we produce.
+constexpr UBaseType_t TELEMETRY_QUEUE_LENGTH = 32;
+constexpr CRC8_t TELEMETRY_CRC_INIT = 0xFF;
+
+struct [[gnu::packed]] Header {
+    Kind kind;
+    uint32_t timestamp_us;
+};
+
+constexpr size_t RECORD_MAX = sizeof(Header) + max({sizeof(Sample), sizeof(Fan), sizeof(SensorRead)});
+
+struct Record {
+    uint8_t size;
+    array<uint8_t, RECORD_MAX> data;
+};
+
+QueueHandle_t g_queue = nullptr;
+TaskStorage<TELEMETRY_STACK_DEPTH> g_task;
+uint32_t g_dropped = 0;  // guarded by the kernel critical section
+
+template <typename A>
+void push(Kind kind, A const& body) {
+    static_assert(sizeof(Header) + sizeof(A) <= RECORD_MAX);
+    if (!g_queue) return;
+
+    Record x{.size = uint8_t(sizeof(Header) + sizeof(A)), .data = {}};
+    Header const header{.kind = kind, .timestamp_us = time_us_32()};
+    memcpy(x.data.data(), &header, sizeof(Header));
+    memcpy(x.data.data() + sizeof(Header), &body, sizeof(A));
+
+    if (xQueueSend(g_queue, &x, 0)) return;
+
+    taskENTER_CRITICAL();
+    g_dropped += 1;
+    taskEXIT_CRITICAL();
+}
+
+// 0x00 first so any stdio text before it ends up in its own (invalid) frame instead of corrupting this one
+void send(span<uint8_t const> record) {
+    array<uint8_t, RECORD_MAX + 1> payload{};
+    copy(record.begin(), record.end(), payload.begin());
+    payload.at(record.size()) = crc8(record, TELEMETRY_CRC_INIT);
+
+    array<uint8_t, cobs_encoded_size_max(payload.size()) + 2> frame{};
+    auto const n = cobs_encode({payload.data(), record.size() + 1}, span{frame}.subspan(1));
+    frame.at(n + 1) = 0;
+    stdio_usb.out_chars(reinterpret_cast<char const*>(frame.data()), int(n + 2));
+}
+
+[[noreturn]] void drain(void*) {
+    for (;;) {
+        Record x{};
+        if (!xQueueReceive(g_queue, &x, portMAX_DELAY)) continue;
+
+        send({x.data.data(), x.size});
+
+        taskENTER_CRITICAL();
+        auto const dropped = g_dropped;
+        g_dropped = 0;
+        taskEXIT_CRITICAL();
+        if (dropped) push(Kind::Dropped, Dropped{.count = dropped});
+    }
+}
+
+}  // namespace
+
+bool init() {
+    g_queue = xQueueCreate(TELEMETRY_QUEUE_LENGTH, sizeof(Record));
+    if (!g_queue) {
+        printf("ERR - telemetry - failed to create queue\n");
+        return false;
+    }
+
+    Task(drain, "telemetry", g_task, nullptr, Priority::Low).release();
+    return true;
+}
+
+void record(Sample const& x) {
+    push(Kind::Sample, x);
+}
+
+void record(Fan const& x) {
+    push(Kind::Fan, x);
+}
+
+void record(SensorRead const& x) {
+    push(Kind::SensorRead, x);
+}
+
+}  // namespace nevermore::telemetry
+
+#endif
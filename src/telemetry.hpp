@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Opt-in (configure w/ `-DTELEMETRY=ON`) binary stream of raw samples over USB CDC, for characterising
+// filters & tuning policies offline. No formatting on the hot path: records are queued as-is & framed by a
+// low priority task. Shares the port w/ stdio text, the host skips anything that isn't a valid frame.
+//
+// Frame: 0x00, COBS(record, CRC8 of record), 0x00.  CRC8 is the Sensirion one (0x31, init 0xFF).
+// Record: u8 kind, u32 timestamp (us since boot, wraps), then the kind's body. All little endian, packed.
+// Disabled builds compile every `record` down to nothing.
+namespace nevermore::telemetry {
+
+enum class Kind : uint8_t {
+    Sample = 1,
+    Fan = 2,
+    SensorRead = 3,
+    Dropped = 4,
+};
+
+constexpr int32_t NOT_KNOWN = INT32_MIN;
+
+// A sensor read, at each stage between the driver & publication. Raw units of the quantity.
+struct [[gnu::packed]] Sample {
+    uint8_t side;      // 0 -> intake, 1 -> exhaust
+    uint8_t quantity;  // `sensors::fusion::Quantity`
+    uint16_t source;   // distinguishes sensors on a side, stable until reboot
+    int32_t raw;       // as read by the driver
+    int32_t filtered;  // `NOT_KNOWN` -> dropped by the filter as a glitch
+    int32_t fused;     // what was published for the side, `NOT_KNOWN` if dropped
+};
+
+struct [[gnu::packed]] Fan {
+    uint8_t channel;
+    uint16_t duty;  // PWM level [0, 65535]
+    uint16_t rpm;
+    uint16_t rpm_target;  // RPM control's setpoint (target scaled by the policy), 0 -> open loop
+};
+
+// How long a periodic sensor's read took, from starting to the data being in (incl. awaited conversions).
+struct [[gnu::packed]] SensorRead {
+    std::array<char, 8> name;  // truncated, NUL padded (not terminated if it fills it)
+    uint32_t duration_us;
+};
+
+// Records lost b/c the queue was full, since the last `Dropped`.
+struct [[gnu::packed]] Dropped {
+    uint32_t count;
+};
+
+#if CMAKE_TELEMETRY
+
+bool init();
+
+// Safe to call from any task. Never blocks, drops the record if the queue is full.
+void record(Sample const&);
+void record(Fan const&);
+void record(SensorRead const&);
+
+#else
+
+inline bool init() {
+    return true;
+}
+
+inline void record(Sample const&) {}
+inline void record(Fan const&) {}
+inline void record(SensorRead const&) {}
+
+#endif
+
+// Short, stable id for a sensor instance. Its address is unique, only the low bits are needed to tell the
+// handful of sensors on a controller apart.
+inline uint16_t source_id(void const* x) {
+    return uint16_t(reinterpret_cast<uintptr_t>(x) >> 2);
+}
+
+}  // namespace nevermore::telemetry
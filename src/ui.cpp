@@ -1,18 +1,30 @@
 #include "ui.hpp"
 #include "FreeRTOS.h"
 #include "display.hpp"
+#include "display/chart_history.hpp"
+#include "display/screens.hpp"
+#include "display/stats.hpp"
 #include "gatt/fan.hpp"
+#include "hardware/timer.h"
 #include "lvgl.h"
 #include "sdk/ble_data_types.hpp"
-#include "semphr.h"
+#include "sdk/task.hpp"
 #include "sensors.hpp"
 #include "ui/ui.h"
+#include "utility/format.hpp"
+#include "utility/health.hpp"
+#include "utility/mailbox.hpp"
 #include "utility/task.hpp"
 #include <algorithm>
+#include <array>
+#include <cassert>
 #include <chrono>
-#include <cstdio>
+#include <cmath>
+#include <cstring>
 #include <initializer_list>
-#include <string>
+#include <optional>
+#include <span>
+#include <string_view>
 #include <tuple>
 
 using namespace std;
@@ -22,12 +34,27 @@ namespace nevermore::ui {
 
 namespace {
 
-constexpr auto CHART_X_AXIS_LENGTH = 1.h;
 constexpr uint8_t CHART_SERIES_ENTIRES_MAX = display::RESOLUTION.width / 3;
+// Zoom levels, finest first. Swipe the chart left/right to zoom out/in.
+constexpr array CHART_X_AXIS_LENGTHS{1h, 6h, 24h};
 
-constexpr auto DISPLAY_TIMER_PLOT_INTERVAL = CHART_X_AXIS_LENGTH / CHART_SERIES_ENTIRES_MAX;
+constexpr auto DISPLAY_TIMER_PLOT_INTERVAL =
+        chrono::seconds(CHART_X_AXIS_LENGTHS[0]) / CHART_SERIES_ENTIRES_MAX;  // 45s
 constexpr auto DISPLAY_TIMER_LABELS_INTERVAL = 1s;
 constexpr auto DISPLAY_REFRESH_INTERVAL = 5ms;
+constexpr uint32_t DISPLAY_STACK_DEPTH = 1024;
+// `post`s waiting on the display task. They're rare (input device (un)registration, the benchmark).
+constexpr size_t DISPLAY_MESSAGES_PENDING_MAX = 8;
+
+// Activity governor, by time since the last touch (or VOC alert).
+constexpr auto DISPLAY_REFRESH_INTERVAL_IDLE = 50ms;  // still polls touch, LVGL only reads it every 30ms
+constexpr auto DISPLAY_IDLE_AFTER = 30s;              // -> `DISPLAY_REFRESH_INTERVAL_IDLE`
+constexpr auto DISPLAY_DIM_AFTER = 5min;              // -> `display::Power::Dim`
+constexpr auto DISPLAY_SLEEP_AFTER = 15min;           // -> `display::Power::Sleep`
+// Either side's VOC index crossing this (the top of the chart's red zone) wakes the display.
+constexpr int64_t DISPLAY_WAKE_VOC = 200;
+// Filter life below this is shown in red, time to order carbon.
+constexpr float FILTER_LIFE_WARN = 0.1f;
 
 struct ChartDivY {
     uint8_t min;
@@ -38,17 +65,46 @@ constexpr ChartDivY CHART_DIV_VOC{.min = 4, .value_per = 25};
 constexpr ChartDivY CHART_DIV_TEMP{.min = 6, .value_per = 10};
 constexpr lv_opa_t CHART_RED_ZONE_HI = LV_OPA_30;
 
-bool chart_point_less_than(lv_coord_t x, lv_coord_t y) {
-    if (y == LV_CHART_POINT_NONE) return false;
-    if (x == LV_CHART_POINT_NONE) return true;
-    return x < y;
-}
+enum class SeriesId : uint8_t { VocIntake, VocExhaust, TempIntake, TempExhaust };
+constexpr size_t SERIES = 4;
+
+constexpr auto CHART_HISTORY_SPANS = [] {
+    array<uint16_t, CHART_X_AXIS_LENGTHS.size()> spans{};
+    for (size_t i = 0; i < spans.size(); ++i)
+        spans.at(i) = uint16_t(CHART_X_AXIS_LENGTHS.at(i) / CHART_X_AXIS_LENGTHS[0]);
+    return spans;
+}();
+static_assert(
+        [] {
+            for (auto&& x : CHART_X_AXIS_LENGTHS)
+                if (x % CHART_X_AXIS_LENGTHS[0] != 0h) return false;
+            return true;
+        }(),
+        "every zoom level must be a multiple of the finest");
+
+// ~1.9 KiB for all the zoom levels, less than the `lv_coord_t` sliding windows it replaced.
+display::ChartHistory<SERIES, CHART_SERIES_ENTIRES_MAX, CHART_X_AXIS_LENGTHS.size()> g_chart_history{
+        CHART_HISTORY_SPANS};
+uint8_t g_chart_zoom = 0;  // index into `CHART_X_AXIS_LENGTHS`
+
+// What the chart's axes were last set to, see `display_populate_plot`.
+struct ChartScale {
+    lv_coord_t range_voc = 0;
+    lv_coord_t range_temp = 0;
+    uint lines_voc = 0;
+};
+ChartScale g_chart_scale;
 
 struct Series {
+    SeriesId id;
+    // In 0.01 units: VOC index [0, 500] -> steps of 2, temperature [0, 127] C -> steps of 0.5 C
+    display::Quantiser quantiser;
     lv_chart_series_t* ui = {};
+    // LVGL's view of the current zoom level, repopulated from `g_chart_history`.
     array<lv_coord_t, CHART_SERIES_ENTIRES_MAX> values{};
+    lv_coord_t max = 0;  // of the current zoom level's window
 
-    Series() {
+    Series(SeriesId id, int32_t step) : id(id), quantiser{step} {
         values.fill(LV_CHART_POINT_NONE);
     }
 
@@ -57,155 +113,326 @@ struct Series {
         ui = lv_chart_add_series(chart, lv_color_hex(clr), axis);
         lv_chart_set_ext_y_array(chart, ui, values.data());
     }
-};
 
-Series ui_chart_voc_intake;
-Series ui_chart_voc_exhaust;
-Series ui_chart_temp_intake;
-Series ui_chart_temp_exhaust;
-
-lv_point_t top_left(lv_area_t const& coord) {
-    return {.x = coord.x1, .y = coord.y1};
-}
+    // Points are the max of their bucket, so peaks survive being zoomed out.
+    void populate(size_t level) {
+        auto const n = g_chart_history.size(level);
+        max = 0;
+        for (size_t i = 0; i < values.size(); ++i) {
+            auto const bucket = i < n ? g_chart_history.get(level, size_t(id), i) : display::Bucket{};
+            auto const value = quantiser.decode(bucket.max);
+            values.at(i) = value ? lv_coord_t((*value + 50) / 100) : lv_coord_t(LV_CHART_POINT_NONE);
+            if (value) max = std::max(max, values.at(i));
+        }
+    }
+};
 
-[[maybe_unused]] lv_point_t operator+(lv_point_t const& l, lv_point_t const& r) {
-    return {.x = lv_coord_t(l.x + r.x), .y = lv_coord_t(l.y + r.y)};
-}
+Series ui_chart_voc_intake{SeriesId::VocIntake, 2'00};
+Series ui_chart_voc_exhaust{SeriesId::VocExhaust, 2'00};
+Series ui_chart_temp_intake{SeriesId::TempIntake, 50};
+Series ui_chart_temp_exhaust{SeriesId::TempExhaust, 50};
 
-template <typename A, typename Ratio>
-auto pretty_print_time(std::chrono::duration<A, Ratio> const& dur, char const* spec = "%.f") {
-    auto format = [&](char const* unit, double value) -> std::string {
-        char buffer[256];  // b/c we apparently don't have `<format>` yet in GCC 12.2.1
-        auto n = sprintf(buffer, spec, double(value));
-        assert(0 <= n);
-        strcpy(buffer + n, unit);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+// e.g. "45s", "6h", rounded to the largest unit that fits.
+array<char, 16> pretty_print_time(chrono::microseconds dur) {
+    array<char, 16> buffer{};
+    auto format = [&](string_view unit, auto value) {
+        format_fixed(buffer, int32_t(value.count()), 0, 0, unit);
         return buffer;
     };
 
-    if (dur < 1ms) return format("us", dur / 1.us);
-    if (dur < 1s) return format("ms", dur / 1.ms);
-    if (dur < 1min) return format("s", dur / 1.s);
-    if (dur < 1h) return format("min", dur / 1.min);
-    return format("h", dur / 1.h);
+    if (dur < 1ms) return format("us", dur);
+    if (dur < 1s) return format("ms", chrono::round<chrono::milliseconds>(dur));
+    if (dur < 1min) return format("s", chrono::round<chrono::seconds>(dur));
+    if (dur < 1h) return format("min", chrono::round<chrono::minutes>(dur));
+    return format("h", chrono::round<chrono::hours>(dur));
 }
 
+// A label whose text we own. `lv_label_set_text` reallocates LVGL's copy of the text on every change, for
+// labels updated every second that fragments LVGL's heap over days of uptime. `lv_label_set_text_static`
+// only keeps a pointer, so these are never reallocated.
+struct Label {
+    lv_obj_t* const& obj;  // created when its screen is built, null while it's hidden
+    array<char, 24> text{};
+
+    // `lv_label_set_text*` always invalidates (-> re-render & SPI flush), even if the text is the same.
+    // Use this instead, `text` doubles as the cache. Truncates to fit.
+    void set(char const* x) {
+        auto const n = min(strlen(x), text.size() - 1);
+        if (lv_label_get_text(obj) == text.data() && memcmp(text.data(), x, n) == 0 && text.at(n) == '\0')
+            return;
+
+        memcpy(text.data(), x, n);
+        text.at(n) = '\0';
+        lv_label_set_text_static(obj, text.data());
+    }
+};
+
+Label g_label_pressure_in{ui_PressureIn};
+Label g_label_pressure_out{ui_PressureOut};
+Label g_label_humidity_in{ui_HumidityIn};
+Label g_label_humidity_out{ui_HumidityOut};
+Label g_label_voc_in{ui_VocIn};
+Label g_label_voc_out{ui_VocOut};
+Label g_label_temp_in{ui_TempIn};
+Label g_label_temp_out{ui_TempOut};
+Label g_label_fan_power{ui_FanPower};
+Label g_label_filter_life{ui_FilterLife};
+Label g_label_x_axis_scale{ui_XAxisScale};
+Label g_label_chart_max{ui_ChartMax};
+
+// Last snapshot the main screen's sensor labels were formatted from.
+optional<uint32_t> g_sensor_labels_version;
+
+// Diagnostics screen, 1 label per row.
+struct DiagnosticsRows {
+    lv_obj_t* uptime = nullptr;
+    lv_obj_t* render = nullptr;
+    lv_obj_t* flush = nullptr;
+    lv_obj_t* heap_free = nullptr;
+    lv_obj_t* heap_fragmentation = nullptr;
+    lv_obj_t* temperature_mcu = nullptr;
+};
+DiagnosticsRows g_diagnostics;
+
+Label g_label_uptime{g_diagnostics.uptime};
+Label g_label_render{g_diagnostics.render};
+Label g_label_flush{g_diagnostics.flush};
+Label g_label_heap_free{g_diagnostics.heap_free};
+Label g_label_heap_fragmentation{g_diagnostics.heap_fragmentation};
+Label g_label_temperature_mcu{g_diagnostics.temperature_mcu};
+
+// `value` in units of `10^unit_exp10`, w/ `decimals` digits after the point.
 template <typename A>
-auto label_set(lv_obj_t* obj, char const* unk, char const* fmt, A&& value, double scale = 1) {
+void label_set(Label& label, char const* unk, A const& value, uint8_t decimals, string_view suffix,
+        int unit_exp10 = 0) {
     if (value == BLE::NOT_KNOWN) {
-        lv_label_set_text(obj, unk);
+        label.set(unk);
         return;
     }
 
-    char buffer[256];  // b/c we apparently don't have `<format>` yet in GCC 12.2.1
-    sprintf(buffer, fmt, double(value) / scale);
-    lv_label_set_text(obj, buffer);
-};
+    array<char, 16> buffer{};
+    format_scalar(buffer, value, decimals, suffix, unit_exp10);
+    label.set(buffer.data());
+}
 
-double lv_arc_get_percent(lv_obj_t const* obj) {
+// `prefix`, then whatever `format` writes after it.
+template <typename F>
+void label_set_prefixed(Label& label, string_view prefix, F&& format) {
+    array<char, 24> buffer{};
+    auto const n = min(prefix.size(), buffer.size() - 1);
+    copy_n(prefix.begin(), n, buffer.begin());
+    format(span{buffer}.subspan(n));
+    label.set(buffer.data());
+}
+
+BLE::Percentage8 lv_arc_get_percent(lv_obj_t const* obj) {
     auto range = lv_arc_get_max_value(obj) - lv_arc_get_min_value(obj);
     if (range == 0) return 0;
 
-    return lv_arc_get_value(obj) / double(range);
+    auto const value = lv_arc_get_value(obj) - lv_arc_get_min_value(obj);
+    return BLE::Percentage8::from_fixed<-1>(value * 1000 / range);
 }
 
-void lv_arc_set_percent(lv_obj_t* obj, double perc) {
+void lv_arc_set_percent(lv_obj_t* obj, BLE::Percentage8 perc) {
     auto range = lv_arc_get_max_value(obj) - lv_arc_get_min_value(obj);
-    lv_arc_set_value(obj, int16_t(lv_arc_get_min_value(obj) + perc * range));
-}
-
-// returns point relative to `obj`
-auto chart_pos_for_value(
-        lv_obj_t const* obj, lv_chart_series_t const* series, lv_coord_t value, bool last = false) {
-    // HACK: there is no API to do this, so we have to mug an existing value (temporarily)
-    auto id = last ? lv_chart_get_point_count(obj) - 1 : 0;
-    auto id_start = lv_chart_get_x_start_point(  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
-            obj, const_cast<lv_chart_series_t*>(series));
-    auto id_storage = ((int32_t)id_start + id) % lv_chart_get_point_count(obj);
-
-    auto* y_value = series->y_points + id_storage;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
-    auto old = *y_value;
-    *y_value = value;
-    lv_point_t pos;
-    lv_chart_get_point_pos_by_id(  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
-            const_cast<lv_obj_t*>(obj), const_cast<lv_chart_series_t*>(series), id, &pos);
-    *y_value = old;
-    return pos;
-};
+    auto value = int16_t(lv_arc_get_min_value(obj) + perc.fixed_or<-1>(0) * range / 1000);
+    if (lv_arc_get_value(obj) == value) return;  // don't invalidate for nothing
+
+    lv_arc_set_value(obj, value);
+}
 
 void fan_power_arc_colour_update() {
-    lv_obj_set_style_arc_color(ui_FanPowerArc,
-            lv_color_hex(gatt::fan::fan_power_override() == BLE::NOT_KNOWN ? 0x00FFFF : 0xFFFF00),
-            LV_PART_INDICATOR | int(LV_STATE_DEFAULT));
+    auto colour = lv_color_hex(gatt::fan::fan_power_override() == BLE::NOT_KNOWN ? 0x00FFFF : 0xFFFF00);
+    // setting a local style prop always refreshes the style & invalidates, even if it's the same value
+    if (lv_obj_get_style_arc_color(ui_FanPowerArc, LV_PART_INDICATOR).full == colour.full) return;
+
+    lv_obj_set_style_arc_color(ui_FanPowerArc, colour, LV_PART_INDICATOR | int(LV_STATE_DEFAULT));
 }
 
-void display_update_labels() {
-    auto const& state = nevermore::sensors::g_sensors.with_fallbacks();
+// Carbon left, flagged once it's nearly spent.
+void filter_life_update() {
+    auto const remaining = gatt::fan::filter_life_remaining();
+    array<char, 8> text{'C', ' '};
+    format_fixed(span(text).subspan(2), int32_t(lroundf(remaining * 100)), 0, 0, "%");
+    g_label_filter_life.set(text.data());
+
+    auto colour = lv_color_hex(remaining < FILTER_LIFE_WARN ? 0xFF0000 : 0xFFFFFF);
+    if (lv_obj_get_style_text_color(ui_FilterLife, LV_PART_MAIN).full == colour.full) return;
 
-    label_set(ui_PressureIn, "??? kPa", "%.1f kPa", state.pressure_intake, 1e3);
-    label_set(ui_PressureOut, "??? kPa", "%.1f kPa", state.pressure_exhaust, 1e3);
-    label_set(ui_HumidityIn, "??%", "%2.1f%%", state.humidity_intake);
-    label_set(ui_HumidityOut, "??%", "%2.1f%%", state.humidity_exhaust);
+    lv_obj_set_style_text_color(ui_FilterLife, colour, LV_PART_MAIN | int(LV_STATE_DEFAULT));
+}
 
-    label_set(ui_VocIn, "??? VOC", "%.0f VOC", state.voc_index_intake);
-    label_set(ui_VocOut, "??? VOC", "%.0f VOC", state.voc_index_exhaust);
-    label_set(ui_TempIn, "?.?c", "%.1fc", state.temperature_intake);
-    label_set(ui_TempOut, "?.?c", "%.1fc", state.temperature_exhaust);
+void display_render() {
+    auto const bgn = time_us_32();
+    lv_timer_handler();
+    display::stats::render(time_us_32() - bgn);
+}
 
-    label_set(ui_FanPower, "", "%.0f%%", BLE::Percentage8(ceil(gatt::fan::fan_power())));
+// Picks the display's power state & the refresh interval by how long it's been since the last activity.
+// LVGL tracks that for us: any input device activity, or `lv_disp_trig_activity`.
+chrono::milliseconds display_govern() {
+    auto const inactive = chrono::milliseconds(lv_disp_get_inactive_time(nullptr));
+    auto const power = inactive < DISPLAY_DIM_AFTER     ? display::Power::Active
+                       : inactive < DISPLAY_SLEEP_AFTER ? display::Power::Dim
+                                                        : display::Power::Sleep;
+    // the touch that wakes us is swallowed by the touch driver, see `cst816s.cpp`
+    display::power(power);
+    // nobody is looking, don't keep a page other than the main one resident
+    if (power == display::Power::Sleep && display::screens::shown() != 0) display::screens::show(0);
+
+    return inactive < DISPLAY_IDLE_AFTER ? DISPLAY_REFRESH_INTERVAL : DISPLAY_REFRESH_INTERVAL_IDLE;
+}
 
-    lv_arc_set_percent(ui_FanPowerArc, gatt::fan::fan_power() / 100);
-    fan_power_arc_colour_update();
+// Whichever screen is shown, only on crossing, it can stay high for hours during a print.
+void display_wake_on_voc() {
+    auto const& state = nevermore::sensors::snapshot_resolved();
+    static bool g_voc_alert = false;
+    auto const voc_alert = DISPLAY_WAKE_VOC <=
+                           max(state.voc_index_intake.fixed_or<0>(0), state.voc_index_exhaust.fixed_or<0>(0));
+    if (voc_alert && !g_voc_alert) lv_disp_trig_activity(nullptr);
+    g_voc_alert = voc_alert;
 }
 
-void display_update_plot() {
-    auto const& state = nevermore::sensors::g_sensors.with_fallbacks();
+void display_update_sensor_labels() {
+    // formatting 8 floats isn't free, skip it if nothing was published since last time
+    auto const version = nevermore::sensors::snapshot_version();  // read before the snapshot
+    if (g_sensor_labels_version == version) return;
+    g_sensor_labels_version = version;
 
-    if (lv_chart_get_point_count(ui_Chart) < CHART_SERIES_ENTIRES_MAX) {
-        // extend # of points until maximum
-        auto n = lv_chart_get_point_count(ui_Chart) + 1;
-        // HACK:  Directly set the point count w/o using `lv_chart_set_point_count`
-        //        because that function resets the next-point for each series to 0.
-        //        (Sane if the # of points goes down, but not so much for our case.)
-        reinterpret_cast<lv_chart_t*>(ui_Chart)->point_cnt = n;
+    auto const& state = nevermore::sensors::snapshot_resolved();
 
-        lv_label_set_text(ui_XAxisScale, pretty_print_time(n * DISPLAY_TIMER_PLOT_INTERVAL).c_str());
-    }
+    label_set(g_label_pressure_in, "??? kPa", state.pressure_intake, 1, " kPa", 3);
+    label_set(g_label_pressure_out, "??? kPa", state.pressure_exhaust, 1, " kPa", 3);
+    label_set(g_label_humidity_in, "??%", state.humidity_intake, 1, "%");
+    label_set(g_label_humidity_out, "??%", state.humidity_exhaust, 1, "%");
+
+    label_set(g_label_voc_in, "??? VOC", state.voc_index_intake, 0, " VOC");
+    label_set(g_label_voc_out, "??? VOC", state.voc_index_exhaust, 0, " VOC");
+    label_set(g_label_temp_in, "?.?c", state.temperature_intake, 1, "c");
+    label_set(g_label_temp_out, "?.?c", state.temperature_exhaust, 1, "c");
+}
 
-    auto set_next_value = [&](auto* series, auto&& value) {
-        lv_chart_set_next_value(ui_Chart, series, value.value_or(LV_CHART_POINT_NONE));
+void display_update_labels() {
+    display_update_sensor_labels();
+
+    array<char, 8> fan_power{};
+    auto const power = gatt::fan::fan_power();
+    format_fixed(fan_power, int32_t(power.fixed<0>()), 0, 0, "%");  // 0.5 % steps, rounds the .5 up
+    g_label_fan_power.set(fan_power.data());
+
+    lv_arc_set_percent(ui_FanPowerArc, power);
+    fan_power_arc_colour_update();
+
+    filter_life_update();
+}
+
+void display_update_diagnostics() {
+    label_set_prefixed(g_label_uptime, "up ", [](span<char> out) {
+        auto const uptime = pretty_print_time(chrono::microseconds(time_us_64()));
+        copy_n(uptime.begin(), min(strlen(uptime.data()), out.size() - 1), out.begin());
+    });
+
+    auto const stats = display::stats::snapshot();
+    auto const mean_us = [](display::stats::Histogram const& x) {
+        return int32_t(x.samples ? x.total_us / x.samples : 0);
     };
+    label_set_prefixed(g_label_render, "render ",
+            [&](span<char> out) { format_fixed(out, mean_us(stats.render), -3, 1, " ms"); });
+    label_set_prefixed(g_label_flush, "flush ",
+            [&](span<char> out) { format_fixed(out, mean_us(stats.flush), -3, 1, " ms"); });
+    label_set_prefixed(g_label_heap_free, "heap ", [&](span<char> out) {
+        format_fixed(out, int32_t(stats.memory.free * 10 / 1024), -1, 1, " KiB free");
+    });
+    label_set_prefixed(g_label_heap_fragmentation, "heap frag ",
+            [&](span<char> out) { format_fixed(out, int32_t(stats.memory.fragmentation_pct), 0, 0, "%"); });
+
+    auto const& state = nevermore::sensors::snapshot_resolved();
+    label_set(g_label_temperature_mcu, "MCU ?.?c", state.temperature_mcu, 1, "c");
+}
+
+// Every `DISPLAY_TIMER_LABELS_INTERVAL`, whichever screen is shown.
+void display_update() {
+    display_wake_on_voc();
+    display::stats::memory_sample();
+    display::screens::update();
+}
+
+// Rewrites the series in place from the current zoom level, the LVGL series & their arrays are reused.
+void display_populate_plot() {
+    auto const n = g_chart_history.size(g_chart_zoom);
+    // HACK: Need at least 2 points to draw the 100-VOC line.
+    //       Only resets the series' start points, which `populate` always writes from 0 anyways.
+    lv_chart_set_point_count(ui_Chart, max<uint16_t>(2, n));
+
+    for (auto* series : {&ui_chart_voc_intake, &ui_chart_voc_exhaust, &ui_chart_temp_intake,
+                 &ui_chart_temp_exhaust})
+        series->populate(g_chart_zoom);
+    lv_chart_refresh(ui_Chart);
 
-    set_next_value(ui_chart_voc_intake.ui, state.voc_index_intake);
-    set_next_value(ui_chart_voc_exhaust.ui, state.voc_index_exhaust);
-    set_next_value(ui_chart_temp_intake.ui, state.temperature_intake);
-    set_next_value(ui_chart_temp_exhaust.ui, state.temperature_exhaust);
+    auto const interval = DISPLAY_TIMER_PLOT_INTERVAL * g_chart_history.span(g_chart_zoom);
+    g_label_x_axis_scale.set(pretty_print_time(n * interval).data());
 
-    auto scale_axis = [](lv_chart_axis_t axis, ChartDivY const& div, initializer_list<Series> const& xs) {
+    // Changing the range or div lines repaints the entire chart, only do it if the scale actually changes.
+    auto scale_axis = [](lv_chart_axis_t axis, ChartDivY const& div, lv_coord_t& current,
+                              initializer_list<Series const*> xs) {
         // TODO: handle case where plot coords are < 0 (why are you running your printer in a freezer?)
         lv_coord_t top = 0;
-        for (auto&& x : xs) {
-            auto val = *std::max_element(x.values.begin(), x.values.end(), chart_point_less_than);
-            if (val != LV_CHART_POINT_NONE) {
-                top = max(top, val);
-            }
+        for (auto const* x : xs) {
+            top = max(top, x->max);
         }
 
         auto lines = max<uint>(div.min, 1 + (top + div.value_per - 1) / div.value_per);
         auto coord = lv_coord_t(lines * div.value_per);
-        lv_chart_set_range(ui_Chart, axis, 0, coord);
+        if (coord != current) lv_chart_set_range(ui_Chart, axis, 0, coord);
+        current = coord;
         return tuple{lines, coord};
     };
 
-    auto [lines_voc, max_voc] =
-            scale_axis(LV_CHART_AXIS_PRIMARY_Y, CHART_DIV_VOC, {ui_chart_voc_intake, ui_chart_voc_exhaust});
-    auto [_, max_temp] = scale_axis(
-            LV_CHART_AXIS_SECONDARY_Y, CHART_DIV_TEMP, {ui_chart_temp_intake, ui_chart_temp_exhaust});
+    auto [lines_voc, max_voc] = scale_axis(LV_CHART_AXIS_PRIMARY_Y, CHART_DIV_VOC, g_chart_scale.range_voc,
+            {&ui_chart_voc_intake, &ui_chart_voc_exhaust});
+    auto [_, max_temp] = scale_axis(LV_CHART_AXIS_SECONDARY_Y, CHART_DIV_TEMP, g_chart_scale.range_temp,
+            {&ui_chart_temp_intake, &ui_chart_temp_exhaust});
+
+    if (lines_voc != g_chart_scale.lines_voc) lv_chart_set_div_line_count(ui_Chart, lines_voc + 1, 10);
+    g_chart_scale.lines_voc = lines_voc;
+
+    array<char, 24> buffer{};
+    auto const n_voc = format_fixed(buffer, max_voc, 0, 0, " VOC\n");
+    format_fixed(span{buffer}.subspan(n_voc), max_temp, 0, 0, "c");
+    g_label_chart_max.set(buffer.data());
+}
+
+void display_update_plot() {
+    auto const& state = nevermore::sensors::snapshot_resolved();
+
+    auto encode = [](Series const& series, auto&& value) {
+        if (value == BLE::NOT_KNOWN) return display::Quantiser::NONE;
+
+        return series.quantiser.encode(value.template fixed<-2>());
+    };
+
+    // same order as `SeriesId`
+    g_chart_history.push({
+            encode(ui_chart_voc_intake, state.voc_index_intake),
+            encode(ui_chart_voc_exhaust, state.voc_index_exhaust),
+            encode(ui_chart_temp_intake, state.temperature_intake),
+            encode(ui_chart_temp_exhaust, state.temperature_exhaust),
+    });
+    if (ui_Chart) display_populate_plot();  // otherwise it's populated when the main screen is next built
+}
 
-    lv_chart_set_div_line_count(ui_Chart, lines_voc + 1, 10);
+// Swipe left -> zoom out (more history), right -> zoom in.
+void on_chart_gesture(lv_event_t*) {
+    auto const zoom = g_chart_zoom;
+    switch (lv_indev_get_gesture_dir(lv_indev_get_act())) {
+    default: break;
+    case LV_DIR_TOP:
+    case LV_DIR_BOTTOM: lv_event_send(lv_scr_act(), LV_EVENT_GESTURE, nullptr); return;  // page swipes
+    case LV_DIR_LEFT: g_chart_zoom = min<uint8_t>(g_chart_zoom + 1, CHART_X_AXIS_LENGTHS.size() - 1); break;
+    case LV_DIR_RIGHT: g_chart_zoom = g_chart_zoom == 0 ? 0 : g_chart_zoom - 1; break;
+    }
 
-    char buffer[256];
-    sprintf(buffer, "%u VOC\n%uc", max_voc, max_temp);
-    lv_label_set_text(ui_ChartMax, buffer);
+    if (zoom != g_chart_zoom) display_populate_plot();
 }
 
 // Code more or less ripped from LVGL's `lv_chart.c`.
@@ -246,113 +473,146 @@ void chart_draw_hdivs(lv_draw_ctx_t& draw_ctx, lv_draw_line_dsc_t const& line_de
     }
 }
 
+// Screen space positions of a chart's points & values, computed once per frame.
+// Same math as `lv_chart.c`'s `draw_series_line`, so anything drawn w/ it lines up w/ the series.
+struct ChartMapping {
+    lv_coord_t x_ofs;
+    lv_coord_t y_ofs;
+    lv_coord_t w;
+    lv_coord_t h;
+    lv_coord_t y_min;
+    lv_coord_t y_max;
+    uint16_t points;
+
+    static ChartMapping of(lv_chart_t const& chart, lv_chart_axis_t axis) {
+        // WORKAROUND: `lv_obj_get_scroll_*` mistakenly lack a `const` qualifier
+        auto* obj = const_cast<lv_obj_t*>(&chart.obj);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        auto const border_width = lv_obj_get_style_border_width(obj, LV_PART_MAIN);
+        auto const pad_left = lv_obj_get_style_pad_left(obj, LV_PART_MAIN) + border_width;
+        auto const pad_top = lv_obj_get_style_pad_top(obj, LV_PART_MAIN) + border_width;
+        return {
+                .x_ofs = lv_coord_t(obj->coords.x1 + pad_left - lv_obj_get_scroll_left(obj)),
+                .y_ofs = lv_coord_t(obj->coords.y1 + pad_top - lv_obj_get_scroll_top(obj)),
+                .w = lv_coord_t((int32_t(lv_obj_get_content_width(obj)) * chart.zoom_x) >> 8),
+                .h = lv_coord_t((int32_t(lv_obj_get_content_height(obj)) * chart.zoom_y) >> 8),
+                .y_min = chart.ymin[axis == LV_CHART_AXIS_SECONDARY_Y],
+                .y_max = chart.ymax[axis == LV_CHART_AXIS_SECONDARY_Y],
+                .points = chart.point_cnt,
+        };
+    }
+
+    [[nodiscard]] lv_coord_t x(uint32_t point) const {
+        if (points < 2) return x_ofs;
+
+        return lv_coord_t(int32_t(w) * int32_t(point) / (points - 1) + x_ofs);
+    }
+
+    [[nodiscard]] lv_coord_t y(lv_coord_t value) const {
+        if (y_max == y_min) return lv_coord_t(h + y_ofs);
+
+        return lv_coord_t(h - int32_t(value - y_min) * h / (y_max - y_min) + y_ofs);
+    }
+};
+
+// Shades 'neath a series, fading from `CHART_RED_ZONE_HI` @ 200 VOC to transparent @ 100 VOC.
+// Blends straight into the draw buffer in one pass, column by column. Replaces a line mask, a fade mask,
+// & a rect per line segment, which is LVGL's slowest path on an M0+.
+// Nothing on this screen masks the chart (no radius/clip corners), so skipping the mask stack is fine.
+void chart_draw_fill(lv_draw_ctx_t& draw_ctx, ChartMapping const& map, Series const& series) {
+    auto const& clip = *draw_ctx.clip_area;
+    auto const y_fade_top = map.y(200);
+    auto const y_fade_bot = map.y(100);
+    auto const y_end = min(y_fade_bot, clip.y2);  // everything below 100 VOC has 0 opacity -> no-op
+    if (y_end < clip.y1) return;
+
+    // opacity only depends on the row, work it out once per row instead of per pixel
+    array<lv_opa_t, display::RESOLUTION.height> opa_rows{};
+    auto const rows = min<size_t>(y_end - clip.y1 + 1, opa_rows.size());
+    auto const fade_height = max(1, y_fade_bot - y_fade_top);
+    for (size_t i = 0; i < rows; ++i) {
+        auto const y = lv_coord_t(clip.y1 + i);
+        opa_rows[i] = y <= y_fade_top ? CHART_RED_ZONE_HI
+                                      : lv_opa_t(CHART_RED_ZONE_HI * (y_fade_bot - y) / fade_height);
+    }
+
+    auto* buf = static_cast<lv_color_t*>(draw_ctx.buf);
+    auto const& buf_area = *draw_ctx.buf_area;
+    auto const stride = lv_area_get_width(draw_ctx.buf_area);
+    auto const colour = lv_color_make(255, 0, 0);
+    for (uint16_t i = 0; i + 1 < map.points; ++i) {
+        auto const v1 = series.values.at(i);
+        auto const v2 = series.values.at(i + 1);
+        if (v1 == LV_CHART_POINT_NONE || v2 == LV_CHART_POINT_NONE) continue;  // LVGL doesn't draw gaps
+
+        auto const x1 = map.x(i);
+        auto const x2 = map.x(i + 1);
+        auto const y1 = map.y(v1);
+        auto const y2 = map.y(v2);
+        if (y_end < min(y1, y2) || x2 <= x1) continue;
+
+        // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        for (auto x = max(x1, clip.x1); x <= min<lv_coord_t>(x2 - 1, clip.x2); ++x) {
+            auto const y_line = lv_coord_t(y1 + int32_t(y2 - y1) * (x - x1) / (x2 - x1));
+            auto* column = buf + (x - buf_area.x1);
+            for (auto y = max(y_line, clip.y1); y <= y_end; ++y) {
+                auto& dst = column[(y - buf_area.y1) * stride];
+                dst = lv_color_mix(colour, dst, opa_rows[y - clip.y1]);
+            }
+        }
+        // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    }
+}
+
 void on_chart_draw(bool begin, lv_event_t* e) {
     auto* obj = lv_event_get_target(e);
     auto const& chart = *reinterpret_cast<lv_chart_t const*>(obj);
     auto const& desc = *lv_event_get_draw_part_dsc(e);
 
-    auto abs_pos_for_value = [&](lv_chart_series_t const* series, lv_coord_t value, bool last = false) {
-        return chart_pos_for_value(obj, series, value, last) + top_left(obj->coords);
-    };
-
-    switch (desc.part) {
-    default: break;
+    if (desc.part != LV_PART_MAIN) return;
+    if (desc.p1 || desc.p2 || !desc.line_dsc) return;  // drawing main lines, or no line-info
 
-    case LV_PART_MAIN: {
-        if (desc.p1 || desc.p2 || !desc.line_dsc) break;  // drawing main lines, or no line-info
-
-        if (begin) {
-            // draw the secondary axis division lines before the primary axis lines
-            auto y_secondary_range = max(0, chart.ymax[1] - chart.ymin[1]);
-            auto hdiv_cnt = 1 + (y_secondary_range / CHART_DIV_TEMP.value_per);
-
-            auto line_desc = *desc.line_dsc;
-            line_desc.dash_gap = 6;
-            line_desc.dash_width = 6;
-            chart_draw_hdivs(*desc.draw_ctx, line_desc, chart, hdiv_cnt);
-        } else {
-            // draw the VOC clean-line after all other lines
-            lv_draw_line_dsc_t line_desc{
-                    .color = lv_color_make(0, 255, 0),
-                    .width = 2,
-                    .dash_width = 6,
-                    .dash_gap = 6,
-                    .opa = LV_OPA_50,
-            };
-            auto p1 = abs_pos_for_value(ui_chart_voc_intake.ui, 100, false);
-            auto p2 = abs_pos_for_value(ui_chart_voc_intake.ui, 100, true);
-            lv_draw_line(desc.draw_ctx, &line_desc, &p1, &p2);
-        }
-    } break;
-
-    case LV_PART_ITEMS: {
-        // draw before a line segment
-        if (!begin || !desc.p1 || !desc.p2) break;
-
-        auto const* series = reinterpret_cast<lv_chart_series_t const*>(desc.sub_part_ptr);
-        if (series->y_axis_sec) break;  // no BG fade for temperature series
-
-        // HACK: Want to shade only the area under either VOC curve.
-        //       Nominally `intake` should be >= exhaust, so cheat for now and
-        //       only shade 'neath intake curve.
-        //       Bonus: Since intake is drawn before exhaust (registered first),
-        //              we do not draw over the exhaust line.
-        if (series != ui_chart_voc_intake.ui) break;
-
-        auto y_fade_top = abs_pos_for_value(series, 200).y;
-        auto y_fade_bot = abs_pos_for_value(series, 100).y;
-        // everything below the line has 0 opacity -> no-op
-        if (y_fade_bot < min(desc.p1->y, desc.p2->y)) return;
-
-        // mask everything above line
-        lv_draw_mask_line_param_t line_mask_param{};
-        lv_draw_mask_line_points_init(&line_mask_param, desc.p1->x, desc.p1->y, desc.p2->x, desc.p2->y,
-                LV_DRAW_MASK_LINE_SIDE_BOTTOM);
-        auto line_mask_id = lv_draw_mask_add(&line_mask_param, {});
-
-        // fade from line being drawn to 100-voc-index line
-        lv_draw_mask_fade_param_t fade_mask_param{};
-        lv_draw_mask_fade_init(
-                &fade_mask_param, &obj->coords, CHART_RED_ZONE_HI, y_fade_top, LV_OPA_TRANSP, y_fade_bot);
-        auto fade_mask_id = lv_draw_mask_add(&fade_mask_param, {});
-
-        lv_draw_rect_dsc_t draw_rect_dsc{};
-        lv_draw_rect_dsc_init(&draw_rect_dsc);
-        draw_rect_dsc.bg_opa = LV_OPA_COVER;
-        draw_rect_dsc.bg_color = lv_color_make(255, 0, 0);
-        lv_area_t a{
-                .x1 = desc.p1->x,
-                .y1 = min(desc.p1->y, desc.p2->y),
-                .x2 = lv_coord_t(desc.p2->x - 1),
-                .y2 = y_fade_bot,
-        };
-        lv_draw_rect(desc.draw_ctx, &draw_rect_dsc, &a);
+    if (begin) {
+        // draw the secondary axis division lines before the primary axis lines
+        auto y_secondary_range = max(0, chart.ymax[1] - chart.ymin[1]);
+        auto hdiv_cnt = 1 + (y_secondary_range / CHART_DIV_TEMP.value_per);
 
-        lv_draw_mask_free_param(&line_mask_param);
-        lv_draw_mask_free_param(&fade_mask_param);
-        lv_draw_mask_remove_id(line_mask_id);
-        lv_draw_mask_remove_id(fade_mask_id);
-    } break;
+        auto line_desc = *desc.line_dsc;
+        line_desc.dash_gap = 6;
+        line_desc.dash_width = 6;
+        chart_draw_hdivs(*desc.draw_ctx, line_desc, chart, hdiv_cnt);
+        return;
     }
-}
-
-SemaphoreHandle_t g_ui_lock;
-auto using_semaphore(SemaphoreHandle_t& lock, TickType_t ticks_to_wait = portMAX_DELAY) {
-    return [=](auto&& go) {
-        if (!xSemaphoreTake(lock, ticks_to_wait)) return false;
 
-        go();
-        xSemaphoreGive(lock);
-        return true;
+    // after the div lines, before any series
+    auto const map = ChartMapping::of(chart, LV_CHART_AXIS_PRIMARY_Y);
+
+    // HACK: Want to shade only the area under either VOC curve.
+    //       Nominally `intake` should be >= exhaust, so cheat for now and
+    //       only shade 'neath intake curve.
+    chart_draw_fill(*desc.draw_ctx, map, ui_chart_voc_intake);
+
+    // draw the VOC clean-line after all other lines
+    lv_draw_line_dsc_t line_desc{
+            .color = lv_color_make(0, 255, 0),
+            .width = 2,
+            .dash_width = 6,
+            .dash_gap = 6,
+            .opa = LV_OPA_50,
     };
+    lv_point_t const p1{.x = map.x(0), .y = map.y(100)};
+    lv_point_t const p2{.x = map.x(map.points - 1), .y = map.y(100)};
+    lv_draw_line(desc.draw_ctx, &line_desc, &p1, &p2);
 }
 
-}  // namespace
-
-bool init() {
-    g_ui_lock = xSemaphoreCreateMutex();  // we panic on alloc failures, no need to handle null
+// `ui_Main_screen_init`'s objects, they all dangle once it's deleted.
+constexpr array MAIN_OBJECTS{&ui_Main, &ui_Panel0, &ui_PressureLabels, &ui_PressureIn, &ui_PressureOut,
+        &ui_HumidityLabels, &ui_HumidityIn, &ui_HumidityOut, &ui_ChartBox, &ui_ChartOverlay, &ui_Chart,
+        &ui_ChartLabels, &ui_VocLabels, &ui_VocIn, &ui_VocOut, &ui_TempLabels, &ui_TempIn, &ui_TempOut,
+        &ui_ChartMax, &ui_XAxisScale, &ui_FanBox, &ui_FanPowerText, &ui_FanPower, &ui_FilterLife,
+        &ui_FanPowerArc};
 
-    ui_init();  // invoke generated code setup
+lv_obj_t* main_build() {
+    if (!ui_Main) ui_Main_screen_init();  // `ui_init` already built it for its 1st showing
 
     // HACK: Need at least 2 points to draw the 100-VOC line.
     lv_chart_set_point_count(ui_Chart, 2);
@@ -372,12 +632,16 @@ bool init() {
             },
             LV_EVENT_LONG_PRESSED, {});
 
+    // zoom swipes are handled by the chart, not its screen
+    lv_obj_clear_flag(ui_Chart, LV_OBJ_FLAG_GESTURE_BUBBLE);
+    lv_obj_add_event_cb(ui_Chart, on_chart_gesture, LV_EVENT_GESTURE, {});
+
     lv_obj_add_event_cb(ui_FanPowerArc,
             [](lv_event_t* e) {
                 auto state = lv_obj_get_state(ui_FanPowerArc);
                 if (!(state & LV_STATE_PRESSED)) return;
 
-                BLE::Percentage8 power = lv_arc_get_percent(ui_FanPowerArc) * 100;
+                auto power = lv_arc_get_percent(ui_FanPowerArc);
                 if (power == 0) {
                     power = BLE::NOT_KNOWN;  // clear override if dragged to zero
                 }
@@ -387,26 +651,151 @@ bool init() {
             },
             LV_EVENT_VALUE_CHANGED, {});
 
+    // dragging the arc isn't a page swipe
+    lv_obj_clear_flag(ui_FanPowerArc, LV_OBJ_FLAG_GESTURE_BUBBLE);
+
+    display_populate_plot();
+    display_update_labels();
+    return ui_Main;
+}
+
+void main_forget() {
+    for (auto* x : MAIN_OBJECTS)
+        *x = nullptr;
+    for (auto* series : {&ui_chart_voc_intake, &ui_chart_voc_exhaust, &ui_chart_temp_intake,
+                 &ui_chart_temp_exhaust})
+        series->ui = nullptr;  // freed w/ the chart
+    g_chart_scale = {};
+    g_sensor_labels_version.reset();
+}
+
+lv_obj_t* diagnostics_build() {
+    auto* screen = lv_obj_create(nullptr);
+    lv_obj_clear_flag(screen, LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_set_style_bg_color(screen, lv_color_hex(0x000000), LV_PART_MAIN | int(LV_STATE_DEFAULT));
+    lv_obj_set_style_bg_opa(screen, LV_OPA_COVER, LV_PART_MAIN | int(LV_STATE_DEFAULT));
+    lv_obj_set_flex_flow(screen, LV_FLEX_FLOW_COLUMN);
+    lv_obj_set_flex_align(screen, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
+
+    auto* title = lv_label_create(screen);
+    lv_label_set_text_static(title, "Diagnostics");
+    lv_obj_set_style_text_color(title, lv_color_hex(0x00FFFF), LV_PART_MAIN | int(LV_STATE_DEFAULT));
+
+    auto& x = g_diagnostics;
+    for (auto* row :
+            {&x.uptime, &x.render, &x.flush, &x.heap_free, &x.heap_fragmentation, &x.temperature_mcu}) {
+        *row = lv_label_create(screen);
+        lv_obj_set_style_text_color(*row, lv_color_hex(0xFFFFFF), LV_PART_MAIN | int(LV_STATE_DEFAULT));
+        lv_obj_set_style_text_font(*row, &lv_font_montserrat_12, LV_PART_MAIN | int(LV_STATE_DEFAULT));
+    }
+
+    display_update_diagnostics();
+    return screen;
+}
+
+void diagnostics_forget() {
+    g_diagnostics = {};
+}
+
+// Swipe up for the next, down for the previous. The main screen must stay 1st, it's shown at boot.
+constexpr array SCREENS{
+        display::screens::Screen{.build = main_build, .forget = main_forget, .update = display_update_labels},
+        display::screens::Screen{.build = diagnostics_build,
+                .forget = diagnostics_forget,
+                .update = display_update_diagnostics},
+};
+
+struct Message {
+    void (*go)(void*);
+    void* context;
+    TaskHandle_t waiter;  // notified (`TASK_NOTIFY_INDEX_REPLY`) once `go` has run, if any
+};
+
+// LVGL is only ever touched by the display task. Everyone else hands it work through here.
+TaskStorage<DISPLAY_STACK_DEPTH> g_display_task;
+TaskHandle_t g_display = nullptr;
+Mailbox<Message, DISPLAY_MESSAGES_PENDING_MAX> g_messages;
+
+bool message_post(Message const& x) {
+    if (!g_messages.post(x)) return false;
+
+    xTaskNotifyGive(g_display);  // don't wait out the rest of the refresh interval
+    return true;
+}
+
+void messages_run() {
+    g_messages.drain([](Message const& x) {
+        x.go(x.context);
+        if (x.waiter) xTaskNotifyGiveIndexed(x.waiter, TASK_NOTIFY_INDEX_REPLY);
+    });
+}
+
+template <typename A, typename Period>
+uint32_t lv_period(chrono::duration<A, Period> x) {
+    return uint32_t(chrono::duration_cast<chrono::milliseconds>(x).count());
+}
+
+}  // namespace
+
+bool init() {
+    ui_init();  // invoke generated code setup, builds the main screen for its 1st showing
+
 #if 0  // DEBUG HELPER - pre-populate chart with some data to test rendering
-    lv_chart_set_point_count(ui_Chart, CHART_SERIES_ENTIRES_MAX);
-    lv_label_set_text(ui_XAxisScale,
-            pretty_print_time(CHART_SERIES_ENTIRES_MAX * DISPLAY_TIMER_CHART_INTERVAL).c_str());
-    for (uint i = 0; i < CHART_SERIES_ENTIRES_MAX; ++i) {
-        auto p = double(i) / (CHART_SERIES_ENTIRES_MAX - 1);
-        lv_chart_set_next_value(ui_Chart, ui_chart_voc_intake.ui, p * 250);
+    for (uint i = 0; i < CHART_SERIES_ENTIRES_MAX * CHART_HISTORY_SPANS.back(); ++i) {
+        auto p = int64_t(i % CHART_SERIES_ENTIRES_MAX) * 250'00 / (CHART_SERIES_ENTIRES_MAX - 1);
+        g_chart_history.push({ui_chart_voc_intake.quantiser.encode(p), display::Quantiser::NONE,
+                display::Quantiser::NONE, display::Quantiser::NONE});
     }
 #endif
 
-#define DISPLAY_TASK(name, period, stack_size, go)                \
-    mk_task(name, Priority::Display, stack_size)([]() {           \
-        periodic(period)([] { using_semaphore(g_ui_lock)(go); }); \
-    }).release()
+    display::screens::init(SCREENS);
+
+    // LVGL timers, run by `lv_timer_handler`, i.e. on the display task & in between its frames
+    lv_timer_ready(lv_timer_create(
+            [](lv_timer_t*) { display_update(); }, lv_period(DISPLAY_TIMER_LABELS_INTERVAL), {}));
+    lv_timer_ready(lv_timer_create(
+            [](lv_timer_t*) { display_update_plot(); }, lv_period(DISPLAY_TIMER_PLOT_INTERVAL), {}));
 
     // must finish init-ing the UI *before* we start `lv_timer_handler` (which could otherwise interrupt)
-    DISPLAY_TASK("display", DISPLAY_REFRESH_INTERVAL, 1024, lv_timer_handler);
-    DISPLAY_TASK("display-label", DISPLAY_TIMER_LABELS_INTERVAL, 1024, display_update_labels);
-    DISPLAY_TASK("display-plot", DISPLAY_TIMER_PLOT_INTERVAL, 1024, display_update_plot);
+    g_display = mk_task("display", Priority::Display, g_display_task, Core::C1)([]() {
+        // a full frame is ~100ms, anything near this is stuck on the panel (or a posted job)
+        static health::Heartbeat g_heartbeat{.name = "display", .timeout = 2s};
+        health::monitor(g_heartbeat);
+        for (;;) {
+            g_heartbeat.beat();
+            messages_run();
+            auto const interval = display_govern();
+            display_render();
+            // the governor picks the interval, a `post` cuts it short
+            ulTaskNotifyTake(pdTRUE, to_ticks(interval));
+        }
+    }).release();
     return true;
 }
 
+bool post(void (*go)(void*), void* context) {
+    return message_post({.go = go, .context = context, .waiter = nullptr});
+}
+
+void call(void (*go)(void*), void* context) {
+    assert(xTaskGetCurrentTaskHandle() != g_display && "display task would wait on itself");
+    while (!message_post({.go = go, .context = context, .waiter = xTaskGetCurrentTaskHandle()}))
+        task_delay(DISPLAY_REFRESH_INTERVAL);  // full, it'll have drained come the next frame
+
+    ulTaskNotifyTakeIndexed(TASK_NOTIFY_INDEX_REPLY, pdTRUE, portMAX_DELAY);
+}
+
+void update_plot() {
+    call([](void*) { display_update_plot(); }, nullptr);
+}
+
+void render_full_frame() {
+    call(
+            [](void*) {
+                lv_obj_invalidate(lv_scr_act());
+                lv_refr_now(nullptr);
+            },
+            nullptr);
+}
+
 }  // namespace nevermore::ui
@@ -5,4 +5,16 @@ namespace nevermore::ui {
 // Initialises the UI. Must be done using the same async context as the display.
 bool init();
 
+// Only the display task touches LVGL (UI state, input devices, ...), anyone else hands it the work.
+// `go(context)` runs on the display task, before its next frame. Any task, not ISRs. Never blocks, returns
+// false (& `go` is never run) if too many are already pending.
+bool post(void (*go)(void*), void* context);
+// As `post`, but waits until `go` has run, so `context` only needs to outlive the call. That's at most the
+// frame being rendered. Never from the display task itself (i.e. `go` can't `call`).
+void call(void (*go)(void*), void* context);
+
+// For the benchmark suite. Each is a `call`, so includes the hand-off to the display task.
+void update_plot();        // push the next sample onto the plot
+void render_full_frame();  // invalidate the whole screen & render it now (the last flush may still be going)
+
 }  // namespace nevermore::ui
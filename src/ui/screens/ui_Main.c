@@ -306,7 +306,7 @@ void ui_Main_screen_init(void)
     lv_obj_set_style_bg_opa(ui_XAxisScale, 128, LV_PART_MAIN | LV_STATE_DEFAULT);
 
     ui_FanBox = lv_obj_create(ui_Main);
-    lv_obj_set_width(ui_FanBox, lv_pct(30));
+    lv_obj_set_width(ui_FanBox, lv_pct(44));
     lv_obj_set_height(ui_FanBox, LV_SIZE_CONTENT);    /// 50
     lv_obj_set_x(ui_FanBox, 0);
     lv_obj_set_y(ui_FanBox, lv_pct(-5));
@@ -346,6 +346,17 @@ void ui_Main_screen_init(void)
     lv_obj_set_style_pad_top(ui_FanPower, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
     lv_obj_set_style_pad_bottom(ui_FanPower, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
 
+    ui_FilterLife = lv_label_create(ui_FanBox);
+    lv_obj_set_width(ui_FilterLife, LV_SIZE_CONTENT);   /// 1
+    lv_obj_set_height(ui_FilterLife, LV_SIZE_CONTENT);    /// 1
+    lv_label_set_text(ui_FilterLife, "C 100%");
+    lv_obj_set_style_text_color(ui_FilterLife, lv_color_hex(0xFFFFFF), LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_opa(ui_FilterLife, 255, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_pad_left(ui_FilterLife, 2, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_pad_right(ui_FilterLife, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_pad_top(ui_FilterLife, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_pad_bottom(ui_FilterLife, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
+
     ui_FanPowerArc = lv_arc_create(ui_Main);
     lv_obj_set_width(ui_FanPowerArc, lv_pct(100));
     lv_obj_set_height(ui_FanPowerArc, lv_pct(100));
@@ -33,6 +33,7 @@ lv_obj_t * ui_XAxisScale;
 lv_obj_t * ui_FanBox;
 lv_obj_t * ui_FanPowerText;
 lv_obj_t * ui_FanPower;
+lv_obj_t * ui_FilterLife;
 lv_obj_t * ui_FanPowerArc;
 lv_obj_t * ui____initial_actions0;
 
@@ -49,6 +49,7 @@ extern lv_obj_t * ui_XAxisScale;
 extern lv_obj_t * ui_FanBox;
 extern lv_obj_t * ui_FanPowerText;
 extern lv_obj_t * ui_FanPower;
+extern lv_obj_t * ui_FilterLife;
 extern lv_obj_t * ui_FanPowerArc;
 extern lv_obj_t * ui____initial_actions0;
 
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <span>
+#include <utility>
+
+// Minimal benchmark harness, shared by the host build & the on-target benchmark firmware.
+// Times each run individually so the tail (p99) is visible, not just the mean.
+namespace nevermore::benchmark {
+
+struct Stats {
+    std::chrono::nanoseconds min;
+    std::chrono::nanoseconds mean;
+    std::chrono::nanoseconds p99;
+    std::chrono::nanoseconds max;
+};
+
+// Stops the compiler from discarding `x` (and the work that produced it) as dead code.
+template <typename A>
+inline void keep(A const& x) {
+    asm volatile("" : : "g"(&x) : "memory");
+}
+
+// Sorts `samples` in place. Each sample timed `batch` back-to-back runs.
+// PRECONDITION: `samples` isn't empty
+template <typename Duration>
+Stats summarise(std::span<Duration> samples, size_t batch = 1) {
+    using namespace std::chrono;
+
+    std::ranges::sort(samples);
+    Duration total{};
+    for (auto x : samples)
+        total += x;
+
+    auto per_run = [&](auto x) { return duration_cast<nanoseconds>(x) / batch; };
+    auto const n = samples.size();
+    return {
+            .min = per_run(samples.front()),
+            .mean = per_run(total) / n,
+            .p99 = per_run(samples[std::min(n - 1, n * 99 / 100)]),
+            .max = per_run(samples.back()),
+    };
+}
+
+// Takes `SAMPLES` samples of `go`, timed w/ `Clock`. Each sample averages `BATCH` back-to-back runs, for
+// things that are too quick for `Clock`'s resolution (e.g. 1us on target).
+// Samples live on the stack (1 `Clock::duration` each), keep `SAMPLES` modest on target.
+template <typename Clock = std::chrono::steady_clock, size_t SAMPLES = 256, size_t BATCH = 1, typename F>
+Stats measure(F&& go) {
+    static_assert(0 < SAMPLES && 0 < BATCH);
+    using namespace std::chrono;
+
+    go();  // warm up caches/XIP, lazy init, etc.
+
+    std::array<typename Clock::duration, SAMPLES> samples;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+    for (auto& x : samples) {
+        auto const bgn = Clock::now();
+        for (size_t i = 0; i < BATCH; ++i)
+            go();
+        x = Clock::now() - bgn;
+    }
+
+    return summarise<typename Clock::duration>(samples, BATCH);
+}
+
+inline void report(char const* name, Stats const& stats, FILE* out = stdout) {
+    auto us = [](std::chrono::nanoseconds x) { return double(x.count()) / 1000; };
+    fprintf(out, "%-32s min %10.3f us  mean %10.3f us  p99 %10.3f us  max %10.3f us\n", name, us(stats.min),
+            us(stats.mean), us(stats.p99), us(stats.max));
+}
+
+template <typename Clock = std::chrono::steady_clock, size_t SAMPLES = 256, size_t BATCH = 1, typename F>
+void run(char const* name, F&& go) {
+    report(name, measure<Clock, SAMPLES, BATCH>(std::forward<F>(go)));
+}
+
+}  // namespace nevermore::benchmark
@@ -32,6 +32,12 @@ constexpr auto string(uint8_t typ, char const (&str)[M]) {
     return blob(typ, xs);
 }
 
+template <typename UUID, typename A>
+struct [[gnu::packed]] ServiceData {
+    UUID uuid;
+    A data;
+};
+
 }  // namespace internal
 
 enum class Flag : uint8_t {
@@ -91,4 +97,13 @@ BT_ADVERT_SERVICES(services_incomplete, BLUETOOTH_DATA_TYPE_INCOMPLETE_LIST_OF_1
 #undef BT_ADVERT_SERVICES0
 #undef BT_ADVERT_SERVICES
 
+// `data` is sent as-is (i.e. must be packed & LE), after the 16-bit service UUID
+template <uint16_t uuid, typename A>
+constexpr auto service_data(A const& data) {
+    return internal::blob(
+            BLUETOOTH_DATA_TYPE_SERVICE_DATA_16_BIT_UUID, internal::ServiceData<uint16_t, A>{uuid, data});
+}
+static_assert(sizeof(service_data<0x181A>(uint8_t(0))) == 5);
+static_assert(service_data<0x181A>(uint8_t(0x42)) == std::array<uint8_t, 5>{4, 0x16, 0x1A, 0x18, 0x42});
+
 }  // namespace bt::advert
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Consistent Overhead Byte Stuffing: encodes a frame w/o any 0x00, so 0x00 can delimit frames on a byte
+// stream (e.g. USB CDC) & a receiver can resync after garbage by skipping to the next 0x00.
+namespace nevermore {
+
+// Worst case encoded size, w/o the delimiter.
+constexpr size_t cobs_encoded_size_max(size_t n) {
+    return n + n / 254 + 1;
+}
+
+// Returns # of octets written to `out`, which must have room for `cobs_encoded_size_max(in.size())`.
+// Returns 0 if it doesn't.
+constexpr size_t cobs_encode(std::span<uint8_t const> in, std::span<uint8_t> out) {
+    if (out.size() < cobs_encoded_size_max(in.size())) return 0;
+
+    size_t code_at = 0;  // where the current run's length goes
+    size_t o = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < in.size(); ++i) {
+        auto const x = in[i];
+        if (x != 0) {
+            out[o++] = x;
+            code += 1;
+        }
+
+        // a full run ends its block w/o a zero, unless the frame ends there anyways
+        if (x == 0 || (code == 0xFF && i + 1 < in.size())) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        }
+    }
+
+    out[code_at] = code;
+    return o;
+}
+
+namespace internal {
+
+template <size_t N, size_t M>
+constexpr bool cobs_encodes(std::array<uint8_t, N> const& in, std::array<uint8_t, M> const& expected) {
+    std::array<uint8_t, cobs_encoded_size_max(N)> out{};
+    auto const n = cobs_encode(in, out);
+    if (n != M) return false;
+
+    for (size_t i = 0; i < M; ++i)
+        if (out[i] != expected[i]) return false;
+
+    return true;
+}
+
+}  // namespace internal
+
+// examples from the COBS paper/wikipedia
+static_assert(internal::cobs_encodes(std::array<uint8_t, 0>{}, std::array<uint8_t, 1>{0x01}));
+static_assert(internal::cobs_encodes(std::array<uint8_t, 1>{0x00}, std::array<uint8_t, 2>{0x01, 0x01}));
+static_assert(internal::cobs_encodes(std::array<uint8_t, 4>{0x11, 0x22, 0x00, 0x33},
+        std::array<uint8_t, 5>{0x03, 0x11, 0x22, 0x02, 0x33}));
+static_assert(internal::cobs_encodes(std::array<uint8_t, 4>{0x11, 0x00, 0x00, 0x00},
+        std::array<uint8_t, 5>{0x02, 0x11, 0x01, 0x01, 0x01}));
+// a full 254 octet run ends its block, & a trailing one doesn't start an empty block
+static_assert([] {
+    std::array<uint8_t, 255> in{};
+    for (size_t i = 0; i < in.size(); ++i)
+        in[i] = uint8_t(i % 254 + 1);
+
+    std::array<uint8_t, cobs_encoded_size_max(255)> out{};
+    std::span<uint8_t const> const run{in.data(), 254};
+    if (cobs_encode(run, out) != 255 || out[0] != 0xFF || out[254] != 0xFE) return false;
+    return cobs_encode(in, out) == 257 && out[0] == 0xFF && out[255] == 0x02 && out[256] == 0x01;
+}());
+
+}  // namespace nevermore
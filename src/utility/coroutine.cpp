@@ -0,0 +1,80 @@
+#include "coroutine.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "task.h"      // IWYU pragma: keep
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <tuple>
+
+using namespace std;
+
+namespace nevermore::coroutine_detail {
+
+namespace {
+
+// Fixed size blocks for frames of at most `SIZE` octets.
+template <size_t SIZE, size_t N>
+struct Blocks {
+    struct alignas(max_align_t) Block {
+        array<byte, SIZE> bytes;
+    };
+
+    array<Block, N> storage;
+    array<bool, N> used;
+
+    // PRECONDITION: Caller is in the kernel critical section.
+    void* UNSAFE_take(size_t size) {
+        if (SIZE < size) return nullptr;
+
+        for (size_t i = 0; i < N; ++i) {
+            if (used[i]) continue;
+
+            used[i] = true;
+            return storage[i].bytes.data();
+        }
+
+        return nullptr;
+    }
+
+    // PRECONDITION: Caller is in the kernel critical section.
+    bool UNSAFE_give(void* p) {
+        auto const* block = static_cast<Block const*>(p);
+        if (block < storage.data() || storage.data() + N <= block) return false;
+
+        auto const i = size_t(block - storage.data());
+        assert(used[i] && "already freed");
+        used[i] = false;
+        return true;
+    }
+};
+
+// Frame sizes are up to the compiler (locals & awaiters that live across a suspension point), so frames
+// take the smallest free block they fit in. Budgeted for each sensor's `run` -> `read` -> I2C helper chain
+// being suspended at once, w/ a few large ones for the drivers that keep buffers in their frames.
+// Trivial, so zero init'd & usable before static constructors have run.
+tuple<Blocks<64, 24>, Blocks<128, 24>, Blocks<256, 24>, Blocks<512, 8>> g_blocks;
+
+}  // namespace
+
+void* frame_alloc(size_t size) noexcept {
+    void* p = nullptr;
+    taskENTER_CRITICAL();
+    apply([&](auto&... blocks) { (void)((p = blocks.UNSAFE_take(size)) || ...); }, g_blocks);
+    taskEXIT_CRITICAL();
+
+    if (!p) printf("WARN - coroutine - no free frame block for %u octets\n", unsigned(size));
+    return p;
+}
+
+void frame_free(void* p) noexcept {
+    if (!p) return;
+
+    taskENTER_CRITICAL();
+    [[maybe_unused]] bool const found =
+            apply([&](auto&... blocks) { return (blocks.UNSAFE_give(p) || ...); }, g_blocks);
+    taskEXIT_CRITICAL();
+    assert(found && "not a coroutine frame");
+}
+
+}  // namespace nevermore::coroutine_detail
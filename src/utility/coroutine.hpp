@@ -0,0 +1,168 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace nevermore {
+
+struct Executor;
+
+namespace coroutine_detail {
+
+// Frames come from a static arena of fixed size blocks rather than the heap; a sensor's read allocates &
+// frees a handful every period, forever. Yields null when no block fits (it doesn't throw).
+void* frame_alloc(size_t size) noexcept;
+void frame_free(void*) noexcept;
+
+struct PromiseBase {
+    Executor* executor = nullptr;          // inherited from the awaiting coroutine, set by `spawn` for roots
+    std::coroutine_handle<> continuation;  // null for a root coroutine
+    std::exception_ptr exception;
+
+    static void* operator new(size_t size) noexcept {
+        return frame_alloc(size);
+    }
+
+    static void operator delete(void* p) noexcept {
+        frame_free(p);
+    }
+
+    struct Final {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        void await_resume() noexcept {}
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> self) noexcept {
+            auto& promise = self.promise();
+            if (promise.continuation) return promise.continuation;
+
+            // root coroutine -> owned by the executor, which will destroy it
+            retire(*promise.executor, self, promise.exception);
+            return std::noop_coroutine();
+        }
+    };
+
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+
+    Final final_suspend() noexcept {
+        return {};
+    }
+
+    void unhandled_exception() noexcept {
+        exception = std::current_exception();
+    }
+
+    void rethrow_if_failed() const {
+        if (exception) std::rethrow_exception(exception);
+    }
+
+private:
+    static void retire(Executor&, std::coroutine_handle<>, std::exception_ptr const&) noexcept;
+};
+
+template <typename A>
+struct Promise : PromiseBase {
+    std::optional<A> value;
+
+    template <typename B>
+    void return_value(B&& x) {
+        value.emplace(std::forward<B>(x));
+    }
+
+    A take() {
+        rethrow_if_failed();
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    void return_void() {}
+
+    void take() const {
+        rethrow_if_failed();
+    }
+};
+
+}  // namespace coroutine_detail
+
+// Lazily started coroutine. Runs once it is either `co_await`-ed by another coroutine (which
+// resumes once this one completes), or handed to an `Executor` via `spawn`.
+// If its frame couldn't be allocated it is null: `co_await`-ing it throws `std::bad_alloc` &
+// `spawn`-ing it fails.
+template <typename A = void>
+struct [[nodiscard]] Coroutine {
+    struct promise_type : coroutine_detail::Promise<A> {
+        Coroutine get_return_object() {
+            return Coroutine{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        static Coroutine get_return_object_on_allocation_failure() {
+            return Coroutine{Handle{}};
+        }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Coroutine(Coroutine const&) = delete;
+    Coroutine& operator=(Coroutine const&) = delete;
+
+    Coroutine(Coroutine&& rhs) noexcept : handle(std::exchange(rhs.handle, {})) {}
+    Coroutine& operator=(Coroutine&& rhs) noexcept {
+        if (this != &rhs) {
+            if (handle) handle.destroy();
+            handle = std::exchange(rhs.handle, {});
+        }
+
+        return *this;
+    }
+
+    ~Coroutine() {
+        if (handle) handle.destroy();
+    }
+
+    Handle release() {
+        return std::exchange(handle, {});
+    }
+
+    struct Awaiter {
+        Handle handle;
+
+        bool await_ready() noexcept {
+            return !handle;  // never got a frame, fail straight away in `await_resume`
+        }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) noexcept {
+            handle.promise().continuation = caller;
+            handle.promise().executor = caller.promise().executor;
+            return handle;  // symmetric transfer, doesn't grow the stack
+        }
+
+        A await_resume() {
+            if (!handle) throw std::bad_alloc();
+
+            return handle.promise().take();
+        }
+    };
+
+    Awaiter operator co_await() && noexcept {
+        return Awaiter{handle};
+    }
+
+private:
+    explicit Coroutine(Handle handle) : handle(handle) {}
+
+    Handle handle;
+};
+
+}  // namespace nevermore
@@ -1,21 +1,28 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <span>
+#include <type_traits>
 
 namespace nevermore {
 
 using CRC8_t = uint8_t;
 
-// polynomial x^8 + x^5 + x^4 + 1
-constexpr inline CRC8_t crc8(std::span<uint8_t const> data, CRC8_t init) {
+namespace internal {
+
+constexpr CRC8_t CRC8_POLYNOMIAL = 0x31;  // x^8 + x^5 + x^4 + 1
+
+// Reference implementation, one bit at a time. Only used to generate & check the tables.
+constexpr CRC8_t crc8_bitwise(std::span<uint8_t const> data, CRC8_t init) {
     CRC8_t crc = init;
     for (auto x : data) {
         crc ^= x;
 
         for (uint8_t i = 0; i < 8; i++) {
             if (crc & 0x80) {
-                crc = (crc << 1) ^ 0x31u;
+                crc = (crc << 1) ^ CRC8_POLYNOMIAL;
             } else {
                 crc = (crc << 1);
             }
@@ -25,6 +32,49 @@ constexpr inline CRC8_t crc8(std::span<uint8_t const> data, CRC8_t init) {
     return crc;
 }
 
+// `table[i]` is the CRC of the `BITS` wide value `i`, left aligned in the register.
+template <size_t BITS>
+constexpr auto crc8_table() {
+    std::array<CRC8_t, 1u << BITS> table{};
+    for (size_t i = 0; i < table.size(); ++i) {
+        CRC8_t crc = CRC8_t(i << (8 - BITS));
+        for (size_t j = 0; j < BITS; ++j)
+            crc = (crc & 0x80) ? CRC8_t((crc << 1) ^ CRC8_POLYNOMIAL) : CRC8_t(crc << 1);
+        table[i] = crc;
+    }
+    return table;
+}
+
+inline constexpr auto CRC8_TABLE = crc8_table<8>();    // 256 octets, 1 lookup per octet
+inline constexpr auto CRC8_TABLE_4 = crc8_table<4>();  // 16 octets, 2 lookups per octet
+// Runtime copy of `CRC8_TABLE`. Not `const`, so it's in (initialised) SRAM rather than flash & a lookup never
+// waits on an XIP cache miss. NEVER write to it.
+inline constinit auto CRC8_TABLE_SRAM = CRC8_TABLE;
+
+}  // namespace internal
+
+// One lookup per octet.
+constexpr inline CRC8_t crc8(std::span<uint8_t const> data, CRC8_t init) {
+    auto const& table = std::is_constant_evaluated() ? internal::CRC8_TABLE : internal::CRC8_TABLE_SRAM;
+    CRC8_t crc = init;
+    for (auto x : data)
+        crc = table[crc ^ x];
+
+    return crc;
+}
+
+// Nibble at a time, 16 octet table. For when flash/cache footprint matters more than speed.
+constexpr inline CRC8_t crc8_small(std::span<uint8_t const> data, CRC8_t init) {
+    CRC8_t crc = init;
+    for (auto x : data) {
+        crc ^= x;
+        crc = CRC8_t(crc << 4) ^ internal::CRC8_TABLE_4[crc >> 4];
+        crc = CRC8_t(crc << 4) ^ internal::CRC8_TABLE_4[crc >> 4];
+    }
+
+    return crc;
+}
+
 template <typename A>
 constexpr CRC8_t crc8(A const& blob, CRC8_t init) {
     static_assert(!std::is_pointer_v<A>, "probably a mistake, pass blob by ref");
@@ -41,4 +91,87 @@ struct [[gnu::packed]] ResponseCRC {
     };
 };
 
+namespace internal {
+
+constexpr bool crc8_agree(std::span<uint8_t const> data, CRC8_t init) {
+    auto const expected = crc8_bitwise(data, init);
+    return crc8(data, init) == expected && crc8_small(data, init) == expected;
+}
+
+constexpr std::array<uint8_t const, 2> CRC8_EXAMPLE{0xBE, 0xEF};
+
+}  // namespace internal
+
+using CRC32_t = uint32_t;
+
+namespace internal {
+
+constexpr CRC32_t CRC32_POLYNOMIAL = 0xEDB8'8320;  // IEEE 802.3, reflected
+
+// Reference implementation, one bit at a time. Only used to generate & check the table.
+constexpr CRC32_t crc32_bitwise(std::span<uint8_t const> data, CRC32_t init) {
+    CRC32_t crc = ~init;
+    for (auto x : data) {
+        crc ^= x;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+    }
+
+    return ~crc;
+}
+
+// `table[i]` is the CRC of the nibble `i`, right aligned (reflected) in the register.
+inline constexpr auto CRC32_TABLE_4 = [] {
+    std::array<CRC32_t, 16> table{};
+    for (size_t i = 0; i < table.size(); ++i) {
+        CRC32_t crc = CRC32_t(i);
+        for (size_t j = 0; j < 4; ++j)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+        table[i] = crc;
+    }
+    return table;
+}();
+
+}  // namespace internal
+
+// Same CRC as zlib's `crc32`, so hosts can use whatever they've got. Chain by passing the previous result as
+// `init`. Nibble at a time, it's only used for bulk checks (e.g. firmware images) where 64 octets of table
+// beat 1 KiB for a few ms of difference.
+constexpr inline CRC32_t crc32(std::span<uint8_t const> data, CRC32_t init = 0) {
+    CRC32_t crc = ~init;
+    for (auto x : data) {
+        crc ^= x;
+        crc = (crc >> 4) ^ internal::CRC32_TABLE_4[crc & 0xF];
+        crc = (crc >> 4) ^ internal::CRC32_TABLE_4[crc & 0xF];
+    }
+
+    return ~crc;
+}
+
+namespace internal {
+
+constexpr std::array<uint8_t const, 9> CRC32_EXAMPLE{'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+}  // namespace internal
+
+// Sensirion datasheet example: 0xBEEF -> 0x92
+static_assert(crc8(std::span<uint8_t const>{internal::CRC8_EXAMPLE}, 0xFF) == 0x92);
+static_assert(crc8_small(std::span<uint8_t const>{internal::CRC8_EXAMPLE}, 0xFF) == 0x92);
+static_assert(internal::crc8_agree({}, 0xFF));
+// every possible register state & input octet goes through the tables
+static_assert([] {
+    for (unsigned i = 0; i < 256; ++i) {
+        std::array<uint8_t const, 2> const data{uint8_t(i), uint8_t(i * 7)};
+        if (!internal::crc8_agree(data, uint8_t(i ^ 0x5A))) return false;
+    }
+    return true;
+}());
+
+// standard CRC-32 check value
+static_assert(crc32(std::span<uint8_t const>{internal::CRC32_EXAMPLE}) == 0xCBF4'3926);
+static_assert(internal::crc32_bitwise(std::span<uint8_t const>{internal::CRC32_EXAMPLE}, 0) == 0xCBF4'3926);
+// chaining is the same as one pass
+static_assert(crc32(std::span<uint8_t const>{internal::CRC32_EXAMPLE}.subspan(4),
+                      crc32(std::span<uint8_t const>{internal::CRC32_EXAMPLE}.first(4))) == 0xCBF4'3926);
+
 }  // namespace nevermore
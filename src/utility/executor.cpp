@@ -0,0 +1,319 @@
+#include "executor.hpp"
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "sdk/task.hpp"
+#include "utility/pool.hpp"
+#include <cassert>
+#include <cstdio>
+
+using namespace std;
+
+namespace nevermore {
+
+// Pooled, a sensor being hot-plugged (re)starts one each time & shouldn't fragment the heap doing it.
+struct Executor::Root : Pooled<Executor::Root, Executor::ROOTS_MAX> {
+    explicit Root(coroutine_handle<> handle) : handle(handle), start{.handle = handle} {}
+
+    coroutine_handle<> handle;
+    Waiter start;
+    Root* next = nullptr;
+    bool cancelled = false;
+};
+
+namespace {
+
+struct CriticalSection {
+    CriticalSection() {
+        taskENTER_CRITICAL();
+    }
+    ~CriticalSection() {
+        taskEXIT_CRITICAL();
+    }
+};
+
+struct CriticalSectionFromISR {
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    ~CriticalSectionFromISR() {
+        taskEXIT_CRITICAL_FROM_ISR(saved);
+    }
+};
+
+void push_back(Executor::Waiter*& head, Executor::Waiter*& tail, Executor::Waiter& x) {
+    assert(!x.queued);
+    x.next = nullptr;
+    x.queued = true;
+    (head ? tail->next : head) = &x;
+    tail = &x;
+}
+
+void insert_sorted(Executor::Waiter*& head, Executor::Waiter& x) {
+    assert(!x.queued);
+    auto** it = &head;
+    while (*it && (*it)->wake_at <= x.wake_at)
+        it = &(*it)->next;
+
+    x.next = *it;
+    x.queued = true;
+    *it = &x;
+}
+
+// Returns true if found & removed. `tail`, if given, is kept pointing at the last node.
+bool remove(Executor::Waiter*& head, Executor::Waiter& x, Executor::Waiter** tail = nullptr) {
+    Executor::Waiter* prev = nullptr;
+    for (auto** it = &head; *it; prev = *it, it = &(*it)->next) {
+        if (*it != &x) continue;
+
+        *it = x.next;
+        if (tail && *tail == &x) *tail = prev;
+        x.next = nullptr;
+        x.queued = false;
+        return true;
+    }
+
+    return false;
+}
+
+}  // namespace
+
+void coroutine_detail::PromiseBase::retire(
+        Executor& executor, coroutine_handle<> self, exception_ptr const& exception) noexcept {
+    // same outcome as an exception escaping a task's entry point
+    if (exception) {
+        printf("ERR - executor `%s` - unhandled exception in coroutine\n", executor.name);
+        std::terminate();
+    }
+
+    executor.retire(self);
+}
+
+Executor::Job Executor::spawn(Coroutine<> co) {
+    auto handle = co.release();
+    if (!handle) return {};  // no frame, nothing to run
+
+    handle.promise().executor = this;
+
+    auto* root = new Root(handle);
+    if (!root) {
+        handle.destroy();  // never started, nothing to unwind
+        return {};
+    }
+
+    {
+        CriticalSection _;
+        root->next = roots;
+        roots = root;
+        push_back(ready_head, ready_tail, root->start);
+    }
+
+    if (!task) task = Task(run, name, memory, this, priority);
+    notify();
+    return root;
+}
+
+void Executor::cancel(Job job) {
+    assert(job);
+    {
+        CriticalSection _;
+        job->cancelled = true;
+    }
+
+    notify();
+}
+
+void Executor::schedule(Waiter& waiter) {
+    {
+        CriticalSection _;
+        push_back(ready_head, ready_tail, waiter);
+    }
+
+    notify();
+}
+
+// The ISR side (`*_from_isr`) runs from RAM, it's on the path from a device's IRQ to its coroutine.
+void __not_in_flash("executor") Executor::schedule_from_isr(Waiter& waiter) {
+    {
+        CriticalSectionFromISR _;
+        push_back(ready_head, ready_tail, waiter);
+    }
+
+    notify_from_isr();
+}
+
+void Executor::schedule_at(Waiter& waiter) {
+    CriticalSection _;
+    insert_sorted(sleeping, waiter);
+    // no need to notify: only ever called from our own task, which re-evaluates before sleeping
+}
+
+void Executor::unlink(Waiter& waiter) {
+    CriticalSection _;
+    if (!waiter.queued) return;
+    if (remove(ready_head, waiter, &ready_tail)) return;
+    remove(sleeping, waiter);
+}
+
+// Called from within the root's `final_suspend`, on our own task.
+void Executor::retire(coroutine_handle<> handle) noexcept {
+    Root* root = nullptr;
+    {
+        CriticalSection _;
+        for (auto** it = &roots; *it; it = &(*it)->next) {
+            if ((*it)->handle != handle) continue;
+
+            root = *it;
+            *it = root->next;
+            break;
+        }
+    }
+
+    assert(root && "retiring a coroutine that isn't a root of this executor?");
+    handle.destroy();  // OK: suspended at final suspend point & nothing touches the frame afterwards
+    delete root;
+}
+
+void Executor::reap_cancelled() {
+    for (;;) {
+        Root* root = nullptr;
+        {
+            CriticalSection _;
+            for (auto** it = &roots; *it; it = &(*it)->next) {
+                if (!(*it)->cancelled) continue;
+
+                root = *it;
+                *it = root->next;
+                break;
+            }
+
+            if (root && root->start.queued) remove(ready_head, root->start, &ready_tail);
+        }
+
+        if (!root) return;
+
+        // Must be done outside of the critical section: awaiters unlink themselves on destruction.
+        root->handle.destroy();
+        delete root;
+    }
+}
+
+Executor::Waiter* Executor::pop_ready(chrono::microseconds& wait) {
+    auto const now = time_64u();
+
+    CriticalSection _;
+    while (sleeping && sleeping->wake_at <= now) {
+        auto& x = *sleeping;
+        sleeping = x.next;
+        x.queued = false;
+        push_back(ready_head, ready_tail, x);
+    }
+
+    if (auto* x = ready_head) {
+        ready_head = x->next;
+        if (!ready_head) ready_tail = nullptr;
+        x->next = nullptr;
+        x->queued = false;
+        return x;
+    }
+
+    wait = sleeping ? sleeping->wake_at - now : chrono::microseconds::max();
+    return nullptr;
+}
+
+void Executor::run(void* self_) {
+    auto& self = *reinterpret_cast<Executor*>(self_);
+    health::monitor(self.heartbeat);
+    for (;;) {
+        self.heartbeat.beat();
+        self.reap_cancelled();
+
+        chrono::microseconds wait{};
+        if (auto* x = self.pop_ready(wait)) {
+            x->handle.resume();
+            continue;
+        }
+
+        self.heartbeat.idle();
+
+        if (TICK_PERIOD <= wait) {  // early wake-ups are fine, we re-evaluate before sleeping again
+            ulTaskNotifyTake(pdTRUE, wait == chrono::microseconds::max() ? portMAX_DELAY : to_ticks(wait));
+            continue;
+        }
+
+        // Deadline is finer than the tick, have a hardware alarm wake us. Stray wake-ups from a late alarm
+        // are harmless for the same reason.
+        auto const alarm = add_alarm_in_us(
+                wait / 1us,
+                [](alarm_id_t, void* self) -> int64_t {
+                    static_cast<Executor*>(self)->notify_from_isr();
+                    return 0;  // 0 -> no repeat
+                },
+                &self, false);
+        if (alarm == 0) continue;  // already due
+        if (alarm < 0) {           // out of alarm slots, fall back to the nearest tick
+            ulTaskNotifyTake(pdTRUE, 1);
+            continue;
+        }
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        cancel_alarm(alarm);  // no-op if it already fired
+    }
+}
+
+void Executor::notify() {
+    if (task) xTaskNotifyGive(task.handle());
+}
+
+void __not_in_flash("executor") Executor::notify_from_isr() {
+    if (!task) return;
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task.handle(), &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);  // NOLINT
+}
+
+bool Event::consume() {
+    CriticalSection _;
+    return std::exchange(pending, false);
+}
+
+bool Event::park(Executor::Waiter& x, Executor& executor) {
+    CriticalSection _;
+    if (std::exchange(pending, false)) return false;  // raced w/ a `set`, don't suspend
+
+    assert(!waiter && "only a single coroutine may wait on an event");
+    waiter = &x;
+    this->executor = &executor;
+    return true;
+}
+
+void Event::unpark(Executor::Waiter& x, Executor& executor) {
+    {
+        CriticalSection _;
+        if (waiter == &x) waiter = nullptr;
+    }
+
+    executor.unlink(x);
+}
+
+void Event::set() {
+    Executor::Waiter* x = nullptr;
+    {
+        CriticalSection _;
+        x = std::exchange(waiter, nullptr);
+        if (!x) pending = true;
+    }
+
+    if (x) executor->schedule(*x);
+}
+
+void __not_in_flash("executor") Event::set_from_isr() {
+    Executor::Waiter* x = nullptr;
+    {
+        CriticalSectionFromISR _;
+        x = std::exchange(waiter, nullptr);
+        if (!x) pending = true;
+    }
+
+    if (x) executor->schedule_from_isr(*x);
+}
+
+}  // namespace nevermore
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "sdk/timer.hpp"
+#include "utility/coroutine.hpp"
+#include "utility/health.hpp"
+#include "utility/task.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+namespace nevermore {
+
+// Runs any number of coroutines on a single FreeRTOS task.
+// Coroutines are cooperative: they run until they `co_await` a delay/event, so anything
+// that blocks (busy waits, blocking I/O) holds up every other coroutine on the executor.
+struct Executor {
+    // Queue node for a suspended coroutine. Lives in the awaiter, so no allocation is needed.
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        std::chrono::microseconds wake_at{};
+        Waiter* next = nullptr;
+        bool queued = false;
+    };
+
+    struct Root;
+    using Job = Root*;
+
+    // Coroutines spawned & not yet finished, across every executor. Roots come from a fixed pool.
+    static constexpr size_t ROOTS_MAX = 32;
+
+    // A resumed coroutine must get back to the executor within this long, or it's considered stalled.
+    static constexpr auto STALL_TIMEOUT = 2s;
+
+    // Task is created on first `spawn`, so it is safe to define executors as globals.
+    Executor(char const* name, Priority priority, TaskMemory memory)
+            : name(name), priority(priority), memory(memory) {
+        heartbeat.name = name;
+        heartbeat.timeout = STALL_TIMEOUT;
+    }
+    Executor(Executor const&) = delete;
+    Executor& operator=(Executor const&) = delete;
+
+    // Returns null (& destroys the coroutine) if `ROOTS_MAX` are already running, or if it has no frame.
+    Job spawn(Coroutine<>);
+    // Destroys the job's coroutine before its next resumption. `job` must not have completed.
+    void cancel(Job job);
+
+    void schedule(Waiter&);           // make ready
+    void schedule_from_isr(Waiter&);  // make ready, from an ISR
+    void schedule_at(Waiter&);        // make ready once `time_64u() >= waiter.wake_at`
+    void unlink(Waiter&);             // remove from whichever queue it is in, if any
+
+private:
+    friend struct coroutine_detail::PromiseBase;
+
+    [[noreturn]] static void run(void* self);
+    void retire(std::coroutine_handle<>) noexcept;
+    Waiter* pop_ready(std::chrono::microseconds& wait);
+    void reap_cancelled();
+    void notify();
+    void notify_from_isr();
+
+    char const* name;
+    Priority priority;
+    TaskMemory memory;
+    Task task;
+    health::Heartbeat heartbeat;  // idle while sleeping, nothing being ready is fine
+
+    // guarded by the kernel critical section
+    Root* roots = nullptr;
+    Waiter* ready_head = nullptr;
+    Waiter* ready_tail = nullptr;
+    Waiter* sleeping = nullptr;  // sorted by `wake_at`
+};
+
+struct [[nodiscard]] DelayUntil {
+    std::chrono::microseconds wake_at;
+
+    DelayUntil(std::chrono::microseconds wake_at) : wake_at(wake_at) {}
+    DelayUntil(DelayUntil const&) = delete;
+    DelayUntil& operator=(DelayUntil const&) = delete;
+
+    ~DelayUntil() {
+        if (executor) executor->unlink(waiter);
+    }
+
+    [[nodiscard]] bool await_ready() const {
+        return wake_at <= time_64u();
+    }
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> caller) {
+        executor = caller.promise().executor;
+        waiter.handle = caller;
+        waiter.wake_at = wake_at;
+        executor->schedule_at(waiter);
+    }
+
+    void await_resume() const {}
+
+private:
+    Executor* executor = nullptr;
+    Executor::Waiter waiter;
+};
+
+// `wake_at` is in `time_64u` time
+inline DelayUntil delay_until(std::chrono::microseconds wake_at) {
+    return {wake_at};
+}
+
+template <typename A, typename Period>
+DelayUntil delay(std::chrono::duration<A, Period> duration) {
+    return {time_64u() + std::chrono::duration_cast<std::chrono::microseconds>(duration)};
+}
+
+// Auto-resetting event with (at most) a single waiting coroutine.
+// Setting an event that nobody is waiting on is remembered until the next wait.
+struct Event {
+    Event() = default;
+    Event(Event const&) = delete;
+    Event& operator=(Event const&) = delete;
+
+    void set();
+    void set_from_isr();
+
+    struct [[nodiscard]] Awaiter {
+        Awaiter(Event& event) : event(event) {}
+        Awaiter(Awaiter const&) = delete;
+        Awaiter& operator=(Awaiter const&) = delete;
+
+        ~Awaiter() {
+            if (executor) event.unpark(waiter, *executor);
+        }
+
+        bool await_ready() {
+            return event.consume();
+        }
+
+        template <typename P>
+        bool await_suspend(std::coroutine_handle<P> caller) {
+            executor = caller.promise().executor;
+            waiter.handle = caller;
+            return event.park(waiter, *executor);
+        }
+
+        void await_resume() const {}
+
+    private:
+        Event& event;  // NOLINT(cppcoreguidelines-avoid-const-or-ref-data-members)
+        Executor* executor = nullptr;
+        Executor::Waiter waiter{};
+    };
+
+    Awaiter operator co_await() {
+        return {*this};
+    }
+
+private:
+    bool consume();
+    bool park(Executor::Waiter&, Executor&);
+    void unpark(Executor::Waiter&, Executor&);
+
+    Executor::Waiter* waiter = nullptr;
+    Executor* executor = nullptr;
+    bool pending = false;
+};
+
+}  // namespace nevermore
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Fan fault detection, from how a fan's RPM answers the duty it's driven at.
+// * stall: a fan whose tachometer has been seen spinning reads 0 while driven well past its start-up duty.
+// * clog: a blocked intake/filter unloads the impeller, it spins faster than usual for its duty.
+//   "Usual" is learnt per duty band while the fan's healthy, so it follows the fan & filter as installed, and
+//   soaks up the slow drift of a filter loading up (that's `FilterLife`'s business). Not persisted, a fan
+//   that's already clogged at boot looks normal until it's cleared.
+// Fans w/o a tachometer always read 0 RPM, they're never seen spinning & never flagged.
+namespace nevermore {
+
+struct FanHealth {
+    enum class Fault : uint8_t {
+        None = 0,
+        Stall = 1,
+        Clog = 2,  // latched until the fan's next stopped, re-checked on its next run
+    };
+
+    // Below this duty a fan may legitimately sit still, nothing's judged.
+    static constexpr float DUTY_MIN = 0.2f;
+    // Seconds after starting (or changing duty band) before the RPM is expected to have settled.
+    static constexpr float SETTLE = 3;
+    // Seconds a fault must persist before it's raised (or a stall cleared).
+    static constexpr float CONFIRM = 2;
+    // Duty bands, each w/ its own RPM-per-duty baseline.
+    static constexpr size_t BANDS = 5;
+    // Seconds of healthy, settled running in a band before its baseline is trusted.
+    static constexpr float BASELINE_LEARNT = 60;
+    // Baseline EWMA time constant, in seconds.
+    static constexpr float BASELINE_WINDOW = 5 * 60;
+    // Clogged once RPM-per-duty exceeds the baseline by this fraction.
+    static constexpr float CLOG_EXCESS = 0.2f;
+
+    Fault fault = Fault::None;
+
+    std::array<float, BANDS> baseline{};  // RPM per unit duty
+    std::array<float, BANDS> learnt{};    // seconds, saturates at `BASELINE_LEARNT`
+    bool spinning_seen = false;
+    size_t band = BANDS;   // `BANDS` -> not running
+    float running = 0;     // seconds since duty last rose past `DUTY_MIN`
+    float steady = 0;      // seconds in `band`
+    Fault pending = Fault::None;
+    float pending_for = 0;  // seconds
+
+    // `duty` [0, 1] is what the fan's driven at, `rpm` what it's measured at right now.
+    // Returns the (possibly new) fault.
+    constexpr Fault operator()(float duty, uint32_t rpm, std::chrono::duration<float> dt_) {
+        if (0 < rpm) spinning_seen = true;
+
+        if (!(DUTY_MIN <= duty)) {
+            fault = pending = Fault::None;
+            band = BANDS;
+            running = steady = pending_for = 0;
+            return fault;
+        }
+
+        auto const dt = dt_.count();
+        if (!(0 < dt)) return fault;
+
+        auto const band_now = std::min(size_t(duty * BANDS), BANDS - 1);
+        steady = band_now == band ? steady + dt : 0;
+        band = band_now;
+        running += dt;
+        if (running < SETTLE) return fault;
+
+        auto sample = Fault::None;
+        if (rpm == 0) {
+            if (!spinning_seen) return fault;  // no tachometer (or never seen it work), can't tell
+            sample = Fault::Stall;
+        } else if (fault == Fault::Clog) {
+            return fault;
+        } else if (SETTLE <= steady) {
+            auto const per_duty = float(rpm) / duty;
+            auto& base = baseline.at(band);
+            auto& base_learnt = learnt.at(band);
+            if (BASELINE_LEARNT <= base_learnt && base * (1 + CLOG_EXCESS) < per_duty) {
+                sample = Fault::Clog;
+            } else {
+                base = base_learnt <= 0 ? per_duty : base + (per_duty - base) * dt / (BASELINE_WINDOW + dt);
+                base_learnt = std::min(base_learnt + dt, BASELINE_LEARNT);
+            }
+        }
+
+        pending_for = sample == pending ? pending_for + dt : dt;
+        pending = sample;
+        if (sample != fault && CONFIRM <= pending_for) fault = sample;
+        return fault;
+    }
+};
+
+namespace internal {
+
+constexpr std::chrono::duration<float> FAN_HEALTH_TICK{0.25f};
+
+// `seconds` of driving `x` at `duty`, reading `rpm`
+constexpr FanHealth::Fault fan_health_run(FanHealth& x, float duty, uint32_t rpm, float seconds) {
+    for (float t = 0; t < seconds; t += FAN_HEALTH_TICK.count())
+        x(duty, rpm, FAN_HEALTH_TICK);
+    return x.fault;
+}
+
+// no tachometer -> never a fault
+static_assert([] {
+    FanHealth x;
+    return fan_health_run(x, 1, 0, 60) == FanHealth::Fault::None;
+}());
+// low duty -> a still fan isn't a stall
+static_assert([] {
+    FanHealth x;
+    fan_health_run(x, 0.5f, 2000, 10);
+    return fan_health_run(x, 0.1f, 0, 60) == FanHealth::Fault::None;
+}());
+// stall raised within ~`CONFIRM`, cleared once it's spinning again
+static_assert([] {
+    FanHealth x;
+    fan_health_run(x, 0.5f, 2000, 10);
+    bool const early = fan_health_run(x, 0.5f, 0, 1.5f) == FanHealth::Fault::None;
+    bool const stalled = fan_health_run(x, 0.5f, 0, 1) == FanHealth::Fault::Stall;
+    return early && stalled && fan_health_run(x, 0.5f, 2000, 3) == FanHealth::Fault::None;
+}());
+// spinning up from a stop isn't a stall
+static_assert([] {
+    FanHealth x;
+    fan_health_run(x, 0.5f, 2000, 10);
+    x(0, 0, FAN_HEALTH_TICK);
+    return fan_health_run(x, 1, 0, FanHealth::SETTLE - 0.5f) == FanHealth::Fault::None;
+}());
+// clog once the baseline's learnt, latched until the fan stops
+static_assert([] {
+    FanHealth x;
+    bool const learning = fan_health_run(x, 0.8f, 4000, 30) == FanHealth::Fault::None &&
+                          fan_health_run(x, 0.8f, 5000, 10) == FanHealth::Fault::None;
+    fan_health_run(x, 0.8f, 4000, 120);
+    bool const clogged = fan_health_run(x, 0.8f, 5000, 3) == FanHealth::Fault::Clog;
+    bool const latched = fan_health_run(x, 0.8f, 4000, 10) == FanHealth::Fault::Clog;
+    x(0, 0, FAN_HEALTH_TICK);
+    return learning && clogged && latched && x.fault == FanHealth::Fault::None;
+}());
+// each band has its own baseline
+static_assert([] {
+    FanHealth x;
+    fan_health_run(x, 0.8f, 4000, 120);
+    return fan_health_run(x, 0.5f, 3200, 60) == FanHealth::Fault::None;
+}());
+
+}  // namespace internal
+
+}  // namespace nevermore
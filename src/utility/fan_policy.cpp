@@ -1,5 +1,6 @@
 #include "fan_policy.hpp"
 #include "sdk/ble_data_types.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <utility>
@@ -24,40 +25,171 @@ constexpr bool policy_voc_improving(VOCIndex voc_improve_min, VOCIndex intake, V
     return voc_improve_min <= voc_improvement;
 }
 
-constexpr bool should_filter(FanPolicyEnvironmental const& params, VOCIndex intake, VOCIndex exhaust) {
+// `slope` in index/s
+constexpr bool policy_voc_rising(
+        VOCIndex voc_passive_max, TimeSecond16 horizon, VOCIndex intake, float slope) {
+    if (intake == NOT_KNOWN || !(0 < slope)) return false;  // Need a reading, and it has to be getting worse.
+
+    return voc_passive_max <= intake.value_or(0) + slope * horizon.value_or(0);
+}
+
+constexpr bool should_filter(
+        FanPolicyEnvironmental const& params, VOCIndex intake, VOCIndex exhaust, float slope) {
     return policy_voc_too_high(params.voc_passive_max, intake, exhaust) ||
-           policy_voc_improving(params.voc_improve_min, intake, exhaust);
+           policy_voc_improving(params.voc_improve_min, intake, exhaust) ||
+           policy_voc_rising(params.voc_passive_max, params.voc_trend.horizon, intake, slope);
+}
+
+// Continuous-time EWMA of the slope. Sample rate independent: each update contributes ~`dVOC / window`,
+// however often we're called & however the reading's steps are spread across calls.
+constexpr void slope_update(
+        FanPolicyEnvironmental::Instance& instance, VOCIndex intake, chrono::system_clock::time_point now) {
+    if (intake == NOT_KNOWN) {
+        instance.voc_slope = 0;
+        instance.voc_slope_at = chrono::system_clock::time_point::min();
+        return;
+    }
+
+    auto const voc = float(intake.value_or(0));
+    if (instance.voc_slope_at == chrono::system_clock::time_point::min()) {
+        // first reading, no slope yet
+        instance.voc_slope_last = voc;
+        instance.voc_slope_at = now;
+        return;
+    }
+
+    auto const dt = chrono::duration<float>(now - instance.voc_slope_at).count();
+    if (!(0 < dt)) return;
+
+    auto const window = float(instance.params.voc_trend.window.value_or(0));
+    auto const alpha = dt / (window + dt);
+    auto const slope = (voc - instance.voc_slope_last) / dt;
+    instance.voc_slope += alpha * (slope - instance.voc_slope);
+    instance.voc_slope_last = voc;
+    instance.voc_slope_at = now;
 }
 
-enum class PolicyState { Idle, Filtering, Cooldown };
+using Hint = FanPolicyEnvironmental::Hint;
+
+enum class PolicyState { Idle, Filtering, PreSpin, Cooldown, Scrub };
 using enum PolicyState;
 
+constexpr bool pre_spin(FanPolicyEnvironmental::Instance const& instance) {
+    return instance.printing() && instance.print_material == Hint::Material::High &&
+           0 < instance.params.print.power;
+}
+
+// A filtered print's end is known -> its scrub replaces the fixed cooldown.
+constexpr chrono::system_clock::time_point cooldown_end(FanPolicyEnvironmental::Instance const& instance) {
+    auto const& params = instance.params;
+    if (instance.print_ended == chrono::system_clock::time_point::min())
+        return instance.last_filter + chrono::seconds(uint32_t(params.cooldown.value_or(0)));
+
+    return max(instance.last_filter, instance.print_ended) +
+           chrono::seconds(uint32_t(params.print.scrub.value_or(0)));
+}
+
 constexpr PolicyState evaluate(FanPolicyEnvironmental::Instance const& instance,
         nevermore::sensors::Sensors const& state, chrono::system_clock::time_point now) {
-    if (should_filter(instance.params, state.voc_index_intake, state.voc_index_exhaust)) return Filtering;
+    if (should_filter(instance.params, state.voc_index_intake, state.voc_index_exhaust, instance.voc_slope))
+        return Filtering;
+
+    if (pre_spin(instance)) return PreSpin;
 
-    auto cooldown_end =
-            instance.last_filter + chrono::seconds(uint32_t(instance.params.cooldown.value_or(0)));
-    if (now < cooldown_end) return Cooldown;
+    if (now < cooldown_end(instance))
+        return instance.print_ended == chrono::system_clock::time_point::min() ? Cooldown : Scrub;
 
     return Idle;
 }
 
+// Curve w/ hysteresis: rises immediately, falls only once the VOC has dropped `voc_hysteresis` below the
+// level the current power was set at.
+constexpr float power_curve(FanPolicyEnvironmental::Instance& instance, VOCIndex intake, VOCIndex exhaust) {
+    auto const voc = float(max(intake.value_or(0), exhaust.value_or(0)));
+    auto const hysteresis = max(0.f, instance.params.voc_hysteresis);
+    instance.voc_held = clamp(instance.voc_held, voc, voc + hysteresis);
+    return clamp(instance.params.curve(instance.voc_held), 0.f, 1.f);
+}
+
+constexpr float step(FanPolicyEnvironmental::Instance& instance, nevermore::sensors::Sensors const& state,
+        chrono::system_clock::time_point now) {
+    slope_update(instance, state.voc_index_intake, now);
+
+    float power = 0;
+    switch (evaluate(instance, state, now)) {
+    case Idle: {
+        instance.voc_held = 0;  // next run starts from the current readings, not whatever we last saw
+        instance.print_ended = chrono::system_clock::time_point::min();  // scrub's done
+        break;
+    }
+    case Filtering: instance.last_filter = now; [[fallthrough]];
+    case Cooldown: power = power_curve(instance, state.voc_index_intake, state.voc_index_exhaust); break;
+    case PreSpin:
+    case Scrub: {
+        auto const floor = float(instance.params.print.power.value_or(0) / 100);
+        power = max(power_curve(instance, state.voc_index_intake, state.voc_index_exhaust), floor);
+        break;
+    }
+    }
+
+    // kick a stopped fan, low duties might not get it turning
+    if (0 < power && instance.power_last <= 0) instance.spin_up_end = now + instance.params.spin_up_time;
+    instance.power_last = power;
+
+    if (0 < power && now < instance.spin_up_end) return max(power, instance.params.spin_up_power);
+    return power;
+}
+
+constexpr chrono::system_clock::time_point deadline(
+        FanPolicyEnvironmental::Instance const& instance, chrono::system_clock::time_point now) {
+    auto next = chrono::system_clock::time_point::max();
+    if (instance.power_last <= 0) return next;  // idle, stays that way until the sensors say otherwise
+
+    for (auto const at : {cooldown_end(instance), instance.spin_up_end})
+        if (now < at) next = min(next, at);
+
+    return next;
+}
+
+constexpr void hint(FanPolicyEnvironmental::Instance& instance, Hint const& hint,
+        chrono::system_clock::time_point now) {
+    switch (hint.event) {
+    case Hint::Event::PrintStarted: {
+        instance.print_started = now;
+        instance.print_ended = chrono::system_clock::time_point::min();  // a new print supersedes a scrub
+        instance.print_material = hint.material;
+        break;
+    }
+    case Hint::Event::PrintEnded: {
+        if (!instance.printing()) break;
+
+        // only scrub after a print that was filtered, a clean print leaves the fan off
+        if (pre_spin(instance) || instance.print_started <= instance.last_filter) instance.print_ended = now;
+        instance.print_started = chrono::system_clock::time_point::min();
+        instance.print_material = Hint::Material::Unknown;
+        break;
+    }
+    case Hint::Event::Material: {
+        if (instance.printing()) instance.print_material = hint.material;
+        break;
+    }
+    }
+}
+
 }  // namespace
 
 float FanPolicyEnvironmental::Instance::operator()(
         nevermore::sensors::Sensors const& state, chrono::system_clock::time_point now) {
-    switch (evaluate(*this, state, now)) {
-    case Idle: return 0;
-    case Cooldown: return 1;
-    case Filtering: {
-        last_filter = now;
-        return 1;
-    }
-    }
+    return step(*this, state, now);
+}
 
-    // Annoying. GCC's case analysis fails to detect that switch is total.
-    std::unreachable();
+void FanPolicyEnvironmental::Instance::hint(Hint const& x, chrono::system_clock::time_point now) {
+    nevermore::hint(*this, x, now);
+}
+
+chrono::system_clock::time_point FanPolicyEnvironmental::Instance::deadline(
+        chrono::system_clock::time_point now) const {
+    return nevermore::deadline(*this, now);
 }
 
 // Policy Tests
@@ -81,4 +213,179 @@ static_assert(!policy_voc_improving(2, NOT_KNOWN, 1));          // basic case -
 static_assert(!policy_voc_improving(NOT_KNOWN, 3, 1));          // disabled
 static_assert(!policy_voc_improving(2, NOT_KNOWN, NOT_KNOWN));  // sensors not connected
 
+// VOC-trending-towards-limits case
+static_assert(policy_voc_rising(100, 60, 70, .5f));         // barely
+static_assert(!policy_voc_rising(100, 60, 70, .4f));        // not fast enough
+static_assert(!policy_voc_rising(100, 60, 150, -1));        // falling (too high is someone else's job)
+static_assert(!policy_voc_rising(100, 0, 70, 10));          // disabled
+static_assert(!policy_voc_rising(NOT_KNOWN, 60, 70, 10));   // disabled
+static_assert(!policy_voc_rising(100, 60, NOT_KNOWN, 10));  // sensor not connected
+
+// Power Curve Tests
+
+namespace {
+
+using Curve = FanPolicyEnvironmental::Curve;
+
+constexpr Curve CURVE_TEST{{{
+        {.voc = 100, .power = 20},
+        {.voc = 200, .power = 60},
+        {.voc = NOT_KNOWN, .power = 0},
+        {.voc = NOT_KNOWN, .power = 0},
+}}};
+
+constexpr bool near(float a, float b) {
+    return abs(a - b) < 1e-4f;
+}
+
+constexpr chrono::system_clock::time_point at(chrono::system_clock::duration t) {
+    return chrono::system_clock::time_point{t};
+}
+
+constexpr nevermore::sensors::Sensors voc(VOCIndex intake, VOCIndex exhaust = NOT_KNOWN) {
+    nevermore::sensors::Sensors state;
+    state.voc_index_intake = intake;
+    state.voc_index_exhaust = exhaust;
+    return state;
+}
+
+}  // namespace
+
+static_assert(FanPolicyEnvironmental{}.curve.valid());
+static_assert(CURVE_TEST.valid());
+static_assert(CURVE_TEST.size() == 2);
+static_assert(near(CURVE_TEST(50), .2f));   // clamped below the first point
+static_assert(near(CURVE_TEST(150), .4f));  // interpolated
+static_assert(near(CURVE_TEST(500), .6f));  // clamped above the last point
+static_assert(Curve{}(1) == 1);             // empty -> full power
+
+// Malformed curves
+static_assert(!Curve{{{{.voc = 200, .power = 20}, {.voc = 100, .power = 60}}}}.valid());  // decreasing
+static_assert(!Curve{{{{.voc = 100, .power = 20}, {.voc = 100, .power = 60}}}}.valid());  // repeated
+static_assert(!Curve{{{{.voc = NOT_KNOWN}, {.voc = 100, .power = 60}}}}.valid());         // gap
+static_assert(!Curve{{{{.voc = 100, .power = NOT_KNOWN}}}}.valid());                      // no power
+
+// Spin-up kick from stopped, then settle to the curve.
+static_assert([] {
+    FanPolicyEnvironmental params{.voc_passive_max = 100, .curve = CURVE_TEST};
+    auto instance = params.instance();
+    return step(instance, voc(150), at(0s)) == 1 && step(instance, voc(150), at(1s)) == 1 &&
+           near(step(instance, voc(150), at(2s)), .4f);
+}());
+
+// Hysteresis: holds power through a small dip, drops once the dip is deep enough.
+static_assert([] {
+    FanPolicyEnvironmental params{.voc_passive_max = 100, .curve = CURVE_TEST, .spin_up_time = 0s};
+    auto instance = params.instance();
+    return near(step(instance, voc(150), at(0s)), .4f) && near(step(instance, voc(145), at(1s)), .4f) &&
+           near(step(instance, voc(130), at(2s)), .36f);
+}());
+
+// Cooldown runs at the curve's floor, then stops.
+static_assert([] {
+    FanPolicyEnvironmental params{
+            .cooldown = 10, .voc_passive_max = 100, .curve = CURVE_TEST, .spin_up_time = 0s};
+    auto instance = params.instance();
+    return near(step(instance, voc(150), at(0s)), .4f) && near(step(instance, voc(50), at(5s)), .2f) &&
+           step(instance, voc(50), at(11s)) == 0;
+}());
+
+// A single full power point reproduces plain on/off.
+static_assert([] {
+    FanPolicyEnvironmental params{.cooldown = 0,
+            .voc_passive_max = 100,
+            .curve = {{{{.voc = 1, .power = 100}}}}};
+    auto instance = params.instance();
+    return step(instance, voc(50), at(0s)) == 0 && step(instance, voc(150), at(1s)) == 1 &&
+           step(instance, voc(50), at(2s)) == 0;
+}());
+
+// Trend Tests
+
+// A steady ramp starts filtering well before the threshold is reached.
+static_assert([] {
+    FanPolicyEnvironmental params{.voc_passive_max = 200, .voc_trend = {.window = 10, .horizon = 60}};
+    auto instance = params.instance();
+    // +1/s, sampled at 10 Hz but only changing once per second
+    for (int i = 0; i < 100 * 10; ++i)
+        if (0 < step(instance, voc(100 + i / 10), at(i * 100ms))) return 100 + i / 10 < 150;
+    return false;
+}());
+
+// A steady reading (or one w/o an intake sensor) never triggers.
+static_assert([] {
+    FanPolicyEnvironmental params{.voc_passive_max = 200};
+    auto instance = params.instance();
+    for (int i = 0; i <= 100; ++i)
+        if (0 < step(instance, voc(150), at(i * 1s)) || 0 < step(instance, voc(NOT_KNOWN, 150), at(i * 1s)))
+            return false;
+    return instance.voc_slope == 0;
+}());
+
+// Print Hint Tests
+
+namespace {
+
+constexpr Hint PRINT_HIGH{.event = Hint::Event::PrintStarted, .material = Hint::Material::High};
+constexpr Hint PRINT_LOW{.event = Hint::Event::PrintStarted, .material = Hint::Material::Low};
+constexpr Hint PRINT_ENDED{.event = Hint::Event::PrintEnded};
+
+}  // namespace
+
+static_assert(PRINT_HIGH.valid() && PRINT_ENDED.valid());
+static_assert(!Hint{.event = Hint::Event(0)}.valid());
+static_assert(!Hint{.event = Hint::Event::Material, .material = Hint::Material(3)}.valid());
+static_assert(FanPolicyEnvironmental::Print{}.valid());
+
+// A high VOC print pre-spins at the print floor, then scrubs for `scrub` after it ends.
+static_assert([] {
+    FanPolicyEnvironmental params{.cooldown = 100,
+            .voc_passive_max = 100,
+            .curve = CURVE_TEST,
+            .spin_up_time = 0s,
+            .print = {.power = 50, .scrub = 10}};
+    auto instance = params.instance();
+    if (step(instance, voc(50), at(0s)) != 0) return false;
+    hint(instance, PRINT_HIGH, at(1s));
+    if (!near(step(instance, voc(50), at(1s)), .5f)) return false;
+    hint(instance, PRINT_ENDED, at(20s));
+    return near(step(instance, voc(50), at(25s)), .5f) && deadline(instance, at(25s)) == at(30s) &&
+           step(instance, voc(50), at(30s)) == 0;
+}());
+
+// A clean low VOC print never spins the fan, not even after it ends.
+static_assert([] {
+    FanPolicyEnvironmental params{.voc_passive_max = 100, .curve = CURVE_TEST};
+    auto instance = params.instance();
+    hint(instance, PRINT_LOW, at(0s));
+    if (step(instance, voc(50), at(1s)) != 0) return false;
+    hint(instance, PRINT_ENDED, at(2s));
+    return step(instance, voc(50), at(3s)) == 0;
+}());
+
+// A print the VOCs filtered swaps the fixed cooldown for the scrub, counted from the last trigger.
+static_assert([] {
+    FanPolicyEnvironmental params{.cooldown = 100,
+            .voc_passive_max = 100,
+            .curve = CURVE_TEST,
+            .spin_up_time = 0s,
+            .print = {.power = 0, .scrub = 10}};
+    auto instance = params.instance();
+    hint(instance, PRINT_LOW, at(0s));
+    if (!near(step(instance, voc(150), at(5s)), .4f)) return false;
+    hint(instance, PRINT_ENDED, at(6s));
+    return near(step(instance, voc(50), at(15s)), .2f) && step(instance, voc(50), at(16s)) == 0;
+}());
+
+// Deadline Tests
+
+// Idle has nothing pending, running wakes for the end of the spin-up, then the end of the cooldown.
+static_assert([] {
+    FanPolicyEnvironmental params{.cooldown = 10, .voc_passive_max = 100, .curve = CURVE_TEST};
+    auto instance = params.instance();
+    if (step(instance, voc(50), at(0s)) != 0 || deadline(instance, at(0s)) != at(0s).max()) return false;
+    if (step(instance, voc(150), at(1s)) == 0 || deadline(instance, at(1s)) != at(3s)) return false;
+    return step(instance, voc(50), at(3s)) != 0 && deadline(instance, at(3s)) == at(11s);
+}());
+
 }  // namespace nevermore
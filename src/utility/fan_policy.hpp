@@ -1,6 +1,7 @@
 #pragma once
 
 #include "sensors.hpp"
+#include <array>
 #include <chrono>
 
 namespace nevermore {
@@ -10,19 +11,170 @@ using namespace std::literals::chrono_literals;
 struct FanPolicyEnvironmental {
     using VOCIndex = nevermore::sensors::VOCIndex;
 
+    // Fan power while filtering/cooling down, by VOC index (max of intake & exhaust).
+    // Linearly interpolated between points, clamped to the first/last point's power outside of them.
+    // Requirements:
+    // * Must be tightly laid out, sent as-is by the fan policy service's curve characteristic.
+    struct Curve {
+        struct [[gnu::packed]] Point {
+            VOCIndex voc;  // `NOT_KNOWN` -> unused, must come after all used points
+            BLE::Percentage8 power;
+        };
+
+        static constexpr size_t POINTS_MAX = 4;
+        std::array<Point, POINTS_MAX> points;
+
+        // Returns fan power [0, 1].
+        [[nodiscard]] constexpr float operator()(float voc) const {
+            auto const n = size();
+            if (n == 0) return 1;
+
+            auto power = [&](size_t i) { return float(points[i].power.value_or(100) / 100); };
+            auto voc_at = [&](size_t i) { return float(points[i].voc.value_or(0)); };
+            if (voc <= voc_at(0)) return power(0);
+
+            for (size_t i = 1; i < n; ++i) {
+                if (voc_at(i) <= voc) continue;
+
+                auto const t = (voc - voc_at(i - 1)) / (voc_at(i) - voc_at(i - 1));
+                return power(i - 1) + t * (power(i) - power(i - 1));
+            }
+
+            return power(n - 1);
+        }
+
+        // # of used points
+        [[nodiscard]] constexpr size_t size() const {
+            size_t n = 0;
+            while (n < points.size() && points[n].voc != BLE::NOT_KNOWN)
+                ++n;
+            return n;
+        }
+
+        // Strictly increasing VOC, powers in [0, 100], unused points only trailing.
+        [[nodiscard]] constexpr bool valid() const {
+            auto const n = size();
+            for (size_t i = 0; i < points.size(); ++i) {
+                if (n <= i) {
+                    if (points[i].voc != BLE::NOT_KNOWN) return false;
+                    continue;
+                }
+
+                if (!(0 <= points[i].power && points[i].power <= 100)) return false;
+                if (0 < i && !(points[i - 1].voc < points[i].voc)) return false;
+            }
+            return true;
+        }
+    };
+    static_assert(sizeof(Curve) == sizeof(Curve::Point) * Curve::POINTS_MAX);
+
+    // Predictive trigger: filter early if the intake VOC's recent slope says it'll reach `voc_passive_max`
+    // within `horizon`. Catches a print starting to off-gas well before the intake is actually dirty.
+    // Requirements:
+    // * Must be packed, sent as-is by the fan policy service's trend characteristic.
+    struct [[gnu::packed]] Trend {
+        BLE::TimeSecond16 window = 30;   // slope EWMA time constant
+        BLE::TimeSecond16 horizon = 60;  // 0 -> disabled
+
+        [[nodiscard]] constexpr bool valid() const {
+            return window != BLE::NOT_KNOWN;
+        }
+    };
+
+    // Host's print lifecycle hints, lets filtering start ahead of a print's VOCs & end with the print.
+    // Requirements:
+    // * Must be packed, sent as-is to the fan policy service's print hint characteristic.
+    struct [[gnu::packed]] Hint {
+        enum class Event : uint8_t {
+            PrintStarted = 1,
+            PrintEnded = 2,
+            Material = 3,  // the running print's material changed (e.g. a tool change)
+        };
+
+        // How much a material off-gasses, as the host classifies it.
+        enum class Material : uint8_t {
+            Unknown = 0,
+            Low = 1,   // e.g. PLA, PETG
+            High = 2,  // e.g. ABS, ASA, PC, nylon
+        };
+
+        Event event;
+        Material material = Material::Unknown;  // ignored by `PrintEnded`
+
+        [[nodiscard]] constexpr bool valid() const {
+            return Event::PrintStarted <= event && event <= Event::Material && material <= Material::High;
+        }
+    };
+
+    // What to do w/ the hints.
+    // Requirements:
+    // * Must be packed, sent as-is by the fan policy service's print characteristic.
+    struct [[gnu::packed]] Print {
+        // Floor while printing a `High` material & while scrubbing, even if the VOCs don't call for it yet.
+        // 0 -> no pre-spin (hints then only replace the cooldown).
+        BLE::Percentage8 power = 30;
+        // Once a print that was filtered ends, keep filtering this long instead of `cooldown`. Counted from
+        // the end of the print, or the last time the VOCs called for filtering if that's later.
+        BLE::TimeSecond16 scrub = 60 * 10;
+
+        [[nodiscard]] constexpr bool valid() const {
+            return 0 <= power && power <= 100 && scrub != BLE::NOT_KNOWN;
+        }
+    };
+
     // How long to keep spinning after `should_filter` returns `false`
     BLE::TimeSecond16 cooldown = 60 * 15;
     VOCIndex voc_passive_max = 125;  // <= max(intake, exhaust)  -> filthy in here; get scrubbin'
     VOCIndex voc_improve_min = 5;    // <= (intake - exhaust)    -> things are improving, keep filtering
+    // Quiet by default: barely ticking over just past `voc_passive_max`, full power only when it's awful.
+    Curve curve{{{
+            {.voc = 125, .power = 30},
+            {.voc = 250, .power = 60},
+            {.voc = 400, .power = 100},
+            {.voc = BLE::NOT_KNOWN, .power = 0},
+    }}};
+    Trend voc_trend;
+    // VOC must fall this far below the level that set the current power before the power drops.
+    // Stops the fan hunting on a noisy sensor sitting right at a curve point.
+    float voc_hysteresis = 10;
+    // Low duties may not overcome a stopped fan's stiction. Starting from stopped, run at (at least)
+    // `spin_up_power` for `spin_up_time`, then settle to the curve.
+    float spin_up_power = 1;
+    std::chrono::system_clock::duration spin_up_time = 2s;
+    Print print;
 
     struct Instance {
         FanPolicyEnvironmental const& params;  // NOLINT(cppcoreguidelines-avoid-const-or-ref-data-members)
         std::chrono::system_clock::time_point last_filter = std::chrono::system_clock::time_point::min();
+        std::chrono::system_clock::time_point spin_up_end = std::chrono::system_clock::time_point::min();
+        float voc_held = 0;  // VOC after hysteresis
+        float power_last = 0;
+        // intake VOC slope [index/s], EWMA over `voc_trend.window`
+        float voc_slope = 0;
+        float voc_slope_last = 0;  // intake VOC at the last slope update
+        std::chrono::system_clock::time_point voc_slope_at = std::chrono::system_clock::time_point::min();
+        // `min()` -> not printing (as far as the host has told us)
+        std::chrono::system_clock::time_point print_started = std::chrono::system_clock::time_point::min();
+        // `min()` -> no scrub pending, else when the last filtered print ended
+        std::chrono::system_clock::time_point print_ended = std::chrono::system_clock::time_point::min();
+        Hint::Material print_material = Hint::Material::Unknown;
 
         // Stateful.
         // Returns fan power [0, 1] based on env state and policy parameters.
         [[nodiscard]] float operator()(nevermore::sensors::Sensors const& state,
                 std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+
+        // Applies a (valid) hint. Stateful, takes effect from the next call.
+        void hint(Hint const&, std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+
+        [[nodiscard]] constexpr bool printing() const {
+            return print_started != std::chrono::system_clock::time_point::min();
+        }
+
+        // Earliest time after `now` the result could change w/o the sensors changing (cooldown or spin-up
+        // ending). `time_point::max()` -> nothing pending, only a sensor update can change the result.
+        [[nodiscard]] std::chrono::system_clock::time_point deadline(
+                std::chrono::system_clock::time_point now) const;
     };
 
     // NB: DANGER - `this` must outlive `instance`
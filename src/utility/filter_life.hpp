@@ -0,0 +1,134 @@
+#pragma once
+
+#include "sensors.hpp"
+#include "utility/wire.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// Carbon filter saturation estimate.
+// Activated carbon only holds so much. Two signs it's spent, whichever comes first counts:
+// * load: what it's taken out of the air so far (fan duty x how far the exhaust is below the intake, over
+//   time), against a nominal capacity.
+// * efficiency: how much of the intake's excess over clean air it removes in a pass. Sags as it fills.
+// Both are rough (the nominal capacity especially). Meant to flag a filter that's plausibly spent, not to be
+// a lab measurement.
+namespace nevermore {
+
+struct FilterLife {
+    using VOCIndex = nevermore::sensors::VOCIndex;
+
+    // What the gas index algorithm settles at in clean air, efficiency is measured against it.
+    static constexpr float VOC_CLEAN = 100;
+    // Intake must be this far above clean for an efficiency sample, closer in it's mostly sensor noise.
+    static constexpr float VOC_EXCESS_MIN = 50;
+    // Efficiency EWMA time constant, in seconds of filtering at full duty (lower duties count for less).
+    static constexpr float EFFICIENCY_WINDOW = 30 * 60;
+    // The efficiency once this much of the capacity is used is taken as the fresh filter's.
+    // Gives the EWMA time to settle, while still being well before the carbon saturates.
+    static constexpr float EFFICIENCY_FRESH_AT = 0.02f;
+    // Spent once efficiency falls to this fraction of the fresh filter's.
+    static constexpr float EFFICIENCY_SPENT = 0.5f;
+    // VOC index x seconds at full duty. ~300h of a print holding the exhaust 100 below the intake.
+    static constexpr uint32_t CAPACITY_DEFAULT = 100 * 60 * 60 * 300;
+
+    // Requirements:
+    // * Must be tightly laid out, persisted as-is.
+    struct State {
+        uint32_t capacity = CAPACITY_DEFAULT;  // `0 < capacity`
+        uint32_t load = 0;                     // same units as `capacity`
+        float efficiency = -1;                 // [0, 1], < 0 -> no samples yet
+        float efficiency_fresh = -1;           // [0, 1], < 0 -> not established yet
+
+        [[nodiscard]] constexpr bool valid() const {
+            return 0 < capacity && efficiency <= 1 && efficiency_fresh <= 1;
+        }
+    };
+    static_assert(wire::tight<State>({WIRE_FIELD(State, capacity), WIRE_FIELD(State, load),
+            WIRE_FIELD(State, efficiency), WIRE_FIELD(State, efficiency_fresh)}));
+
+    State state;
+    float load_carry = 0;  // sub-unit remainder of `load`, not worth persisting
+
+    // `duty` [0, 1] is the mean fan duty over the `dt` leading up to the sample.
+    constexpr void operator()(
+            float duty, VOCIndex intake, VOCIndex exhaust, std::chrono::duration<float> dt) {
+        if (!(0 < duty) || !(0 < dt.count())) return;
+        if (intake == BLE::NOT_KNOWN || exhaust == BLE::NOT_KNOWN) return;
+
+        auto const voc_intake = float(intake.value_or(0));
+        auto const removed = std::max(voc_intake - float(exhaust.value_or(0)), 0.f);
+        auto const duty_time = duty * dt.count();
+
+        load_carry += removed * duty_time;
+        auto const whole = uint32_t(load_carry);
+        load_carry -= float(whole);
+        state.load = UINT32_MAX - state.load < whole ? UINT32_MAX : state.load + whole;
+
+        auto const excess = voc_intake - VOC_CLEAN;
+        if (excess < VOC_EXCESS_MIN) return;
+
+        auto const sample = std::clamp(removed / excess, 0.f, 1.f);
+        if (state.efficiency < 0)
+            state.efficiency = sample;
+        else
+            state.efficiency += (sample - state.efficiency) * duty_time / (EFFICIENCY_WINDOW + duty_time);
+
+        if (state.efficiency_fresh < 0 && EFFICIENCY_FRESH_AT <= used())
+            state.efficiency_fresh = state.efficiency;
+    }
+
+    // Fraction of `capacity` taken up, [0, 1]
+    [[nodiscard]] constexpr float used() const {
+        return std::min(float(state.load) / float(state.capacity), 1.f);
+    }
+
+    // Fraction of the filter's life left, [0, 1]
+    [[nodiscard]] constexpr float remaining() const {
+        auto const by_load = 1 - used();
+        if (state.efficiency_fresh <= 0 || state.efficiency < 0) return by_load;
+
+        auto const relative = state.efficiency / state.efficiency_fresh;
+        auto const by_efficiency = (relative - EFFICIENCY_SPENT) / (1 - EFFICIENCY_SPENT);
+        return std::clamp(std::min(by_load, by_efficiency), 0.f, 1.f);
+    }
+};
+
+namespace internal {
+
+// nothing removed while the fan is off, or w/o both sensors
+static_assert([] {
+    FilterLife x;
+    x(0, 300, 100, std::chrono::seconds(60));
+    x(1, 300, BLE::NOT_KNOWN, std::chrono::seconds(60));
+    return x.state.load == 0 && x.state.efficiency < 0 && x.remaining() == 1;
+}());
+// load integrates duty x removed x time, sub-unit amounts carry over
+static_assert([] {
+    FilterLife x;
+    for (int i = 0; i < 4; ++i)
+        x(0.5f, 101, 100, std::chrono::duration<float>(0.5f));
+    x(1, 300, 200, std::chrono::seconds(10));
+    return x.state.load == 1001 && x.load_carry == 0 && x.state.efficiency == 0.5f;
+}());
+// runs out by load
+static_assert([] {
+    FilterLife x{.state = {.capacity = 1000}};
+    x(1, 150, 140, std::chrono::seconds(75));
+    return x.remaining() == 0.25f;
+}());
+// runs out by efficiency long before the load says so
+static_assert([] {
+    FilterLife x{.state = {.capacity = 10'000'000}};
+    for (int i = 0; i < 60 * 60; ++i)
+        x(1, 300, 120, std::chrono::seconds(1));  // 90 %
+    bool const fresh = x.state.efficiency_fresh == 0.9f && 0.9f < x.remaining();
+
+    for (int i = 0; i < 4 * 60 * 60; ++i)
+        x(1, 300, 228, std::chrono::seconds(1));  // 36 %, < half of fresh
+    return fresh && x.remaining() == 0 && x.used() < 0.5f;
+}());
+
+}  // namespace internal
+
+}  // namespace nevermore
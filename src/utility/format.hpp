@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// Integer only number formatting, for text that's refreshed constantly (e.g. the UI's labels).
+// `printf("%.1f")` on an FPU-less core means soft-float doubles & all of newlib's float printf.
+namespace nevermore {
+
+// Writes `raw * 10^exponent` w/ `decimals` digits after the point (rounded half away from zero) & `suffix`.
+// Always NUL terminated, truncated to fit `out`. Returns # of chars written, w/o the NUL.
+constexpr size_t format_fixed(
+        std::span<char> out, int32_t raw, int exponent, uint8_t decimals, std::string_view suffix = {}) {
+    if (out.empty()) return 0;
+
+    // magnitude in units of `10^-decimals`
+    uint32_t mag = raw < 0 ? 0u - uint32_t(raw) : uint32_t(raw);
+    auto shift = exponent + int(decimals);
+    for (; 0 < shift; --shift)
+        mag *= 10;
+    if (shift < 0) {
+        uint32_t div = 1;
+        for (; shift < 0; ++shift)
+            div *= 10;
+        mag = mag / div + (div / 2 <= mag % div ? 1 : 0);
+    }
+
+    std::array<char, 12> digits{};  // least significant first, enough for `UINT32_MAX`
+    size_t n = 0;
+    bool const negative = raw < 0 && mag != 0;  // no "-0.0"
+    do {
+        digits.at(n++) = char('0' + mag % 10);
+        mag /= 10;
+    } while ((mag || n <= decimals) && n < digits.size());
+
+    size_t o = 0;
+    auto put = [&](char c) {
+        if (o + 1 < out.size()) out[o++] = c;
+    };
+
+    if (negative) put('-');
+    for (size_t i = n; 0 < i--;) {
+        put(digits.at(i));
+        if (i == decimals && decimals != 0) put('.');
+    }
+    for (auto c : suffix)
+        put(c);
+
+    out[o] = '\0';
+    return o;
+}
+
+// A BLE scalar in units of `10^unit_exp10` (e.g. 3 for kPa from a `Pressure`).
+template <typename A>
+    requires(A::M == 1 && A::b == 0)
+constexpr size_t format_scalar(
+        std::span<char> out, A x, uint8_t decimals, std::string_view suffix = {}, int unit_exp10 = 0) {
+    return format_fixed(out, int32_t(x.raw_value), A::d - unit_exp10, decimals, suffix);
+}
+
+namespace internal {
+
+template <size_t N = 16>
+constexpr bool formats(std::string_view expected, int32_t raw, int exponent, uint8_t decimals,
+        std::string_view suffix = {}) {
+    std::array<char, N> buffer{};
+    auto const n = format_fixed(buffer, raw, exponent, decimals, suffix);
+    return n == expected.size() && std::string_view{buffer.data(), n} == expected;
+}
+
+static_assert(formats("0", 0, 0, 0));
+static_assert(formats("21.5c", 2150, -2, 1, "c"));
+static_assert(formats("21.6", 2155, -2, 1));  // half away from zero
+static_assert(formats("-3.2", -315, -2, 1));
+static_assert(formats("0.0", -4, -2, 1));  // no negative zero
+static_assert(formats("0.05", 5, -2, 2));
+static_assert(formats("101.3 kPa", 1013250, -4, 1, " kPa"));  // 0.1 Pa -> kPa
+static_assert(formats("120", 12, 1, 0));
+static_assert(formats("-2147483648", INT32_MIN, 0, 0));
+static_assert(formats<4>("123", 12345, 0, 0));  // truncated to fit
+
+}  // namespace internal
+
+}  // namespace nevermore
@@ -0,0 +1,127 @@
+#include "health.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "hardware/structs/watchdog.h"
+#include "hardware/timer.h"
+#include "hardware/watchdog.h"
+#include "task.h"    // IWYU pragma: keep
+#include "utility/timer.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+namespace nevermore::health {
+
+namespace {
+
+constexpr auto SUPERVISE_PERIOD = 100ms;
+// Reset this long after the last feed. Long enough for a stall's log line to make it out over USB.
+constexpr auto WATCHDOG_TIMEOUT = 1s;
+constexpr size_t HEARTBEATS_MAX = 8;
+
+// Scratch 0-3 survive a watchdog reset & are ours (4-7 belong to the bootrom).
+// [0] = magic, [1, 3] = the stalled heartbeat's name (truncated, NUL padded).
+constexpr uint32_t SCRATCH_STALL_MAGIC = 0x5354'4C4C;  // "STLL"
+constexpr size_t SCRATCH_NAME_LENGTH = 3 * sizeof(uint32_t);
+
+// Append only, entries are immutable once `g_hearts_count` covers them.
+array<Heartbeat*, HEARTBEATS_MAX> g_hearts{};
+atomic<size_t> g_hearts_count = 0;
+
+bool g_stalled = false;  // latched, only touched by the timer task
+
+void stall_record(char const* name) {
+    array<char, SCRATCH_NAME_LENGTH> buffer{};
+    strncpy(buffer.data(), name ? name : "?", buffer.size());
+
+    for (size_t i = 0; i < 3; ++i) {
+        uint32_t x = 0;
+        memcpy(&x, buffer.data() + i * sizeof(x), sizeof(x));
+        watchdog_hw->scratch[1 + i] = x;
+    }
+    watchdog_hw->scratch[0] = SCRATCH_STALL_MAGIC;
+}
+
+void stall_report() {
+    if (watchdog_hw->scratch[0] != SCRATCH_STALL_MAGIC) {
+        if (watchdog_enable_caused_reboot()) printf("WARN - health - watchdog reset (timer task stalled?)\n");
+        return;
+    }
+
+    array<char, SCRATCH_NAME_LENGTH + 1> name{};
+    for (size_t i = 0; i < 3; ++i) {
+        uint32_t const x = watchdog_hw->scratch[1 + i];
+        memcpy(name.data() + i * sizeof(x), &x, sizeof(x));
+    }
+    watchdog_hw->scratch[0] = 0;
+
+    printf("WARN - health - watchdog reset, `%s` had stalled\n", name.data());
+}
+
+// A stall is latched, the controller is reset even if the task comes back before the watchdog fires.
+void supervise() {
+    if (g_stalled) return;
+
+    auto const now = time_us_32();
+    auto const n = g_hearts_count.load(memory_order_acquire);
+    for (size_t i = 0; i < n; ++i) {
+        auto const& heart = *g_hearts.at(i);
+        if (heart.waiting.load(memory_order_acquire)) continue;
+
+        auto const since = now - heart.beat_at_us.load(memory_order_relaxed);
+        if (since <= uint32_t(chrono::microseconds(heart.timeout).count())) continue;
+
+        printf("ERR - health - `%s` hasn't checked in for %u ms, resetting\n", heart.name,
+                unsigned(since / 1000));
+        stall_record(heart.name);
+        g_stalled = true;
+        return;
+    }
+
+    watchdog_update();
+}
+
+}  // namespace
+
+void Heartbeat::beat() {
+    beat_at_us.store(time_us_32(), memory_order_relaxed);
+    waiting.store(false, memory_order_release);
+}
+
+void Heartbeat::idle() {
+    waiting.store(true, memory_order_release);
+}
+
+void monitor(Heartbeat& heart) {
+    heart.beat();
+
+    taskENTER_CRITICAL();
+    auto const n = g_hearts_count.load(memory_order_relaxed);
+    bool const full = g_hearts.size() <= n;
+    if (!full) {
+        g_hearts.at(n) = &heart;
+        g_hearts_count.store(n + 1, memory_order_release);
+    }
+    taskEXIT_CRITICAL();
+
+    if (full)
+        printf("WARN - health - more than %u heartbeats, `%s` isn't monitored\n", unsigned(HEARTBEATS_MAX),
+                heart.name);
+}
+
+bool init() {
+    stall_report();
+
+    if (!mk_periodic("health", SUPERVISE_PERIOD)(supervise)) {
+        printf("ERR - health - failed to create supervisor timer\n");
+        return false;
+    }
+
+    // paused while a debugger has the cores halted
+    watchdog_enable(uint32_t(chrono::milliseconds(WATCHDOG_TIMEOUT).count()), true);
+    return true;
+}
+
+}  // namespace nevermore::health
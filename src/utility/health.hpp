@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Task health monitor. The hardware watchdog is only fed while every monitored task is alive, so a wedged
+// task (deadlock, a bus transaction that never completes) reboots the controller instead of leaving it
+// silently half working. The supervisor runs on the timer task, if that stalls the watchdog isn't fed either.
+namespace nevermore::health {
+
+using namespace std::literals::chrono_literals;
+
+// A task's pulse. A monitored task must `beat` at least every `timeout` while it's working, & go `idle`
+// before blocking on something that may legitimately never come (e.g. a work queue w/o any producers).
+// Only the owning task may `beat`/`idle`.
+struct Heartbeat {
+    char const* name = nullptr;
+    std::chrono::milliseconds timeout = 1s;
+
+    // written by the owning task, read by the supervisor
+    std::atomic<uint32_t> beat_at_us = 0;
+    std::atomic<bool> waiting = false;
+
+    void beat();
+    void idle();
+};
+
+// Starts monitoring `heart`, which must live forever. From any task, before or after `init`.
+// Arms it, as if it had just beaten.
+void monitor(Heartbeat& heart);
+
+// Reports if the last reset was a stall, then starts the watchdog & the supervisor.
+bool init();
+
+}  // namespace nevermore::health
@@ -0,0 +1,85 @@
+#include "log.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "pico/time.h"
+#include "sdk/task.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include "utility/task.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+using namespace std;
+using namespace std::literals::chrono_literals;
+
+namespace nevermore::logging {
+
+namespace {
+
+constexpr uint32_t LOG_STACK_DEPTH = 512;  // `printf` w/ a handful of integer conversions
+constexpr auto LOG_DRAIN_PERIOD = 50ms;    // polled, so queueing doesn't cost a task notification
+constexpr size_t LOG_QUEUE_LENGTH = 32;
+
+TaskStorage<LOG_STACK_DEPTH> g_task;
+
+struct Entry {
+    Site const* site;
+    array<int32_t, 3> args;
+    uint32_t suppressed;
+};
+
+// Multiple producers on both cores & the M0+ has no atomic RMW, so it's a ring under the kernel critical
+// section. Pushes are a handful of loads/stores inside it.
+array<Entry, LOG_QUEUE_LENGTH> g_queue;
+size_t g_head = 0;  // free running
+size_t g_tail = 0;  // free running
+uint32_t g_dropped = 0;
+
+[[noreturn]] void drain(void*) {
+    for (;;) {
+        task_delay(LOG_DRAIN_PERIOD);
+
+        for (;;) {
+            taskENTER_CRITICAL();
+            bool const empty = g_head == g_tail;
+            auto const x = empty ? Entry{} : g_queue[g_head++ % g_queue.size()];
+            auto const dropped = g_dropped;
+            g_dropped = 0;
+            taskEXIT_CRITICAL();
+
+            if (dropped) printf("WARN - log - queue full, %u messages dropped\n", unsigned(dropped));
+            if (empty) break;
+
+            // NOLINTNEXTLINE(clang-diagnostic-format-nonliteral)
+            printf(x.site->format, x.args[0], x.args[1], x.args[2]);
+            if (x.suppressed) printf("    (+%u more since last shown)\n", unsigned(x.suppressed));
+        }
+    }
+}
+
+}  // namespace
+
+bool init() {
+    Task(drain, "log", g_task, nullptr, Priority::Low).release();
+    return true;
+}
+
+void deferred(Site& site, int32_t a, int32_t b, int32_t c) {
+    auto const now = to_ms_since_boot(get_absolute_time());
+
+    taskENTER_CRITICAL();
+    if (site.ever && now - site.last_ms < LOG_DEFERRED_INTERVAL_MS) {
+        site.suppressed += 1;
+    } else if (g_tail - g_head < g_queue.size()) {
+        g_queue[g_tail++ % g_queue.size()] = {
+                .site = &site, .args = {a, b, c}, .suppressed = site.suppressed};
+        site.last_ms = now;
+        site.suppressed = 0;
+        site.ever = true;
+    } else {
+        g_dropped += 1;
+    }
+    taskEXIT_CRITICAL();
+}
+
+}  // namespace nevermore::logging
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+// Deferred, rate limited logging for hot paths (sensor reads, I2C, LED updates, GATT dispatch).
+// The caller only queues the site & its integer args, a low priority task does the `printf`. A flaky cable
+// can't flood stdio or stall a sensor read on USB CDC. Repeats of a site within `LOG_DEFERRED_INTERVAL_MS`
+// are counted, not queued; the count is reported w/ the site's next message.
+// Use plain `printf` everywhere else (init, rare events), it's simpler & immediate.
+namespace nevermore::logging {
+
+constexpr uint32_t LOG_DEFERRED_INTERVAL_MS = 1000;
+
+struct Site {
+    // `printf` format. Only integer conversions (`%d`, `%u`, `%x`, ...), at most 3 of them.
+    char const* format;
+
+    // guarded by the log's lock
+    uint32_t last_ms = 0;
+    uint32_t suppressed = 0;  // since the last one queued
+    bool ever = false;
+};
+
+bool init();
+
+// From task context. A few dozen cycles, never blocks. Dropped (& counted) if the queue is full.
+void deferred(Site&, int32_t a = 0, int32_t b = 0, int32_t c = 0);
+
+}  // namespace nevermore::logging
+
+// Each expansion is its own site, w/ its own rate limit. Args must be convertible to `int32_t`.
+#define LOG_DEFERRED(format, ...)                                             \
+    do {                                                                      \
+        static constinit ::nevermore::logging::Site log_site_{format};        \
+        ::nevermore::logging::deferred(log_site_ __VA_OPT__(, ) __VA_ARGS__); \
+    } while (0)
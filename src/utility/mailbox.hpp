@@ -0,0 +1,35 @@
+#pragma once
+
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "spsc_queue.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include <cstddef>
+
+namespace nevermore {
+
+// Bounded command queue into a state's owning task: any # of producers (tasks on either core, or ISRs),
+// exactly 1 consumer, the owner. Producers never wait on the owner, they only serialise among themselves on
+// the kernel critical section for the few instructions a push takes (the M0+ has no CAS). The owner drains
+// it w/o taking any lock, it's the consumer side of an `SpscQueue`.
+template <typename A, size_t N>
+struct Mailbox {
+    // Any context. Returns false, & drops `x`, if full.
+    bool post(A const& x) {
+        auto const saved = taskENTER_CRITICAL_FROM_ISR();
+        bool const ok = queue.push(x);
+        taskEXIT_CRITICAL_FROM_ISR(saved);
+        return ok;
+    }
+
+    // Owner only. Applies every command posted so far, oldest first.
+    template <typename F>
+    void drain(F&& go) {
+        while (auto x = queue.pop())
+            go(*x);
+    }
+
+private:
+    SpscQueue<A, N> queue;
+};
+
+}  // namespace nevermore
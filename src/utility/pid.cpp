@@ -0,0 +1,42 @@
+#include "pid.hpp"
+
+namespace nevermore {
+
+namespace {
+
+// PID Tests
+
+// Output change is rate limited.
+static_assert([] {
+    PID pid{.gains = {.kp = 1}, .output_rate_max = 1};
+    return pid(10, 0, .25f) == .25f;
+}());
+
+// Output is clamped.
+static_assert([] {
+    PID pid{.gains = {.kp = 1}, .output_rate_max = 100};
+    return pid(10, 0, 1) == 1 && pid(-10, 0, 1) == 0;
+}());
+
+// No wind-up while saturated: recovers as soon as the error flips sign.
+static_assert([] {
+    PID pid{.gains = {.kp = 0, .ki = 1}, .output_rate_max = 100};
+    for (int i = 0; i < 100; ++i)
+        pid(10, 0, 1);  // unreachable target, output pinned at max
+    return pid(0, 10, .5f) < 1;
+}());
+
+// Bumpless restart at the error-free steady state.
+static_assert([] {
+    PID pid{.gains = {.kp = 1, .ki = 1}};
+    pid.reset(.5f);
+    return pid(3, 3, .1f) == .5f;
+}());
+
+// Invalid gains are rejected.
+static_assert(!PID::Gains{.kp = -1}.valid());
+static_assert(!PID::Gains{.ki = __builtin_nanf("")}.valid());
+
+}  // namespace
+
+}  // namespace nevermore
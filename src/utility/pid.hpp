@@ -0,0 +1,67 @@
+#pragma once
+
+#include "utility/wire.hpp"
+#include <algorithm>
+
+namespace nevermore {
+
+// PID controller w/ a clamped & rate limited output.
+// Anti-windup: the integral only accumulates while the output isn't pinned (by the clamp or the rate limit)
+// in the direction the error pushes. Derivative is on the measurement, so target changes don't kick.
+struct PID {
+    // Requirements:
+    // * Must be tightly laid out, sent as-is by the fan service's gains characteristic & persisted.
+    struct Gains {
+        float kp = 0;
+        float ki = 0;
+        float kd = 0;
+
+        [[nodiscard]] constexpr bool valid() const {
+            // also rejects NaNs
+            return 0 <= kp && 0 <= ki && 0 <= kd;
+        }
+    };
+    static_assert(wire::tight<Gains>({WIRE_FIELD(Gains, kp), WIRE_FIELD(Gains, ki), WIRE_FIELD(Gains, kd)}));
+
+    Gains gains;
+    float output_min = 0;
+    float output_max = 1;
+    float output_rate_max = 1;  // max change in output, per second
+
+    // Returns the new output, `dt` in seconds.
+    constexpr float operator()(float target, float measured, float dt) {
+        if (!(0 < dt)) return output;
+
+        auto const error = target - measured;
+        auto const derivative = primed ? (measured - measured_last) / dt : 0;
+        measured_last = measured;
+        primed = true;
+
+        auto const integral_next = integral + gains.ki * error * dt;
+        auto const raw = gains.kp * error + integral_next - gains.kd * derivative;
+
+        auto const step = output_rate_max * dt;
+        auto const limited = std::clamp(std::clamp(raw, output - step, output + step), output_min, output_max);
+        // only keep the accumulated error if it didn't push us further into a limit
+        bool const pinned = (raw < limited && error < 0) || (limited < raw && 0 < error);
+        if (!pinned) integral = std::clamp(integral_next, output_min, output_max);
+
+        output = limited;
+        return output;
+    }
+
+    // Bumpless (re)start from whatever `current` output is already applied.
+    constexpr void reset(float current = 0) {
+        output = std::clamp(current, output_min, output_max);
+        integral = output;
+        primed = false;
+    }
+
+    // Controller state, hands off.
+    float output = 0;
+    float integral = 0;  // includes `ki`, so gain changes don't rescale the history
+    float measured_last = 0;
+    bool primed = false;
+};
+
+}  // namespace nevermore
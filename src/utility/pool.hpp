@@ -0,0 +1,68 @@
+#pragma once
+
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "task.h"      // IWYU pragma: keep
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+
+// Fixed capacity, statically allocated storage for a class's instances.
+// Deriving from `Pooled<A, N>` gives `A` class specific `operator new`/`delete` backed by `N` slots, so
+// `make_unique<A>` & `delete` work as usual but never touch the heap, & the slots are reused forever w/o
+// fragmenting. An exhausted pool's `new` yields null (it doesn't throw), the same as any failed factory.
+namespace nevermore {
+
+template <typename A, size_t N>
+    requires(0 < N)
+struct Pooled {
+    static void* operator new(size_t size) noexcept {
+        assert(size == sizeof(A) && "slots are sized for `A`, not for anything derived from it");
+        (void)size;
+
+        auto& pool = slots();
+        void* p = nullptr;
+        taskENTER_CRITICAL();
+        for (size_t i = 0; i < N && !p; ++i) {
+            if (pool.used[i]) continue;
+
+            pool.used[i] = true;
+            p = pool.storage[i].bytes.data();
+        }
+        taskEXIT_CRITICAL();
+
+        if (!p)
+            printf("WARN - pool - all %u slots (%u octets each) in use\n", unsigned(N), unsigned(sizeof(A)));
+        return p;
+    }
+
+    static void operator delete(void* p) noexcept {
+        if (!p) return;
+
+        auto& pool = slots();
+        auto const i = size_t(static_cast<Slot*>(p) - pool.storage.data());
+        assert(i < N && pool.used[i] && "not from this pool, or already freed");
+
+        taskENTER_CRITICAL();
+        pool.used[i] = false;
+        taskEXIT_CRITICAL();
+    }
+
+private:
+    struct alignas(A) Slot {
+        std::array<std::byte, sizeof(A)> bytes;
+    };
+
+    struct Slots {
+        std::array<Slot, N> storage;
+        std::array<bool, N> used;
+    };
+
+    // function local b/c `A` isn't complete until `Pooled<A, N>` is. Trivial, so zero init'd & unguarded.
+    static Slots& slots() {
+        static Slots x;
+        return x;
+    }
+};
+
+}  // namespace nevermore
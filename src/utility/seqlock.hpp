@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace nevermore {
+
+// Single-writer, many-reader sequence lock. Readers never block the writer & never take a lock, they
+// retry if a write raced with their copy.
+// Writers must be serialised by the caller. Do so w/ the kernel critical section: that also stops a reader
+// on the writer's core from preempting it mid-write & spinning forever on an odd sequence #.
+template <typename A>
+    requires(std::is_trivially_copyable_v<A>)
+struct SeqLock {
+    [[nodiscard]] A load() const {
+        A value;
+        for (;;) {
+            auto const seq = sequence.load(std::memory_order_acquire);
+            if (seq & 1) continue;  // write in progress
+
+            memcpy(&value, &data, sizeof(A));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == seq) return value;
+        }
+    }
+
+    // Bumped once per `store`. Read it *before* `load`ing, then a racing `store` can only make the caller
+    // redo work for a version it already has, never miss one.
+    [[nodiscard]] uint32_t version() const {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+
+    // PRECONDITION: Caller is the only writer (see above).
+    void store(A const& value) {
+        auto const seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&data, &value, sizeof(A));
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint32_t> sequence = 0;  // odd -> write in progress
+    A data{};
+};
+
+}  // namespace nevermore
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+namespace nevermore {
+
+// Lock-free, bounded, single-producer single-consumer queue.
+// Producer & consumer can be on different cores (or one can be an ISR), as long as there is exactly one of
+// each. Only needs atomic loads/stores, no RMW ops (which the M0+ doesn't have).
+template <typename A, size_t N>
+    requires(std::is_trivially_copyable_v<A> && std::has_single_bit(N))
+struct SpscQueue {
+    // Producer only. Returns false, & drops `x`, if full.
+    bool push(A const& x) {
+        auto const tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - head.load(std::memory_order_acquire) == N) return false;
+
+        items[tail % N] = x;
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only.
+    std::optional<A> pop() {
+        auto const head = this->head.load(std::memory_order_relaxed);
+        if (head == tail.load(std::memory_order_acquire)) return {};
+
+        A x = items[head % N];
+        this->head.store(head + 1, std::memory_order_release);
+        return x;
+    }
+
+    // Consumer only.
+    [[nodiscard]] bool empty() const {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<A, N> items{};
+    // free running, unsigned wrap is harmless b/c `N` divides 2^32
+    std::atomic<uint32_t> head{0};  // written by the consumer
+    std::atomic<uint32_t> tail{0};  // written by the producer
+};
+
+}  // namespace nevermore
@@ -5,6 +5,7 @@
 
 #include "config.hpp"
 #include "sdk/pwm.hpp"
+#include <algorithm>
 #include <cstdint>
 #include <optional>
 
@@ -17,8 +18,10 @@ constexpr std::optional<GPIO_Pin> square_wave_pwm_first_available_pin() {
     // skip pins {0, 1}, they're reserved for UART
     for (GPIO_Pin pin = 2; pin < PIN_MAX; ++pin) {
         // O(n^2) inefficient, but who cares, it's compile time.
-        if (pwm_gpio_to_slice_num_(pin) == pwm_gpio_to_slice_num_(PIN_FAN_PWM)) continue;
-        if (pwm_gpio_to_slice_num_(pin) == pwm_gpio_to_slice_num_(PIN_FAN_TACHOMETER)) continue;
+        auto same_slice = [&](auto&& fan) {
+            return pwm_gpio_to_slice_num_(fan.pwm) == pwm_gpio_to_slice_num_(pin);
+        };
+        if (std::ranges::any_of(PINS_FAN, same_slice)) continue;
         if (pin_exists([&](GPIO_Pin p) { return p == pin; })) continue;
 
         return pin;
@@ -4,7 +4,10 @@
 #include "portmacro.h"
 #include "sdk/task.hpp"
 #include "task.h"  // IWYU pragma: keep
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <span>
 
 namespace nevermore {
 
@@ -13,10 +16,41 @@ enum class Priority : UBaseType_t {
     Low,
     Display,
     Sensors,
-    Communication,
+    Communication,  // BTstack, i.e. the CYW43 async context's task (set by the build)
     Max,
 };
 
+// Affinity policy:
+//  - core 0 owns BTstack, the sensors, the I2C workers, and the timer daemon. All init happens on core 0
+//    (the "main" task), so IRQs (WS2812's DMA_IRQ_0, I2C, GPIO) are enabled on core 0's NVIC. ISRs only set
+//    flags/notify tasks, which is safe across cores.
+//  - core 1 is dedicated to LVGL rendering (incl. the display flush), so it never stalls radio/sensor work.
+//    The display's flush completion (DMA_IRQ_1) is enabled on core 1's NVIC (via `on_core`), next to LVGL.
+// Tasks default to core 0; place anything on `Core::Any`/`Core::C1` deliberately.
+enum class Core : UBaseType_t {
+    Any = tskNO_AFFINITY,
+    C0 = 1 << 0,
+    C1 = 1 << 1,
+};
+
+// Stack & TCB for a task, so tasks never draw from the FreeRTOS heap. Define it w/ static storage duration.
+// Backs one task, once: a task that deletes itself is only let go of by the idle task, some time later.
+template <uint32_t STACK_DEPTH>
+struct TaskStorage {
+    std::array<StackType_t, STACK_DEPTH> stack;
+    StaticTask_t tcb;
+};
+
+// Any `TaskStorage`, whatever its depth.
+struct TaskMemory {
+    std::span<StackType_t> stack;
+    StaticTask_t* tcb = nullptr;
+
+    template <uint32_t STACK_DEPTH>
+    constexpr TaskMemory(TaskStorage<STACK_DEPTH>& storage)  // NOLINT(google-explicit-constructor)
+            : stack(storage.stack), tcb(&storage.tcb) {}
+};
+
 struct Task {
     Task() = default;
     Task(Task const&) = delete;
@@ -33,19 +67,20 @@ struct Task {
 
     explicit Task(TaskHandle_t task) : task(task) {}
 
-    Task(void (*go)(void*), char const* name, uint32_t stack_depth, void* param, Priority priority) {
-        xTaskCreate(go, "", stack_depth, param, UBaseType_t(priority), &task);
+    Task(void (*go)(void*), char const* name, TaskMemory memory, void* param, Priority priority,
+            Core core = Core::C0) {
+        create(go, name, memory, param, priority, core);
     }
 
-    Task(void (*go)(), char const* name, Priority priority, uint32_t stack_depth) {
-        xTaskCreate([](void* go) { reinterpret_cast<void (*)()>(go)(); }, "", stack_depth,
-                reinterpret_cast<void*>(go), UBaseType_t(priority), &task);
+    Task(void (*go)(), char const* name, Priority priority, TaskMemory memory, Core core = Core::C0) {
+        create([](void* go) { reinterpret_cast<void (*)()>(go)(); }, name, memory,
+                reinterpret_cast<void*>(go), priority, core);
     }
 
     template <typename A>
-    Task(A (*go)(), char const* name, Priority priority, uint32_t stack_depth) {
-        xTaskCreate([](void* go) { reinterpret_cast<A (*)()>(go)(); }, "", stack_depth,
-                reinterpret_cast<void*>(go), UBaseType_t(priority), &task);
+    Task(A (*go)(), char const* name, Priority priority, TaskMemory memory, Core core = Core::C0) {
+        create([](void* go) { reinterpret_cast<A (*)()>(go)(); }, name, memory,
+                reinterpret_cast<void*>(go), priority, core);
     }
 
     ~Task() {
@@ -56,6 +91,10 @@ struct Task {
         return !!task;
     }
 
+    [[nodiscard]] TaskHandle_t handle() const {
+        return task;
+    }
+
     void suspend() {
         if (task) vTaskSuspend(task);
     }
@@ -80,10 +119,39 @@ struct Task {
 
 private:
     TaskHandle_t task{};
+
+    void create(void (*go)(void*), char const* name, TaskMemory memory, void* param, Priority priority,
+            Core core) {
+        assert(memory.tcb && !memory.stack.empty());
+#if configNUM_CORES > 1 && configUSE_CORE_AFFINITY
+        task = xTaskCreateStaticAffinitySet(go, name, memory.stack.size(), param, UBaseType_t(priority),
+                memory.stack.data(), memory.tcb, UBaseType_t(core));
+#else
+        (void)core;
+        task = xTaskCreateStatic(
+                go, name, memory.stack.size(), param, UBaseType_t(priority), memory.stack.data(), memory.tcb);
+#endif
+    }
 };
 
-constexpr auto mk_task(char const* name, Priority priority, uint32_t stack_depth) {
-    return [=](auto go) { return Task(go, name, priority, stack_depth); };
+constexpr auto mk_task(char const* name, Priority priority, TaskMemory memory, Core core = Core::C0) {
+    return [=](auto go) { return Task(go, name, priority, memory, core); };
+}
+
+// Runs `go` on `core`, by moving the calling task there for the duration (it yields to migrate).
+// For per-core state, e.g. enabling an IRQ in that core's NVIC. Only from a task, w/ the scheduler running.
+template <typename F>
+void on_core(Core core, F&& go) {
+#if configNUM_CORES > 1 && configUSE_CORE_AFFINITY
+    auto const affinity = vTaskCoreAffinityGet(nullptr);
+    vTaskCoreAffinitySet(nullptr, UBaseType_t(core));
+    assert(core == Core::Any || (UBaseType_t(core) & (1u << portGET_CORE_ID())));
+    go();
+    vTaskCoreAffinitySet(nullptr, affinity);
+#else
+    (void)core;
+    go();
+#endif
 }
 
 template <typename A, typename Period>
@@ -0,0 +1,69 @@
+#include "timer.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+
+using namespace std;
+
+namespace nevermore {
+
+namespace {
+
+struct Entry {
+    char const* name = nullptr;
+    uint32_t period = 1;  // turns
+    void (*go)() = nullptr;
+};
+
+// Append only, entries are immutable once `g_entries_count` covers them.
+array<Entry, TIMER_WHEEL_ENTRIES_MAX> g_entries{};
+atomic<size_t> g_entries_count = 0;
+
+StaticTimer_t g_timer_storage;
+TimerHandle_t g_timer = nullptr;
+uint32_t g_turn = 0;  // only touched by the timer task
+
+void turn(TimerHandle_t) {
+    g_turn += 1;
+
+    auto const n = g_entries_count.load(memory_order_acquire);
+    for (size_t i = 0; i < n; ++i) {
+        auto const& entry = g_entries.at(i);
+        if (g_turn % entry.period == 0) entry.go();
+    }
+}
+
+}  // namespace
+
+bool timer_wheel_add(char const* name, uint32_t period_turns, void (*go)()) {
+    assert(0 < period_turns && go);
+
+    taskENTER_CRITICAL();
+    auto const n = g_entries_count.load(memory_order_relaxed);
+    bool const full = g_entries.size() <= n;
+    if (!full) {
+        g_entries.at(n) = {.name = name, .period = period_turns, .go = go};
+        g_entries_count.store(n + 1, memory_order_release);
+    }
+    taskEXIT_CRITICAL();
+
+    if (full) {
+        printf("ERR - timer wheel - more than %u entries, can't add `%s`\n",
+                unsigned(TIMER_WHEEL_ENTRIES_MAX), name);
+        return false;
+    }
+
+    // the 1st entry brings the wheel up, later ones only have to be published
+    if (n == 0) {
+        constexpr auto PERIOD = to_ticks_safe(TIMER_WHEEL_RESOLUTION);
+        g_timer = xTimerCreateStatic("timer-wheel", PERIOD, pdTRUE, nullptr, turn, &g_timer_storage);
+        assert(g_timer && "static creation can't fail");
+        xTimerStart(g_timer, portMAX_DELAY);
+    }
+
+    return true;
+}
+
+}  // namespace nevermore
@@ -4,9 +4,12 @@
 #include "sdk/task.hpp"
 #include "timers.h"  // IWYU pragma: keep
 #include <chrono>
+#include <cstdint>
 
 namespace nevermore {
 
+using namespace std::literals::chrono_literals;
+
 template <typename A, typename Period>
 consteval auto mk_timer(char const* name, std::chrono::duration<A, Period> period, bool one_shot = false) {
     auto ticks = to_ticks_safe(period);
@@ -17,4 +20,26 @@ consteval auto mk_timer(char const* name, std::chrono::duration<A, Period> perio
     };
 }
 
+// Timer wheel: periodic, fire-and-forget callbacks sharing a single timer (& so a single daemon wakeup).
+// The wheel turns every `TIMER_WHEEL_RESOLUTION`. An entry fires on the turns that are a multiple of its
+// period, so entries w/ the same (or a multiple of the same) period fire back to back from one wakeup.
+// Callbacks run on the timer task, in the order they were added, & must not block.
+// Use `mk_timer` for anything that has to be stopped, restarted, re-periodised, or is a one-shot.
+constexpr auto TIMER_WHEEL_RESOLUTION = 100ms;
+constexpr size_t TIMER_WHEEL_ENTRIES_MAX = 8;
+
+// `period_turns` is in turns of the wheel, `0 < period_turns`. Returns false if the wheel is full.
+// First fires within a period of being added (on the next turn that's a multiple of it).
+bool timer_wheel_add(char const* name, uint32_t period_turns, void (*go)());
+
+template <typename A, typename Period>
+consteval auto mk_periodic(char const* name, std::chrono::duration<A, Period> period) {
+    auto const period_us = std::chrono::duration_cast<std::chrono::duration<int64_t, std::micro>>(period);
+    if (period_us.count() <= 0) throw "invalid period";
+    if (period_us % TIMER_WHEEL_RESOLUTION != 0us) throw "period isn't a multiple of the wheel's resolution";
+
+    auto const turns = uint32_t(period_us / TIMER_WHEEL_RESOLUTION);
+    return [=](void (*go)()) { return timer_wheel_add(name, turns, go); };
+}
+
 }  // namespace nevermore
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <span>
+#include <type_traits>
+
+// Wire layout (BLE & persisted settings) of in-memory structs.
+// Every access to a packed member is a byte-wise load/store on the M0+, so structs used for computation are
+// kept naturally aligned. `[[gnu::packed]]` is for structs that only ever exist on the wire.
+// A struct's schema is its fields in wire order (`WIRE_FIELD`). Either:
+// * `tight`: its natural layout already is the wire layout, so it's sent/persisted as-is, or
+// * it has padding, `Packed` is its wire image, built at the boundary.
+// NB: `BLE::internal::Scalar`s are packed (GCC won't pack a struct around an unpacked non-POD member), so
+//     they're always byte-wise. This only buys anything for plain integers & floats.
+namespace nevermore::wire {
+
+struct Field {
+    size_t offset;  // within the in-memory struct
+    size_t size;
+};
+
+#define WIRE_FIELD(type, name) ::nevermore::wire::Field{offsetof(type, name), sizeof(type::name)}
+
+// Octets `fields` take up on the wire.
+constexpr size_t packed_size(std::span<Field const> fields) {
+    size_t n = 0;
+    for (auto&& x : fields)
+        n += x.size;
+    return n;
+}
+
+// True if `fields` cover every octet of `A`, back to back in declared order.
+template <typename A>
+constexpr bool tight(std::span<Field const> fields) {
+    size_t offset = 0;
+    for (auto&& x : fields) {
+        if (x.offset != offset) return false;
+        offset += x.size;
+    }
+    return offset == sizeof(A);
+}
+
+template <typename A>
+constexpr bool tight(std::initializer_list<Field> fields) {
+    return tight<A>(std::span{fields.begin(), fields.size()});
+}
+
+// Wire image of an `A`: `FIELDS`, back to back in schema order.
+template <typename A, auto const& FIELDS>
+    requires(std::is_trivially_copyable_v<A>)
+struct [[gnu::packed]] Packed {
+    static_assert(
+            [] {
+                for (auto&& x : FIELDS)
+                    if (sizeof(A) < x.offset + x.size) return false;
+                return true;
+            }(),
+            "schema field outside of the struct");
+
+    std::array<uint8_t, packed_size(FIELDS)> bytes{};
+
+    Packed() = default;
+
+    explicit Packed(A const& x) {
+        auto const* src = reinterpret_cast<uint8_t const*>(&x);
+        size_t at = 0;
+        for (auto&& field : FIELDS) {
+            memcpy(bytes.data() + at, src + field.offset, field.size);  // NOLINT(*-pointer-arithmetic)
+            at += field.size;
+        }
+    }
+
+    // The `A` this is the image of. Anything outside of `FIELDS` (i.e. padding) is value initialised.
+    [[nodiscard]] A unpack() const {
+        A x{};
+        auto* dst = reinterpret_cast<uint8_t*>(&x);
+        size_t at = 0;
+        for (auto&& field : FIELDS) {
+            memcpy(dst + field.offset, bytes.data() + at, field.size);  // NOLINT(*-pointer-arithmetic)
+            at += field.size;
+        }
+        return x;
+    }
+};
+
+namespace internal {
+
+struct Example {
+    uint32_t a;
+    uint16_t b;
+    uint8_t c;
+};
+
+constexpr std::array EXAMPLE_FIELDS{WIRE_FIELD(Example, a), WIRE_FIELD(Example, b), WIRE_FIELD(Example, c)};
+
+static_assert(tight<Example>({WIRE_FIELD(Example, a), WIRE_FIELD(Example, b)}) == false);  // misses `c`
+static_assert(tight<Example>({WIRE_FIELD(Example, b), WIRE_FIELD(Example, a)}) == false);  // out of order
+static_assert(tight<Example>(EXAMPLE_FIELDS) == false);                                    // tail padding
+static_assert(sizeof(Packed<Example, EXAMPLE_FIELDS>) == 7);
+
+}  // namespace internal
+
+}  // namespace nevermore::wire
@@ -1,15 +1,22 @@
 #include "ws2812.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
 #include "config.hpp"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
 #include "hardware/pio.h"
+#include "pico/platform.h"
 #include "pico/sem.h"
-#include "pico/time.h"
+#include "sdk/dma.hpp"
+#include "task.h"  // IWYU pragma: keep
+#include "utility/log.hpp"
 #include "ws2812.pio.h"
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <chrono>
 #include <climits>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
 
@@ -36,25 +43,60 @@ namespace {
 
 // Fixed sized simplifies memory & error handling.
 // Must be a multiple of 4 for DMA transfer purposes.
-constexpr size_t N_PIXEL_COMPONENTS_MAX = 64 * sizeof(int);
+constexpr size_t N_PIXEL_COMPONENTS_MAX = WS2812_COMPONENTS_MAX;
+// 0xFFFF is reserved as not-known for the `BLE::Count16` the chain length is configured with
+static_assert(N_PIXEL_COMPONENTS_MAX < UINT16_MAX, "`WS2812_COMPONENTS_MAX` too large");
 
 // WS2812 protocol ends a string of pixel data with a 'long' period of 0v
 constexpr auto WS2812_TIME_RESET = 50us;
 constexpr auto WS2812_TIME_PER_BIT = 1.25us;
+// The PIO program holds the line low for the reset period itself, after every frame.
+constexpr auto WS2812_TIME_LATCH = WS2812_TIME_PER_BIT / (ws2812_T1 + ws2812_T2 + ws2812_T3) *
+                                   (1 + (ws2812_LATCH_LOOPS + 1) * ws2812_LATCH_LOOP_CYCLES);
 
 static_assert(50us <= WS2812_TIME_RESET, "datasheet says quiet period must be >= 50us");
+static_assert(WS2812_TIME_RESET <= WS2812_TIME_LATCH, "PIO program's latch is shorter than the reset period");
+static_assert(ws2812_LATCH_LOOPS <= 31, "PIO `set` immediates are 5 bits");
 
 auto* const WS2812_PIO = pio0;  // NOLINT
 constexpr auto WS2812_SM = 0;
 
-auto const g_dma_channel = dma_claim_unused_channel(true);
-
-array<uint8_t, N_PIXEL_COMPONENTS_MAX> g_pixel_data;
-size_t g_pixel_data_size = 0;  // INVARIANT(pixel_size_active <= g_pixel_data.size())
+// Completions are handled on core 0, w/ the rest of the LED work (effects & BLE writes).
+constexpr auto DMA_IRQ_CORE = Core::C0;
+
+uint g_dma_channel = 0;  // claimed by `init`
+
+// A transfer is the PIO program's frame header (# of bits - 1, see `ws2812.pio`) followed by the pixels.
+struct Frame {
+    uint32_t header = 0;  // stored byte swapped, the channel swaps every word on its way to the PIO
+    array<uint8_t, N_PIXEL_COMPONENTS_MAX> pixels{};
+};
+static_assert(offsetof(Frame, pixels) == sizeof(Frame::header), "transfer must be contiguous");
+
+using Lut = array<uint8_t, 256>;
+
+// `write` target, the frame as written (uncorrected). Always the latest frame, partial writes apply to it.
+array<uint8_t, N_PIXEL_COMPONENTS_MAX> g_canvas{};
+Correction g_correction;
+Lut g_lut{};  // `g_correction` as a table, unused if it's the identity
+
+// Triple buffered, so a transfer never splices 2 frames & a frame is never shown half written:
+// * front   - being read by the DMA engine, never written
+// * pending - last committed frame, becomes the front when the next transfer launches
+// * back    - `commit` renders the canvas (corrected) into it, then it becomes pending
+// Swaps only exchange indices. Guarded by the kernel critical section (incl. the IRQ side swap), as are the
+// canvas & the correction. The back frame's pixels & the LUT are also guarded by `g_render_lock`, so the
+// correction is applied outside of the critical section.
+array<Frame, 3> g_frames{};
+uint8_t g_frame_front = 0;
+uint8_t g_frame_pending = 1;
+uint8_t g_frame_back = 2;
+bool g_frame_committed = false;  // `pending` holds a frame that hasn't been launched yet
+size_t g_pixel_data_size = 0;    // INVARIANT(g_pixel_data_size <= N_PIXEL_COMPONENTS_MAX)
 
 semaphore g_update_requested;
 semaphore g_update_in_progress;
-alarm_id_t g_update_delay_alarm_id = 0;
+semaphore g_render_lock;
 
 void DBG_update_deferred_rate_log([[maybe_unused]] bool deferred) {
 #if DEBUG_WS2812_UPDATE_DEFERRED_RATE
@@ -78,32 +120,51 @@ void DBG_update_deferred_rate_log([[maybe_unused]] bool deferred) {
 }
 
 // PRECONDITION: Caller is holding `g_update_in_progress`.
-void UNSAFE_update_launch_or_release() {
+// Called from both task & IRQ (DMA) context, hence the `FROM_ISR` critical section (fine in either).
+// The IRQ path (incl. this) runs from RAM, so the relaunch never waits on an XIP cache miss.
+// No need to wait out the latch before a relaunch, the PIO program does that before it takes the next frame.
+void __not_in_flash_func(UNSAFE_update_launch_or_release)() {
     if (sem_try_acquire(&g_update_requested)) {  // launch any pending update request
-        dma_channel_set_read_addr(g_dma_channel, g_pixel_data.data(), true);
+        auto const saved = taskENTER_CRITICAL_FROM_ISR();
+        if (g_frame_committed) {
+            swap(g_frame_front, g_frame_pending);
+            g_frame_committed = false;
+        }
+        auto const* front = &g_frames.at(g_frame_front).header;
+        taskEXIT_CRITICAL_FROM_ISR(saved);
+
+        dma_channel_set_read_addr(g_dma_channel, front, true);
     } else {
         sem_release(&g_update_in_progress);
     }
 }
 
-int64_t update_complete_handler(alarm_id_t id, void* user_data) {
-    g_update_delay_alarm_id = 0;
-    UNSAFE_update_launch_or_release();
+void __isr __not_in_flash_func(dma_complete_handler)() {
+    dma_irqn_acknowledge_channel(dma_irq_index(DMA_IRQ_CORE), g_dma_channel);  // the line's only channel
 
-    return 0;  // 0 -> no repeat
+    UNSAFE_update_launch_or_release();
 }
 
-void __isr dma_complete_handler() {
-    if (!dma_channel_get_irq0_status(g_dma_channel)) return;
-    dma_channel_acknowledge_irq0(g_dma_channel);
+Lut lut_of(Correction const& correction) {
+    Lut lut;
+    auto const gamma = float(correction.gamma_tenths) / 10;
+    for (size_t i = 0; i < lut.size(); ++i) {
+        auto const x = powf(float(i) / float(UINT8_MAX), gamma) * float(correction.brightness);
+        lut[i] = uint8_t(lroundf(x));  // `x` in [0, 255]
+    }
+    return lut;
+}
 
-    if (g_update_delay_alarm_id) cancel_alarm(g_update_delay_alarm_id);
-    g_update_delay_alarm_id =
-            add_alarm_in_us(WS2812_TIME_RESET / 1us, update_complete_handler, nullptr, true);
+// Corrects the first `size` components of `frame` in place.
+// PRECONDITION: Caller is holding `g_render_lock`.
+void UNSAFE_correct(Frame& frame, size_t size) {
+    auto* px = frame.pixels.data();
+    for (size_t i = 0; i < size; ++i)
+        px[i] = g_lut[px[i]];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
 }
 
 void update_or_defer() {
-    // raise update-requested; alarm could fire and handle everything before we take update-in-progress
+    // raise update-requested; a completion could handle everything before we take update-in-progress
     sem_release(&g_update_requested);
     auto acquired = sem_try_acquire(&g_update_in_progress);
     DBG_update_deferred_rate_log(!acquired);
@@ -113,12 +174,12 @@ void update_or_defer() {
 }
 
 #if DEBUG_WS2812_PATTERN
-void dbg_animate(TimerHandle_t) {
+void dbg_animate() {
     struct GRB {
         uint8_t g, r, b;
     };
     array<GRB, 10> px_data{};
-    static_assert(sizeof(px_data) * 2 <= sizeof(g_pixel_data), "not enough space for animated area");
+    static_assert(sizeof(px_data) * 2 <= sizeof(Frame), "not enough space for animated area");
 
     for (unsigned i = 0; i < px_data.size(); ++i) {
         auto& x = px_data[i];  // NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
@@ -129,21 +190,23 @@ void dbg_animate(TimerHandle_t) {
     static uint pixel_offset = 0;
     pixel_offset = (pixel_offset + 1) % (px_data.size() + 1);
 
-    g_pixel_data = {};
-    auto* p = g_pixel_data.begin() + pixel_offset * sizeof(*px_data.begin());
+    static array<uint8_t, N_PIXEL_COMPONENTS_MAX> g_frame;
+    g_frame = {};
+    auto* p = g_frame.begin() + pixel_offset * sizeof(*px_data.begin());
     for (auto x : px_data) {
         memcpy(p, &x, sizeof(x));
         p += sizeof(x);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
     }
 
 #if 1  // dump buffer to PIO w/o DMA
-    auto const* xs = (uint32_t const*)g_pixel_data.data();
-    for (unsigned i = 0; i < g_pixel_data.size() / sizeof(int); ++i) {
+    auto const* xs = (uint32_t const*)g_frame.data();
+    pio_sm_put_blocking(WS2812_PIO, WS2812_SM, g_frame.size() * CHAR_BIT - 1);
+    for (unsigned i = 0; i < g_frame.size() / sizeof(int); ++i) {
         // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
         pio_sm_put_blocking(WS2812_PIO, WS2812_SM, byteswap(xs[i]));
     }
 #else  // dump buffer to PIO via DMA
-    update_or_defer();
+    update(0, span(g_frame).first(components_total()));
 #endif
 }
 #endif
@@ -153,11 +216,11 @@ void dbg_animate(TimerHandle_t) {
 void init() {
     sem_init(&g_update_requested, 0, 1);
     sem_init(&g_update_in_progress, 1, 1);
+    sem_init(&g_render_lock, 1, 1);
 
-    irq_set_enabled(DMA_IRQ_0, true);
-    irq_add_shared_handler(DMA_IRQ_0, dma_complete_handler, PICO_DEFAULT_IRQ_PRIORITY);
-    dma_channel_set_irq0_enabled(g_dma_channel, true);
+    g_dma_channel = dma_channel_claim_with_irq(DMA_IRQ_CORE, dma_complete_handler);
 
+    pio_sm_claim(WS2812_PIO, WS2812_SM);  // so the display's PIO SPI doesn't grab it
     uint offset = pio_add_program(WS2812_PIO, &ws2812_program);
     ws2812_program_init(WS2812_PIO, WS2812_SM, offset, PIN_NEOPIXEL_DATA_IN, 1s / WS2812_TIME_PER_BIT);
 
@@ -167,7 +230,7 @@ void init() {
     setup(N_PIXEL_COMPONENTS_MAX);
 
 #if DEBUG_WS2812_PATTERN
-    mk_timer("dbg-ws2812-blink", 100ms)(dbg_animate);
+    mk_periodic("dbg-ws2812-blink", 100ms)(dbg_animate);
 #endif
 }
 
@@ -178,16 +241,28 @@ size_t components_total() {
 bool setup(size_t num_components_total) {
     if (g_pixel_data_size == num_components_total) return true;  // no-op
 
-    if (g_pixel_data.size() < num_components_total) {
+    if (N_PIXEL_COMPONENTS_MAX < num_components_total) {
         printf("ERR - ws2812_setup - n=%u exceeds compile-time specified max size\n", num_components_total);
         return false;  // not enough space in fixed buffer for this setup
     }
 
-    // FUTURE WORK: can tighten timing. only need to wait for DMA to finish, not for full update (DMA + delay)
+    // Only waits for the DMA to finish. The PIO may still be shifting out/latching the last frame, but that's
+    // out of the buffers already.
     sem_acquire_blocking(&g_update_in_progress);  // block until all transfers are done
+    sem_acquire_blocking(&g_render_lock);         // & any render into the back frame
     {
+        // This'll write up to 3 extra components (/w value 0) to the end of the sequence.
+        // This is benign, and the extra data should be ignored/forwarded by the pixel chain.
+        // At least 1 word, a header can't say 0 bits.
+        auto const words = max<size_t>((num_components_total + 3) / 4, 1);
+        taskENTER_CRITICAL();
         g_pixel_data_size = num_components_total;
-        g_pixel_data = {};  // reset to zero for consistency
+        g_canvas = {};  // reset to zero for consistency
+        g_frames = {};
+        for (auto& frame : g_frames)
+            frame.header = byteswap(uint32_t(words * 32 - 1));
+        g_frame_committed = false;
+        taskEXIT_CRITICAL();
 
         auto c = dma_channel_get_default_config(g_dma_channel);
         channel_config_set_dreq(&c, pio_get_dreq(WS2812_PIO, WS2812_SM, true));
@@ -196,30 +271,83 @@ bool setup(size_t num_components_total) {
         static_assert(CHAR_BIT == 8 && sizeof(int) == 4);
         static_assert(
                 N_PIXEL_COMPONENTS_MAX % 4 == 0, "`N_MAX_BYTES` must be a multiple of `sizeof(int)` for DMA");
-        // This'll write up to 3 extra components (/w value 0) to the end of the sequence.
-        // This is benign, and the extra data should be ignored/forwarded by the pixel chain.
-        dma_channel_configure(g_dma_channel, &c, &WS2812_PIO->txf[WS2812_SM], nullptr,
-                (num_components_total + 3) / 4, false);
+        dma_channel_configure(g_dma_channel, &c, &WS2812_PIO->txf[WS2812_SM], nullptr, 1 + words, false);
     }
+    sem_release(&g_render_lock);
     sem_release(&g_update_in_progress);
 
     return true;
 }
 
 bool update(size_t offset, span<uint8_t const> pixel_data) {
+    if (!write(offset, pixel_data)) return false;
+
+    commit();
+    return true;
+}
+
+bool write(size_t offset, span<uint8_t const> pixel_data) {
+    // Bounds check & copy together, a concurrent `setup` could otherwise shrink the buffer in between.
+    // No need to wait for the DMA engine, it never reads the canvas.
     size_t write_end;
-    if (__builtin_add_overflow(offset, pixel_data.size(), &write_end) || g_pixel_data_size < write_end) {
-        printf("ERR - ws2812_update - offset=%u len=%u is not within declared bounds max=%u\n", offset,
-                pixel_data.size(), g_pixel_data_size);
+    taskENTER_CRITICAL();
+    auto const size = g_pixel_data_size;
+    bool const ok = !__builtin_add_overflow(offset, pixel_data.size(), &write_end) && write_end <= size;
+    if (ok) copy_n(pixel_data.begin(), pixel_data.size(), g_canvas.begin() + offset);
+    taskEXIT_CRITICAL();
+
+    if (!ok) {
+        LOG_DEFERRED("ERR - ws2812_update - offset=%u len=%u is not within declared bounds max=%u\n",
+                int32_t(offset), int32_t(pixel_data.size()), int32_t(size));
         return false;  // out of bounds
     }
 
-    if (g_pixel_data.empty()) return true;  // no-op
+    return true;
+}
+
+void commit() {
+    // Only the canvas is snapshotted in the critical section. The correction (a lookup per component) is
+    // applied outside of it, so writers & the DMA IRQ aren't held up by it.
+    sem_acquire_blocking(&g_render_lock);  // the back frame is ours until it's swapped out
+    taskENTER_CRITICAL();
+    auto& frame = g_frames.at(g_frame_back);
+    auto const size = g_pixel_data_size;
+    bool const identity = g_correction.identity();
+    copy_n(g_canvas.begin(), size, frame.pixels.begin());
+    taskEXIT_CRITICAL();
+
+    if (!identity) UNSAFE_correct(frame, size);
+
+    taskENTER_CRITICAL();
+    // replaces any committed frame that hasn't launched yet, it's already out of date
+    swap(g_frame_back, g_frame_pending);
+    g_frame_committed = true;
+    taskEXIT_CRITICAL();
+    sem_release(&g_render_lock);
 
-    // DATA RACE - Intentionally don't lock. We'll race with the DMA engine and accept spliced reads.
-    copy_n(pixel_data.begin(), pixel_data.size(), g_pixel_data.begin() + offset);
     update_or_defer();
+}
+
+bool correction_set(Correction const& correction) {
+    if (!correction.valid()) return false;
+
+    auto const lut = lut_of(correction);  // `powf` is slow w/o an FPU, keep it out of the critical section
+    sem_acquire_blocking(&g_render_lock);  // not while a render is looking things up in it
+    taskENTER_CRITICAL();
+    g_correction = correction;
+    g_lut = lut;
+    taskEXIT_CRITICAL();
+    sem_release(&g_render_lock);
+
+    commit();  // re-render the latest frame
     return true;
 }
 
+Correction correction() {
+    taskENTER_CRITICAL();
+    auto const x = g_correction;
+    taskEXIT_CRITICAL();
+    return x;
+}
+
 }  // namespace nevermore::ws2812
@@ -5,13 +5,39 @@
 
 namespace nevermore::ws2812 {
 
+// Output correction, applied to every component on its way out (via a LUT), after everything else.
+// Frames are kept as written, so a change re-renders the last frame w/o the host having to resend it.
+// Requirements:
+// * Must be packed, sent as-is by the WS2812 correction characteristic.
+struct [[gnu::packed]] Correction {
+    uint8_t brightness = UINT8_MAX;  // scale, [0, 255] -> [0, 1]
+    uint8_t gamma_tenths = 10;       // exponent, in tenths. [10, 30] -> [1.0, 3.0]
+
+    [[nodiscard]] constexpr bool valid() const {
+        return 10 <= gamma_tenths && gamma_tenths <= 30;
+    }
+
+    [[nodiscard]] constexpr bool identity() const {
+        return brightness == UINT8_MAX && gamma_tenths == 10;
+    }
+};
+
 void init();
 
 // returns false if the update couldn't be applied for whatever reason
 bool update(size_t offset, std::span<uint8_t const> pixel_data);
+// As `update`, but only stages the write. Batch several writes, then `commit` them as one frame.
+bool write(size_t offset, std::span<uint8_t const> pixel_data);
+// Present everything written since the last commit as a single frame, w/o tearing.
+// Shown once any in-progress transfer finishes. A newer commit replaces a frame still waiting to be shown.
+void commit();
 // returns false if unable to setup (e.g. insufficent memory, etc)
 // NB: We deal in total number of pixel components b/c a user could have a heterogenous pixel chain.
 bool setup(size_t num_components_total);
 size_t components_total();
 
+// Returns false if `correction` is invalid. Applies to the last committed frame right away.
+bool correction_set(Correction const& correction);
+Correction correction();
+
 }  // namespace nevermore::ws2812
@@ -0,0 +1,134 @@
+#include "effects.hpp"
+#include "FreeRTOS.h"  // IWYU pragma: keep
+#include "config.hpp"
+#include "pico/time.h"
+#include "sdk/task.hpp"
+#include "sensors.hpp"
+#include "settings.hpp"
+#include "task.h"    // IWYU pragma: keep
+#include "timers.h"  // IWYU pragma: keep
+#include "ws2812.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+using namespace std::literals::chrono_literals;
+
+namespace nevermore::ws2812::effects {
+
+namespace {
+
+constexpr auto FRAME_PERIOD_ANIMATED = 1000ms / 30;  // NB: `1s / 30 == 0s`
+// static effects only change w/ the sensors
+constexpr auto FRAME_PERIOD_STATIC = SENSOR_UPDATE_PERIOD;
+
+// Multiple of 3 & 4, so a chunk always starts on a pixel boundary.
+constexpr size_t RENDER_CHUNK = 48;
+
+// Written by BTstack, read by the timer task. Guarded by the kernel critical section.
+Params g_params;
+TimerHandle_t g_timer = nullptr;
+
+void frame(TimerHandle_t) {
+    taskENTER_CRITICAL();
+    auto const params = g_params;
+    taskEXIT_CRITICAL();
+    if (params.kind == Kind::None) return;
+
+    auto const now_ms = to_ms_since_boot(get_absolute_time());
+    auto const sensors = nevermore::sensors::snapshot_resolved();
+    auto const voc = max(sensors.voc_index_intake, sensors.voc_index_exhaust, [](auto a, auto b) {
+        return a.value_or(0) < b.value_or(0);
+    });
+
+    // render straight into the back buffer in chunks, no frame sized scratch buffer
+    auto const total = components_total();
+    array<uint8_t, RENDER_CHUNK> chunk;
+    for (size_t offset = 0; offset < total; offset += chunk.size()) {
+        auto const out = span(chunk).first(min(chunk.size(), total - offset));
+        render(params, now_ms, voc, total, offset, out);
+        write(offset, out);
+    }
+    commit();
+}
+
+}  // namespace
+
+bool set(Params const& params) {
+    if (!params.valid()) return false;
+
+    if (!g_timer) {
+        g_timer = xTimerCreate("ws2812-fx", to_ticks_safe(FRAME_PERIOD_STATIC), pdTRUE, nullptr, frame);
+        if (!g_timer) {
+            printf("ERR - WS2812 effects - failed to create timer\n");
+            return false;
+        }
+    }
+
+    taskENTER_CRITICAL();
+    g_params = params;
+    taskEXIT_CRITICAL();
+
+    if (params.kind == Kind::None) {
+        xTimerStop(g_timer, 0);
+        return true;
+    }
+
+    bool const animated = params.period_ms != 0 && params.kind != Kind::VocMap;
+    // starts the timer (if stopped), 1st frame is a period away
+    xTimerChangePeriod(g_timer,
+            animated ? to_ticks_safe(FRAME_PERIOD_ANIMATED) : to_ticks_safe(FRAME_PERIOD_STATIC), 0);
+    return true;
+}
+
+Params get() {
+    taskENTER_CRITICAL();
+    auto const params = g_params;
+    taskEXIT_CRITICAL();
+    return params;
+}
+
+// Render Tests
+
+namespace {
+
+constexpr Params GRADIENT{.kind = Kind::Gradient, .colour_a = {0, 0, 0}, .colour_b = {255, 255, 255}};
+constexpr Params VOC_MAP{.kind = Kind::VocMap, .colour_b = {200}, .voc_low = 100, .voc_high = 200};
+constexpr Params PULSE{.kind = Kind::Pulse, .colour_a = {255}, .period_ms = 1000};
+
+constexpr array<uint8_t, 6> render_test(
+        Params const& params, uint32_t now_ms = 0, sensors::VOCIndex voc = {}) {
+    array<uint8_t, 6> out{};
+    render(params, now_ms, voc, out.size(), 0, out);
+    return out;
+}
+
+}  // namespace
+
+static_assert(internal::lerp(10, 20, 0) == 10 && internal::lerp(10, 20, 256) == 20);
+static_assert(internal::lerp(20, 10, 128) == 15);
+static_assert(internal::triangle(0) == 0 && internal::triangle(0x8000) == 256);
+static_assert(internal::triangle(0x10000) == 0);  // wraps
+
+// 2 pixel gradient: start & middle of the triangle.
+static_assert(render_test(GRADIENT) == array<uint8_t, 6>{0, 0, 0, 255, 255, 255});
+// Chunked rendering matches rendering the chain in one go.
+static_assert([] {
+    array<uint8_t, 6> out{};
+    render(GRADIENT, 0, {}, out.size(), 3, span(out).subspan(3));
+    return out == array<uint8_t, 6>{0, 0, 0, 255, 255, 255};
+}());
+// VOC map clamps & interpolates.
+static_assert(render_test(VOC_MAP, 0, 50)[0] == 0);
+static_assert(render_test(VOC_MAP, 0, 150)[0] == 100);
+static_assert(render_test(VOC_MAP, 0, 400)[3] == 200);
+// Pulse peaks half way through the period.
+static_assert(render_test(PULSE, 500)[0] == 255);
+static_assert(render_test(PULSE, 0)[0] == 0);
+
+static_assert(sizeof(Params) <= settings::VALUE_SIZE_MAX, "persisted as-is");
+static_assert(!Params{.components_per_pixel = 2}.valid());
+static_assert(!Params{.kind = Kind::VocMap, .voc_low = 200, .voc_high = 100}.valid());
+
+}  // namespace nevermore::ws2812::effects
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "sensors.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// On-device animations, so the host doesn't have to stream every frame.
+// Rendering is integer only (Q8 fractions, Q16 phase).
+namespace nevermore::ws2812::effects {
+
+enum class Kind : uint8_t {
+    None = 0,      // host is in control, nothing is rendered
+    Gradient = 1,  // `colour_a` -> `colour_b` -> `colour_a` along the chain, scrolls once per period
+    Pulse = 2,     // whole chain breathes between `colour_b` & `colour_a` once per period
+    VocMap = 3,    // whole chain `colour_a` at/below `voc_low`, `colour_b` at/above `voc_high`
+};
+
+// Components in the chain's own order (e.g. GRB), only the first `components_per_pixel` are used.
+using Colour = std::array<uint8_t, 4>;
+
+// Requirements:
+// * Must be packed, sent as-is by the WS2812 effect characteristic.
+struct [[gnu::packed]] Params {
+    Kind kind = Kind::None;
+    uint8_t components_per_pixel = 3;  // 3 (e.g. GRB) or 4 (e.g. GRBW)
+    Colour colour_a{};
+    Colour colour_b{};
+    uint16_t period_ms = 0;  // 0 -> static
+    nevermore::sensors::VOCIndex voc_low = 100;
+    nevermore::sensors::VOCIndex voc_high = 250;
+
+    [[nodiscard]] constexpr bool valid() const {
+        if (Kind::VocMap < kind) return false;
+        if (components_per_pixel != 3 && components_per_pixel != 4) return false;
+        if (kind == Kind::VocMap && !(voc_low < voc_high)) return false;  // also rejects not-known
+        return true;
+    }
+};
+
+namespace internal {
+
+// `t` in [0, 256]
+constexpr uint8_t lerp(uint8_t a, uint8_t b, uint32_t t) {
+    return uint8_t(int32_t(a) + ((int32_t(b) - int32_t(a)) * int32_t(t) >> 8));
+}
+
+// [0, 65536) -> [0, 256] -> [0, 256)
+constexpr uint32_t triangle(uint32_t phase16) {
+    auto const p = (phase16 & 0xFFFF) >> 7;  // [0, 512)
+    return p < 256 ? p : 512 - p;
+}
+
+constexpr uint32_t phase(Params const& params, uint32_t now_ms) {
+    if (params.period_ms == 0) return 0;
+    return ((now_ms % params.period_ms) << 16) / params.period_ms;
+}
+
+}  // namespace internal
+
+// Renders components `[offset, offset + out.size())` of a `components_total` long chain.
+// `offset` lets a long chain be rendered in small chunks.
+constexpr void render(Params const& params, uint32_t now_ms, nevermore::sensors::VOCIndex voc,
+        size_t components_total, size_t offset, std::span<uint8_t> out) {
+    using namespace internal;
+
+    auto const cpp = params.components_per_pixel;
+    auto const pixels = std::max<size_t>((components_total + cpp - 1) / cpp, 1);
+    auto const phase16 = phase(params, now_ms);
+
+    uint32_t t_uniform = 0;  // for the whole-chain effects
+    switch (params.kind) {
+    case Kind::None: return;
+    case Kind::Gradient: break;
+    case Kind::Pulse: t_uniform = 256 - triangle(phase16); break;  // `colour_a` at the peak
+    case Kind::VocMap: {
+        auto const lo = uint32_t(params.voc_low.value_or(0));
+        auto const hi = uint32_t(params.voc_high.value_or(0));
+        auto const x = std::clamp(uint32_t(voc.value_or(0)), lo, hi);
+        t_uniform = hi <= lo ? 0 : ((x - lo) << 8) / (hi - lo);
+    } break;
+    }
+
+    for (size_t i = 0; i < out.size(); ++i) {
+        auto const component = offset + i;
+        auto const pixel = component / cpp;
+        // `pixel <= pixels`, so `pixel << 16` can't overflow for any chain that fits in RAM
+        auto const t = params.kind == Kind::Gradient ? triangle((uint32_t(pixel) << 16) / pixels + phase16)
+                                                     : t_uniform;
+        out[i] = lerp(params.colour_a.at(component % cpp), params.colour_b.at(component % cpp), t);
+    }
+}
+
+// Returns false if `params` are invalid. `Kind::None` stops the animation & leaves the chain as-is.
+bool set(Params const&);
+Params get();
+
+}  // namespace nevermore::ws2812::effects